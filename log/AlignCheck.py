@@ -0,0 +1,148 @@
+# -*- coding: utf-8 -*-
+"""
+Created on Tue Nov 13 21:37:07 2024
+
+@author: Ahron Ramos, Adrian Co, Zaira Ramji
+
+@description: Alignment check for capture_devices() in VoltageADCPlotter.py.
+              Runs a merged capture from simulated controllers whose
+              clocks drift apart and reports how well the same event
+              lines up across them.
+
+Usage:
+    python AlignCheck.py               # 6 s capture, 2 ms tolerance
+    python AlignCheck.py --seconds 10
+
+Each simulated port sends FRAME_SAMPLE frames at SAMPLE_RATE on host time,
+stamped with its own drifting tick. Every device steps its duty from 10 to
+90 at STEP_ON and back at STEP_OFF host seconds. STEP_ON falls in the
+first ALIGN_SECONDS window, before the drift is known, so it is only
+reported; STEP_OFF must line up within the tolerance, and the script
+exits with status 1 if it does not.
+"""
+
+import argparse
+import csv
+import os
+import sys
+import tempfile
+import threading
+import time
+
+import serial
+
+import VoltageADCPlotter as plotter
+
+SAMPLE_RATE = 100               # Samples per second of host time
+STEP_ON = 1.0                   # Host seconds of the duty steps
+STEP_OFF = 5.0
+TOLERANCE = 0.002               # Seconds
+
+# Port: (device ID or None for none set, clock rate against the host)
+DEVICES = {
+    "COM1": (0x0A01, 1.00),
+    "COM2": (0x0B02, 1.02),     # FRC 2 % fast
+    "COM3": (None, 0.98),       # 2 % slow, named by its port
+}
+
+
+class SimulatedPort:
+    """
+    Stands in for serial.Serial: answers CMD_QUERY and streams samples.
+
+    Time starts at the first read by a SerialReader thread, shared by
+    every port, so all devices see the steps at the same host time.
+    """
+
+    start = None
+    start_lock = threading.Lock()
+
+    def __init__(self, port: str, **settings):
+        self.device_id, self.rate = DEVICES[port]
+        self.timeout = settings.get("timeout")
+        self.pending = b""
+        self.sent = 0
+
+    def write(self, data: bytes) -> int:
+        if data[2] == plotter.CMD_QUERY and self.device_id is not None:
+            reply = bytearray(plotter.QUERY_FLAGS_OFFSET + 1)
+            reply[plotter.QUERY_ID_OFFSET] = self.device_id & 0xFF
+            reply[plotter.QUERY_ID_OFFSET + 1] = self.device_id >> 8
+            self.pending += plotter.encode_frame(
+                0, plotter.CMD_QUERY | plotter.FRAME_REPLY,
+                bytes([data[1], plotter.CMD_OK]) + bytes(reply))
+        return len(data)
+
+    def _generate(self):
+        if not isinstance(threading.current_thread(), plotter.SerialReader):
+            return                              # Not capturing yet
+        with SimulatedPort.start_lock:
+            if SimulatedPort.start is None:
+                SimulatedPort.start = time.time()
+        now = time.time() - SimulatedPort.start
+        while self.sent < now * SAMPLE_RATE:
+            host_time = self.sent / SAMPLE_RATE
+            tick = int(host_time * self.rate * plotter.TICK_HZ) & 0xFFFF
+            duty = 90 if STEP_ON <= host_time < STEP_OFF else 10
+            payload = bytes([tick & 0xFF, tick >> 8, duty, 0, 1])
+            self.pending += plotter.encode_frame(self.sent & 0xFF, plotter.FRAME_SAMPLE, payload)
+            self.sent += 1
+
+    @property
+    def in_waiting(self) -> int:
+        self._generate()
+        return len(self.pending)
+
+    def read(self, size: int = 1) -> bytes:
+        self._generate()
+        if not self.pending:
+            time.sleep(0.005)
+            return b""
+        chunk, self.pending = self.pending[:size], self.pending[size:]
+        return chunk
+
+    def close(self):
+        pass
+
+
+def step_times(rows: list, device: str, before: str, after: str) -> list[float]:
+    """
+    Aligned times at which a device's intensity goes from before to after.
+    """
+    samples = [row for row in rows if row[1] == device]
+    return [float(samples[k][2]) for k in range(1, len(samples))
+            if samples[k - 1][3] == before and samples[k][3] == after]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Check multi-device capture alignment")
+    parser.add_argument("--seconds", type=float, default=6.0)
+    parser.add_argument("--tolerance", type=float, default=TOLERANCE)
+    args = parser.parse_args()
+
+    serial.Serial = SimulatedPort
+    path = os.path.join(tempfile.mkdtemp(), "align.csv")
+    stats = plotter.capture_devices(list(DEVICES), "binary", args.seconds, path,
+                                    report_interval=0)
+
+    with open(path, newline="") as file:
+        rows = list(csv.reader(file))[1:]
+
+    failed = False
+    for device in stats:
+        on = step_times(rows, device, "10", "90")
+        off = step_times(rows, device, "90", "10")
+        if not on or not off:
+            print(f"{device}: steps missing from the capture")
+            failed = True
+            continue
+        error = off[0] - STEP_OFF
+        ok = abs(error) <= args.tolerance
+        failed |= not ok
+        print(f"{device}: step at {on[0]:.3f} s (first window), "
+              f"{off[0]:.3f} s ({error * 1000:+.1f} ms) {'ok' if ok else 'FAIL'}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,236 @@
+# -*- coding: utf-8 -*-
+"""
+Created on Tue Nov 13 21:37:07 2024
+
+@author: Ahron Ramos, Adrian Co, Zaira Ramji
+
+@description: Micro-benchmark regression check.
+              Reads the results of the benchmark firmware (src/bench.h,
+              built with `make bench` in src/) and compares them with
+              bench_baseline.csv.
+
+Usage:
+    python BenchCompare.py                 # read from PORT, compare
+    python BenchCompare.py --input run.txt # compare a saved capture
+    python BenchCompare.py --update        # accept the results as baseline
+
+A benchmark regresses when its min or mean cycles per call grow by more
+than TOLERANCE plus one Timer3 step shared over the batch. Max is shown
+but not checked, since any interrupt that lands in a sample moves it. The script
+exits with status 1 on any regression, and also when the baseline is empty
+or lacks a row for one of the benchmarks, so an unchecked run cannot pass
+a merge gate.
+"""
+
+import argparse
+import os
+import sys
+
+import serial
+
+# Serial settings; the benchmarks run at 500 kHz, where UART2 is 4800 baud
+PORT = 'COM5'
+BAUD_RATE = 4800
+READ_TIMEOUT = 30               # Seconds to wait for a complete block
+
+# Output format, mirrors src/bench.h
+BENCH_FORMAT_VERSION = 1
+BASELINE_FILE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "bench_baseline.csv")
+
+# Allowed growth before a benchmark counts as regressed
+TOLERANCE = 0.05
+
+
+def parse_block(lines: list) -> tuple[dict, dict]:
+    """
+    Parse one BENCH_BEGIN ... BENCH_END block.
+
+    Args:
+        lines: Text lines from the firmware; anything before BENCH_BEGIN
+               and '#' lines are skipped
+
+    Returns:
+        Tuple of (settings, results). Settings holds fcy_khz, resolution,
+        batch and samples; results maps each name to (min, mean, max)
+        cycles per call.
+
+    Raises:
+        ValueError: On an unknown format version or a malformed line
+    """
+    settings = {}
+    results = {}
+    started = False
+    for line in lines:
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue            # Formatter benchmark output
+        fields = line.split(",")
+        if not started and fields[0] != "BENCH_BEGIN":
+            continue            # Start-up output or a block cut off by the capture
+        if fields[0] == "BENCH_BEGIN":
+            started = True
+            if int(fields[1]) != BENCH_FORMAT_VERSION:
+                raise ValueError(f"unknown benchmark format {fields[1]}")
+            settings = {"fcy_khz": int(fields[2]), "resolution": int(fields[3]),
+                        "batch": int(fields[4]), "samples": int(fields[5])}
+            results = {}
+        elif fields[0] == "BENCH" and len(fields) == 5:
+            results[fields[1]] = tuple(int(value) for value in fields[2:5])
+        elif fields[0] == "BENCH_END":
+            return settings, results
+        else:
+            raise ValueError(f"unexpected line: {line}")
+    raise ValueError("no complete BENCH_BEGIN ... BENCH_END block")
+
+
+def read_block(serial_conn: serial.Serial, timeout: float) -> list:
+    """
+    Read lines from the firmware until a full result block has arrived.
+
+    The firmware repeats its block, so whatever was cut off by opening the
+    port midway is skipped.
+
+    Args:
+        serial_conn: Open serial connection
+        timeout: Seconds to wait for BENCH_END
+
+    Returns:
+        Lines from BENCH_BEGIN to BENCH_END
+    """
+    serial_conn.timeout = timeout
+    lines = []
+    started = False
+    while True:
+        raw = serial_conn.readline()
+        if not raw:
+            raise TimeoutError("no benchmark output; is the bench build flashed?")
+        line = raw.decode("ascii", errors="replace").strip()
+        if line.startswith("BENCH_BEGIN"):
+            started = True
+            lines = []
+        if started:
+            lines.append(line)
+            if line == "BENCH_END":
+                return lines
+
+
+def load_baseline(path: str) -> tuple[dict, dict]:
+    """
+    Load a baseline written by save_baseline().
+
+    Args:
+        path: CSV file
+
+    Returns:
+        Tuple of (settings, results) as returned by parse_block()
+    """
+    settings = {}
+    results = {}
+    with open(path) as file:
+        for line in file:
+            line = line.strip()
+            if line.startswith("# settings:"):
+                for item in line.split(":", 1)[1].split():
+                    key, value = item.split("=")
+                    settings[key] = int(value)
+            elif line and not line.startswith("#") and not line.startswith("name,"):
+                name, low, mean, high = line.split(",")
+                results[name] = (int(low), int(mean), int(high))
+    return settings, results
+
+
+def save_baseline(path: str, settings: dict, results: dict) -> None:
+    """
+    Write results as the new baseline.
+
+    Args:
+        path: CSV file
+        settings: Settings from parse_block()
+        results: Results from parse_block()
+    """
+    with open(path, "w") as file:
+        file.write("# Benchmark baseline for log/BenchCompare.py, cycles per call\n")
+        file.write("# settings: " + " ".join(f"{key}={value}" for key, value
+                                             in settings.items()) + "\n")
+        file.write("name,min,mean,max\n")
+        for name, (low, mean, high) in results.items():
+            file.write(f"{name},{low},{mean},{high}\n")
+
+
+def compare(settings: dict, results: dict, base_settings: dict,
+            baseline: dict, tolerance: float) -> bool:
+    """
+    Print a comparison table and report any regression.
+
+    Args:
+        settings: Settings of the new run
+        results: Results of the new run
+        base_settings: Settings of the baseline
+        baseline: Baseline results
+        tolerance: Allowed relative growth
+
+    Returns:
+        True if every benchmark has a baseline row and none regressed
+    """
+    if base_settings and base_settings != settings:
+        print(f"warning: run settings {settings} differ from baseline {base_settings}")
+
+    # One Timer3 step spread over the batch is measurement noise
+    slack = settings["resolution"] / settings["batch"]
+    passed = True
+
+    print(f"{'benchmark':<20}{'min':>7}{'mean':>7}{'max':>7}   {'baseline mean':>13}  status")
+    for name, (low, mean, high) in results.items():
+        if name not in baseline:
+            status = "NO BASELINE"      # Unchecked; --update to accept it
+            base_text = "-"
+            passed = False
+        else:
+            base_low, base_mean, _ = baseline[name]
+            regressed = (low > base_low * (1 + tolerance) + slack
+                         or mean > base_mean * (1 + tolerance) + slack)
+            status = "REGRESSED" if regressed else "ok"
+            passed &= not regressed
+            base_text = str(base_mean)
+        print(f"{name:<20}{low:>7}{mean:>7}{high:>7}   {base_text:>13}  {status}")
+
+    for name in baseline:
+        if name not in results:
+            print(f"{name:<20}{'missing from this run':>38}")
+            passed = False
+    return passed
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Compare firmware micro-benchmarks with the baseline")
+    parser.add_argument("--port", default=PORT)
+    parser.add_argument("--baud", type=int, default=BAUD_RATE)
+    parser.add_argument("--input", help="saved firmware output instead of the serial port")
+    parser.add_argument("--baseline", default=BASELINE_FILE)
+    parser.add_argument("--tolerance", type=float, default=TOLERANCE)
+    parser.add_argument("--update", action="store_true", help="write the results as the new baseline")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input, errors="replace") as file:
+            lines = file.readlines()
+    else:
+        with serial.Serial(args.port, args.baud) as serial_conn:
+            lines = read_block(serial_conn, READ_TIMEOUT)
+    settings, results = parse_block(lines)
+
+    if args.update:
+        save_baseline(args.baseline, settings, results)
+        print(f"Baseline written to {args.baseline}")
+        return 0
+
+    base_settings, baseline = load_baseline(args.baseline)
+    if not baseline:
+        print("Baseline is empty; run with --update on reference hardware first")
+        return 1
+    return 0 if compare(settings, results, base_settings, baseline, args.tolerance) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,478 @@
+# -*- coding: utf-8 -*-
+"""
+Created on Tue Nov 13 21:37:07 2024
+
+@author: Ahron Ramos, Adrian Co, Zaira Ramji
+
+@description: Chunked binary archive for captured samples, and batch
+              analysis of archives too large to load.
+              VoltageADCPlotter.py writes one instead of a CSV when the
+              output name ends in ARCHIVE_EXTENSION.
+
+Usage:
+    python CaptureArchive.py info Group_26.lcap
+    python CaptureArchive.py summary Group_26.lcap --start 60 --end 120
+    python CaptureArchive.py query Group_26.lcap --start 60 --end 61 --output rows.csv
+    python CaptureArchive.py resample Group_26.lcap --interval 1 --output seconds.csv
+    python CaptureArchive.py import Group_26.csv Group_26.lcap
+
+Format: a HEADER, then fixed-size RECORDs (time, intensity, ADC value,
+device number) in capture order, so the file can be memory-mapped and
+record n found at HEADER.size + n * RECORD.size. Records are grouped in
+chunks of chunk_records. The index, "<archive>.idx", is JSON holding the
+device names and, per chunk, the count, min, max, mean and M2 (sum of
+squared deviations) of each column. Queries skip the chunks whose time
+range misses theirs; summaries take whole chunks from the index. Only
+one chunk is in memory at a time.
+
+The writer appends records and rewrites the index on every flush, so a
+capture cut short leaves a readable archive; records past the index are
+indexed again when it is opened.
+"""
+
+import argparse
+import csv
+import json
+import math
+import mmap
+import os
+import struct
+import sys
+
+ARCHIVE_EXTENSION = ".lcap"
+INDEX_EXTENSION = ".idx"
+ARCHIVE_VERSION = 1
+ARCHIVE_MAGIC = b"LEDCAPT\0"
+ARCHIVE_CHUNK_RECORDS = 65536   # 1.25 MB of records per chunk
+
+HEADER = struct.Struct("<8sHHI16x")     # MAGIC, VERSION, RECORD SIZE, CHUNK RECORDS
+RECORD = struct.Struct("<dffI")         # Time (s), intensity (%), ADC value, device
+
+COLUMNS = ["time", "intensity", "adc"]
+CSV_COLUMNS = {"time": "Time", "intensity": "Intensity", "adc": "ADC Value"}
+
+# Summary, one line per column
+SUMMARY_HEADER = f"{'column':<12}{'count':>12}{'min':>12}{'max':>12}{'mean':>12}{'std':>12}"
+
+
+def archive_index(filename: str) -> str:
+    """Name of an archive's index file."""
+    return filename + INDEX_EXTENSION
+
+
+def csv_value(value: float) -> float | int:
+    """A stored float32 as the CSV writers would have written it."""
+    return int(value) if value.is_integer() else round(value, 6)
+
+
+class ColumnStats:
+    """
+    Count, min, max, mean and M2 of one column.
+
+    Built a value at a time (Welford) or by merging other ColumnStats
+    (Chan et al.), so chunk statistics add up without revisiting records.
+    """
+
+    __slots__ = ("count", "low", "high", "mean", "m2")
+
+    def __init__(self, values: list | None = None):
+        self.count, self.low, self.high, self.mean, self.m2 = values or (0, math.inf, -math.inf, 0.0, 0.0)
+
+    def add(self, value: float) -> None:
+        """Add one value."""
+        self.count += 1
+        delta = value - self.mean
+        self.mean += delta / self.count
+        self.m2 += delta * (value - self.mean)
+        if value < self.low:
+            self.low = value
+        if value > self.high:
+            self.high = value
+
+    def merge(self, other: "ColumnStats") -> None:
+        """Add every value other has seen."""
+        if not other.count:
+            return
+        count = self.count + other.count
+        delta = other.mean - self.mean
+        self.mean += delta * other.count / count
+        self.m2 += other.m2 + delta * delta * self.count * other.count / count
+        self.count = count
+        self.low = min(self.low, other.low)
+        self.high = max(self.high, other.high)
+
+    def std(self) -> float:
+        """Population standard deviation, NaN when empty."""
+        return math.sqrt(self.m2 / self.count) if self.count else math.nan
+
+    def to_list(self) -> list:
+        return [self.count, self.low, self.high, self.mean, self.m2]
+
+
+def chunk_stats(records) -> dict:
+    """ColumnStats per column of (time, intensity, adc, device) records."""
+    stats = {column: ColumnStats() for column in COLUMNS}
+    for t, intensity, adc, _ in records:
+        stats["time"].add(t)
+        stats["intensity"].add(intensity)
+        stats["adc"].add(adc)
+    return stats
+
+
+class ArchiveWriter:
+    """
+    Appends samples to an archive as they are captured.
+
+    Drop-in for CsvSampleWriter in VoltageADCPlotter.py: write(), flush()
+    and close(), and the record count in rows. Records are buffered
+    until flush(), which also rewrites the index (atomically, so a reader
+    never sees half of one).
+    """
+
+    def __init__(self, filename: str, chunk_records: int = ARCHIVE_CHUNK_RECORDS):
+        self.filename = filename
+        self.file = open(filename, "wb")
+        self.file.write(HEADER.pack(ARCHIVE_MAGIC, ARCHIVE_VERSION, RECORD.size, chunk_records))
+        self.chunk_records = chunk_records
+        self.buffer = bytearray()
+        self.devices = {}                       # Name to device number
+        self.chunks = []                        # Finished chunks' stats
+        self.current = chunk_stats([])
+        self.rows = 0
+
+    def write(self, samples: list[tuple[float, float, float]], device: str | None = None) -> None:
+        """Append (time, duty cycle %, ADC value) rows, from device if merging."""
+        number = 0
+        if device is not None:
+            number = self.devices.setdefault(device, len(self.devices))
+        for t, intensity, adc in samples:
+            record = RECORD.pack(t, intensity, adc, number)
+            self.buffer += record
+            _, intensity, adc, _ = RECORD.unpack(record)     # Stats of what is stored (float32)
+            self.current["time"].add(t)
+            self.current["intensity"].add(intensity)
+            self.current["adc"].add(adc)
+            self.rows += 1
+            if self.current["time"].count == self.chunk_records:
+                self.chunks.append(self.current)
+                self.current = chunk_stats([])
+
+    def flush(self) -> None:
+        """Push everything written so far to disk, then the index."""
+        self.file.write(self.buffer)
+        self.buffer.clear()
+        self.file.flush()
+        os.fsync(self.file.fileno())
+
+        chunks = self.chunks + ([self.current] if self.current["time"].count else [])
+        index = {
+            "version": ARCHIVE_VERSION,
+            "records": self.rows,
+            "devices": list(self.devices),
+            "chunks": [{column: stats[column].to_list() for column in COLUMNS} for stats in chunks],
+        }
+        temporary = archive_index(self.filename) + ".tmp"
+        with open(temporary, "w") as file:
+            json.dump(index, file)
+        os.replace(temporary, archive_index(self.filename))
+
+    def close(self) -> None:
+        self.flush()
+        self.file.close()
+
+
+class CaptureArchive:
+    """
+    Read access to an archive, a chunk at a time.
+
+    Attributes:
+        records:       Records in the file
+        chunk_records: Records per chunk
+        chunks:        Per chunk, ColumnStats per column (see chunk_stats())
+        devices:       Device names by number; empty for one unnamed device
+        reindexed:     Records indexed from the file on opening
+
+    Raises:
+        ValueError: If the file is not an archive of this version
+    """
+
+    def __init__(self, filename: str):
+        self.file = open(filename, "rb")
+        magic, version, record_size, self.chunk_records = HEADER.unpack(self.file.read(HEADER.size))
+        if magic != ARCHIVE_MAGIC or version != ARCHIVE_VERSION or record_size != RECORD.size:
+            raise ValueError(f"{filename} is not a version {ARCHIVE_VERSION} capture archive")
+        size = os.fstat(self.file.fileno()).st_size
+        self.records = (size - HEADER.size) // RECORD.size      # A torn last record is ignored
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ) if self.records else b""
+
+        self.chunks = []
+        self.devices = []
+        indexed = 0
+        try:
+            with open(archive_index(filename)) as file:
+                index = json.load(file)
+            if index["version"] == ARCHIVE_VERSION:
+                self.devices = index["devices"]
+                self.chunks = [{column: ColumnStats(chunk[column]) for column in COLUMNS}
+                               for chunk in index["chunks"]]
+                indexed = index["records"]
+        except (OSError, ValueError, KeyError):
+            pass                                # Missing or damaged: rebuilt below
+
+        # Unless the index covers the file exactly, keep the full chunks it
+        # holds and index the records after them again
+        full = len(self.chunks)
+        if indexed != self.records:
+            full = min(self.records // self.chunk_records, full)
+            while full and self.chunks[full - 1]["time"].count != self.chunk_records:
+                full -= 1
+        del self.chunks[full:]
+        self.reindexed = self.records - sum(stats["time"].count for stats in self.chunks)
+        for number in range(full, math.ceil(self.records / self.chunk_records)):
+            self.chunks.append(chunk_stats(self.chunk(number)[1]))
+
+    def close(self) -> None:
+        if self.records:
+            self.map.close()
+        self.file.close()
+
+    def device_number(self, device: str | None) -> int | None:
+        """
+        Number of a device name, None for every device.
+
+        Raises:
+            ValueError: If the archive has no such device
+        """
+        if device is None:
+            return None
+        if device not in self.devices:
+            raise ValueError(f"no device {device}; the archive has {', '.join(self.devices) or 'none'}")
+        return self.devices.index(device)
+
+    def chunk(self, number: int):
+        """
+        One chunk's records.
+
+        Returns:
+            Tuple of (index of the first record, iterator of (time,
+            intensity, ADC value, device number) tuples)
+        """
+        first = number * self.chunk_records
+        end = min(first + self.chunk_records, self.records)
+        offset = HEADER.size + first * RECORD.size
+        return first, RECORD.iter_unpack(self.map[offset:offset + (end - first) * RECORD.size])
+
+    def overlapping(self, start: float | None, end: float | None) -> list[int]:
+        """Chunks that may hold records with start <= time < end."""
+        return [number for number, stats in enumerate(self.chunks)
+                if (start is None or stats["time"].high >= start)
+                and (end is None or stats["time"].low < end)]
+
+    def scan(self, start: float | None = None, end: float | None = None,
+             device: str | None = None):
+        """
+        Records with start <= time < end, in file order.
+
+        Yields:
+            (index, device number, time, intensity, ADC value) tuples
+        """
+        number_wanted = self.device_number(device)
+        for number in self.overlapping(start, end):
+            first, records = self.chunk(number)
+            for index, (t, intensity, adc, device_number) in enumerate(records, first):
+                if ((start is None or t >= start) and (end is None or t < end)
+                        and (number_wanted is None or device_number == number_wanted)):
+                    yield index, device_number, t, intensity, adc
+
+    def summarize(self, start: float | None = None, end: float | None = None,
+                  device: str | None = None) -> tuple[dict, int]:
+        """
+        Count, min, max, mean and standard deviation per column.
+
+        Chunks entirely inside the range come from the index; only those
+        it cuts through (and every chunk when filtering by device in a
+        merged archive) are read.
+
+        Returns:
+            Tuple of (ColumnStats per column, chunks read)
+        """
+        number_wanted = self.device_number(device)
+        totals = chunk_stats([])
+        read = 0
+        for number in self.overlapping(start, end):
+            times = self.chunks[number]["time"]
+            if ((start is None or times.low >= start) and (end is None or times.high < end)
+                    and (number_wanted is None or len(self.devices) <= 1)):
+                for column in COLUMNS:
+                    totals[column].merge(self.chunks[number][column])
+                continue
+            read += 1
+            first, records = self.chunk(number)
+            for t, intensity, adc, device_number in records:
+                if ((start is None or t >= start) and (end is None or t < end)
+                        and (number_wanted is None or device_number == number_wanted)):
+                    totals["time"].add(t)
+                    totals["intensity"].add(intensity)
+                    totals["adc"].add(adc)
+        return totals, read
+
+    def resample(self, interval: float, start: float | None = None,
+                 end: float | None = None, device: str | None = None):
+        """
+        Fixed-interval buckets of the records with start <= time < end.
+
+        Buckets are counted from start, or from the first record. Each is
+        yielded once no chunk still to be read can reach it, so memory
+        holds only the buckets the current chunk spans when the capture
+        is in time order.
+
+        Yields:
+            (bucket start time, ColumnStats of intensity, of ADC value)
+            for each non-empty bucket, in time order
+        """
+        number_wanted = self.device_number(device)
+        chunks = self.overlapping(start, end)
+        if not chunks:
+            return
+        origin = start if start is not None else min(self.chunks[n]["time"].low for n in chunks)
+        # Earliest time any chunk from position i on can hold
+        later = [math.inf] * (len(chunks) + 1)
+        for i in range(len(chunks) - 1, -1, -1):
+            later[i] = min(later[i + 1], self.chunks[chunks[i]]["time"].low)
+
+        buckets = {}
+        for i, number in enumerate(chunks):
+            _, records = self.chunk(number)
+            for t, intensity, adc, device_number in records:
+                if ((start is None or t >= start) and (end is None or t < end)
+                        and (number_wanted is None or device_number == number_wanted)):
+                    key = int((t - origin) // interval)
+                    if key not in buckets:
+                        buckets[key] = (ColumnStats(), ColumnStats())
+                    bucket = buckets[key]
+                    bucket[0].add(intensity)
+                    bucket[1].add(adc)
+            done = math.floor((later[i + 1] - origin) / interval) if later[i + 1] < math.inf else None
+            for key in sorted(key for key in buckets if done is None or key < done):
+                intensity, adc = buckets.pop(key)
+                yield origin + key * interval, intensity, adc
+
+
+def read_columns(filename: str) -> tuple[list, list, list]:
+    """Every record's time, intensity and ADC value, for plot_data()."""
+    archive = CaptureArchive(filename)
+    time_stamps, intensities, adc_values = [], [], []
+    for _, _, t, intensity, adc in archive.scan():
+        time_stamps.append(t)
+        intensities.append(intensity)
+        adc_values.append(adc)
+    archive.close()
+    return time_stamps, intensities, adc_values
+
+
+def import_csv(csv_file: str, filename: str) -> int:
+    """
+    Convert a capture CSV (with or without a Device column) to an archive.
+
+    Returns:
+        Records written
+    """
+    writer = ArchiveWriter(filename)
+    with open(csv_file, newline="") as file:
+        for row in csv.DictReader(file):
+            writer.write([(float(row["Time"]), float(row["Intensity"]), float(row["ADC Value"]))],
+                         row.get("Device"))
+    writer.close()
+    return writer.rows
+
+
+def open_output(filename: str | None):
+    """filename for writing, or stdout for None or "-"."""
+    if filename in (None, "-"):
+        return sys.stdout
+    return open(filename, "w", newline="")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Query, resample and summarize capture archives")
+    commands = parser.add_subparsers(dest="command", required=True)
+    ranged = argparse.ArgumentParser(add_help=False)
+    ranged.add_argument("archive")
+    ranged.add_argument("--start", type=float, help="first capture second to include")
+    ranged.add_argument("--end", type=float, help="capture second to stop before")
+    ranged.add_argument("--device", help="one device of a merged capture")
+
+    commands.add_parser("info", help="records, devices and time span").add_argument("archive")
+    commands.add_parser("summary", parents=[ranged], help="statistics per column")
+    query = commands.add_parser("query", parents=[ranged], help="records as CSV (also the CSV export)")
+    query.add_argument("--output", help="CSV file instead of stdout")
+    resample = commands.add_parser("resample", parents=[ranged], help="per-interval mean, min and max as CSV")
+    resample.add_argument("--interval", type=float, required=True, help="bucket length in seconds")
+    resample.add_argument("--output", help="CSV file instead of stdout")
+    convert = commands.add_parser("import", help="convert a capture CSV to an archive")
+    convert.add_argument("csv")
+    convert.add_argument("archive")
+    args = parser.parse_args()
+
+    if args.command == "import":
+        print(f"{import_csv(args.csv, args.archive)} records written to {args.archive}")
+        return 0
+    if args.command == "resample" and args.interval <= 0:
+        parser.error("--interval must be positive")
+
+    try:
+        archive = CaptureArchive(args.archive)
+        archive.device_number(getattr(args, "device", None))
+    except ValueError as error:
+        parser.error(str(error))
+
+    if args.command == "info":
+        times = ColumnStats()
+        for stats in archive.chunks:
+            times.merge(stats["time"])
+        print(f"{archive.records} records in {len(archive.chunks)} chunks of {archive.chunk_records}")
+        if archive.records:
+            print(f"time {times.low:.3f} s to {times.high:.3f} s")
+        if archive.devices:
+            print(f"devices {', '.join(archive.devices)}")
+        if archive.reindexed:
+            print(f"{archive.reindexed} records were not in the index (capture cut short?)")
+
+    elif args.command == "summary":
+        totals, read = archive.summarize(args.start, args.end, args.device)
+        print(SUMMARY_HEADER)
+        for column in COLUMNS:
+            stats = totals[column]
+            print(f"{column:<12}{stats.count:>12}{stats.low:>12.3f}{stats.high:>12.3f}"
+                  f"{stats.mean:>12.3f}{stats.std():>12.3f}")
+        print(f"{read} of {len(archive.chunks)} chunks read, the rest from the index")
+
+    elif args.command == "query":
+        output = open_output(args.output)
+        writer = csv.writer(output)
+        merged = bool(archive.devices)
+        writer.writerow(["Index"] + (["Device"] if merged else []) + list(CSV_COLUMNS.values()))
+        for index, device_number, t, intensity, adc in archive.scan(args.start, args.end, args.device):
+            writer.writerow([index] + ([archive.devices[device_number]] if merged else [])
+                            + [t, csv_value(intensity), csv_value(adc)])
+        if output is not sys.stdout:
+            output.close()
+
+    elif args.command == "resample":
+        output = open_output(args.output)
+        writer = csv.writer(output)
+        writer.writerow(["Time", "Samples", "Intensity", "Intensity Min", "Intensity Max",
+                         "ADC Value", "ADC Min", "ADC Max"])
+        for t, intensity, adc in archive.resample(args.interval, args.start, args.end, args.device):
+            writer.writerow([round(t, 6), intensity.count,
+                             round(intensity.mean, 6), csv_value(intensity.low), csv_value(intensity.high),
+                             round(adc.mean, 6), csv_value(adc.low), csv_value(adc.high)])
+        if output is not sys.stdout:
+            output.close()
+
+    archive.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -10,10 +10,16 @@ Created on Tue Nov 13 21:37:07 2024
               and creates interactive plots.
               
 This script performs four main functions:
-1. Reading raw ADC and duty cycle data from a serial connection
-2. Processing and structuring the raw data
-3. Saving the processed data to a CSV file
-4. Creating interactive visualizations of the data
+1. Reading raw ADC and duty cycle data from a serial connection, on a
+   reader thread that does bulk reads
+2. Parsing the byte stream incrementally as it arrives
+3. Appending the samples to a CSV file, flushed every few seconds, so a
+   capture can run for hours and survives a crash up to the last flush
+4. Creating interactive visualizations of the data, live during the
+   capture and once it ends, decimated so long captures stay responsive
+
+The firmware can send either ASCII records ("ddd aaaa\n") or binary
+frames (see src/telemetry.h); set PROTOCOL below to match.
 """
 
 # Import required libraries
@@ -21,78 +27,1208 @@ from plotly.subplots import make_subplots
 import plotly.graph_objects as go
 import plotly.io as pio
 import pandas as pd
+import collections
+import csv
+import heapq
+import os
+import queue
+import threading
 import time 
+import webbrowser
 import serial
 
+from CaptureArchive import ARCHIVE_EXTENSION, ArchiveWriter, read_columns
+
 # Set plotly to open plots in browser
 pio.renderers.default = "browser"
 
-def read_serial_data(serial_conn: serial.Serial, duration: float) -> tuple[str, list]:
+# Telemetry framing, mirrors src/telemetry.h
+FRAME_SYNC = 0xA5
+FRAME_OVERHEAD = 5              # SYNC, SEQ, TYPE, LEN, CRC
+FRAME_MAX_PAYLOAD = 32
+FRAME_SAMPLE = 0x01
+FRAME_WINDOW = 0x02
+FRAME_KEY = 0x03
+FRAME_DELTA = 0x04
+FRAME_PROFILE = 0x05
+FRAME_LOG = 0x06                # Data EEPROM log dump
+FRAME_LATENCY = 0x07            # Input-to-LED latency, LATENCY_ENABLED builds
+FRAME_REPLY = 0x80              # OR'd with the command type
+
+# Host commands, mirrors src/command.h
+CMD_SET_DUTY = 0x10             # Optional trailing channel byte, like CMD_SET_BLINK
+CMD_SET_BLINK = 0x11
+CMD_SET_RATE = 0x12
+CMD_STREAM = 0x13
+CMD_QUERY = 0x14
+CMD_SET_MODE = 0x15
+CMD_SET_FORMAT = 0x16
+CMD_SET_LOOP = 0x17
+CMD_PROFILE = 0x18
+CMD_SET_PATTERN = 0x19          # Optional trailing channel byte
+CMD_LOG = 0x1A
+CMD_SET_ID = 0x1B               # Device ID reported by CMD_QUERY
+CMD_OK = 0
+QUERY_ID_OFFSET = 24            # ID in the CMD_QUERY reply data
+QUERY_FLAGS_OFFSET = 26         # FLAGS byte, mirrors src/command.h
+QUERY_FLAG_BOOT_LATE = 0x01     # Boot went over BOOT_BUDGET_MS
+
+# CMD_LOG operations and record layout, mirrors src/eeLog.h
+LOG_STOP = 0
+LOG_START = 1
+LOG_DUMP = 2
+LOG_CLEAR = 3
+LOG_STAMP_SECONDS = (1 << 15) / 31250   # One STAMP step (EELOG_STAMP_SHIFT)
+LOG_STAMP_WRAP = 1 << 14
+LOG_DUTY_MAX = 31
+
+# Patterns in PATTERN_* order, mirrors src/patternTable.h
+PATTERNS = ["steady", "blink", "fade_in", "fade_out", "breathe", "strobe",
+            "heartbeat", "candle"]
+
+# Instrumented sites in profSite_t order, mirrors src/profile.h
+PROFILE_SITES = ["systick", "pwm_sw", "cn", "u2tx", "u2rx", "adc",
+                 "adc_read", "loop", "work", "idle"]
+
+# Latency stages and inputs in latStage_t and LAT_SOURCE_* order, mirrors src/latency.h
+LATENCY_STAGES = ["input", "accept", "state", "publish", "output"]
+LATENCY_SOURCES = ["PB1", "PB2", "PB3", "pot"]
+
+# Device tick rate, mirrors TICK_HZ in src/timeDelay.h
+TICK_HZ = 31250
+
+# Window means are 12.4 fixed point; duty counts are out of PWM_PERIOD
+MEAN_SCALE = 16
+PWM_PERIOD = 1024
+
+# Capture pipeline defaults
+READER_QUEUE_CHUNKS = 4096      # Chunks buffered between the reader and the parser
+FLUSH_SECONDS = 2.0             # CSV flush period
+REPORT_SECONDS = 10.0           # Throughput report period
+ALIGN_SECONDS = 2.0             # Device clock alignment: window per lag minimum
+ALIGN_WINDOWS = 8               # Minima the offset and drift are fitted to
+MERGE_DELAY_SECONDS = 1.0       # Merged output holds rows this long to order them
+
+# Plotting defaults
+PLOT_BUCKETS = 1000             # Min/max pairs per full-history trace
+LIVE_WINDOW_SAMPLES = 2000      # Samples in the live view's recent window
+LIVE_REFRESH_SECONDS = 2.0      # Live view redraw and browser reload period
+
+# CRC-8 (poly 0x07, init 0x00) lookup table
+CRC8_TABLE = []
+for _byte in range(256):
+    _crc = _byte
+    for _ in range(8):
+        _crc = ((_crc << 1) ^ 0x07) & 0xFF if _crc & 0x80 else (_crc << 1) & 0xFF
+    CRC8_TABLE.append(_crc)
+
+
+def crc8(data: bytes) -> int:
     """
-    Read serial data for specified duration and collect timestamps.
-    
-    The function:
-    1. Reads data line by line from the serial port
-    2. Filters out empty lines and whitespace
-    3. Records timestamp for each reading
-    4. Continues reading until specified duration is reached
-    
+    Compute the CRC-8 used by the firmware's telemetry frames.
+
     Args:
-        serial_conn: Serial connection object for communication
-        duration: How long to record data, in seconds
-    
+        data: Bytes covered by the CRC (SEQ through end of payload)
+
     Returns:
-        Tuple containing:
-        - Raw data string with all readings
-        - List of timestamps for each reading
+        CRC-8 value (0-255)
     """
-    data_lines = []      # Store raw data lines
-    time_stamps = []     # Store corresponding timestamps
-    start_time = time.time()
-    
-    # Read data until duration is reached
-    while (time.time() - start_time < duration):
-        if line := serial_conn.readline():  # Read a line if available
-            if line not in [b' \n', b'\n']: # Skip empty lines
-                data_lines.append(line.decode("ascii"))
-                time_stamps.append(time.time() - start_time)
-    
-    serial_conn.close()
-    return ''.join(data_lines).strip(), time_stamps
+    crc = 0
+    for byte in data:
+        crc = CRC8_TABLE[crc ^ byte]
+    return crc
 
 
-def process_data(data_str: str, time_stamps: list) -> tuple[list, list, list]:
+class FrameDecoder:
     """
-    Process raw serial data into structured data arrays.
-    
-    The function:
-    1. Splits raw data into lines
-    2. Extracts duty cycle and ADC values from each line
-    3. Converts string values to integers
-    4. Removes first and last readings to avoid partial data
-    
+    Incremental decoder for the firmware's binary telemetry frames.
+
+    Bytes can be fed in arbitrary chunks. The decoder hunts for the sync
+    byte, checks the length and CRC, and uses the sequence counter to
+    count frames lost on the way (UART FIFO full, line noise).
+
+    Attributes:
+        crc_errors: Candidate frames rejected by the CRC check
+        dropped:    Frames missing according to sequence number gaps
+        frames:     Frames decoded successfully
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.last_seq = None
+        self.crc_errors = 0
+        self.dropped = 0
+        self.frames = 0
+
+    def feed(self, data: bytes) -> list[tuple[int, int, bytes]]:
+        """
+        Add received bytes and return every complete frame found.
+
+        Args:
+            data: Newly received bytes
+
+        Returns:
+            List of (sequence, type, payload) tuples
+        """
+        self.buffer.extend(data)
+        decoded = []
+
+        while True:
+            start = self.buffer.find(FRAME_SYNC)
+            if start < 0:
+                self.buffer.clear()
+                break
+            del self.buffer[:start]
+
+            if len(self.buffer) < 4:
+                break                           # Header incomplete
+            length = self.buffer[3]
+            if length > FRAME_MAX_PAYLOAD:
+                del self.buffer[0]              # Not a real sync byte
+                continue
+            if len(self.buffer) < length + FRAME_OVERHEAD:
+                break                           # Frame incomplete
+
+            body = bytes(self.buffer[1:4 + length])
+            if crc8(body) != self.buffer[4 + length]:
+                self.crc_errors += 1
+                del self.buffer[0]              # Resync on the next 0xA5
+                continue
+
+            seq, frame_type = body[0], body[1]
+            if self.last_seq is not None:
+                self.dropped += (seq - self.last_seq - 1) & 0xFF
+            self.last_seq = seq
+            self.frames += 1
+
+            decoded.append((seq, frame_type, body[3:]))
+            del self.buffer[:length + FRAME_OVERHEAD]
+
+        return decoded
+
+
+def decode_sample(payload: bytes) -> tuple[int, int, int, list]:
+    """
+    Unpack a sample frame payload.
+
     Args:
-        data_str: Raw data string containing all readings
-        time_stamps: List of timestamps for each reading
-    
+        payload: Payload of a FRAME_SAMPLE frame
+
     Returns:
-        Tuple containing:
-        - List of timestamps
-        - List of duty cycle values (LED intensity)
-        - List of ADC buffer values (light sensor readings)
-    """
-    data_lines = data_str.split('\n')[1:-1]  # Split into lines, remove first/last
-    duty_cycle_values = []                   # Store LED intensity values
-    adc_buffer_values = []                   # Store light sensor readings
-    
-    # Process each line of data
-    for line in data_lines:
-        if values := line.strip().split():  # Split line into values
-            if len(values) >= 2:            # Ensure both values exist
-                duty_cycle_values.append(int(values[0]))  # First value is duty cycle
-                adc_buffer_values.append(int(values[1]))  # Second value is ADC reading
-    
-    return time_stamps[1:-1], duty_cycle_values, adc_buffer_values
+        Tuple of (device tick, duty cycle %, ADC value, list of extra fields).
+        Multi-channel builds send channel 0 first and duty %, ADC pairs of
+        channels 1 and up as the extras.
+    """
+    tick = payload[0] | (payload[1] << 8)
+    duty = payload[2]
+    adc = payload[3] | (payload[4] << 8)
+    extras = [payload[i] | (payload[i + 1] << 8)
+              for i in range(5, len(payload) - 1, 2)]
+    return tick, duty, adc, extras
+
+
+def decode_window(payload: bytes) -> dict:
+    """
+    Unpack a window statistics frame payload.
+
+    Args:
+        payload: Payload of a FRAME_WINDOW frame
+
+    Returns:
+        Dict with tick, count, adc_min, adc_max, adc_mean, duty_min,
+        duty_max and duty_mean (means as floats, duty in PWM counts)
+    """
+    fields = [payload[i] | (payload[i + 1] << 8) for i in range(0, 16, 2)]
+    return {
+        "tick": fields[0],
+        "count": fields[1],
+        "adc_min": fields[2],
+        "adc_max": fields[3],
+        "adc_mean": fields[4] / MEAN_SCALE,
+        "duty_min": fields[5],
+        "duty_max": fields[6],
+        "duty_mean": fields[7] / MEAN_SCALE,
+    }
+
+
+def read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    """
+    Read one varint (7 bits per byte, low group first).
+
+    Returns:
+        Tuple of (value, position after the varint)
+    """
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value: int) -> int:
+    """Undo the zig-zag map 0, 1, 2, 3 ... -> 0, -1, 1, -2 ..."""
+    return (value >> 1) ^ -(value & 1)
+
+
+class DeltaStream:
+    """
+    Rebuilds samples from the firmware's compressed telemetry stream.
+
+    Keyframes carry a full sample; delta frames carry zig-zag varint
+    differences and runs of unchanged samples relative to it. Delta
+    samples are spaced evenly between the previous frame's tick and their
+    own frame's tick. After a sequence gap, deltas are ignored until the
+    next keyframe.
+
+    Attributes:
+        skipped: Delta frames ignored while waiting for a keyframe
+    """
+
+    def __init__(self):
+        self.synced = False
+        self.tick = 0
+        self.duty = 0
+        self.adc = 0
+        self.skipped = 0
+
+    def lost_frames(self):
+        """Mark the stream broken after a sequence gap."""
+        self.synced = False
+
+    def key(self, payload: bytes) -> tuple[int, int, int]:
+        """
+        Apply a keyframe.
+
+        Returns:
+            The (tick, duty %, ADC) sample it carries
+        """
+        self.tick, self.duty, self.adc, _ = decode_sample(payload)
+        self.synced = True
+        return self.tick, self.duty, self.adc
+
+    def delta(self, payload: bytes, span: int | None = None) -> list[tuple[float, int, int]]:
+        """
+        Apply a delta frame.
+
+        Args:
+            payload: Delta frame payload
+            span:    Ticks since the previous frame, if known beyond the
+                     16-bit wrap (TickClock)
+
+        Returns:
+            List of (tick, duty %, ADC) samples; ticks may be fractional
+            and are not wrapped
+        """
+        if not self.synced:
+            self.skipped += 1
+            return []
+
+        end_tick = payload[0] | (payload[1] << 8)
+        count = payload[2]
+        if span is None:
+            span = (end_tick - self.tick) & 0xFFFF
+        step = span / count
+        values = []
+        pos = 3
+
+        while pos < len(payload):
+            head, pos = read_varint(payload, pos)
+            if head & 1:
+                values.extend([(self.duty, self.adc)] * (head >> 1))
+            else:
+                duty_delta, pos = read_varint(payload, pos)
+                self.adc += unzigzag(head >> 1)
+                self.duty += unzigzag(duty_delta)
+                values.append((self.duty, self.adc))
+
+        samples = [(self.tick + step * (i + 1), duty, adc)
+                   for i, (duty, adc) in enumerate(values)]
+        self.tick = end_tick
+        return samples
+
+
+def encode_frame(seq: int, frame_type: int, payload: bytes = b"") -> bytes:
+    """
+    Build a frame in the firmware's telemetry layout.
+
+    Args:
+        seq:        Sequence number (0-255), echoed in the device's reply
+        frame_type: CMD_* value
+        payload:    Command payload
+
+    Returns:
+        Complete frame including sync byte and CRC
+    """
+    body = bytes([seq & 0xFF, frame_type, len(payload)]) + payload
+    return bytes([FRAME_SYNC]) + body + bytes([crc8(body)])
+
+
+def send_command(serial_conn: serial.Serial, decoder: FrameDecoder, seq: int,
+                 command: int, payload: bytes = b"",
+                 timeout: float = 1.0) -> tuple[int, bytes]:
+    """
+    Send one command and wait for its reply.
+
+    Sample frames that arrive while waiting are discarded.
+
+    Args:
+        serial_conn: Open serial connection
+        decoder:     FrameDecoder for the connection
+        seq:         Sequence number to match the reply
+        command:     CMD_* value
+        payload:     Command payload, multi-byte fields little-endian
+        timeout:     Seconds to wait for the reply
+
+    Returns:
+        Tuple of (status, reply data); status is None on timeout
+    """
+    serial_conn.write(encode_frame(seq, command, payload))
+    deadline = time.time() + timeout
+
+    while time.time() < deadline:
+        for _, frame_type, reply in decoder.feed(serial_conn.read(serial_conn.in_waiting or 1)):
+            if frame_type == command | FRAME_REPLY and reply[0] == seq & 0xFF:
+                return reply[1], reply[2:]
+    return None, b""
+
+
+def read_profile(serial_conn: serial.Serial, decoder: FrameDecoder, seq: int,
+                 clear: bool = False, timeout: float = 2.0) -> dict:
+    """
+    Fetch the wake latencies, and the cycle-count statistics of a
+    PROFILE_ENABLED build.
+
+    Args:
+        serial_conn: Open serial connection
+        decoder:     FrameDecoder for the connection
+        seq:         Sequence number for the command
+        clear:       Clear the statistics after reading them
+        timeout:     Seconds to wait for the reply and the site frames
+
+    Returns:
+        Dict with elapsed (cycles since the last clear), resolution (cycles
+        per count), sites, mapping site name to a dict of count, min, max,
+        mean and total cycles (empty if the build has no profiling), and
+        wake: last and max ms from a wake to its debounced press, and
+        misses over WAKE_LATENCY_BUDGET_MS; empty if there is no reply
+    """
+    status, data = send_command(serial_conn, decoder, seq, CMD_PROFILE,
+                                bytes([1 if clear else 0]), timeout)
+    if status != CMD_OK:
+        return {}
+
+    result = {
+        "elapsed": int.from_bytes(data[2:6], "little"),
+        "resolution": 1 << data[1],
+        "sites": {},
+        "wake": {
+            "last": int.from_bytes(data[6:8], "little") * 1000 / TICK_HZ,
+            "max": int.from_bytes(data[8:10], "little") * 1000 / TICK_HZ,
+            "misses": int.from_bytes(data[10:12], "little"),
+        },
+    }
+    deadline = time.time() + timeout
+    while len(result["sites"]) < data[0] and time.time() < deadline:
+        for _, frame_type, payload in decoder.feed(serial_conn.read(serial_conn.in_waiting or 1)):
+            if frame_type != FRAME_PROFILE:
+                continue
+            count = payload[1] | (payload[2] << 8)
+            values = [int.from_bytes(payload[i:i + 4], "little") for i in (3, 7, 11)]
+            name = PROFILE_SITES[payload[0]] if payload[0] < len(PROFILE_SITES) else str(payload[0])
+            result["sites"][name] = {
+                "count": count,
+                "min": values[0],
+                "max": values[1],
+                "mean": values[2] / count if count else 0.0,
+                "total": values[2],
+            }
+    return result
+
+
+def print_profile(profile: dict) -> None:
+    """
+    Print read_profile() results as a table, with CPU share per site.
+    """
+    elapsed = profile["elapsed"] or 1
+    wake = profile["wake"]
+    print(f"wake to press {wake['last']:.1f} ms, max {wake['max']:.1f} ms, "
+          f"{wake['misses']} over budget")
+    print(f"elapsed {profile['elapsed']} cycles, resolution {profile['resolution']} cycles")
+    print(f"{'site':<10}{'count':>8}{'min':>10}{'max':>10}{'mean':>10}{'cpu %':>8}")
+    for name, stat in profile["sites"].items():
+        print(f"{name:<10}{stat['count']:>8}{stat['min']:>10}{stat['max']:>10}"
+              f"{stat['mean']:>10.1f}{100 * stat['total'] / elapsed:>8.2f}")
+
+
+def read_latency(serial_conn: serial.Serial, duration: float | None = None,
+                 decoder: FrameDecoder | None = None) -> list[dict]:
+    """
+    Collect the measurements a LATENCY_ENABLED build streams.
+
+    Every button release and potentiometer change the device measures
+    becomes one record; press the buttons and turn the knobs meanwhile.
+    Other frames and ASCII text are skipped.
+
+    Args:
+        serial_conn: Open serial connection, closed at the end
+        duration:    Seconds to listen, None to listen until Ctrl-C
+        decoder:     FrameDecoder for the connection
+
+    Returns:
+        List of dicts with source (LATENCY_SOURCES name) and, for each
+        stage after "input", the ms since "input", None if not reached
+    """
+    decoder = decoder or FrameDecoder()
+    records = []
+    start = time.time()
+
+    try:
+        while duration is None or time.time() - start < duration:
+            for _, frame_type, payload in decoder.feed(serial_conn.read(serial_conn.in_waiting or 1)):
+                if frame_type != FRAME_LATENCY or len(payload) < 12:
+                    continue
+                record = {"source": LATENCY_SOURCES[payload[0]]
+                          if payload[0] < len(LATENCY_SOURCES) else str(payload[0])}
+                for stage in range(1, len(LATENCY_STAGES)):
+                    ticks = payload[2 * stage + 2] | (payload[2 * stage + 3] << 8)
+                    record[LATENCY_STAGES[stage]] = (ticks * 1000 / TICK_HZ
+                                                     if payload[1] & (1 << stage) else None)
+                records.append(record)
+    except KeyboardInterrupt:
+        pass                                    # Listening stopped
+    finally:
+        serial_conn.close()
+    return records
+
+
+def latency_spans(record: dict) -> dict:
+    """
+    Split one read_latency() record into the time spent in each stage.
+
+    Returns:
+        Dict of debounce (input to accept), dispatch (to state), update
+        (to publish), pwm (to output) and total (input to output) in ms;
+        spans whose end was not reached are left out
+    """
+    spans = {}
+    previous = 0.0
+    for name, stage in (("debounce", "accept"), ("dispatch", "state"),
+                        ("update", "publish"), ("pwm", "output")):
+        if record[stage] is None:
+            break
+        spans[name] = record[stage] - previous
+        previous = record[stage]
+    if record["output"] is not None:
+        spans["total"] = record["output"]
+    return spans
+
+
+def print_latency(records: list[dict]) -> None:
+    """
+    Print read_latency() results per input kind and span, in ms.
+    """
+    print(f"{'input':<8}{'span':<10}{'count':>7}{'min':>9}{'p50':>9}{'p95':>9}{'max':>9}")
+    for kind in ("button", "pot"):
+        spans = collections.defaultdict(list)
+        for record in records:
+            if (record["source"] == "pot") == (kind == "pot"):
+                for name, value in latency_spans(record).items():
+                    spans[name].append(value)
+        for name, values in spans.items():
+            values.sort()
+            print(f"{kind:<8}{name:<10}{len(values):>7}{values[0]:>9.2f}"
+                  f"{values[len(values) // 2]:>9.2f}{values[int(len(values) * 0.95)]:>9.2f}"
+                  f"{values[-1]:>9.2f}")
+    unfinished = sum(record["output"] is None for record in records)
+    if unfinished:
+        print(f"{unfinished} measurements did not reach the LED")
+
+
+def plot_latency(records: list[dict]) -> None:
+    """
+    Histograms of the read_latency() spans, buttons and potentiometer overlaid.
+
+    One plot per span (see latency_spans()), total last, so the share of
+    each stage and its spread can be compared before and after a change.
+    """
+    names = ["debounce", "dispatch", "update", "pwm", "total"]
+    fig = make_subplots(rows=1, cols=len(names), subplot_titles=names)
+
+    for kind, color in (("button", "blue"), ("pot", "red")):
+        spans = [latency_spans(record) for record in records
+                 if (record["source"] == "pot") == (kind == "pot")]
+        for col, name in enumerate(names, start=1):
+            values = [span[name] for span in spans if name in span]
+            if values:
+                fig.add_trace(go.Histogram(x=values, name=kind, legendgroup=kind,
+                                           showlegend=(col == 1), opacity=0.6,
+                                           marker=dict(color=color)),
+                              row=1, col=col)
+    for col in range(1, len(names) + 1):
+        fig.update_xaxes(title_text="Latency (ms)", row=1, col=col)
+    fig.update_yaxes(title_text="Inputs", row=1, col=1)
+    fig.update_layout(barmode="overlay")
+    fig.show()
+
+
+def read_log(serial_conn: serial.Serial, decoder: FrameDecoder, seq: int,
+             timeout: float = 5.0) -> tuple[list, list, list]:
+    """
+    Dump the samples the device logged to its data EEPROM.
+
+    Records come oldest first. STAMP wraps every ~4.8 hours; steps back
+    are taken as wraps, so time across a long unpowered gap is not exact.
+
+    Args:
+        serial_conn: Open serial connection
+        decoder:     FrameDecoder for the connection
+        seq:         Sequence number for the command
+        timeout:     Seconds to wait for the reply and the whole dump
+
+    Returns:
+        Tuple of (time stamps, duty cycle percentages, ADC readings), time
+        in seconds from the oldest record; empty lists if the device is busy
+    """
+    status, data = send_command(serial_conn, decoder, seq, CMD_LOG,
+                                bytes([LOG_DUMP]), timeout)
+    if status != CMD_OK:
+        return [], [], []
+
+    records = {}
+    count = data[1]
+    deadline = time.time() + timeout
+    while len(records) < count and time.time() < deadline:
+        for _, frame_type, payload in decoder.feed(serial_conn.read(serial_conn.in_waiting or 1)):
+            if frame_type != FRAME_LOG:
+                continue
+            for i in range((len(payload) - 2) // 4):
+                field = payload[2 + 4 * i:6 + 4 * i]
+                records[payload[0] + i] = (field[0] | (field[1] << 8),
+                                           field[2] | (field[3] << 8))
+
+    time_stamps, duty_cycle_values, adc_buffer_values = [], [], []
+    stamps = 0
+    last = None
+    for position in sorted(records):
+        stamp, packed = records[position]
+        if last is not None:
+            stamps += (stamp - last) % LOG_STAMP_WRAP
+        last = stamp
+        time_stamps.append(stamps * LOG_STAMP_SECONDS)
+        duty_cycle_values.append(round(100 * (packed >> 10) / LOG_DUTY_MAX))
+        adc_buffer_values.append(packed & 0x3FF)
+    return time_stamps, duty_cycle_values, adc_buffer_values
+
+
+class SerialReader(threading.Thread):
+    """
+    Reader thread that moves bytes from the serial port into a queue.
+
+    Each read takes everything the driver has buffered, so a fast stream
+    costs one call per chunk rather than one per byte or line. Chunks are
+    stamped with the host time they arrived. If the parser falls behind
+    and the queue fills, chunks are dropped and counted rather than
+    growing memory without limit. Readers for several ports can share
+    one queue; source tells their chunks apart.
+
+    Attributes:
+        chunks:     Queue of (source, host time, bytes) tuples
+        bytes_read: Bytes received so far
+        overflows:  Chunks dropped because the queue was full
+        error:      SerialException that ended the thread, if any
+    """
+
+    def __init__(self, serial_conn: serial.Serial,
+                 chunks: queue.Queue | None = None, source=None):
+        super().__init__(daemon=True)
+        self.serial_conn = serial_conn
+        self.chunks = queue.Queue(READER_QUEUE_CHUNKS) if chunks is None else chunks
+        self.source = source
+        self.bytes_read = 0
+        self.overflows = 0
+        self.error = None
+        self._stop_event = threading.Event()
+
+    def run(self) -> None:
+        try:
+            while not self._stop_event.is_set():
+                chunk = self.serial_conn.read(max(1, self.serial_conn.in_waiting))
+                if not chunk:
+                    continue                    # Read timeout
+                self.bytes_read += len(chunk)
+                try:
+                    self.chunks.put_nowait((self.source, time.time(), chunk))
+                except queue.Full:
+                    self.overflows += 1
+        except serial.SerialException as error:
+            self.error = error
+
+    def stop(self) -> None:
+        """Ask the thread to finish and wait for it (up to one read timeout)."""
+        self._stop_event.set()
+        self.join()
+
+
+class AsciiSampleDecoder:
+    """
+    Incremental parser for the firmware's ASCII records ("ddd aaaa\n").
+
+    Bytes can be fed in arbitrary chunks; a partial line is kept until the
+    rest arrives. The first line is discarded because the capture may
+    have started in the middle of it. Multi-channel records carry further
+    "ddd aaaa" pairs; channel 0 is used.
+
+    Attributes:
+        lines:    Complete lines seen
+        dropped:  Lines that did not parse (noise, or bytes lost on the way)
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.synced = False
+        self.lines = 0
+        self.dropped = 0
+
+    def feed(self, data: bytes, host_time: float) -> list[tuple[float, float, float]]:
+        """
+        Add received bytes and return every complete sample found.
+
+        Args:
+            data:      Newly received bytes
+            host_time: Capture time the bytes arrived, in seconds
+
+        Returns:
+            List of (time, duty cycle %, ADC value) tuples
+        """
+        self.buffer.extend(data)
+        end = self.buffer.rfind(b"\n")
+        if end < 0:
+            return []
+        lines = self.buffer[:end].split(b"\n")
+        del self.buffer[:end + 1]
+
+        if not self.synced:
+            lines = lines[1:]                   # Partial first line
+            self.synced = True
+
+        samples = []
+        for line in lines:
+            values = line.split()
+            if not values:
+                continue                        # Blank line
+            self.lines += 1
+            try:
+                samples.append((host_time, int(values[0]), int(values[1])))
+            except (IndexError, ValueError):
+                self.dropped += 1
+        return samples
+
+    def stats(self) -> str:
+        """One-line summary of the counters."""
+        return f"{self.lines} lines, {self.dropped} dropped"
+
+
+class TickClock:
+    """
+    Rebuilds device time from the 16-bit tick carried in each frame.
+
+    The tick wraps every 65536 / TICK_HZ seconds (about 2.1 s), and frames
+    can be further apart than that: window statistics, a slow CMD_SET_RATE,
+    or a still pot in TELEMETRY_MODE_CHANGE. The host time between two
+    frames says how many wraps went by; it only has to be right to within
+    half a wrap, so it is scaled by the device rate measured so far, which
+    follows an FRC that is off by a few percent.
+    """
+
+    RATE_SECONDS = 10.0                     # Host time before the rate is measured
+
+    def __init__(self, tick_hz: int = TICK_HZ):
+        self.tick_hz = tick_hz
+        self.last = None
+        self.total = 0
+        self.first_host = None
+        self.last_host = None
+
+    def advance(self, tick: int, host_time: float | None = None) -> int:
+        """
+        Move the clock to one 16-bit tick.
+
+        Args:
+            tick:      Tick value from a frame
+            host_time: Capture time the frame arrived, in seconds; without
+                       it, frames are taken to be less than a wrap apart
+
+        Returns:
+            Device ticks since the first frame
+        """
+        if self.last is not None:
+            step = (tick - self.last) & 0xFFFF
+            if host_time is not None and self.last_host is not None:
+                rate = self.tick_hz
+                if host_time - self.first_host >= self.RATE_SECONDS:
+                    rate = self.total / (self.last_host - self.first_host)
+                expected = (host_time - self.last_host) * rate
+                step += max(0, round((expected - step) / 0x10000)) * 0x10000
+            self.total += step
+        self.last = tick
+        if host_time is not None:
+            if self.first_host is None:
+                self.first_host = host_time
+            self.last_host = host_time
+        return self.total
+
+    def seconds(self, tick: int, host_time: float | None = None) -> float:
+        """
+        Convert one 16-bit tick to seconds since the first frame.
+
+        Args:
+            tick:      Tick value from a frame
+            host_time: Capture time the frame arrived, as for advance()
+
+        Returns:
+            Device time in seconds
+        """
+        return self.advance(tick, host_time) / self.tick_hz
+
+
+class BinarySampleDecoder:
+    """
+    Incremental decoder from binary telemetry frames to samples.
+
+    Unlike the ASCII path, frames carry their own boundaries, so nothing
+    has to be discarded at the start of the capture. Timestamps come from
+    the device tick taken when each ADC reading was completed, not from
+    when the host happened to receive it. Window statistics frames
+    contribute their means; compressed streams are expanded.
+
+    Attributes:
+        frames:    FrameDecoder for the byte stream, with its counters
+        deltas:    DeltaStream for the compressed format
+        dropped:   Frames lost according to sequence number gaps
+    """
+
+    def __init__(self):
+        self.frames = FrameDecoder()
+        self.deltas = DeltaStream()
+        self.clock = TickClock()
+        self.last_seq = None
+
+    @property
+    def dropped(self) -> int:
+        return self.frames.dropped
+
+    def feed(self, data: bytes, host_time: float) -> list[tuple[float, float, float]]:
+        """
+        Add received bytes and return every complete sample found.
+
+        Args:
+            data:      Newly received bytes
+            host_time: Capture time the bytes arrived, in seconds; frames
+                       carry device time, this only counts its wraps
+
+        Returns:
+            List of (device time in seconds, duty cycle %, ADC value) tuples
+        """
+        samples = []
+
+        for seq, frame_type, payload in self.frames.feed(data):
+            if self.last_seq is not None and seq != (self.last_seq + 1) & 0xFF:
+                self.deltas.lost_frames()
+            self.last_seq = seq
+
+            if frame_type == FRAME_KEY:
+                self.deltas.key(payload)
+                frame_type = FRAME_SAMPLE       # Same layout as a sample
+            elif frame_type == FRAME_DELTA:
+                # The frame's own tick sets the span its samples share
+                start, prev = self.clock.total, self.deltas.tick
+                span = self.clock.advance(payload[0] | (payload[1] << 8), host_time) - start
+                for tick, duty, adc in self.deltas.delta(payload, span):
+                    samples.append(((start + tick - prev) / self.clock.tick_hz, duty, adc))
+                continue
+
+            if frame_type == FRAME_SAMPLE:
+                tick, duty, adc, _ = decode_sample(payload)
+                samples.append((self.clock.seconds(tick, host_time), duty, adc))
+            elif frame_type == FRAME_WINDOW:
+                # Window mode: plot the means
+                window = decode_window(payload)
+                samples.append((self.clock.seconds(window["tick"], host_time),
+                                window["duty_mean"] * 100 / PWM_PERIOD,
+                                window["adc_mean"]))
+        return samples
+
+    def stats(self) -> str:
+        """One-line summary of the counters."""
+        return (f"{self.frames.frames} frames, {self.frames.dropped} dropped, "
+                f"{self.frames.crc_errors} CRC errors, "
+                f"{self.deltas.skipped} delta frames skipped")
+
+
+class CsvSampleWriter:
+    """
+    Appends samples to a CSV file as they are captured.
+
+    Same columns as save_to_csv(), with a Device column after Index when
+    merging devices. Rows are buffered by the file object and pushed to
+    disk by flush(), so at most one flush period is lost if the script or
+    the PC dies mid-capture.
+    """
+
+    def __init__(self, filename: str, merged: bool = False):
+        self.file = open(filename, "w", newline="")
+        self.writer = csv.writer(self.file)
+        self.writer.writerow(["Index"] + (["Device"] if merged else []) + ["Time", "Intensity", "ADC Value"])
+        self.rows = 0
+
+    def write(self, samples: list[tuple[float, float, float]], device: str | None = None) -> None:
+        """Append (time, duty cycle %, ADC value) rows, from device if merging."""
+        for sample in samples:
+            self.writer.writerow((self.rows,) + ((device,) if device is not None else ()) + tuple(sample))
+            self.rows += 1
+
+    def flush(self) -> None:
+        """Push everything written so far to disk."""
+        self.file.flush()
+        os.fsync(self.file.fileno())
+
+    def close(self) -> None:
+        self.flush()
+        self.file.close()
+
+
+def open_sample_writer(filename: str, merged: bool = False):
+    """
+    CsvSampleWriter, or an ArchiveWriter (CaptureArchive.py) if filename
+    ends in ARCHIVE_EXTENSION.
+    """
+    if filename.endswith(ARCHIVE_EXTENSION):
+        return ArchiveWriter(filename)
+    return CsvSampleWriter(filename, merged)
+
+
+def capture(serial_conn: serial.Serial, protocol: str = "ascii",
+            duration: float | None = None, filename: str = "Group_26.csv",
+            flush_interval: float = FLUSH_SECONDS,
+            report_interval: float = REPORT_SECONDS,
+            on_samples=None) -> dict:
+    """
+    Stream telemetry from the serial port to a CSV file.
+
+    A SerialReader thread does the port reads; this thread parses the
+    chunks as they come, appends the samples, flushes the file every
+    flush_interval and prints throughput and loss counters every
+    report_interval. Memory use does not grow with the capture length.
+    Ctrl-C ends an open-ended capture cleanly. The port is closed at the
+    end.
+
+    Args:
+        serial_conn:     Open serial connection
+        protocol:        "ascii" or "binary" (also decodes the compressed
+                         and window frames), matching the firmware's format
+        duration:        Seconds to capture, None to run until Ctrl-C
+        filename:        CSV file to write, or archive (open_sample_writer())
+        flush_interval:  Seconds between flushes to disk
+        report_interval: Seconds between progress lines, 0 for none
+        on_samples:      Optional callable given each batch of new
+                         (time, duty cycle %, ADC value) samples
+
+    Returns:
+        Dict with seconds, bytes, samples, dropped (frames or lines lost
+        or rejected) and overflows (chunks the reader had to discard)
+    """
+    decoder = BinarySampleDecoder() if protocol == "binary" else AsciiSampleDecoder()
+    reader = SerialReader(serial_conn)
+    writer = open_sample_writer(filename)
+    start = time.time()
+    next_flush = start + flush_interval
+    next_report = start + report_interval
+    reported_bytes = 0
+
+    reader.start()
+    try:
+        while duration is None or time.time() - start < duration:
+            try:
+                _, received, chunk = reader.chunks.get(timeout=0.2)
+            except queue.Empty:
+                chunk = None
+            if chunk:
+                samples = decoder.feed(chunk, received - start)
+                writer.write(samples)
+                if on_samples and samples:
+                    on_samples(samples)
+
+            now = time.time()
+            if now >= next_flush:
+                writer.flush()
+                next_flush = now + flush_interval
+            if report_interval and now >= next_report:
+                rate = (reader.bytes_read - reported_bytes) / (now - next_report + report_interval)
+                print(f"{now - start:8.0f} s  {rate:7.0f} B/s  {writer.rows} samples  "
+                      f"{decoder.stats()}, {reader.overflows} overflows")
+                reported_bytes = reader.bytes_read
+                next_report = now + report_interval
+            if reader.error:
+                raise reader.error
+    except KeyboardInterrupt:
+        pass                                    # Open-ended capture stopped
+    finally:
+        reader.stop()
+        writer.close()
+        serial_conn.close()
+
+    elapsed = time.time() - start
+    print(f"{elapsed:.0f} s, {reader.bytes_read} bytes, {writer.rows} samples, "
+          f"{decoder.stats()}, {reader.overflows} overflows")
+    return {
+        "seconds": elapsed,
+        "bytes": reader.bytes_read,
+        "samples": writer.rows,
+        "dropped": decoder.dropped,
+        "overflows": reader.overflows,
+    }
+
+
+def query_device_id(serial_conn: serial.Serial, timeout: float = 1.0) -> int | None:
+    """
+    Read the device ID (CMD_SET_ID) with CMD_QUERY.
+
+    Works while the controller streams in either format; the reply frame
+    is picked out of the stream. OFF_MODE does not take commands. Warns
+    if the device reports its last boot as over budget.
+
+    Returns:
+        The ID, 0 if none was set, or None if the device did not answer
+    """
+    status, data = send_command(serial_conn, FrameDecoder(), 0xF0, CMD_QUERY,
+                                timeout=timeout)
+    if status != CMD_OK or len(data) < QUERY_ID_OFFSET + 2:
+        return None                             # No reply, or older firmware
+    device_id = data[QUERY_ID_OFFSET] | (data[QUERY_ID_OFFSET + 1] << 8)
+    if len(data) > QUERY_FLAGS_OFFSET and data[QUERY_FLAGS_OFFSET] & QUERY_FLAG_BOOT_LATE:
+        print(f"Device {device_id:04X}: boot went over its budget")
+    return device_id
+
+
+class DeviceClockAligner:
+    """
+    Maps one device's sample times onto the capture's host clock.
+
+    Binary frames carry device time, counted from that device's first
+    frame on its own oscillator (the FRC is only trimmed to about 2 %),
+    so times from several units cannot be compared as they are. Each
+    chunk gives one lag, arrival minus the device time of its newest
+    sample; the smallest lag of every ALIGN_SECONDS window is the sample
+    that travelled fastest. A line through the last ALIGN_WINDOWS of
+    those minima gives the offset and the drift, and is used to map the
+    samples. ASCII samples already carry host time and pass through
+    unchanged. Aligned times never go backwards.
+    """
+
+    MAX_DRIFT = 0.05                            # Beyond the FRC tolerance: jitter
+
+    def __init__(self, window: float = ALIGN_SECONDS, windows: int = ALIGN_WINDOWS):
+        self.window = window
+        self.window_end = None
+        self.minima = collections.deque(maxlen=windows)     # (device time, lag)
+        self.current = None                     # Smallest lag this window
+        self.last = float("-inf")
+
+    def _fit(self) -> tuple[float, float]:
+        """Lag at device time 0, and lag per second of device time."""
+        points = list(self.minima) + [self.current]
+        if len(points) < 2:
+            return points[0][1], 0.0
+        mean_t = sum(t for t, _ in points) / len(points)
+        mean_lag = sum(lag for _, lag in points) / len(points)
+        spread = sum((t - mean_t) ** 2 for t, _ in points)
+        drift = sum((t - mean_t) * (lag - mean_lag) for t, lag in points) / spread if spread else 0.0
+        drift = max(-self.MAX_DRIFT, min(self.MAX_DRIFT, drift))
+        return mean_lag - drift * mean_t, drift
+
+    def align(self, samples: list[tuple[float, float, float]],
+              arrival: float) -> list[tuple[float, float, float]]:
+        """
+        Map a batch of (time, duty cycle %, ADC value) samples.
+
+        Args:
+            samples: Samples decoded from one chunk
+            arrival: Capture time the chunk arrived, in seconds
+        """
+        if not samples:
+            return samples
+        if self.window_end is None or arrival >= self.window_end:
+            if self.current:
+                self.minima.append(self.current)
+            self.current = None
+            self.window_end = arrival + self.window
+        newest = samples[-1][0]
+        if self.current is None or arrival - newest < self.current[1]:
+            self.current = (newest, arrival - newest)
+        offset, drift = self._fit()
+
+        aligned = []
+        for t, duty, adc in samples:
+            self.last = max(self.last, t + offset + drift * t)
+            aligned.append((self.last, duty, adc))
+        return aligned
+
+
+class MergedSampleWriter:
+    """
+    One file for several devices, in aligned time order.
+
+    Samples from different ports arrive with different delays, so rows
+    are held for MERGE_DELAY_SECONDS and written once no port can still
+    deliver an earlier one. The file is a CSV with a Device column, or an
+    archive (open_sample_writer()).
+    """
+
+    def __init__(self, filename: str, delay: float = MERGE_DELAY_SECONDS):
+        self.output = open_sample_writer(filename, merged=True)
+        self.delay = delay
+        self.pending = []                       # Heap of (time, order, device, duty, adc)
+        self.order = 0
+
+    def add(self, device: str, samples: list[tuple[float, float, float]]) -> None:
+        """Queue one device's aligned samples."""
+        for t, duty, adc in samples:
+            heapq.heappush(self.pending, (t, self.order, device, duty, adc))
+            self.order += 1
+
+    def write_until(self, now: float) -> None:
+        """Write the rows older than now - delay (capture time, seconds)."""
+        while self.pending and self.pending[0][0] <= now - self.delay:
+            t, _, device, duty, adc = heapq.heappop(self.pending)
+            self.output.write([(t, duty, adc)], device)
+
+    def flush(self) -> None:
+        """Push everything written so far to disk."""
+        self.output.flush()
+
+    def close(self) -> None:
+        self.write_until(float("inf"))
+        self.output.close()
+
+
+def capture_devices(ports: list[str], protocol: str = "ascii",
+                    duration: float | None = None, filename: str = "Group_26.csv",
+                    merged: bool = True, baudrate: int = 4800,
+                    flush_interval: float = FLUSH_SECONDS,
+                    report_interval: float = REPORT_SECONDS) -> dict:
+    """
+    Capture several controllers at once, like capture() does for one.
+
+    Each port gets its own SerialReader thread, so every port is drained
+    at full rate whatever the others do; the readers share one queue and
+    this thread decodes each chunk with that port's decoder. A device is
+    named by its ID (CMD_SET_ID, as 4 hex digits) when it answers
+    CMD_QUERY and has one, otherwise by its port.
+
+    Args:
+        ports:           Serial port names
+        protocol:        "ascii" or "binary", for every device
+        duration:        Seconds to capture, None to run until Ctrl-C
+        filename:        Merged CSV file or archive, or the pattern for
+                         per-device files: "Group_26.csv" becomes
+                         "Group_26_<device>.csv"
+        merged:          True for one file in aligned time order
+                         (MergedSampleWriter), False for a file per device
+        baudrate:        Baud rate of every port
+        flush_interval:  Seconds between flushes to disk
+        report_interval: Seconds between progress lines, 0 for none
+
+    Returns:
+        Dict from device name to its capture() style statistics
+    """
+    connections = [serial.Serial(port=port, baudrate=baudrate, bytesize=8,
+                                 timeout=0.5, stopbits=serial.STOPBITS_ONE)
+                   for port in ports]
+    names = []
+    for port, serial_conn in zip(ports, connections):
+        device_id = query_device_id(serial_conn)
+        name = f"{device_id:04X}" if device_id else os.path.basename(port)
+        names.append(name if name not in names else f"{name}_{os.path.basename(port)}")
+
+    chunks = queue.Queue(READER_QUEUE_CHUNKS * len(ports))
+    readers = [SerialReader(serial_conn, chunks, index)
+               for index, serial_conn in enumerate(connections)]
+    decoders = [BinarySampleDecoder() if protocol == "binary" else AsciiSampleDecoder()
+                for _ in ports]
+    aligners = [DeviceClockAligner() for _ in ports]
+    stem, extension = os.path.splitext(filename)
+    if merged:
+        writer = MergedSampleWriter(filename)
+        writers = [writer]
+    else:
+        writers = [open_sample_writer(f"{stem}_{name}{extension}") for name in names]
+    samples_seen = [0] * len(ports)
+    reported_bytes = [0] * len(ports)
+    start = time.time()
+    next_flush = start + flush_interval
+    next_report = start + report_interval
+
+    for reader in readers:
+        reader.start()
+    try:
+        while duration is None or time.time() - start < duration:
+            try:
+                index, received, chunk = chunks.get(timeout=0.2)
+            except queue.Empty:
+                chunk = None
+            if chunk:
+                arrival = received - start
+                samples = aligners[index].align(decoders[index].feed(chunk, arrival), arrival)
+                samples_seen[index] += len(samples)
+                if merged:
+                    writer.add(names[index], samples)
+                else:
+                    writers[index].write(samples)
+
+            now = time.time()
+            if merged:
+                writer.write_until(now - start)
+            if now >= next_flush:
+                for each in writers:
+                    each.flush()
+                next_flush = now + flush_interval
+            if report_interval and now >= next_report:
+                for index, reader in enumerate(readers):
+                    rate = (reader.bytes_read - reported_bytes[index]) / (now - next_report + report_interval)
+                    print(f"{now - start:8.0f} s  {names[index]:>8}  {rate:7.0f} B/s  "
+                          f"{samples_seen[index]} samples  {decoders[index].stats()}, "
+                          f"{reader.overflows} overflows")
+                    reported_bytes[index] = reader.bytes_read
+                next_report = now + report_interval
+            for reader in readers:
+                if reader.error:
+                    raise reader.error
+    except KeyboardInterrupt:
+        pass                                    # Open-ended capture stopped
+    finally:
+        for reader in readers:
+            reader.stop()
+        for each in writers:
+            each.close()
+        for serial_conn in connections:
+            serial_conn.close()
+
+    elapsed = time.time() - start
+    stats = {}
+    for index, reader in enumerate(readers):
+        print(f"{names[index]}: {reader.bytes_read} bytes, {samples_seen[index]} samples, "
+              f"{decoders[index].stats()}, {reader.overflows} overflows")
+        stats[names[index]] = {
+            "seconds": elapsed,
+            "bytes": reader.bytes_read,
+            "samples": samples_seen[index],
+            "dropped": decoders[index].dropped,
+            "overflows": reader.overflows,
+        }
+    return stats
 
 
 def save_to_csv(time_stamps: list, duty_cycle_values: list, 
@@ -110,8 +1246,14 @@ def save_to_csv(time_stamps: list, duty_cycle_values: list,
         time_stamps: List of reading timestamps
         duty_cycle_values: List of LED intensity values
         adc_buffer_values: List of ADC readings
-        filename: Name of output CSV file
+        filename: Name of output CSV file, or of an archive if it ends
+                  in ARCHIVE_EXTENSION
     """
+    if filename.endswith(ARCHIVE_EXTENSION):
+        writer = ArchiveWriter(filename)
+        writer.write(list(zip(time_stamps, duty_cycle_values, adc_buffer_values)))
+        writer.close()
+        return
     df = pd.DataFrame({
         "Time": time_stamps,
         "Intensity": duty_cycle_values,
@@ -120,6 +1262,73 @@ def save_to_csv(time_stamps: list, duty_cycle_values: list,
     df.to_csv(filename, index=True, index_label="Index")
 
 
+class MinMaxDecimator:
+    """
+    Running min/max decimation of one series.
+
+    Samples are grouped into at most PLOT_BUCKETS buckets of equal sample
+    count, and each bucket keeps only its lowest and highest point. When
+    the buckets run out, neighbours are merged and each new bucket takes
+    twice as many samples, so memory and the points handed to Plotly stay
+    bounded however long the capture runs, while spikes and dropouts
+    remain visible at one bucket per pixel or so.
+    """
+
+    def __init__(self, buckets: int = PLOT_BUCKETS):
+        self.limit = buckets
+        self.width = 1                  # Samples per bucket
+        self.buckets = []               # [count, t of min, min, t of max, max]
+
+    def add(self, t: float, y: float) -> None:
+        """Add one sample."""
+        if not self.buckets or self.buckets[-1][0] >= self.width:
+            self.buckets.append([1, t, y, t, y])
+            if len(self.buckets) > self.limit:
+                self._merge()
+            return
+        bucket = self.buckets[-1]
+        bucket[0] += 1
+        if y < bucket[2]:
+            bucket[1], bucket[2] = t, y
+        if y > bucket[4]:
+            bucket[3], bucket[4] = t, y
+
+    def _merge(self) -> None:
+        merged = []
+        for i in range(0, len(self.buckets) - 1, 2):
+            a, b = self.buckets[i], self.buckets[i + 1]
+            low = a if a[2] <= b[2] else b
+            high = a if a[4] >= b[4] else b
+            merged.append([a[0] + b[0], low[1], low[2], high[3], high[4]])
+        if len(self.buckets) % 2:
+            merged.append(self.buckets[-1])
+        self.buckets = merged
+        self.width *= 2
+
+    def points(self) -> tuple[list, list]:
+        """Each bucket's extremes in time order, as (times, values)."""
+        times, values = [], []
+        for _, t_min, y_min, t_max, y_max in self.buckets:
+            for t, y in sorted(((t_min, y_min), (t_max, y_max)))[:1 if t_min == t_max else 2]:
+                times.append(t)
+                values.append(y)
+        return times, values
+
+
+def decimate(time_stamps: list, values: list, buckets: int = PLOT_BUCKETS) -> tuple[list, list]:
+    """
+    Min/max decimation of a whole series (see MinMaxDecimator).
+
+    Series of up to 2 * buckets points are returned as they are.
+    """
+    if len(values) <= 2 * buckets:
+        return list(time_stamps), list(values)
+    decimator = MinMaxDecimator(buckets)
+    for t, y in zip(time_stamps, values):
+        decimator.add(t, y)
+    return decimator.points()
+
+
 def plot_data(time_stamps: list, duty_cycle_values: list, adc_buffer_values: list) -> None:
     """
     Create interactive dual plots of ADC readings and LED intensity.
@@ -127,18 +1336,16 @@ def plot_data(time_stamps: list, duty_cycle_values: list, adc_buffer_values: lis
     Creates two side-by-side plots:
     1. ADC Reading vs Time: Shows raw light sensor readings
     2. LED Intensity vs Time: Shows duty cycle percentage
+    Long captures are min/max decimated to about PLOT_BUCKETS pairs per
+    trace and drawn with WebGL, so the browser stays responsive.
     
     Args:
         time_stamps: List of reading timestamps
         duty_cycle_values: List of LED intensity values
         adc_buffer_values: List of ADC readings
     """
-    # Create DataFrame for plotting
-    df = pd.DataFrame({
-        "Time": time_stamps,
-        "Intensity": duty_cycle_values,
-        "ADC Value": adc_buffer_values
-    })
+    adc_times, adc_values = decimate(time_stamps, adc_buffer_values)
+    duty_times, duty_values = decimate(time_stamps, duty_cycle_values)
     
     # Create subplot layout
     fig = make_subplots(
@@ -148,14 +1355,14 @@ def plot_data(time_stamps: list, duty_cycle_values: list, adc_buffer_values: lis
     
     # Add ADC Value trace (blue line)
     fig.add_trace(
-        go.Scatter(x=df["Time"], y=df["ADC Value"], 
+        go.Scattergl(x=adc_times, y=adc_values, 
                   mode="lines", name="ADC Value"),
         row=1, col=1
     )
     
     # Add Intensity trace (red line)
     fig.add_trace(
-        go.Scatter(x=df["Time"], y=df["Intensity"], 
+        go.Scattergl(x=duty_times, y=duty_values, 
                   mode="lines", name="Intensity", 
                   line=dict(color="red")),
         row=1, col=2
@@ -170,16 +1377,133 @@ def plot_data(time_stamps: list, duty_cycle_values: list, adc_buffer_values: lis
     fig.show()
 
 
-if __name__ == "__main__":
+class LivePlot:
+    """
+    Live view of a capture, redrawn while it runs.
+
+    Pass add() as capture()'s on_samples. Every LIVE_REFRESH_SECONDS the
+    view is written to an HTML page that reloads itself, opened in the
+    browser on the first redraw. The top row shows the last
+    LIVE_WINDOW_SAMPLES samples as received, the bottom row the whole
+    capture through MinMaxDecimator, so each redraw costs the same after
+    a minute or after a day. A reload resets any zoom; the final page,
+    written by render(final=True), does not reload.
+    """
+
+    RELOAD_SCRIPT = "setTimeout(function () { location.reload(); }, %d);"
+
+    def __init__(self, filename: str = "live_plot.html",
+                 window: int = LIVE_WINDOW_SAMPLES,
+                 refresh: float = LIVE_REFRESH_SECONDS,
+                 buckets: int = PLOT_BUCKETS):
+        self.filename = filename
+        self.refresh = refresh
+        self.recent = collections.deque(maxlen=window)
+        self.adc = MinMaxDecimator(buckets)
+        self.duty = MinMaxDecimator(buckets)
+        self.next_render = 0.0
+        self.opened = False
+
+    def add(self, samples: list[tuple[float, float, float]]) -> None:
+        """Take new (time, duty cycle %, ADC value) samples; redraw when due."""
+        for t, duty, adc in samples:
+            self.recent.append((t, duty, adc))
+            self.adc.add(t, adc)
+            self.duty.add(t, duty)
+        if time.time() >= self.next_render:
+            self.render()
+
+    def render(self, final: bool = False) -> None:
+        """Write the page now."""
+        recent_times = [sample[0] for sample in self.recent]
+        fig = make_subplots(
+            rows=2, cols=2,
+            subplot_titles=("ADC Reading [Raw], recent", "LED Intensity, recent",
+                            "ADC Reading [Raw], full capture", "LED Intensity, full capture"),
+        )
+        fig.add_trace(go.Scattergl(x=recent_times, y=[sample[2] for sample in self.recent],
+                                   mode="lines", name="ADC Value"), row=1, col=1)
+        fig.add_trace(go.Scattergl(x=recent_times, y=[sample[1] for sample in self.recent],
+                                   mode="lines", name="Intensity",
+                                   line=dict(color="red")), row=1, col=2)
+        adc_times, adc_values = self.adc.points()
+        duty_times, duty_values = self.duty.points()
+        fig.add_trace(go.Scattergl(x=adc_times, y=adc_values, mode="lines",
+                                   name="ADC Value (min/max)"), row=2, col=1)
+        fig.add_trace(go.Scattergl(x=duty_times, y=duty_values, mode="lines",
+                                   name="Intensity (min/max)",
+                                   line=dict(color="red")), row=2, col=2)
+        for row in (1, 2):
+            fig.update_xaxes(title_text="Time (s)", row=row, col=1)
+            fig.update_xaxes(title_text="Time (s)", row=row, col=2)
+            fig.update_yaxes(title_text="ADC Reading", row=row, col=1)
+            fig.update_yaxes(title_text="Intensity (Duty Cycle %)", row=row, col=2)
+
+        # Replace the page whole so a reload never sees half of it
+        temporary = self.filename + ".tmp"
+        fig.write_html(temporary, include_plotlyjs="directory", auto_open=False,
+                       post_script=None if final else
+                       self.RELOAD_SCRIPT % (self.refresh * 1000))
+        os.replace(temporary, self.filename)
+        if not self.opened:
+            webbrowser.open("file://" + os.path.abspath(self.filename))
+            self.opened = True
+        self.next_render = time.time() + self.refresh
+
+
+# "ascii" or "binary" (also decodes the compressed and window frames),
+# must match the firmware's telemetry format; "latency" collects the
+# measurements of a LATENCY_ENABLED build for CAPTURE_SECONDS instead;
+# "log" fetches the samples
+# logged to the device's data EEPROM instead of recording live
+PROTOCOL = "ascii"
+
+# Seconds to record, or None to record until Ctrl-C
+CAPTURE_SECONDS = 60
+# Output file; a name ending in ARCHIVE_EXTENSION (".lcap") writes the
+# chunked binary archive instead, for batch analysis with CaptureArchive.py
+CSV_FILE = "Group_26.csv"
+
+# Plot live during the capture (live_plot.html) instead of only at the end
+LIVE_PLOT = True
+
+# Ports to record; with more than one, all are captured at once
+# (capture_devices) into one merged CSV, or one per device if
+# MERGED_OUTPUT is False
+PORTS = ["COM5"]
+MERGED_OUTPUT = True
+
+# UART_BAUD in src/clkChange.h, shared by the ON and TRANSMIT states
+BAUD_RATE = 4800
+
+if __name__ == "__main__" and len(PORTS) > 1 and PROTOCOL != "log":
+    capture_devices(PORTS, PROTOCOL, CAPTURE_SECONDS, CSV_FILE, MERGED_OUTPUT, BAUD_RATE)
+elif __name__ == "__main__":
     serial_conn = serial.Serial(
-        port="COM5",          
-        baudrate=4800,      
+        port=PORTS[0],          
+        baudrate=BAUD_RATE,
         bytesize=8,
         timeout=2,
         stopbits=serial.STOPBITS_ONE
     )
     
-    raw_data, time_stamps = read_serial_data(serial_conn, 60)
-    time_stamps, duty_cycle_values, adc_buffer_values = process_data(raw_data, time_stamps)
-    save_to_csv(time_stamps, duty_cycle_values, adc_buffer_values)
-    plot_data(time_stamps, duty_cycle_values, adc_buffer_values)
\ No newline at end of file
+    if PROTOCOL == "latency":
+        latency_records = read_latency(serial_conn, CAPTURE_SECONDS)
+        print_latency(latency_records)
+        plot_latency(latency_records)
+    elif PROTOCOL == "log":
+        time_stamps, duty_cycle_values, adc_buffer_values = read_log(serial_conn, FrameDecoder(), 1)
+        serial_conn.close()
+        save_to_csv(time_stamps, duty_cycle_values, adc_buffer_values, CSV_FILE)
+        plot_data(time_stamps, duty_cycle_values, adc_buffer_values)
+    elif LIVE_PLOT:
+        live = LivePlot()
+        capture(serial_conn, PROTOCOL, CAPTURE_SECONDS, CSV_FILE, on_samples=live.add)
+        live.render(final=True)
+    else:
+        capture(serial_conn, PROTOCOL, CAPTURE_SECONDS, CSV_FILE)
+        if CSV_FILE.endswith(ARCHIVE_EXTENSION):
+            plot_data(*read_columns(CSV_FILE))
+        else:
+            df = pd.read_csv(CSV_FILE)
+            plot_data(df["Time"], df["Intensity"], df["ADC Value"])
@@ -4,25 +4,67 @@
  * Created on November 13, 2024, 4:28 PM
  * 
  * Description: Implementation of ADC functions.
- *             Handles configuration and operation of 10-bit ADC for analog input AN5.
+ *             Handles configuration and operation of 10-bit ADC scanning of the
+ *             potentiometer inputs (ADC_POT_INPUTS) and the light sensor.
  */
 
 #include "ADC.h"
+#include "events.h"
+#include "telemetry.h"
+#include "control.h"
+#include "profile.h"
+#include "adcFilter.h"
+#include "latency.h"
+
+#if ADC_SAMPLES_PER_INT < 1 || ADC_SAMPLES_PER_INT > 16
+#error "ADC_SAMPLES_PER_INT must be between 1 and 16"
+#endif
+
+#if ADC_SAMPLES_PER_INT % ADC_SCAN_INPUTS
+#error "ADC_SAMPLES_PER_INT must be a multiple of ADC_SCAN_INPUTS"
+#endif
+
+#define ADC_SENSOR_INDEX PWM_CHANNELS   // Scanned input after the potentiometers
+
+#define ADCS_CONTINUOUS 0b000001    // TAD = 2 TCY while free-running
+#define ADCS_BLOCKING   0b111111    // TAD = 64 TCY for one-shot reads
+
+static const uint8_t POT_INPUTS[] = ADC_POT_INPUTS;
+
+static volatile uint16_t adcLatest[PWM_CHANNELS];   // Filtered readings of the last buffer fill
+static volatile uint16_t adcTick = 0;       // Tick when adcLatest was published
+static volatile uint8_t adcReady = 0;       // Set by ISR, cleared by reader
+static volatile uint16_t sensorLatest = 0;  // Average of the sensor readings
+
+// Input index (channel, or ADC_SENSOR_INDEX) of each scan position
+static uint8_t scanOrder[ADC_SCAN_INPUTS];
+
+/**
+ * @brief Analog input number of a scanned input
+ */
+static uint8_t inputChannel(uint8_t index) {
+#if ADC_SENSOR_ENABLED
+    if (index == ADC_SENSOR_INDEX) {
+        return ADC_SENSOR_CHANNEL;
+    }
+#endif
+    return POT_INPUTS[index];
+}
 
 void init_ADC() {
     // ---- AD1CON1 Register Configuration ----
     AD1CON1bits.ADSIDL = 0;         // Continue ADC operation in idle mode
     AD1CON1bits.FORM = 0b00;        // Output in integer format
     AD1CON1bits.SSRC = 0b111;       // Internal counter ends sampling and starts conversion
-    AD1CON1bits.ASAM = 0;           // Manual sampling start
+    AD1CON1bits.ASAM = 1;           // Sampling restarts after each conversion
     
     // ---- AD1CON2 Register Configuration ----
     AD1CON2bits.VCFG = 0b000;       // Voltage Reference Configuration
                                     // AVdd as positive reference
                                     // AVss as negative reference
     
-    AD1CON2bits.CSCNA = 0;          // Do not scan inputs 
-    AD1CON2bits.SMPI = 0b0000;      // Generate interrupt after each conversion
+    AD1CON2bits.CSCNA = 1;          // Scan the inputs selected in AD1CSSL
+    AD1CON2bits.SMPI = ADC_SAMPLES_PER_INT - 1; // Interrupt once the buffer is filled
     AD1CON2bits.BUFM = 0;           // Buffer configured as one 16-word buffer
     AD1CON2bits.ALTS = 0;           // Always use input multiplexer A
     
@@ -31,21 +73,84 @@ void init_ADC() {
     AD1CON3bits.SAMC = 0b11111;     // Auto-sample time = 31 TAD
                                     // Longer sample time = more accurate reading
 
-    AD1CON3bits.ADCS = 0b111111;    // ADC Conversion Clock = 64  TCY
-                                    // Slower clock = more accurate reading
+    AD1CON3bits.ADCS = ADCS_CONTINUOUS; // ADC Conversion Clock = 2  TCY
+                                    // ADC_readBlocking() drops to 64  TCY
     
     // ---- Channel Selection Configuration ----
     AD1CHSbits.CH0NA = 0;           // Negative input is AVss
-    AD1CHSbits.CH0SA = 0b00101;     // Positive input is AN5 (Channel 5)
-    
-    // ---- Port Configuration ----
-    TRISAbits.TRISA3 = 1;           // Set AN5 pin as input
-    AD1PCFGbits.PCFG5 = 0;          // Configure AN5 as analog input
-    AD1CSSLbits.CSSL5 = 0;          // Remove AN5 from input scan
+    AD1CHSbits.CH0SA = POT_INPUTS[0];   // Used only by ADC_readWith()
+
+    // ---- Port and Scan Configuration ----
+    // Pins are inputs from reset; the scan runs in rising AN order
+    AD1CSSL = 0;
+    for (uint8_t i = 0; i < ADC_SCAN_INPUTS; i++) {
+        AD1PCFG &= ~(1 << inputChannel(i)); // Configure as analog input
+        AD1CSSL |= 1 << inputChannel(i);    // Add to the input scan
+    }
+    for (uint8_t an = 0, pos = 0; an < 16; an++) {
+        for (uint8_t i = 0; i < ADC_SCAN_INPUTS; i++) {
+            if (inputChannel(i) == an) {
+                scanOrder[pos++] = i;
+            }
+        }
+    }
+
+    // ---- Interrupt Configuration ----
+    IPC3bits.AD1IP = 5;             // ADC interrupt priority
+    IFS0bits.AD1IF = 0;             // Clear ADC interrupt flag
+    IEC0bits.AD1IE = 1;             // Enable ADC interrupt
 }
 
-uint16_t do_ADC() {
+void ADC_start() {
+    if (!AD1CON1bits.ADON) {
+        adcFilterReset();           // Readings from before the stop are stale
+    }
+    AD1CON1bits.ADON = 1;           // Conversions run on their own from here
+}
+
+void ADC_stop() {
+    AD1CON1bits.ADON = 0;           // Turn off ADC module to save power
+    IFS0bits.AD1IF = 0;             // Discard a fill that raced the stop
+}
+
+uint16_t ADC_latest() {
+    return ADC_latestChannel(0);
+}
+
+uint16_t ADC_latestChannel(uint8_t channel) {
+    adcReady = 0;
+    return adcLatest[channel];
+}
+
+uint16_t ADC_latestTick() {
+    return adcTick;
+}
+
+uint16_t ADC_latestSensor() {
+    return sensorLatest;
+}
+
+uint8_t ADC_sampleReady() {
+    return adcReady;
+}
+
+uint16_t ADC_readBlocking() {
+    return ADC_readWith(0b11111, ADCS_BLOCKING);
+}
+
+uint16_t ADC_readWith(uint8_t samc, uint8_t adcs) {
+    PROFILE_START(start);
     uint16_t ADCvalue;
+    uint8_t wasRunning = AD1CON1bits.ADON;
+
+    // Switch to a single, slow, manually started conversion
+    IEC0bits.AD1IE = 0;             // Keep the ISR off the buffer
+    AD1CON1bits.ADON = 0;
+    AD1CON1bits.ASAM = 0;           // Manual sampling start
+    AD1CON2bits.CSCNA = 0;          // Channel 0's potentiometer only
+    AD1CON2bits.SMPI = 0b0000;      // Flag after each conversion
+    AD1CON3bits.SAMC = samc;
+    AD1CON3bits.ADCS = adcs;        // Slower clock = more accurate reading
     
     // Start sampling
     AD1CON1bits.ADON = 1;           // Turn on ADC module
@@ -57,7 +162,68 @@ uint16_t do_ADC() {
     // Get result
     ADCvalue = ADC1BUF0;            // Read the ADC conversion result
     AD1CON1bits.SAMP = 0;           // Stop sampling
-    AD1CON1bits.ADON = 0;           // Turn off ADC module to save power
+    AD1CON1bits.ADON = 0;
+
+    // Restore continuous sampling
+    AD1CON1bits.ASAM = 1;
+    AD1CON2bits.CSCNA = 1;
+    AD1CON2bits.SMPI = ADC_SAMPLES_PER_INT - 1;
+    AD1CON3bits.SAMC = 0b11111;
+    AD1CON3bits.ADCS = ADCS_CONTINUOUS;
+    IFS0bits.AD1IF = 0;
+    IEC0bits.AD1IE = 1;
+    AD1CON1bits.ADON = wasRunning;
+    PROFILE_STOP(PROF_ADC_READ, start);
     
     return ADCvalue;                // Return 10-bit result (0-1023)
-}
\ No newline at end of file
+}
+
+/**
+ * @brief ADC interrupt service routine.
+ *
+ * Runs once every ADC_SAMPLES_PER_INT conversions, which hold
+ * ADC_SCAN_PASSES scans of every input. Sums each input over the filled
+ * part of ADC1BUF0..ADC1BUFF, runs the potentiometer sums through the
+ * filter (adcFilter.h) and publishes the results for ADC_latestChannel(),
+ * posting EVT_INPUT as well as EVT_ADC if one changed. With
+ * ADC_SENSOR_ENABLED the sensor average drives the brightness loop. One
+ * pass over the buffer serves every channel. Sampling keeps going in
+ * hardware while the buffer is read.
+ */
+void __attribute__((interrupt, no_auto_psv)) _ADC1Interrupt(void) {
+    PROFILE_START(start);
+    volatile uint16_t *buf = &ADC1BUF0;
+    uint16_t sums[ADC_SCAN_INPUTS] = {0};   // 16 x 1023 still fits in 16 bits
+    uint8_t changed = 0;
+
+    for (uint8_t pass = 0; pass < ADC_SCAN_PASSES; pass++) {
+        for (uint8_t pos = 0; pos < ADC_SCAN_INPUTS; pos++) {
+            sums[scanOrder[pos]] += *buf++;
+        }
+    }
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        uint16_t reading = adcFilterStep(i, sums[i]);
+
+        changed |= (reading != adcLatest[i]);
+        adcLatest[i] = reading;
+    }
+#if ADC_SENSOR_ENABLED
+    // Constant divisor; a shift for powers of two
+    sensorLatest = sums[ADC_SENSOR_INDEX] / ADC_SCAN_PASSES;
+#endif
+    adcTick = tickNow16();
+    adcReady = 1;
+    telemetryWindowAdd(adcLatest[0]);   // Every reading counts, even if EVT_ADC coalesces
+#if ADC_SENSOR_ENABLED
+    controlStep(sensorLatest);      // Fixed-rate PI; returns at once between steps
+#endif
+    postEvent(EVT_ADC);
+    if (changed) {
+        postEvent(EVT_INPUT);       // Only when a knob really moved
+        LATENCY_START(LAT_SOURCE_POT);
+    }
+    PROFILE_STOP(PROF_ADC, start);
+
+    IFS0bits.AD1IF = 0;             // Clear ADC interrupt flag
+}
@@ -4,30 +4,135 @@
  * Created on November 13, 2024, 4:28 PM
  * 
  * Description: Header file for ADC configuration and operation on microcontroller.
- *             Provides functions for initializing and reading from analog input AN5.
+ *             Provides functions for initializing and reading the scanned analog inputs.
  */
 
 #ifndef ADC_H
 #define ADC_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
+#include "timeDelay.h"
+#include "PWM.h"
+
+
+/**
+ * @brief Light sensor (photodiode) input for closed-loop brightness
+ *
+ * Define ADC_SENSOR_ENABLED as 1 when a photodiode is fitted on
+ * ADC_SENSOR_CHANNEL (AN4, pin 6 by default). It is then scanned along
+ * with the potentiometers.
+ */
+#ifndef ADC_SENSOR_ENABLED
+#define ADC_SENSOR_ENABLED 0
+#endif
+
+#ifndef ADC_SENSOR_CHANNEL
+#define ADC_SENSOR_CHANNEL 4
+#endif
+
+/**
+ * @brief Potentiometer input of each LED channel (PWM_CHANNELS in PWM.h)
+ *
+ * Analog input numbers: AN5 (pin 8), AN12 (pin 15), AN11 (pin 16). The
+ * ADC scans every potentiometer in use and the sensor in one pass per
+ * ADC_SCAN_INPUTS conversions, in rising AN order.
+ */
+#ifndef ADC_POT_INPUTS
+#define ADC_POT_INPUTS {5, 12, 11}
+#endif
+
+#define ADC_SCAN_INPUTS (PWM_CHANNELS + ADC_SENSOR_ENABLED)
+
+/**
+ * @brief Conversions per ADC interrupt (1-16)
+ *
+ * The module samples continuously and only interrupts once this many
+ * results have been written to ADC1BUF0..ADC1BUFF. A whole number of
+ * scan passes; each input's readings in them are averaged.
+ */
+#ifndef ADC_SAMPLES_PER_INT
+#define ADC_SAMPLES_PER_INT (16 / ADC_SCAN_INPUTS * ADC_SCAN_INPUTS)
+#endif
+
+#define ADC_SCAN_PASSES (ADC_SAMPLES_PER_INT / ADC_SCAN_INPUTS)
 
 /**
  * @brief Initializes the Analog-to-Digital Converter module.
  *
  * Configures ADC settings, including reference voltages, sampling, and channel selection, 
- * to prepare for analog input readings on AN5.
+ * to prepare for analog input readings on ADC_POT_INPUTS. The module is set up for
+ * continuous scanning with an interrupt per buffer fill but is left off until ADC_start().
  */
 void init_ADC();
 
 /**
- * @brief Performs an ADC conversion on the selected analog input.
+ * @brief Turns the ADC on and begins continuous sampling.
+ */
+void ADC_start();
+
+/**
+ * @brief Turns the ADC off to save power.
+ */
+void ADC_stop();
+
+/**
+ * @brief Returns the most recent filtered reading without blocking.
+ *
+ * Also clears the flag returned by ADC_sampleReady().
+ * 
+ * @return uint16_t Channel 0's reading from the last interrupt (0-1023).
+ */
+uint16_t ADC_latest();
+
+/**
+ * @brief ADC_latest() for any channel's potentiometer.
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
+ * @return uint16_t The channel's reading from the last interrupt (0-1023),
+ *                  after the filter in adcFilter.h.
+ */
+uint16_t ADC_latestChannel(uint8_t channel);
+
+/**
+ * @brief Returns the tick at which the latest average was completed.
+ *
+ * @return uint16_t Low 16 bits of tickNow() taken in the ADC interrupt.
+ */
+uint16_t ADC_latestTick();
+
+/**
+ * @brief Returns the most recent averaged light sensor reading.
+ *
+ * @return uint16_t Sensor average (0-1023), 0 without ADC_SENSOR_ENABLED.
+ */
+uint16_t ADC_latestSensor();
+
+/**
+ * @brief Reports whether a new average was published since ADC_latest().
+ *
+ * @return uint8_t 1 if a new value is available, 0 otherwise.
+ */
+uint8_t ADC_sampleReady();
+
+/**
+ * @brief Performs a single slow ADC conversion on the selected analog input.
  *
- * Starts sampling, waits for the conversion to complete, and returns the resulting 16-bit value.
+ * Pauses continuous sampling, runs one manually started conversion at 64 TCY per TAD,
+ * waits for it to complete, then restores the previous mode. Meant for calibration.
  * 
- * @return uint16_t The converted analog value from AN5.
+ * @return uint16_t The converted analog value of channel 0's potentiometer.
+ */
+uint16_t ADC_readBlocking();
+
+/**
+ * @brief ADC_readBlocking() with a chosen sample time and conversion clock.
+ *
+ * A conversion takes samc + 12 TAD of (adcs + 1) TCY each.
+ *
+ * @param samc  Auto-sample time in TAD (1-31)
+ * @param adcs  Conversion clock, TAD = (adcs + 1) TCY (0-63)
+ * @return uint16_t The converted analog value of channel 0's potentiometer.
  */
-uint16_t do_ADC();
+uint16_t ADC_readWith(uint8_t samc, uint8_t adcs);
 
 #endif
\ No newline at end of file
@@ -8,71 +8,118 @@
  */
 
 #include "IOs.h"
+#include "events.h"
+#include "latency.h"
+#include "power.h"
 
 ButtonState buttons[3] = {
     {
         0,  // pressed:     No new press detected
         1,  // newState:    PB1 is currently released
-        1   // prevState:   PB1 was previously released
+        1,  // prevState:   PB1 was previously released
+        DEBOUNCE_TICKS  // integrator: settled at released
     },  // PB1
     {
         0,  // pressed:     No new press detected
         1,  // newState:    PB2 is currently released
-        1   // prevState:   PB2 was previously released
+        1,  // prevState:   PB2 was previously released
+        DEBOUNCE_TICKS  // integrator: settled at released
     },  // PB2
     {
         0,  // pressed:     No new press detected
         1,  // newState:    PB3 is currently released
-        1   // prevState:   PB3 was previously released
+        1,  // prevState:   PB3 was previously released
+        DEBOUNCE_TICKS  // integrator: settled at released
     }   // PB3
 };
 
+static volatile uint16_t buttonEvents = 0;  // BUTTON_* bits not yet taken
+
 void IOinit() {
-    // ---- LED Configuration (RB8) ----
-    TRISBbits.TRISB8 = 0;     // Set RB8 as output for LED
-    LATBbits.LATB8 = 0;       // Initialize LED to OFF state
-    
-    // ---- Button 1 Configuration (RA2) ----
-    TRISAbits.TRISA4 = 1;     // Set RA4 as input
-    CNPU1bits.CN0PUE = 1;     // Enable internal pull-up resistor
-    CNEN1bits.CN0IE = 1;      // Enable change notification interrupt
-    
-    // ---- Button 2 Configuration (RB4) ----
-    TRISBbits.TRISB4 = 1;     // Set RB4 as input
-    CNPU1bits.CN1PUE = 1;     // Enable internal pull-up resistor
-    CNEN1bits.CN1IE = 1;      // Enable change notification interrupt
-    
-    // ---- Button 3 Configuration (RA4) ----
-    TRISAbits.TRISA2 = 1;     // Set RA2 as input
-    CNPU2bits.CN30PUE = 1;    // Enable internal pull-up resistor
-    CNEN2bits.CN30IE = 1;     // Enable change notification interrupt
-    
-    // ---- Change Notification Interrupt Configuration ----
-    IPC4bits.CNIP = 6;        // Set interrupt priority
-    IFS1bits.CNIF = 0;        // Clear interrupt flag
-    IEC1bits.CNIE = 1;        // Enable change notification interrupts
+    // LED pin is configured by initPWM() for the selected PWM backend
+    halButtonsInit();         // Pull-ups and change notification (hal.h)
 }
 
 uint8_t IOcheck() {
+    uint8_t active = 0;
+    uint16_t events = 0;
+
     // Check each button's state
     for (int i = 0; i < 3; i++) {
-        // Get current state of appropriate button
-        buttons[i].newState = (i == 0) 
-                ? PB1 
-                : (i == 1) 
-                    ? PB2 
-                    : PB3;
-        
-        // Check for state change
-        if (buttons[i].newState != buttons[i].prevState) {
+        ButtonState *button = &buttons[i];
+
+        // Get current raw state of appropriate button
+        uint8_t raw = halButtonLevel(i);
+
+        // Integrate towards the raw level; bounces cancel out
+        if (raw) {
+            if (button->integrator < DEBOUNCE_TICKS) button->integrator++;
+        } else {
+            if (button->integrator > 0) button->integrator--;
+        }
+
+        // Debounced level only moves when the integrator saturates
+        if (button->integrator == 0) {
+            button->newState = 0;
+        } else if (button->integrator == DEBOUNCE_TICKS) {
+            button->newState = 1;
+        }
+
+        if (button->newState == 0) {
+            // Held down: time it for the long press
+            if (button->prevState == 1) {
+                button->heldTicks = 0;
+                button->longPressed = 0;
+                recordWakeLatency();    // First debounced press after a wake
+            } else if (!button->longPressed && ++button->heldTicks >= LONG_PRESS_TICKS) {
+                button->longPressed = 1;
+                events |= BUTTON_LONG(i);
+            }
+        } else if (button->prevState == 0) {
             // Detect rising edge (button release)
-            if (buttons[i].prevState == 0 && buttons[i].newState == 1) {
-                buttons[i].pressed = 1;  // Set pressed flag
+            if (button->longPressed) {
+                // Already reported as a long press
+            } else if (button->sinceRelease) {
+                events |= BUTTON_DOUBLE(i);
+                button->sinceRelease = 0;
+                LATENCY_START(LAT_SOURCE_PB1 + i);
+            } else {
+                button->pressed = 1;  // Set pressed flag
+                events |= BUTTON_PRESS(i);
+                button->sinceRelease = DOUBLE_PRESS_TICKS;
+                LATENCY_START(LAT_SOURCE_PB1 + i);
             }
-            // Update previous state
-            buttons[i].prevState = buttons[i].newState;
+        } else if (button->sinceRelease) {
+            button->sinceRelease--;   // Double-press window closing
+        }
+
+        // Update previous state
+        button->prevState = button->newState;
+
+        if (button->newState == 0 || button->sinceRelease ||
+            (button->integrator != 0 && button->integrator != DEBOUNCE_TICKS)) {
+            active = 1;
         }
     }
+
+    if (events) {
+        buttonEvents |= events;
+        postEvent(EVT_BUTTON);
+    }
     
-    return 0;
+    return active;
+}
+
+uint16_t takeButtonEvents() {
+    uint16_t events;
+    uint8_t savedIPL = halMaskInterrupts();     // IOcheck() runs in the system tick ISR
+
+    events = buttonEvents;
+    buttonEvents = 0;
+    for (int i = 0; i < 3; i++) {
+        buttons[i].pressed = 0;
+    }
+    halRestoreInterrupts(savedIPL);
+
+    return events;
 }
\ No newline at end of file
@@ -9,25 +9,48 @@
 #ifndef IOS_H
 #define IOS_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
+#include "timeDelay.h"
 
-#define PB1 PORTAbits.RA2   // Button 1 on pin RA2
-#define PB2 PORTBbits.RB4   // Button 2 on pin RB4
-#define PB3 PORTAbits.RA4   // Button 3 on pin RA4
+/**
+ * Debounce and press timing, in system ticks (SYSTICK_MS each):
+ * - DEBOUNCE_TICKS:     Integrator span; a level must dominate this long
+ * - LONG_PRESS_TICKS:   Hold time that turns a press into a long press
+ * - DOUBLE_PRESS_TICKS: Window after a release in which the next release
+ *                       counts as a double press
+ */
+#define DEBOUNCE_TICKS      (20 / SYSTICK_MS)
+#define LONG_PRESS_TICKS    (1000 / SYSTICK_MS)
+#define DOUBLE_PRESS_TICKS  (300 / SYSTICK_MS)
+
+/**
+ * Button event bits returned by takeButtonEvents(). Bit n of each group is
+ * button n+1, so the bit index matches the smEvent_t order.
+ */
+#define BUTTON_PRESS(i)     (0x001 << (i))
+#define BUTTON_LONG(i)      (0x008 << (i))
+#define BUTTON_DOUBLE(i)    (0x040 << (i))
 
 /**
  * @brief Structure to track button state and transitions
  * 
- * Each button's state is tracked using three flags:
- * @field pressed:    Set to 1 when button is released (rising edge detected)
- * @field newState:   Current state of the button (1 = released, 0 = pressed)
- * @field prevState:  Previous state of the button for edge detection
+ * Each button's state is tracked using the following fields:
+ * @field pressed:      Set to 1 when button is released (debounced rising edge)
+ * @field newState:     Debounced state of the button (1 = released, 0 = pressed)
+ * @field prevState:    Previous debounced state for edge detection
+ * @field integrator:   Debounce integrator, 0 (pressed) to DEBOUNCE_TICKS (released)
+ * @field heldTicks:    Ticks the button has been held down
+ * @field sinceRelease: Ticks since the last short release, for double presses
+ * @field longPressed:  Set once the current hold has produced a long press
  */
 typedef struct {
-    uint8_t pressed;    // Button press event flag
-    uint8_t newState;   // Current button state
-    uint8_t prevState;  // Previous button state
+    uint8_t pressed;        // Button press event flag
+    uint8_t newState;       // Current button state
+    uint8_t prevState;      // Previous button state
+    uint8_t integrator;     // Debounce integrator
+    uint16_t heldTicks;     // Duration of the current hold
+    uint8_t sinceRelease;   // Double-press window timer
+    uint8_t longPressed;    // Long press already reported
 } ButtonState;
 
 // Array to track states of all three buttons
@@ -35,26 +58,37 @@ typedef struct {
 extern ButtonState buttons[3];
 
 /**
- * @brief Initializes input/output configurations for buttons and LED.
+ * @brief Initializes input/output configurations for buttons.
  *
- * This function sets the appropriate TRIS registers for buttons (input) 
- * and the LED (output), and enables pull-up resistors and change notifications 
- * for the buttons.
+ * This function sets the appropriate TRIS registers for buttons (input),
+ * and enables pull-up resistors and change notifications for the buttons.
+ * The LED pin belongs to the PWM backend and is set up by initPWM().
  */
 void IOinit();
 
 /**
- * @brief Checks and updates button states.
+ * @brief Samples and debounces the buttons; called once per system tick.
  *
  * For each button:
- * 1. Reads current button state
- * 2. Detects changes from previous state
- * 3. Sets pressed flag on rising edge (button release)
- * 4. Updates previous state for next check
+ * 1. Integrates the raw pin level towards 0 (pressed) or DEBOUNCE_TICKS
+ * 2. Changes the debounced state only when the integrator saturates
+ * 3. Reports a long press once the hold reaches LONG_PRESS_TICKS
+ * 4. On release, reports a press, or a double press if within
+ *    DOUBLE_PRESS_TICKS of the previous short release
  *
- * @return 0 when state check is complete
+ * Posts EVT_BUTTON whenever a press event is recorded.
+ *
+ * @return 1 while any button still needs ticks (bouncing, held or inside a
+ *         double-press window), 0 once all buttons are idle
  */
 uint8_t IOcheck();
 
+/**
+ * @brief Returns and clears the pending button events.
+ *
+ * @return Bitmask of BUTTON_PRESS/BUTTON_LONG/BUTTON_DOUBLE bits
+ */
+uint16_t takeButtonEvents();
+
 
-#endif
\ No newline at end of file
+#endif
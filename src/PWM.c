@@ -4,84 +4,311 @@
  * Created on November 13, 2024, 4:28 PM
  *
  * Description: Implementation of PWM-based LED control functions.
- *             Handles brightness adjustment and blinking patterns.
+ *             Handles brightness adjustment and the pattern engine.
  */
 
+#include <stddef.h>
 #include "PWM.h"
+#include "events.h"
+#include "telemetry.h"
+#include "gammaTable.h"
+#include "patternTable.h"
+#include "control.h"
+#include "latency.h"
 
-// Initialize PWM control structure with default values
-PWMControl pwmControl = {
-    50, // period:              PWM frequency
-    0,  // baseDutyCycle:       start with LED off
-    0,  // blinkDutyCycle:      initial blink brightness
-    0,  // currentDutyCycle:    start with LED off
-    0,  // blinkEnabled:        start in steady mode
-    0   // blinkState:          start in OFF state
-};
-
-void updateBrightness(uint8_t overrideDutyCycle)
+PWMControl pwmControl[PWM_CHANNELS];
+
+static uint8_t pwmRunning = 0;      // Set while the PWM timebase is active
+
+/**
+ * @brief Step length from the host override or the pattern's default
+ */
+static void loadStepTicks(PWMControl *control)
+{
+    control->stepTicks = control->stepOverride
+            ? control->stepOverride
+            : patternTables[control->pattern].stepMs / SYSTICK_MS;
+}
+
+void initPWM()
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        // LED off and steady
+        pwmControl[i].period = PWM_PERIOD;
+        pwmControl[i].pattern = PATTERN_STEADY;
+        pwmControl[i].patternLevel = PATTERN_LEVEL_MAX;
+        loadStepTicks(&pwmControl[i]);
+    }
+    halPwmInit();
+}
+
+void startPWM()
 {
-    // Start Timer1 for PWM timing
-    startTimer1(pwmControl.period);
+    if (pwmRunning)
+    {
+        return;
+    }
+    pwmRunning = 1;
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        halPwmSetDuty(i, pwmControl[i].currentDutyCycle);
+    }
+    halPwmStart(PWM_PERIOD);
+}
 
-    // Get new ADC reading
-    pwmControl.adcValue = do_ADC();
+void stopPWM()
+{
+    pwmRunning = 0;
+    pauseControl();                 // Nothing for the controller to drive
+    halPwmStop();
+}
+
+void updateChannelBrightness(uint8_t channel, uint16_t overrideDutyCycle)
+{
+    PWMControl *control = &pwmControl[channel];
+
+    // Make sure the PWM timebase is running
+    startPWM();
 
     // Calculate base duty cycle
     if (!overrideDutyCycle)
     {
-        // Scale ADC value (0-1023) to duty cycle range (0-period)
-        pwmControl.baseDutyCycle = (uint8_t)((uint32_t)pwmControl.adcValue *
-                                             pwmControl.period / 1023);
+        // Latest averaged reading from the free-running ADC
+        ADC_start();
+        control->adcValue = ADC_latestChannel(channel);
+        control->adcTick = ADC_latestTick();
+
+        if (channel == 0 && getLoopMode() == LOOP_CLOSED)
+        {
+            // The ADC interrupt steps the controller toward this target
+            resumeControl(getLoopTarget() ? getLoopTarget()
+                                          : control->adcValue);
+        }
+        else
+        {
+            // Gamma-corrected duty count straight from the ADC value
+            control->baseDutyCycle = gammaTable[GAMMA_INDEX(control->adcValue)];
+        }
     }
     else
     {
         // Use provided duty cycle directly
-        pwmControl.baseDutyCycle = overrideDutyCycle;
+        if (channel == 0)
+        {
+            pauseControl();
+        }
+        control->baseDutyCycle = overrideDutyCycle;
+    }
+
+    refreshDutyCycle(channel);
+}
+
+void updateBrightness(uint16_t overrideDutyCycle)
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        updateChannelBrightness(i, overrideDutyCycle);
+    }
+}
+
+void refreshDutyCycle(uint8_t channel)
+{
+    PWMControl *control = &pwmControl[channel];
+    uint8_t version;
+    uint16_t duty;
+
+    // Also called from the pattern tick and the controller's ADC interrupt.
+    // If one of those updates the channel in between, its inputs may be
+    // newer than the ones read here: go again after it
+    do
+    {
+        version = ++control->dutyVersion;   // Single-instruction increment
+
+        // Base brightness scaled by the pattern's current step
+        duty = PATTERN_SCALE(control->baseDutyCycle, control->patternLevel);
+        control->currentDutyCycle = duty;
+        LATENCY_STAGE(LAT_PUBLISH);
+        halPwmSetDuty(channel, duty);
+    } while (version != control->dutyVersion);
+}
+
+/**
+ * @brief 1 if any channel has pattern steps left to play
+ */
+static uint8_t patternsRunning(void)
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        if (pwmControl[i].stepCountdown)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void playPattern(uint8_t channel, uint8_t pattern)
+{
+    const PatternTable *table = &patternTables[pattern];
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        PWMControl *control = &pwmControl[i];
+
+        if (channel != PWM_ALL_CHANNELS && channel != i)
+        {
+            continue;
+        }
+
+        // Park the channel so the system tick leaves it alone meanwhile
+        control->stepCountdown = 0;
+        control->pattern = pattern;
+        control->patternStep = 0;
+        control->patternLevel = table->levels[0];
+        loadStepTicks(control);
+        refreshDutyCycle(i);
+
+        // Publish; a single step never changes, so it needs no ticks
+        if (table->length > 1)
+        {
+            control->stepCountdown = control->stepTicks;
+        }
     }
 
-    // Set current duty cycle based on mode
-    if (!pwmControl.blinkEnabled)
+    if (patternsRunning())
     {
-        // Normal mode: use base duty cycle
-        pwmControl.currentDutyCycle = pwmControl.baseDutyCycle;
+        requestSysTick(SYSTICK_PATTERN);
     }
     else
     {
-        pwmControl.blinkDutyCycle = pwmControl.baseDutyCycle;
+        releaseSysTick(SYSTICK_PATTERN);
+    }
+}
+
+uint8_t getPattern(uint8_t channel)
+{
+    return pwmControl[channel].pattern;
+}
 
-        // Blinking mode: alternate between duty cycle and off
-        pwmControl.currentDutyCycle = (pwmControl.blinkState) ?
-                                // ON state: use base duty cycle
-                                pwmControl.blinkDutyCycle :
-                                // OFF state: save duty cycle but output 0
-                                0;
+void setPatternStep(uint8_t channel, uint16_t stepMs)
+{
+    uint16_t ticks = stepMs / SYSTICK_MS;
+
+    if (stepMs && !ticks)
+    {
+        ticks = 1;
+    }
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        if (channel == PWM_ALL_CHANNELS || channel == i)
+        {
+            // Single writes; the ISR reloads from stepTicks
+            pwmControl[i].stepOverride = ticks;
+            loadStepTicks(&pwmControl[i]);
+        }
     }
 }
 
-void blink()
+uint16_t getPatternStep(uint8_t channel)
 {
-    pwmControl.blinkEnabled = 1; // Enable blinking mode
-    startTimer2(500);            // Start blink timer
+    return pwmControl[channel].stepTicks * SYSTICK_MS;
 }
 
-void stopBlink()
+void patternTick()
 {
-    pwmControl.blinkEnabled = 0; // Disable blinking mode
-    stopTimer2();                // Stop blink timer
+    uint8_t passed = 0;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        PWMControl *control = &pwmControl[i];
+        const PatternTable *table;
+
+        if (!control->stepCountdown || --control->stepCountdown)
+        {
+            continue;
+        }
+        table = &patternTables[control->pattern];
+
+        // Next step; loop back or hold the last one at the end
+        if (++control->patternStep == table->length)
+        {
+            passed = 1;
+            if (!table->loops)
+            {
+                control->patternStep--;     // stepCountdown stays 0
+                continue;
+            }
+            control->patternStep = 0;
+        }
+        control->stepCountdown = control->stepTicks;
+
+        // Table index and scale only
+        control->patternLevel = table->levels[control->patternStep];
+        refreshDutyCycle(i);
+    }
+
+    if (passed)
+    {
+        postEvent(EVT_PATTERN);
+        if (!patternsRunning())
+        {
+            releaseSysTick(SYSTICK_PATTERN);    // One-shot patterns all ended
+        }
+    }
 }
 
-void transmitVoltageADC()
+/**
+ * @brief Duty cycle as a percentage (0-100): duty * 100 / 1024
+ */
+static inline uint8_t dutyPercent(uint8_t channel)
 {
-    // Convert duty cycle to percentage (0-100)
-    uint8_t dutyPercent = (uint32_t)pwmControl.currentDutyCycle * 100 /
-                          pwmControl.period;
-
-    // Transmit duty cycle percentage
-    DispNum(dutyPercent, 3);
-    XmitUART2(' ', 1);
-
-    // Transmit ADC value
-    DispNum(pwmControl.adcValue, 4);
-    XmitUART2('\n', 1);
-}
\ No newline at end of file
+    return (pwmControl[channel].currentDutyCycle * 25) >> 8;
+}
+
+uint8_t transmitVoltageADC()
+{
+    if (getTelemetryFormat() == TELEMETRY_COMPRESSED)
+    {
+        // Held back and delta-encoded; keyframes resync the host
+        return sendCompressedSample(pwmControl[0].adcTick, dutyPercent(0),
+                                    pwmControl[0].adcValue);
+    }
+
+    if (getTelemetryFormat() == TELEMETRY_BINARY)
+    {
+        uint16_t extras[2 * (PWM_CHANNELS - 1) + 1];    // + 1 keeps it non-empty
+
+        for (uint8_t i = 1; i < PWM_CHANNELS; i++)
+        {
+            extras[2 * i - 2] = dutyPercent(i);
+            extras[2 * i - 1] = pwmControl[i].adcValue;
+        }
+
+        // Whole frame or nothing; SEQ lets the host count skips
+        return sendSampleFrame(pwmControl[0].adcTick, dutyPercent(0),
+                               pwmControl[0].adcValue, extras,
+                               2 * (PWM_CHANNELS - 1));
+    }
+
+    // "ddd aaaa\n", with " ddd aaaa" for each further channel
+    char record[9 * PWM_CHANNELS];
+    uint8_t length = 0;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        if (i)
+        {
+            record[length++] = ' ';
+        }
+
+        // Duty cycle percentage, then ADC value
+        length += FormatDec(&record[length], dutyPercent(i), 3);
+        record[length++] = ' ';
+        length += FormatDec(&record[length], pwmControl[i].adcValue, 4);
+    }
+    record[length++] = '\n';
+
+    // Skipped rather than queued partially if it does not fit
+    return PutRecordUART2(record, length);
+}
@@ -4,91 +4,258 @@
  * Created on November 13, 2024, 4:28 PM
  * 
  * Description: Header file for PWM-based LED control.
- *             Manages LED brightness and blinking based on ADC input or manual control.
+ *             Manages LED brightness based on ADC input or manual control,
+ *             and plays waveform patterns (patternTable.h) over it.
  */
 
 #ifndef PWM_H
 #define PWM_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
 #include "ADC.h"
 #include "UART2.h"
 #include "timeDelay.h"
+#include "patternTable.h"
+
+/**
+ * @brief PWM backend selection
+ *
+ * PWM_BACKEND_OC:     Output Compare 1 in PWM mode, clocked by Timer2.
+ *                     The LED is driven by hardware with no per-period ISR,
+ *                     and Timer1 becomes the system tick timer.
+ * PWM_BACKEND_TIMER1: Original software PWM toggling the LED from
+ *                     _T1Interrupt, with Timer2 as the system tick timer.
+ *
+ * Override by defining PWM_BACKEND in the project's preprocessor macros.
+ */
+#define PWM_BACKEND_TIMER1  0
+#define PWM_BACKEND_OC      1
+
+#ifndef PWM_BACKEND
+#define PWM_BACKEND PWM_BACKEND_OC
+#endif
+
+/**
+ * @brief Duty cycle resolution
+ *
+ * Duty cycles are counts out of PWM_PERIOD. Both 0 and PWM_PERIOD are
+ * valid: 0 is fully off, PWM_PERIOD fully on. gen_gamma.py must be
+ * re-run if this changes.
+ */
+#define PWM_RESOLUTION_BITS 10
+#define PWM_PERIOD          (1U << PWM_RESOLUTION_BITS)
+
+/**
+ * @brief Software PWM scaling for the Timer1 backend
+ *
+ * An ISR per duty count would be far too slow at 10 bits, so the Timer1
+ * backend drops PWM_SW_SHIFT bits (64 steps) and steps its counter every
+ * PWM_SW_TICK instruction cycles.
+ */
+#define PWM_SW_SHIFT        4
+#define PWM_SW_STEPS        (PWM_PERIOD >> PWM_SW_SHIFT)
+#define PWM_SW_TICK         50
+
+/**
+ * @brief Number of LED channels
+ *
+ * Each channel has its own potentiometer (ADC_POT_INPUTS in ADC.h), duty
+ * cycle and pattern. All channels share one PWM timebase. Only the
+ * Timer1 backend can drive more than one, since the PIC24F16KA101 has a
+ * single output compare module.
+ */
+#ifndef PWM_CHANNELS
+#define PWM_CHANNELS        1
+#endif
+
+#if PWM_CHANNELS < 1 || PWM_CHANNELS > HAL_PWM_MAX_CHANNELS
+#error "PWM_CHANNELS must be between 1 and HAL_PWM_MAX_CHANNELS"
+#endif
+#if PWM_CHANNELS > 1 && PWM_BACKEND != PWM_BACKEND_TIMER1
+#error "PWM_CHANNELS > 1 needs PWM_BACKEND_TIMER1"
+#endif
+
+#define PWM_ALL_CHANNELS    0xFF    // Channel argument that means every channel
 
 /**
  * @brief Structure to manage all PWM-related parameters and states
  * 
- * Centralizes PWM control variables for LED brightness and blinking:
- * @field period:           PWM period value (determines frequency)
+ * Centralizes PWM control variables for LED brightness and patterns, one
+ * per channel:
+ * @field period:           Duty counts per PWM period (PWM_PERIOD)
  * @field baseDutyCycle:    Base brightness level (0-period)
- * @field blinkDutyCycle:   Brightness level during blink ON state
- * @field currentDutyCycle: Currently active duty cycle
- * @field blinkEnabled:     Flag to indicate if blinking is active
- * @field blinkState:       Current state of blink (ON/OFF)
+ * @field currentDutyCycle: Currently active duty cycle, base scaled by the
+ *                          pattern level
  * @field adcValue:         Latest ADC reading (0-1023)
+ * @field adcTick:          Low 16 bits of tickNow() when adcValue was sampled
+ * @field pattern:          PATTERN_* being played
+ * @field patternStep:      Index of the current step in the pattern
+ * @field patternLevel:     Level of the current step (0-PATTERN_LEVEL_MAX)
+ * @field stepOverride:     Host-set system ticks per step, 0 for the
+ *                          pattern's own
+ * @field stepTicks:        System ticks per step in effect
+ * @field stepCountdown:    System ticks left in this step, 0 once the
+ *                          pattern holds still
+ * @field dutyVersion:      Bumped by every duty update, so an update that
+ *                          was pre-empted by a newer one can tell
+ *
+ * Fields the system tick or the ADC interrupt also touch are volatile.
+ * Nothing here is guarded by masking interrupts: duty updates retry on a
+ * dutyVersion change (refreshDutyCycle()), and a new pattern is set up
+ * while stepCountdown is 0 and published by its final write.
  */
 typedef struct {
-    uint8_t period;           // PWM period
-    uint8_t baseDutyCycle;    // Normal brightness level
-    uint8_t blinkDutyCycle;   // Blink ON state brightness
-    uint8_t currentDutyCycle; // Active duty cycle value
-    uint8_t blinkEnabled;     // Blinking mode flag
-    uint8_t blinkState;       // Current blink state
-    uint16_t adcValue;        // Latest ADC reading
+    uint16_t period;                    // PWM period
+    volatile uint16_t baseDutyCycle;    // Normal brightness level
+    volatile uint16_t currentDutyCycle; // Duty last handed to the PWM output
+    uint16_t adcValue;                  // Latest ADC reading
+    uint16_t adcTick;                   // Tick when adcValue was sampled
+    volatile uint8_t pattern;           // Waveform being played
+    volatile uint8_t patternStep;       // ISR-owned while animating
+    volatile uint16_t patternLevel;     // Multiplier of baseDutyCycle
+    uint16_t stepOverride;              // Survives pattern changes
+    volatile uint16_t stepTicks;        // Step length; the ISR reloads from it
+    volatile uint16_t stepCountdown;    // ISR-owned while animating
+    volatile uint8_t dutyVersion;       // Incremented by each duty update
 } PWMControl;
 
-// Global PWM control structure
-// Initialized in PWM.c with default values
-extern PWMControl pwmControl;
+// Global PWM control structures, one per channel
+// Initialized in initPWM()
+extern PWMControl pwmControl[PWM_CHANNELS];
+
+/**
+ * @brief Configures the LED pins and the timers used by the PWM backend
+ *
+ * Must be called after timerInit(). For the OC backend this sets Timer2
+ * to a 1:1 PWM timebase with its interrupt disabled. The LEDs are left
+ * off until startPWM() is called.
+ */
+void initPWM();
+
+/**
+ * @brief Starts PWM output on the LEDs
+ *
+ * Safe to call repeatedly; the timebase is only (re)started when PWM
+ * is not already running.
+ */
+void startPWM();
+
+/**
+ * @brief Stops PWM output and drives the LEDs low
+ */
+void stopPWM();
 
 /**
  * @brief Updates LED brightness based on ADC or manual control
  *
  * Operation modes:
  * 1. ADC-controlled (overrideDutyCycle = 0):
- *    - Reads ADC value
- *    - Scales to PWM range
+ *    - Starts the ADC if needed and takes the channel's latest average
+ *      (non-blocking)
+ *    - Looks up the gamma-corrected duty count in gammaTable
  *    - Updates duty cycle
  * 
  * 2. Manual control (overrideDutyCycle > 0):
  *    - Uses provided duty cycle directly
  *
- * In both modes, final brightness considers blinking state
+ * With LOOP_CLOSED (control.h) channel 0's ADC reading becomes the
+ * controller's target instead, and the ADC interrupt adjusts its base
+ * duty cycle. The light sensor only sees channel 0.
+ *
+ * In all modes the final brightness is scaled by the pattern level
+ *
+ * @param channel           0 to PWM_CHANNELS - 1
+ * @param overrideDutyCycle Manual duty cycle value (0 for ADC control)
+ */
+void updateChannelBrightness(uint8_t channel, uint16_t overrideDutyCycle);
+
+/**
+ * @brief updateChannelBrightness() for every channel
  *
  * @param overrideDutyCycle Manual duty cycle value (0 for ADC control)
  */
-void updateBrightness(uint8_t overrideDutyCycle);
+void updateBrightness(uint16_t overrideDutyCycle);
+
+/**
+ * @brief Pushes a channel's baseDutyCycle to the output
+ *
+ * Applies the pattern level, updates currentDutyCycle and stages it for
+ * the next PWM period (halPwmSetDuty()). Lock-free and safe to call from
+ * interrupts: a call that a newer one pre-empts repeats its update, so the
+ * output always ends up with the latest base duty and level.
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
+ */
+void refreshDutyCycle(uint8_t channel);
+
+/**
+ * @brief Starts a pattern from its first step
+ *
+ * The pattern scales the channel's base duty cycle step by step from the
+ * system tick, so brightness changes need no main-loop work. The system
+ * tick runs while any channel has steps left to play; PATTERN_STEADY and
+ * finished one-shot patterns do not need it.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1, or PWM_ALL_CHANNELS
+ * @param pattern  PATTERN_* (patternTable.h)
+ */
+void playPattern(uint8_t channel, uint8_t pattern);
+
+/**
+ * @brief Returns the pattern a channel is playing
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
+ */
+uint8_t getPattern(uint8_t channel);
 
 /**
- * @brief Enables LED blinking mode
+ * @brief Sets the length of each pattern step
  *
- * Sets up blinking:
- * 1. Enables blink flag
- * 2. Starts Timer2 with 500ms period
- * 3. Uses current base duty cycle for ON state
+ * Takes effect from the next step and is kept across pattern changes.
+ * Each step of PATTERN_BLINK is one on or off phase. Rounded down to
+ * whole system ticks, with a minimum of one.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1, or PWM_ALL_CHANNELS
+ * @param stepMs   Milliseconds per step, 0 for each pattern's own
+ */
+void setPatternStep(uint8_t channel, uint16_t stepMs);
+
+/**
+ * @brief Returns a channel's step length in effect, in milliseconds
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
  */
-void blink();
+uint16_t getPatternStep(uint8_t channel);
 
 /**
- * @brief Disables LED blinking mode
+ * @brief Advances the patterns by one system tick
  *
- * Cleanup actions:
- * 1. Disables blink flag
- * 2. Stops Timer2
- * 3. Restores continuous brightness
+ * Called from the system tick ISR. A channel whose step ends moves to the
+ * next table entry and scales its base duty by it: one table read and
+ * one multiply.
  */
-void stopBlink();
+void patternTick();
 
 /**
  * @brief Sends PWM and ADC data via UART
  *
- * Transmits:
+ * In TELEMETRY_ASCII format, transmits:
  * 1. Duty cycle as percentage (0-100)
  * 2. Space character separator
  * 3. Raw ADC value (0-1023)
- * 4. Newline character
+ * 4. The same pair, space separated, for each further channel
+ * 5. Newline character
+ *
+ * In TELEMETRY_BINARY format, sends the same values as one
+ * TELEMETRY_FRAME_SAMPLE frame (see telemetry.h), with channels 1 and up
+ * as DUTY, ADC extra pairs. TELEMETRY_COMPRESSED adds channel 0 to the
+ * delta-encoded stream instead.
+ *
+ * The record is queued for interrupt-driven transmission. If the UART
+ * FIFO cannot take the whole record the sample is skipped.
+ *
+ * @return 1 if the record was queued, 0 if it was skipped
  */
-void transmitVoltageADC();
+uint8_t transmitVoltageADC();
 
 #endif
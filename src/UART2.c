@@ -12,128 +12,271 @@
  *              interrupt-driven operation and supports configurable baud rates.
  */
 
-#include "xc.h"
-#include "math.h"
-#include "string.h"
 #include "UART2.h"
+#include "events.h"
+#include "clkChange.h"
+#include "profile.h"
 
 // Static lookup table for hex conversion
 static const char HEX_CHARS[] = "0123456789ABCDEF";
 
+// Place values for FormatDec(); subtracting them avoids the software divide
+#define DEC_DIGITS 5
+static const uint16_t POW10[DEC_DIGITS] = {10000, 1000, 100, 10, 1};
+
+#define TX_MASK (UART2_TX_BUFFER_SIZE - 1)
+#define RX_MASK (UART2_RX_BUFFER_SIZE - 1)
+
+#if (UART2_TX_BUFFER_SIZE & TX_MASK) || UART2_TX_BUFFER_SIZE > 256
+#error "UART2_TX_BUFFER_SIZE must be a power of two no larger than 256"
+#endif
+#if (UART2_RX_BUFFER_SIZE & RX_MASK) || UART2_RX_BUFFER_SIZE > 256
+#error "UART2_RX_BUFFER_SIZE must be a power of two no larger than 256"
+#endif
+
+// Software transmit FIFO
+// txHead is only written by the main program, txTail only by TxServiceUART2(),
+// so a byte-wide index update is all the synchronisation needed.
+static char txBuffer[UART2_TX_BUFFER_SIZE];
+static volatile uint8_t txHead = 0;     // Next free slot
+static volatile uint8_t txTail = 0;     // Next byte to send
+static uint16_t txDropped = 0;          // Bytes lost to a full FIFO
+
+// Software receive FIFO; rxHead is only written by RxServiceUART2(),
+// rxTail only by the main program
+static char rxBuffer[UART2_RX_BUFFER_SIZE];
+static volatile uint8_t rxHead = 0;     // Next free slot
+static volatile uint8_t rxTail = 0;     // Next byte to read
+static volatile uint16_t rxDropped = 0; // Bytes lost to a full FIFO or overrun
+
 void InitUART2(void) {
-    // Configure I/O pins
-    TRISBbits.TRISB0 = 0;           // TX output
-    TRISBbits.TRISB1 = 1;           // RX input
-    LATBbits.LATB0 = 1;             // TX idle high
+    halUartInit(getClockProfile()->brg);    // Baud rate for the current clock mode
+}
 
-    // Configure UART2: 8-bit, no parity, 1 stop bit, high-speed mode
-    U2MODE = 0x0008;                // BRGH = 1 (16x clock)
+/**
+ * @brief Appends one byte to the software FIFO without starting transmission
+ *
+ * @return 1 if queued, 0 if the FIFO was full and the byte was dropped
+ */
+static uint8_t enqueue(char character) {
+    uint8_t next = (txHead + 1) & TX_MASK;
 
-    // Set baud rate based on system clock frequency
-    static const uint16_t BAUD_RATES[] = {103, 12, 12}; // 8MHz, 500kHz, 32kHz
-    U2BRG = BAUD_RATES[OSCCONbits.COSC & 0x7];
+    if (next == txTail) {
+        if (txDropped != 0xFFFF) {
+            txDropped++;            // Saturate rather than wrap
+        }
+        return 0;
+    }
 
-    // Configure TX interrupts and enable UART
-    U2STA = 0xA000;                 // Interrupt on TX complete
-    IFS1bits.U2TXIF = 0;            // Clear TX flag
-    IPC7bits.U2TXIP = 3;            // TX priority
-    IEC1bits.U2TXIE = 1;            // Enable TX interrupt
+    txBuffer[txHead] = character;
+    txHead = next;
+    return 1;
+}
 
-    U2MODEbits.UARTEN = 1;          // Enable UART
-    U2STAbits.UTXEN = 1;            // Enable transmitter
+/**
+ * @brief Starts draining the FIFO if the transmitter is idle
+ *
+ * Raising the flag by hand makes _U2TXInterrupt run even when the hardware
+ * has nothing left in flight to raise it for us.
+ */
+static inline void kickTX(void) {
+    halUartKick();
 }
 
-inline void WaitForTXReady(void) {
-    while (U2STAbits.UTXBF)
-        ; // Wait for TX buffer
+uint8_t PutUART2(char character) {
+    uint8_t queued = enqueue(character);
+    kickTX();
+    return queued;
 }
 
-void XmitUART2(char character, unsigned int count) {
-    while (count--) {
-        WaitForTXReady();
-        U2TXREG = character;
+uint8_t PutRecordUART2(const char *record, uint8_t length) {
+    uint8_t head = txHead;
+
+    if (TxSpaceUART2() < length) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        txBuffer[head] = record[i];
+        head = (head + 1) & TX_MASK;
     }
-    while (!U2STAbits.TRMT)
-        ; // Wait for completion
+    txHead = head;                  // Publish the whole record at once
+    kickTX();
+    return 1;
 }
 
-void Disp2Hex(unsigned int value) {
-    char output[6] = {' ', '0', 'x'};
+uint16_t TxSpaceUART2(void) {
+    return (uint8_t)(txTail - txHead - 1) & TX_MASK;
+}
 
-    // Convert 3 nibbles (12 bits)
-    for (int i = 0; i < 3; i++) {
-        output[5 - i] = HEX_CHARS[value & 0xF];
-        value >>= 4;
+uint8_t TxIdleUART2(void) {
+    return txHead == txTail && halUartTxDone();
+}
+
+uint16_t TxDroppedUART2(void) {
+    return txDropped;
+}
+
+void ClearTxDroppedUART2(void) {
+    txDropped = 0;
+}
+
+void FlushUART2(void) {
+    // Polls the hardware on every pass so the host build's time moves
+    while (!halUartTxDone() || txHead != txTail)
+        ; // Wait for the ISR to empty the FIFO and the last byte to leave
+}
+
+uint8_t GetUART2(char *character) {
+    if (rxTail == rxHead) {
+        return 0;
     }
-    output[5] = ' ';
+    *character = rxBuffer[rxTail];
+    rxTail = (rxTail + 1) & RX_MASK;
+    return 1;
+}
+
+uint16_t RxDroppedUART2(void) {
+    return rxDropped;
+}
 
-    // Send all characters at once
-    for (int i = 0; i < 6; i++) {
-        WaitForTXReady();
-        U2TXREG = output[i];
+void SetBaudUART2(uint16_t brg) {
+    halUartSetBaud(brg);
+}
+
+void XmitUART2(char character, unsigned int count) {
+    while (count--) {
+        enqueue(character);
     }
+    kickTX();
 }
 
-void Disp2Hex32(unsigned long value) {
-    char output[11] = {' ', '0', 'x'};
+uint8_t FormatDec(char *buffer, uint16_t value, uint8_t digits) {
+    if (digits > DEC_DIGITS) {
+        digits = DEC_DIGITS;
+    }
+
+    // At most 9 subtractions per place; the places above digits still
+    // have to come off value, they are just not written
+    for (uint8_t i = 0; i < DEC_DIGITS; i++) {
+        char digit = '0';
 
-    // Convert 8 nibbles (32 bits)
-    for (int i = 0; i < 8; i++) {
-        output[10 - i] = HEX_CHARS[value & 0xF];
+        while (value >= POW10[i]) {
+            value -= POW10[i];
+            digit++;
+        }
+        if (i >= DEC_DIGITS - digits) {
+            *buffer++ = digit;
+        }
+    }
+    return digits;
+}
+
+uint8_t FormatHex(char *buffer, uint32_t value, uint8_t digits) {
+    // Lowest nibble last
+    for (uint8_t i = digits; i > 0; i--) {
+        buffer[i - 1] = HEX_CHARS[value & 0xF];
         value >>= 4;
     }
-    output[10] = ' ';
+    return digits;
+}
 
-    // Send all characters at once
-    for (int i = 0; i < 11; i++) {
-        WaitForTXReady();
-        U2TXREG = output[i];
+/**
+ * @brief Queues a formatted field byte by byte, then starts transmission
+ *
+ * Unlike PutRecordUART2(), bytes that do not fit are dropped one by one,
+ * as the Disp2* functions always have.
+ */
+static void queueField(const char *field, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        enqueue(field[i]);
     }
+    kickTX();
+}
+
+void Disp2Hex(unsigned int value) {
+    char output[7] = {' ', '0', 'x'};
+
+    // 3 nibbles (12 bits)
+    FormatHex(&output[3], value, 3);
+    output[6] = ' ';
+    queueField(output, sizeof(output));
+}
+
+void Disp2Hex32(unsigned long value) {
+    char output[12] = {' ', '0', 'x'};
+
+    // 8 nibbles (32 bits)
+    FormatHex(&output[3], value, 8);
+    output[11] = ' ';
+    queueField(output, sizeof(output));
 }
 
 void Disp2String(const char *str) {
     while (*str) {
-        WaitForTXReady();
-        U2TXREG = *str++;
+        enqueue(*str++);
     }
+    kickTX();
 }
 
 void Disp2Dec(uint16_t value) {
     char output[7] = {' '};
-    uint16_t divisor = 10000;       // 5 digits max
 
-    // Convert to ASCII digits
-    for (int i = 1; i < 6; i++) {
-        output[i] = '0' + (value / divisor);
-        value %= divisor;
-        divisor /= 10;
-    }
+    FormatDec(&output[1], value, DEC_DIGITS);
     output[6] = ' ';
-
-    // Send all characters at once
-    for (int i = 0; i < 7; i++) {
-        WaitForTXReady();
-        U2TXREG = output[i];
-    }
+    queueField(output, sizeof(output));
 }
 
 void DispNum(uint16_t number, uint8_t digits) {
-    uint16_t divisor = 1;
+    char output[DEC_DIGITS];
+
+    queueField(output, FormatDec(output, number, digits ? digits : 1));
+}
+
+void TxServiceUART2(void) {
+    PROFILE_START(start);
+
+    // Refill the hardware FIFO from the software FIFO
+    if (txTail == txHead) {
+        PROFILE_STOP(PROF_U2TX, start);
+        return;                     // Nothing queued, e.g. a kick after a drain
+    }
 
-    // Calculate initial divisor
-    for (uint8_t i = 1; i < digits; i++) {
-        divisor *= 10;
+    while (!halUartTxFull() && txTail != txHead) {
+        halUartWrite(txBuffer[txTail]);
+        txTail = (txTail + 1) & TX_MASK;
     }
 
-    // Output digits
-    do {
-        WaitForTXReady();
-        U2TXREG = '0' + ((number / divisor) % 10);
-        divisor /= 10;
-    } while (divisor);
+    if (txTail == txHead) {
+        postEvent(EVT_UART_TX);     // Room for a whole new record
+    }
+    PROFILE_STOP(PROF_U2TX, start);
 }
 
-// Interrupt handlers
-void __attribute__((interrupt, no_auto_psv)) _U2TXInterrupt(void) {
-    IFS1bits.U2TXIF = 0;
-}
\ No newline at end of file
+void RxServiceUART2(void) {
+    PROFILE_START(start);
+
+    // Empty the hardware FIFO into the software FIFO
+    while (halUartRxReady()) {
+        char character = halUartRead();
+        uint8_t next = (rxHead + 1) & RX_MASK;
+
+        if (next == rxTail) {
+            if (rxDropped != 0xFFFF) {
+                rxDropped++;
+            }
+        } else {
+            rxBuffer[rxHead] = character;
+            rxHead = next;
+        }
+    }
+
+    if (halUartRxOverrun()) {       // Reception stops until this is cleared
+        if (rxDropped != 0xFFFF) {
+            rxDropped++;
+        }
+    }
+
+    postEvent(EVT_UART_RX);
+    PROFILE_STOP(PROF_U2RX, start);
+}
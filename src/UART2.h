@@ -6,12 +6,33 @@
  * Description: Header file for UART2 serial communication module.
  *             Provides functions for character, string, and numeric data transmission
  *             with support for various display formats (hex, decimal).
+ *             Records are best built with FormatDec()/FormatHex() into a
+ *             local buffer and queued whole with PutRecordUART2().
  */
 
 #ifndef UART2_H
 #define UART2_H
 
-#include <stdint.h>
+#include "hal.h"
+
+/**
+ * @brief Size of the software transmit FIFO drained by _U2TXInterrupt
+ *
+ * Must be a power of two no larger than 256 so the 8-bit head/tail
+ * indices wrap with a simple mask.
+ */
+#ifndef UART2_TX_BUFFER_SIZE
+#define UART2_TX_BUFFER_SIZE 64
+#endif
+
+/**
+ * @brief Size of the software receive FIFO filled by _U2RXInterrupt
+ *
+ * Same power-of-two rule as UART2_TX_BUFFER_SIZE.
+ */
+#ifndef UART2_RX_BUFFER_SIZE
+#define UART2_RX_BUFFER_SIZE 32
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -32,27 +53,147 @@ extern "C"
      *    - Stop bits: 1
      *    - Mode: High-speed (16x clock)
      *
-     * 3. Baud rates (auto-selected):
-     *    - 8MHz clock:   9600 baud
+     * 3. Baud rates (follow the clock mode, see UART_BAUD_* in clkChange.h):
+     *    - 8MHz clock:   4800 baud
      *    - 500kHz clock: 4800 baud
      *    - 32kHz clock:  300 baud
      *
      * 4. Interrupts:
-     *    - TX enabled (priority 3)
+     *    - TX enabled (priority 3), fires whenever the hardware TX FIFO
+     *      has room so the software FIFO can be drained in the background
+     *    - RX enabled (priority 3), moves each received byte into the
+     *      software receive FIFO and posts EVT_UART_RX
      */
     void InitUART2(void);
 
+    /**
+     * @brief Queues a single character for transmission
+     *
+     * Never blocks. If the software FIFO is full the character is
+     * discarded and the drop counter is incremented.
+     *
+     * @param character     ASCII character to transmit
+     * @return              1 if the character was queued, 0 if it was dropped
+     */
+    uint8_t PutUART2(char character);
+
+    /**
+     * @brief Queues a whole record, or none of it
+     *
+     * Never blocks. The record is copied in one pass and made visible to
+     * the TX interrupt with a single index update, so a line is never cut
+     * short by a full FIFO. A record that does not fit is left to the
+     * caller to retry or skip and is not counted by TxDroppedUART2().
+     *
+     * @param record        Bytes to transmit
+     * @param length        Number of bytes, at most UART2_TX_BUFFER_SIZE - 1
+     * @return              1 if the record was queued, 0 if it was dropped
+     */
+    uint8_t PutRecordUART2(const char *record, uint8_t length);
+
+    /**
+     * @brief Returns the number of free bytes in the transmit FIFO
+     *
+     * Lets callers check that a whole record fits before queuing it,
+     * instead of having it truncated by an overflow.
+     *
+     * @return              Free space in bytes
+     */
+    uint16_t TxSpaceUART2(void);
+
+    /**
+     * @brief Reports whether everything queued has left the pin
+     *
+     * @return              1 if the FIFO and shift register are empty
+     */
+    uint8_t TxIdleUART2(void);
+
+    /**
+     * @brief Returns the number of bytes dropped because the FIFO was full
+     *
+     * The counter saturates at 0xFFFF and is cleared by ClearTxDroppedUART2().
+     *
+     * @return              Dropped byte count since the last clear
+     */
+    uint16_t TxDroppedUART2(void);
+
+    /**
+     * @brief Resets the dropped byte counter
+     */
+    void ClearTxDroppedUART2(void);
+
+    /**
+     * @brief Blocks until every queued byte has left the shift register
+     *
+     * Only meant for the rare cases that need the line idle, such as
+     * before a clock switch or entering Sleep.
+     */
+    void FlushUART2(void);
+
+    /**
+     * @brief Takes one received byte from the software FIFO
+     *
+     * Never blocks.
+     *
+     * @param character     Receives the byte
+     * @return              1 if a byte was read, 0 if the FIFO was empty
+     */
+    uint8_t GetUART2(char *character);
+
+    /**
+     * @brief Returns the number of received bytes lost to a full FIFO
+     *        or a hardware overrun (saturates at 0xFFFF)
+     */
+    uint16_t RxDroppedUART2(void);
+
+    /**
+     * @brief Reprograms the baud rate generator
+     *
+     * Called by setClockMode() once the UART has been flushed and the new
+     * clock is running.
+     *
+     * @param brg           U2BRG value for the current clock (BRGH = 1)
+     */
+    void SetBaudUART2(uint16_t brg);
+
     /**
      * @brief Transmits a single character multiple times
      *
-     * Sends the specified character repeatedly over UART2.
-     * Blocks until all transmissions are complete.
+     * Queues the specified character repeatedly for UART2.
+     * Returns immediately; characters that do not fit are dropped.
      *
      * @param character     ASCII character to transmit
      * @param repeatCount   Number of times to transmit the character
      */
     void XmitUART2(char character, unsigned int repeatCount);
 
+    /**
+     * @brief Writes a value as zero-padded decimal digits
+     *
+     * Digits are found by repeated subtraction of powers of ten, never
+     * by division. Digits above the requested count are left out, so
+     * FormatDec(buf, 12345, 3) writes "345". No terminator is written.
+     *
+     * @param buffer        Receives the digits
+     * @param value         Number to format (0-65535)
+     * @param digits        Number of digits to write (1-5)
+     * @return              Number of characters written
+     */
+    uint8_t FormatDec(char *buffer, uint16_t value, uint8_t digits);
+
+    /**
+     * @brief Writes a value as zero-padded uppercase hexadecimal digits
+     *
+     * Keeps the low nibbles like FormatDec() keeps the low digits. No
+     * prefix or terminator is written.
+     *
+     * @param buffer        Receives the digits
+     * @param value         Number to format
+     * @param digits        Number of digits to write (1-8)
+     * @return              Number of characters written
+     */
+    uint8_t FormatHex(char *buffer, uint32_t value, uint8_t digits);
+
     /**
      * @brief Displays a 12-bit value in hexadecimal format
      *
@@ -76,7 +217,7 @@ extern "C"
     /**
      * @brief Displays a null-terminated string
      *
-     * Transmits each character of the string sequentially.
+     * Queues each character of the string sequentially.
      * Stops at null terminator.
      *
      * @param str           Pointer to null-terminated string
@@ -106,12 +247,21 @@ extern "C"
     void DispNum(uint16_t number, uint8_t digits);
 
     /**
-     * @brief TX interrupt handler for UART2
+     * @brief TX interrupt work for UART2
+     *
+     * Called from _U2TXInterrupt whenever the hardware TX FIFO has room.
+     * Moves queued bytes from the software FIFO into the hardware FIFO
+     * until either it is full or nothing is left.
+     */
+    void TxServiceUART2(void);
+
+    /**
+     * @brief RX interrupt work for UART2
      *
-     * Called automatically when TX operations complete.
-     * Manages transmission buffer and status flags.
+     * Called from _U2RXInterrupt. Moves received bytes into the software
+     * FIFO, counts overruns and posts EVT_UART_RX.
      */
-    void __attribute__((interrupt, no_auto_psv)) _U2TXInterrupt(void);
+    void RxServiceUART2(void);
 
 #ifdef __cplusplus
 }
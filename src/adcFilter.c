@@ -0,0 +1,60 @@
+/*
+ * File:   adcFilter.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the potentiometer filter.
+ */
+
+#include "adcFilter.h"
+
+#if ADC_OVERSAMPLE_BITS < 0 || ADC_OVERSAMPLE_BITS > 2
+#error "ADC_OVERSAMPLE_BITS must be between 0 and 2"
+#endif
+
+#if (1 << (2 * ADC_OVERSAMPLE_BITS)) > ADC_SCAN_PASSES
+#error "ADC_OVERSAMPLE_BITS needs 4^n scans per buffer fill (ADC_SAMPLES_PER_INT)"
+#endif
+
+#define FRACTION_BITS   6                       // 16-bit internal readings
+#define HALF_LSB        (1 << (FRACTION_BITS - 1))
+#define BAND            ((uint16_t)ADC_HYSTERESIS << FRACTION_BITS)
+
+// ISR only, apart from adcFilterReset() while the ADC is off
+static uint16_t average[PWM_CHANNELS];          // 16-bit moving average
+static uint16_t published[PWM_CHANNELS];        // 10-bit, as last returned
+static uint8_t seeded = 0;                      // Bit per channel with history
+
+void adcFilterReset() {
+    seeded = 0;
+}
+
+uint16_t adcFilterStep(uint8_t channel, uint16_t sum) {
+    // 16 x 1023 << 2 still fits in 16 bits; a shift for powers of two
+    uint16_t reading = ((sum << ADC_OVERSAMPLE_BITS) / ADC_SCAN_PASSES)
+                       << (FRACTION_BITS - ADC_OVERSAMPLE_BITS);
+    uint16_t level;
+    uint16_t distance;
+
+    if (!(seeded & (1 << channel))) {
+        seeded |= 1 << channel;
+        average[channel] = reading;
+        published[channel] = (reading + HALF_LSB) >> FRACTION_BITS;
+        return published[channel];
+    }
+
+    // Unsigned both ways; falling steps stop short by under 2^shift / 64 LSB
+    if (reading >= average[channel]) {
+        average[channel] += (reading - average[channel]) >> ADC_EMA_SHIFT;
+    } else {
+        average[channel] -= (average[channel] - reading) >> ADC_EMA_SHIFT;
+    }
+
+    level = published[channel] << FRACTION_BITS;
+    distance = (average[channel] >= level) ? average[channel] - level
+                                           : level - average[channel];
+    if (distance > BAND) {
+        published[channel] = (average[channel] + HALF_LSB) >> FRACTION_BITS;
+    }
+    return published[channel];
+}
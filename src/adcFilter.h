@@ -0,0 +1,76 @@
+/*
+ * File:   adcFilter.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the potentiometer filter between the ADC
+ *             interrupt and the published readings. Each channel's
+ *             readings of one buffer fill are oversampled and decimated,
+ *             smoothed by an exponential moving average and held inside
+ *             a hysteresis band, so ADC_latestChannel() only moves, and
+ *             EVT_INPUT is only posted, when the knob really moved.
+ *
+ * Internally a reading is kept at 16 bits (1/64 of a 10-bit LSB), so the
+ * extra bits from oversampling and the average's fraction are not lost
+ * before the hysteresis test. The published reading stays 10-bit.
+ *
+ * The light sensor bypasses the filter: the brightness loop (control.h)
+ * does its own filtering, and lag or a dead band would upset it.
+ */
+
+#ifndef ADCFILTER_H
+#define ADCFILTER_H
+
+#include "ADC.h"
+
+/**
+ * @brief Extra bits from oversampling (0-2)
+ *
+ * n bits sum 4^n readings and drop n bits of the sum, so the buffer fill
+ * must hold at least 4^n scans of each input (ADC_SCAN_PASSES). Every
+ * scan of the fill is used either way.
+ */
+#ifndef ADC_OVERSAMPLE_BITS
+#define ADC_OVERSAMPLE_BITS 1
+#endif
+
+/**
+ * @brief Moving average weight, 1 / 2^ADC_EMA_SHIFT per buffer fill
+ *
+ * 0 turns the average off. At 2 a step settles to within one LSB in
+ * about 20 fills.
+ */
+#ifndef ADC_EMA_SHIFT
+#define ADC_EMA_SHIFT       2
+#endif
+
+/**
+ * @brief Half-width of the hysteresis band, in 10-bit LSBs
+ *
+ * The published reading only follows once the average is more than
+ * this far from it. 0 publishes every change of the rounded average.
+ */
+#ifndef ADC_HYSTERESIS
+#define ADC_HYSTERESIS      1
+#endif
+
+/**
+ * @brief Forgets the filter history.
+ *
+ * Call while the ADC is off, before it starts. The next reading of each
+ * channel is taken as it is.
+ */
+void adcFilterReset();
+
+/**
+ * @brief Runs one buffer fill of a channel through the filter.
+ *
+ * Called from the ADC interrupt.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1
+ * @param sum      Sum of the channel's ADC_SCAN_PASSES readings
+ * @return Reading to publish (0-1023)
+ */
+uint16_t adcFilterStep(uint8_t channel, uint16_t sum);
+
+#endif
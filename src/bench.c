@@ -0,0 +1,254 @@
+/*
+ * File:   bench.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: On-chip micro-benchmarks of the hot paths (see bench.h).
+ *             Compiled out unless BENCH_ENABLED is 1.
+ */
+
+#include "bench.h"
+
+#if BENCH_ENABLED
+
+#include "stateMachine.h"
+#include "timeDelay.h"
+#include "clkChange.h"
+#include "UART2.h"
+#include "PWM.h"
+#include "ADC.h"
+#include "adcFilter.h"
+
+typedef void (*benchFn_t)(uint8_t arg);
+
+/**
+ * @brief Per-call cycle statistics of one benchmark
+ *
+ * @field min:  Fastest sample
+ * @field max:  Slowest sample
+ * @field sum:  Total of all samples, for the mean
+ */
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+} BenchResult;
+
+// Sample times and conversion clocks swept by the ADC benchmarks
+static const uint8_t ADC_SAMC[] = {1, 8, 16, 31};
+static const uint8_t ADC_ADCS[] = {1, 3, 15, 63};
+
+// ---- Benchmarked calls ----
+
+static void benchEmpty(uint8_t arg) {
+    (void)arg;
+}
+
+/**
+ * @brief Raises the Timer1 interrupt and lets it run.
+ *
+ * Times the _T1Interrupt body (system tick with the OC backend, software
+ * PWM with the Timer1 backend) including entry and exit. Timer1 has
+ * priority 2, so it vectors as soon as the level drops.
+ */
+static void benchTimer1Isr(uint8_t arg) {
+    (void)arg;
+    IFS0bits.T1IF = 1;
+    halRestoreInterrupts(0);
+    halMaskInterrupts();
+}
+
+static void benchUpdateBrightness(uint8_t arg) {
+    (void)arg;
+    updateBrightness(0);            // Follow the ADC through the gamma table
+}
+
+static void benchUpdateOverride(uint8_t arg) {
+    (void)arg;
+    updateBrightness(PWM_PERIOD / 2);
+}
+
+static void benchDispNum(uint8_t arg) {
+    (void)arg;
+    DispNum(12345, 5);
+}
+
+static void benchDisp2Dec(uint8_t arg) {
+    (void)arg;
+    Disp2Dec(65535);
+}
+
+static void benchFormatDec(uint8_t arg) {
+    char digits[5];
+
+    (void)arg;
+    FormatDec(digits, 65535, 5);    // Worst case: 9 subtractions per place
+}
+
+/**
+ * @brief The Disp2Dec() output built and queued as one record.
+ */
+static void benchPutRecord(uint8_t arg) {
+    char record[7] = {' '};
+
+    (void)arg;
+    FormatDec(&record[1], 65535, 5);
+    record[6] = ' ';
+    PutRecordUART2(record, sizeof(record));
+}
+
+/**
+ * @brief One channel's buffer fill through the filter, alternating levels.
+ */
+static void benchAdcFilter(uint8_t arg) {
+    static uint16_t sum = 0;
+
+    (void)arg;
+    sum ^= 512 * ADC_SCAN_PASSES;   // Full-band steps: the publish path too
+    adcFilterStep(0, sum);
+}
+
+static void benchAdcRead(uint8_t arg) {
+    ADC_readWith(ADC_SAMC[arg >> 2], ADC_ADCS[arg & 3]);
+}
+
+/**
+ * @brief Toggles ON_MODE and ON_BLINK; an even batch ends in ON_MODE.
+ */
+static void benchDispatch(uint8_t arg) {
+    (void)arg;
+    dispatchEvent(SM_EVENT_PB2);
+}
+
+/**
+ * @brief An event ON_MODE ignores: the table lookup alone.
+ */
+static void benchDispatchIgnored(uint8_t arg) {
+    (void)arg;
+    dispatchEvent(SM_EVENT_PB2_LONG);
+}
+
+// ---- Measurement and output ----
+
+/**
+ * @brief Times BENCH_SAMPLES batches of a call.
+ *
+ * @param fn      Call to time
+ * @param arg     Passed to fn
+ * @param prints  1 if fn sends to UART2; its output goes on a '#' line
+ */
+static BenchResult measure(benchFn_t fn, uint8_t arg, uint8_t prints) {
+    BenchResult result = {0xFFFF, 0, 0};
+
+    for (uint8_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint32_t start;
+        uint32_t elapsed;
+        uint8_t savedIPL;
+
+        if (prints) {
+            Disp2String("# ");
+        }
+        FlushUART2();               // No TX interrupt pending in the batch
+
+        savedIPL = halMaskInterrupts();
+        start = cycleNow();
+        for (uint8_t i = 0; i < BENCH_BATCH; i++) {
+            fn(arg);
+        }
+        elapsed = cycleNow() - start;
+        halRestoreInterrupts(savedIPL);
+
+        if (prints) {
+            Disp2String("\r\n");
+        }
+
+        elapsed = (elapsed + BENCH_BATCH / 2) / BENCH_BATCH;
+        if (elapsed > 0xFFFF) {
+            elapsed = 0xFFFF;
+        }
+        if (elapsed < result.min) {
+            result.min = elapsed;
+        }
+        if (elapsed > result.max) {
+            result.max = elapsed;
+        }
+        result.sum += elapsed;
+    }
+    return result;
+}
+
+static void printResult(const char *name, const BenchResult *result) {
+    Disp2String("BENCH,");
+    Disp2String(name);
+    XmitUART2(',', 1);
+    DispNum(result->min, 5);
+    XmitUART2(',', 1);
+    DispNum((result->sum + BENCH_SAMPLES / 2) / BENCH_SAMPLES, 5);
+    XmitUART2(',', 1);
+    DispNum(result->max, 5);
+    Disp2String("\r\n");
+    FlushUART2();
+}
+
+static void run(const char *name, benchFn_t fn, uint8_t prints) {
+    BenchResult result = measure(fn, 0, prints);
+
+    printResult(name, &result);
+}
+
+static void runAdcSweep() {
+    char name[] = "adc_s00_c00";
+
+    for (uint8_t i = 0; i < sizeof(ADC_SAMC) * sizeof(ADC_ADCS); i++) {
+        uint8_t samc = ADC_SAMC[i >> 2];
+        uint8_t adcs = ADC_ADCS[i & 3];
+        BenchResult result = measure(benchAdcRead, i, 0);
+
+        name[5] = '0' + samc / 10;
+        name[6] = '0' + samc % 10;
+        name[9] = '0' + adcs / 10;
+        name[10] = '0' + adcs % 10;
+        printResult(name, &result);
+    }
+}
+
+void runBenchmarks() {
+    // Into ON_MODE, which runs at CLOCK_500KHZ with or without CLOCK_SCALING
+    dispatchEvent(SM_EVENT_PB1_LONG);
+    dispatchEvent(SM_EVENT_PB1);
+
+    while (1) {
+        Disp2String("BENCH_BEGIN,");
+        DispNum(BENCH_FORMAT_VERSION, 1);
+        XmitUART2(',', 1);
+        DispNum(getClockProfile()->fcy / 1000, 4);
+        XmitUART2(',', 1);
+        DispNum(1 << cycleResolution(), 3);
+        XmitUART2(',', 1);
+        DispNum(BENCH_BATCH, 2);
+        XmitUART2(',', 1);
+        DispNum(BENCH_SAMPLES, 2);
+        Disp2String("\r\n");
+        FlushUART2();
+
+        run("empty", benchEmpty, 0);
+        run("isr_t1", benchTimer1Isr, 0);
+        run("update_brightness", benchUpdateBrightness, 0);
+        run("update_override", benchUpdateOverride, 0);
+        run("disp_num", benchDispNum, 1);
+        run("disp2dec", benchDisp2Dec, 1);
+        run("format_dec", benchFormatDec, 0);
+        run("put_record", benchPutRecord, 1);
+        run("adc_filter", benchAdcFilter, 0);
+        runAdcSweep();
+        run("dispatch", benchDispatch, 0);
+        run("dispatch_ignored", benchDispatchIgnored, 0);
+        updateBrightness(0);        // Back to the pot after the override
+
+        Disp2String("BENCH_END\r\n");
+        FlushUART2();
+        delay_ms(BENCH_REPEAT_MS);
+    }
+}
+
+#endif
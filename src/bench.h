@@ -0,0 +1,63 @@
+/*
+ * File:   bench.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the on-chip micro-benchmarks of the hot
+ *             paths. A build with BENCH_ENABLED defined as 1 runs them in
+ *             place of the normal main loop; log/BenchCompare.py checks
+ *             the output against a committed baseline.
+ *
+ * Every benchmark is run BENCH_SAMPLES times. Each sample times
+ * BENCH_BATCH back-to-back calls with cycleNow() and interrupts masked,
+ * so one Timer3 step is shared out over the batch. Results are cycles per
+ * call and include the loop around the call; "empty" is that loop alone.
+ *
+ * The results are printed as ASCII lines, repeated every BENCH_REPEAT_MS:
+ *   BENCH_BEGIN,<version>,<fcy kHz>,<resolution>,<batch>,<samples>
+ *   BENCH,<name>,<min>,<mean>,<max>
+ *   ...
+ *   BENCH_END
+ * Resolution is the Timer3 step in cycles (1 << cycleResolution()). The
+ * formatter benchmarks also send their own digits; those lines start
+ * with '#'.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "hal.h"
+
+/**
+ * @brief Compile-time switch for the benchmark build
+ *
+ * Define as 1 in the project's preprocessor macros. main() then runs
+ * runBenchmarks() and never enters the state machine loop.
+ */
+#ifndef BENCH_ENABLED
+#define BENCH_ENABLED 0
+#endif
+
+#define BENCH_FORMAT_VERSION    1
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES   16      // Timed samples per benchmark
+#endif
+
+#ifndef BENCH_BATCH
+#define BENCH_BATCH     8       // Calls per sample; 8 Disp2Dec() calls fill 56 of 64 FIFO bytes
+#endif
+
+#ifndef BENCH_REPEAT_MS
+#define BENCH_REPEAT_MS 2000    // Pause between result blocks
+#endif
+
+/**
+ * @brief Runs every benchmark and prints the results, forever.
+ *
+ * Call after init(). Leaves the LED on at the potentiometer brightness
+ * (ON_MODE) and the clock at CLOCK_500KHZ.
+ */
+void runBenchmarks();
+
+#endif
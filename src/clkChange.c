@@ -5,26 +5,78 @@
  */
 
 #include "clkChange.h"
+#include "timeDelay.h"
+#include "UART2.h"
+
+// Instruction clocks
+#define FCY_8MHZ        4000000UL
+#define FCY_500KHZ      250000UL
+#define FCY_32KHZ       15500UL             // LPRC, nominal
+
+// Nearest U2BRG (BRGH = 1), and the baud rate it gives
+#define BRG_FOR(fcy, baud)      (((fcy) + 2UL * (baud)) / (4UL * (baud)) - 1)
+#define BAUD_FOR(fcy, baud)     ((fcy) / (4UL * (BRG_FOR(fcy, baud) + 1)))
+#define BAUD_ERROR_OK(fcy, baud) \
+    (BAUD_FOR(fcy, baud) * 1000UL <= (baud) * (1000UL + UART_BAUD_TOLERANCE) \
+     && BAUD_FOR(fcy, baud) * 1000UL >= (baud) * (1000UL - UART_BAUD_TOLERANCE))
+
+// Per mille; the receiver samples mid-bit, so the total
+// mismatch of both ends must stay well under 5%
+#define UART_BAUD_TOLERANCE     20
+
+#if !BAUD_ERROR_OK(FCY_8MHZ, UART_BAUD_8MHZ)
+#error "UART_BAUD_8MHZ cannot be reached within 2% at 8 MHz"
+#endif
+#if !BAUD_ERROR_OK(FCY_500KHZ, UART_BAUD_500KHZ)
+#error "UART_BAUD_500KHZ cannot be reached within 2% at 500 kHz"
+#endif
+#if !BAUD_ERROR_OK(FCY_32KHZ, UART_BAUD_32KHZ)
+#error "UART_BAUD_32KHZ cannot be reached within 2% at 32 kHz"
+#endif
+
+#define SYSTICK_PR_FOR(rawHz)   ((rawHz) * SYSTICK_MS / 1000 - 1)
+
+// Raw Timer3 rates; each is TICK_HZ after tickShift
+#define RAW_HZ_8MHZ     (FCY_8MHZ / 64)     // 62500 Hz, >> 1
+#define RAW_HZ_500KHZ   (FCY_500KHZ / 8)    // 31250 Hz
+#define RAW_HZ_32KHZ    (FCY_32KHZ / 1)     // ~15500 Hz, << 1 (LPRC tolerance)
+
+static const ClockProfile CLOCK_PROFILES[CLOCK_MODE_COUNT] = {
+    [CLOCK_32KHZ]  = {32,  FCY_32KHZ,  0, -1, SYSTICK_PR_FOR(RAW_HZ_32KHZ),
+                      BRG_FOR(FCY_32KHZ, UART_BAUD_32KHZ)},
+    [CLOCK_500KHZ] = {500, FCY_500KHZ, 1,  0, SYSTICK_PR_FOR(RAW_HZ_500KHZ),
+                      BRG_FOR(FCY_500KHZ, UART_BAUD_500KHZ)},
+    [CLOCK_8MHZ]   = {8,   FCY_8MHZ,   2,  1, SYSTICK_PR_FOR(RAW_HZ_8MHZ),
+                      BRG_FOR(FCY_8MHZ, UART_BAUD_8MHZ)},
+};
+
+static clockMode_t clockMode = CLOCK_500KHZ;   // init() starts at 500 kHz
 
 void newClk(unsigned int clkval) {
-    uint8_t COSCNOSC;
-    switch(clkval) {
-        case 8: // 8 MHz
-            COSCNOSC = 0x00;
-            break;
-        case 500: // 500 kHz
-            COSCNOSC = 0x66;
-            break;
-        case 32: // 32 kHz
-            COSCNOSC = 0x55;
-            break;
-        default:
-            COSCNOSC = 0x55;
+    halClockSwitch(clkval);
+}
+
+void setClockMode(clockMode_t mode) {
+    uint8_t savedIPL;
+
+    if (mode == clockMode || mode >= CLOCK_MODE_COUNT) {
+        return;
     }
-    SRbits.IPL = 7;
-    CLKDIVbits.RCDIV = 0;
-    __builtin_write_OSCCONH(COSCNOSC);
-    __builtin_write_OSCCONL(0x01);
-    while(OSCCONbits.OSWEN==1) {}
-    SRbits.IPL = 0;
+
+    FlushUART2();                   // Bytes in flight would change speed mid-frame
+
+    savedIPL = halMaskInterrupts(); // Tick and timers must change together
+    newClk(CLOCK_PROFILES[mode].clkval);
+    clockMode = mode;
+    retuneTimers();
+    SetBaudUART2(CLOCK_PROFILES[mode].brg);
+    halRestoreInterrupts(savedIPL);
+}
+
+clockMode_t getClockMode() {
+    return clockMode;
+}
+
+const ClockProfile *getClockProfile() {
+    return &CLOCK_PROFILES[clockMode];
 }
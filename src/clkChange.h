@@ -7,14 +7,106 @@
 #ifndef CLKCHANGE_H
 #define CLKCHANGE_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
+
+/**
+ * @brief Enables per-state clock switching
+ *
+ * Define as 0 to keep every state at 500 kHz.
+ */
+#ifndef CLOCK_SCALING
+#define CLOCK_SCALING 1
+#endif
+
+/**
+ * @brief UART2 baud rate for each clock mode
+ *
+ * The ON and TRANSMIT states share one rate so the host can talk to every
+ * LED-on state without following the clock. 9600 is 7% off at 500 kHz
+ * (FCY 250 kHz), so the shared rate is 4800; at that rate 8 MHz gains
+ * nothing, and the TRANSMIT states stay at 500 kHz (stateMachine.c).
+ */
+#ifndef UART_BAUD
+#define UART_BAUD           4800UL
+#endif
+#ifndef UART_BAUD_8MHZ
+#define UART_BAUD_8MHZ      UART_BAUD
+#endif
+#ifndef UART_BAUD_500KHZ
+#define UART_BAUD_500KHZ    UART_BAUD
+#endif
+#ifndef UART_BAUD_32KHZ
+#define UART_BAUD_32KHZ     300UL
+#endif
+
+/**
+ * @brief Supported system clocks, slowest first
+ *
+ * @field CLOCK_32KHZ:   LPRC, 31 kHz nominal (FCY ~15.5 kHz)
+ * @field CLOCK_500KHZ:  FRC divided, 500 kHz (FCY 250 kHz)
+ * @field CLOCK_8MHZ:    FRC, 8 MHz (FCY 4 MHz)
+ */
+typedef enum {
+    CLOCK_32KHZ,
+    CLOCK_500KHZ,
+    CLOCK_8MHZ,
+    CLOCK_MODE_COUNT
+} clockMode_t;
+
+/**
+ * @brief Slowest clock that keeps up with button debouncing
+ */
+#define CLOCK_BUTTONS CLOCK_500KHZ
+
+/**
+ * @brief Peripheral settings that depend on the system clock
+ *
+ * @field clkval:         Argument for newClk()
+ * @field fcy:            Instruction clock in Hz
+ * @field timerPrescale:  TCKPS value for Timer3 and the system tick timer
+ * @field tickShift:      Converts raw Timer3 counts to TICK_HZ
+ *                        (> 0 shift right, < 0 shift left)
+ * @field sysTickPR:      Period register value for SYSTICK_MS
+ * @field brg:            U2BRG value (BRGH = 1)
+ */
+typedef struct {
+    unsigned int clkval;
+    uint32_t fcy;
+    uint8_t timerPrescale;
+    int8_t tickShift;
+    uint16_t sysTickPR;
+    uint16_t brg;
+} ClockProfile;
 
 /**
  * @brief Sets the microcontroller's clock frequency.
  *
- * @param clkval Desired clock value (in Hz).
+ * Only switches the oscillator; use setClockMode() to keep the timers
+ * and UART in step.
+ *
+ * @param clkval Desired clock value (8 = 8 MHz, 500 = 500 kHz, 32 = 32 kHz).
  */
 void newClk(unsigned int clkval);
 
+/**
+ * @brief Switches the system clock and retunes dependent peripherals.
+ *
+ * Drains the UART, switches the oscillator, then recomputes the Timer3
+ * tick scaling, the system tick period and U2BRG for the new clock.
+ * Does nothing if the clock is already in that mode. Main loop only.
+ *
+ * @param mode Clock to switch to
+ */
+void setClockMode(clockMode_t mode);
+
+/**
+ * @brief Returns the current clock mode.
+ */
+clockMode_t getClockMode();
+
+/**
+ * @brief Returns the settings for the current clock mode.
+ */
+const ClockProfile *getClockProfile();
+
 #endif // CLKCHANGE_H
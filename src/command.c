@@ -0,0 +1,384 @@
+/*
+ * File:   command.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the host command protocol.
+ */
+
+#include <stddef.h>
+#include "command.h"
+#include "telemetry.h"
+#include "stateMachine.h"
+#include "clkChange.h"
+#include "PWM.h"
+#include "control.h"
+#include "profile.h"
+#include "UART2.h"
+#include "eeLog.h"
+#include "config.h"
+#include "power.h"
+
+/**
+ * Receive parser states, one per frame field
+ */
+typedef enum {
+    RX_SYNC,
+    RX_SEQ,
+    RX_TYPE,
+    RX_LEN,
+    RX_PAYLOAD,
+    RX_CRC
+} rxState_t;
+
+static rxState_t rxState = RX_SYNC;
+static uint8_t rxHeader[3];             // SEQ, TYPE, LEN
+static uint8_t rxPayload[TELEMETRY_MAX_PAYLOAD];
+static uint8_t rxCount;                 // Payload bytes received so far
+static uint16_t commandErrors = 0;
+
+// A reply the TX FIFO had no room for; LENGTH 0 when none is waiting
+static uint8_t pendingType;
+static uint8_t pendingLength = 0;
+static uint8_t pendingPayload[TELEMETRY_MAX_PAYLOAD];
+
+// CMD_PROFILE work that must follow its held reply
+#define PROFILE_AFTER_DUMP      0x01
+#define PROFILE_AFTER_CLEAR     0x02
+static uint8_t pendingProfile = 0;
+
+static void reply(uint8_t seq, uint8_t type, uint8_t status,
+                  const uint8_t *data, uint8_t length) {
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    payload[0] = seq;
+    payload[1] = status;
+    for (uint8_t i = 0; i < length; i++) {
+        payload[2 + i] = data[i];
+    }
+    if (sendFrame(type | TELEMETRY_FRAME_REPLY, payload, 2 + length)) {
+        return;
+    }
+
+    // Streaming can keep the FIFO full; hold the reply until it drains
+    pendingType = type | TELEMETRY_FRAME_REPLY;
+    pendingLength = 2 + length;
+    for (uint8_t i = 0; i < pendingLength; i++) {
+        pendingPayload[i] = payload[i];
+    }
+}
+
+static void queryReply(uint8_t seq) {
+    uint8_t data[27];
+
+    data[0] = systemState.currentState;
+    data[1] = getClockMode();
+    putU16(&data[2], pwmControl[0].currentDutyCycle);
+    putU16(&data[4], pwmControl[0].adcValue);
+    putU16(&data[6], getDutyOverride(0));
+    putU16(&data[8], getPatternStep(0));
+    putU16(&data[10], getTelemetryInterval());
+    data[12] = getTelemetryFormat();
+    data[13] = getTelemetryMode();
+    data[14] = getLoopMode();
+    putU16(&data[15], getLoopTarget());
+    putU16(&data[17], ADC_latestSensor());
+    data[19] = PWM_CHANNELS;
+    data[20] = getPattern(0);
+    data[21] = getUserPattern(0);
+    putU16(&data[22], getBootTime());
+    putU16(&data[24], getDeviceId());
+    data[26] = bootOverBudget() ? QUERY_FLAG_BOOT_LATE : 0;
+
+    reply(seq, CMD_QUERY, CMD_OK, data, sizeof(data));
+}
+
+/**
+ * @brief Sends the PROFILE frames and clears, after the CMD_PROFILE reply
+ */
+static void finishProfile(uint8_t work) {
+    if (work & PROFILE_AFTER_DUMP) {
+        dumpProfile();
+    }
+    if (work & PROFILE_AFTER_CLEAR) {
+        profileReset();
+        clearWakeLatency();
+    }
+}
+
+static void profileReply(uint8_t seq, uint8_t clear) {
+    uint8_t data[12];
+    WakeLatency wake;
+
+    getWakeLatency(&wake);
+    data[0] = PROFILE_ENABLED ? PROF_SITE_COUNT : 0;
+    data[1] = cycleResolution();
+    putU32(&data[2], getProfileElapsed());
+    putU16(&data[6], wake.last);
+    putU16(&data[8], wake.max);
+    putU16(&data[10], wake.misses);
+
+    reply(seq, CMD_PROFILE, CMD_OK, data, sizeof(data));
+    pendingProfile = (PROFILE_ENABLED ? PROFILE_AFTER_DUMP : 0)
+                   | (clear ? PROFILE_AFTER_CLEAR : 0);
+    if (pendingLength == 0) {
+        finishProfile(pendingProfile);      // Otherwise once the reply is sent
+        pendingProfile = 0;
+    }
+}
+
+static void logReply(uint8_t seq, uint8_t status) {
+    uint8_t data[4];
+
+    data[0] = getLogging();
+    data[1] = getLogCount();
+    putU16(&data[2], getLogInterval());
+
+    reply(seq, CMD_LOG, status, data, sizeof(data));
+}
+
+/**
+ * @brief Runs a CMD_LOG operation
+ *
+ * @return CMD_OK or a CMD_ERR_* value
+ */
+static uint8_t logCommand(const uint8_t *payload, uint8_t length) {
+    uint16_t interval = (length == 3) ? getU16(&payload[1]) : 0;
+
+    if (length != 1 && !(length == 3 && payload[0] == EELOG_START)) {
+        return CMD_ERR_LENGTH;
+    }
+    if (payload[0] > EELOG_CLEAR || (length == 3 && interval < EELOG_MIN_INTERVAL_MS)) {
+        return CMD_ERR_VALUE;
+    }
+
+    switch (payload[0]) {
+        case EELOG_STOP:
+        case EELOG_START:
+            setLogging(payload[0] == EELOG_START, interval);
+            return CMD_OK;
+        case EELOG_DUMP:
+            return startLogDump() ? CMD_OK : CMD_ERR_STATE;
+        default:
+            return clearLog() ? CMD_OK : CMD_ERR_STATE;
+    }
+}
+
+static uint8_t validChannel(uint8_t channel) {
+    return channel < PWM_CHANNELS || channel == PWM_ALL_CHANNELS;
+}
+
+/**
+ * @brief Runs one complete, CRC-checked command
+ */
+static void execute(uint8_t seq, uint8_t type, const uint8_t *payload,
+                    uint8_t length) {
+    uint8_t status = CMD_OK;
+    uint16_t value = (length >= 2) ? getU16(payload) : 0;
+    uint8_t channel = (length == 3) ? payload[2] : PWM_ALL_CHANNELS;
+
+    switch (type) {
+        case CMD_SET_DUTY:
+            if (length != 2 && length != 3) {
+                status = CMD_ERR_LENGTH;
+            } else if (value > PWM_PERIOD || !validChannel(channel)) {
+                status = CMD_ERR_VALUE;
+            } else {
+                setDutyOverride(channel, value);
+            }
+            break;
+
+        case CMD_SET_BLINK:
+            if (length != 2 && length != 3) {
+                status = CMD_ERR_LENGTH;
+            } else if ((value && value < SYSTICK_MS) || !validChannel(channel)) {
+                status = CMD_ERR_VALUE;
+            } else {
+                setPatternStep(channel, value);
+            }
+            break;
+
+        case CMD_SET_PATTERN:
+            channel = (length == 2) ? payload[1] : PWM_ALL_CHANNELS;
+            if (length != 1 && length != 2) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] >= PATTERN_COUNT || !validChannel(channel)) {
+                status = CMD_ERR_VALUE;
+            } else {
+                setUserPattern(channel, payload[0]);
+            }
+            break;
+
+        case CMD_SET_RATE:
+            if (length != 2) {
+                status = CMD_ERR_LENGTH;
+            } else {
+                setTelemetryInterval(value);
+            }
+            break;
+
+        case CMD_STREAM:
+            if (length != 1) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] > 1) {
+                status = CMD_ERR_VALUE;
+            } else if (systemState.currentState < ON_MODE) {
+                status = CMD_ERR_STATE;
+            }
+            // Reply before the transition, so it precedes the first streamed frame
+            reply(seq, type, status, NULL, 0);
+            if (status == CMD_OK) {
+                dispatchEvent(payload[0] ? SM_EVENT_STREAM_ON : SM_EVENT_STREAM_OFF);
+            }
+            return;
+
+        case CMD_SET_MODE:
+            if (length != 1) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] > TELEMETRY_MODE_CHANGE) {
+                status = CMD_ERR_VALUE;
+            } else {
+                setTelemetryMode(payload[0]);
+            }
+            break;
+
+        case CMD_SET_FORMAT:
+            if (length != 1) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] > TELEMETRY_COMPRESSED) {
+                status = CMD_ERR_VALUE;
+            } else {
+                setTelemetryFormat(payload[0]);
+            }
+            break;
+
+        case CMD_SET_LOOP:
+            if (length != 3) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] > LOOP_CLOSED || getU16(&payload[1]) > 1023) {
+                status = CMD_ERR_VALUE;
+            } else if (!setLoopMode(payload[0])) {
+                status = CMD_ERR_STATE;     // Built without the light sensor
+            } else {
+                setLoopTarget(getU16(&payload[1]));
+                if (systemState.currentState >= ON_MODE) {
+                    updateChannelBrightness(0, getDutyOverride(0));
+                }
+            }
+            break;
+
+        case CMD_PROFILE:
+            if (length != 1) {
+                status = CMD_ERR_LENGTH;
+            } else if (payload[0] > 1) {
+                status = CMD_ERR_VALUE;
+            } else {
+                profileReply(seq, payload[0]);
+                return;
+            }
+            break;
+
+        case CMD_LOG:
+            if (length == 0) {
+                status = CMD_ERR_LENGTH;
+                break;
+            }
+            // The dump frames follow the reply as the FIFO drains
+            logReply(seq, logCommand(payload, length));
+            return;
+
+        case CMD_SET_ID:
+            if (length != 2) {
+                status = CMD_ERR_LENGTH;
+            } else if (!setDeviceId(value)) {
+                status = CMD_ERR_STATE;     // Previous ID still being written
+            }
+            break;
+
+        case CMD_QUERY:
+            if (length != 0) {
+                status = CMD_ERR_LENGTH;
+                break;
+            }
+            queryReply(seq);
+            return;
+
+        default:
+            status = CMD_ERR_UNKNOWN;
+            break;
+    }
+
+    reply(seq, type, status, NULL, 0);
+}
+
+static void countError() {
+    if (commandErrors != 0xFFFF) {
+        commandErrors++;
+    }
+}
+
+void processCommands() {
+    char received;
+
+    if (pendingLength != 0) {
+        if (!sendFrame(pendingType, pendingPayload, pendingLength)) {
+            return;                 // Later commands wait in the RX FIFO
+        }
+        pendingLength = 0;
+        finishProfile(pendingProfile);
+        pendingProfile = 0;
+    }
+
+    while (pendingLength == 0 && GetUART2(&received)) {
+        uint8_t byte = (uint8_t)received;
+
+        switch (rxState) {
+            case RX_SYNC:
+                if (byte == TELEMETRY_SYNC) {
+                    rxState = RX_SEQ;
+                }
+                break;
+
+            case RX_SEQ:
+            case RX_TYPE:
+                rxHeader[rxState - RX_SEQ] = byte;
+                rxState++;
+                break;
+
+            case RX_LEN:
+                if (byte > TELEMETRY_MAX_PAYLOAD) {
+                    countError();
+                    rxState = RX_SYNC;      // Not a real frame; hunt again
+                    break;
+                }
+                rxHeader[2] = byte;
+                rxCount = 0;
+                rxState = byte ? RX_PAYLOAD : RX_CRC;
+                break;
+
+            case RX_PAYLOAD:
+                rxPayload[rxCount++] = byte;
+                if (rxCount == rxHeader[2]) {
+                    rxState = RX_CRC;
+                }
+                break;
+
+            case RX_CRC:
+                rxState = RX_SYNC;
+                if (crc8(crc8(0, rxHeader, 3), rxPayload, rxHeader[2]) != byte) {
+                    countError();
+                    break;
+                }
+                execute(rxHeader[0], rxHeader[1], rxPayload, rxHeader[2]);
+                break;
+        }
+    }
+}
+
+uint8_t replyPending() {
+    return pendingLength != 0;
+}
+
+uint16_t getCommandErrors() {
+    return commandErrors;
+}
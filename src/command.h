@@ -0,0 +1,144 @@
+/*
+ * File:   command.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the host command protocol on UART2 RX.
+ *             Commands use the telemetry frame layout (telemetry.h); TYPE is
+ *             one of the CMD_* values and SEQ is chosen by the host.
+ *
+ * Every command is answered with a frame of type (CMD_* | TELEMETRY_FRAME_REPLY):
+ *   [0]     SEQ      SEQ of the command being answered
+ *   [1]     STATUS   CMD_OK or a CMD_ERR_* value
+ *   [2..]   DATA     Command-specific, CMD_QUERY, CMD_PROFILE and CMD_LOG only
+ *
+ * Commands (multi-byte fields little-endian):
+ *   CMD_SET_DUTY   [0..1] duty count, 1-PWM_PERIOD, or 0 to follow the ADC
+ *                  [2]    optional channel, every channel if omitted or 0xFF
+ *   CMD_SET_BLINK  [0..1] pattern step length in ms (one blink phase with
+ *                         PATTERN_BLINK), 0 for each pattern's own
+ *                  [2]    optional channel, as for CMD_SET_DUTY
+ *   CMD_SET_RATE   [0..1] ms per streamed sample or window, 0 for every reading
+ *   CMD_STREAM     [0]    1 to start streaming, 0 to stop (LED-on states)
+ *   CMD_QUERY      none
+ *   CMD_SET_MODE   [0]    TELEMETRY_MODE_RAW, TELEMETRY_MODE_WINDOW or
+ *                         TELEMETRY_MODE_CHANGE
+ *   CMD_SET_FORMAT [0]    TELEMETRY_ASCII, TELEMETRY_BINARY or TELEMETRY_COMPRESSED
+ *   CMD_SET_LOOP   [0]    LOOP_OPEN or LOOP_CLOSED (control.h)
+ *                  [1..2] target sensor reading, 0 to follow the potentiometer
+ *   CMD_PROFILE    [0]    1 to clear the statistics and wake latencies after
+ *                         the dump, 0 to keep them
+ *   CMD_SET_PATTERN [0]   PATTERN_* (patternTable.h) for ON_BLINK and
+ *                         TRANSMIT_UART_BLINK
+ *                  [1]    optional channel, as for CMD_SET_DUTY
+ *   CMD_LOG        [0]    EELOG_STOP, EELOG_START, EELOG_DUMP or EELOG_CLEAR (eeLog.h)
+ *                  [1..2] optional with EELOG_START: ms per logged sample,
+ *                         at least EELOG_MIN_INTERVAL_MS
+ *   CMD_SET_ID     [0..1] device ID, kept in data EEPROM (config.h), 0 to clear
+ *
+ * CMD_QUERY reply data, for channel 0 where it differs per channel:
+ *   [2]      STATE     state_t
+ *   [3]      CLOCK     clockMode_t
+ *   [4..5]   DUTY      Current duty count
+ *   [6..7]   ADC       Latest ADC reading
+ *   [8..9]   OVERRIDE  Duty override, 0 if the ADC is in control
+ *   [10..11] STEP      Pattern step length in ms
+ *   [12..13] RATE      Telemetry interval in ms
+ *   [14]     FORMAT    TELEMETRY_* format
+ *   [15]     MODE      TELEMETRY_MODE_* streaming mode
+ *   [16]     LOOP      LOOP_OPEN or LOOP_CLOSED
+ *   [17..18] TARGET    Closed-loop target, 0 if the potentiometer sets it
+ *   [19..20] SENSOR    Latest light sensor reading
+ *   [21]     CHANNELS  PWM_CHANNELS
+ *   [22]     PATTERN   PATTERN_* playing
+ *   [23]     USER      PATTERN_* selected with CMD_SET_PATTERN
+ *   [24..25] BOOT      Ticks (TICK_HZ) from timerInit() to the LED restored;
+ *                      reset, the Power-up Timer and the first newClk() come
+ *                      before it (config.h)
+ *   [26..27] ID        Device ID set with CMD_SET_ID, 0 if none
+ *   [28]     FLAGS     QUERY_FLAG_* bits
+ *
+ * CMD_PROFILE reply data, followed by one TELEMETRY_FRAME_PROFILE frame
+ * per site (profile.h) in builds with PROFILE_ENABLED:
+ *   [2]      SITES     Number of frames that follow, 0 without PROFILE_ENABLED
+ *   [3]      RES       log2 of the cycle count resolution
+ *   [4..7]   ELAPSED   Cycles since the statistics were cleared
+ *   [8..9]   WAKE      Ticks (TICK_HZ) from the last wake to its debounced
+ *                      press (power.h)
+ *   [10..11] WAKE_MAX  Worst of those ticks
+ *   [12..13] MISSES    Wakes over WAKE_LATENCY_BUDGET_MS
+ *
+ * CMD_LOG reply data, sent before any dump frames; CMD_ERR_STATE if a
+ * dump or clear is still running:
+ *   [2]      LOGGING   1 if logging in the TRANSMIT states
+ *   [3]      COUNT     Records stored, as dumped by EELOG_DUMP
+ *   [4..5]   INTERVAL  ms per logged sample
+ * EELOG_DUMP then sends COUNT records in TELEMETRY_FRAME_LOG frames.
+ *
+ * The ON and TRANSMIT states both run at 500 kHz and UART_BAUD (clkChange.h),
+ * so streaming starts without the host changing rate.
+ * OFF_MODE runs the UART at 32 kHz and sleeps, so it does not take commands.
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "hal.h"
+
+#define CMD_SET_DUTY        0x10
+#define CMD_SET_BLINK       0x11
+#define CMD_SET_RATE        0x12
+#define CMD_STREAM          0x13
+#define CMD_QUERY           0x14
+#define CMD_SET_MODE        0x15
+#define CMD_SET_FORMAT      0x16
+#define CMD_SET_LOOP        0x17
+#define CMD_PROFILE         0x18
+#define CMD_SET_PATTERN     0x19
+#define CMD_LOG             0x1A
+#define CMD_SET_ID          0x1B
+
+/**
+ * CMD_QUERY FLAGS bits:
+ * - QUERY_FLAG_BOOT_LATE:  BOOT plus BOOT_UNTIMED_MS was over BOOT_BUDGET_MS
+ *                          (power.h)
+ */
+#define QUERY_FLAG_BOOT_LATE    0x01
+
+/**
+ * Reply status codes:
+ * - CMD_OK:          Command applied
+ * - CMD_ERR_LENGTH:  Payload length does not match the command
+ * - CMD_ERR_VALUE:   Payload value out of range
+ * - CMD_ERR_STATE:   Not possible in the current state or build
+ * - CMD_ERR_UNKNOWN: Unknown command type
+ */
+#define CMD_OK              0
+#define CMD_ERR_LENGTH      1
+#define CMD_ERR_VALUE       2
+#define CMD_ERR_STATE       3
+#define CMD_ERR_UNKNOWN     4
+
+/**
+ * @brief Parses and executes every complete command in the RX FIFO.
+ *
+ * Call from the main loop on EVT_UART_RX and EVT_UART_TX. Partial frames
+ * are kept until the rest arrives. A reply that does not fit in the TX
+ * FIFO is held and sent first on the next call; parsing stops until then.
+ */
+void processCommands();
+
+/**
+ * @brief Returns 1 while a reply is waiting for room in the TX FIFO.
+ *
+ * The telemetry stream and log dumps hold off meanwhile, so replies are
+ * not starved at UART_BAUD.
+ */
+uint8_t replyPending();
+
+/**
+ * @brief Returns the number of frames rejected by the CRC or length checks.
+ */
+uint16_t getCommandErrors();
+
+#endif
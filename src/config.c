@@ -0,0 +1,235 @@
+/*
+ * File:   config.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the stored configuration.
+ */
+
+#include "config.h"
+#include "eeprom.h"
+#include "stateMachine.h"
+#include "clkChange.h"
+#include "timeDelay.h"
+#include "power.h"
+#include "telemetry.h"
+#include "control.h"
+#include "eeLog.h"
+#include "PWM.h"
+#include "patternTable.h"
+
+#define SETTINGS_WORDS  (CONFIG_SLOT_WORDS - 1)     // Words 1-7
+
+// Settings indexes of STATE and OVERRIDE: stored with every save, but a
+// change to them alone only saves when it is urgent (entering OFF_MODE)
+#define LIVE_SETTINGS   ((1 << 0) | (1 << 4))
+
+// Word 2 flags
+#define FLAG_FORMAT     0x03
+#define FLAG_MODE       0x0C
+#define FLAG_MODE_SHIFT 2
+#define FLAG_CLOSED     0x10
+#define FLAG_LOGGING    0x20
+
+static Config config = {
+    .state = OFF_MODE,
+    .userPattern = PATTERN_BLINK,
+    .dutyOverride = 0
+};
+
+static uint8_t started = 0;                 // recordBootTime() has run
+static uint16_t saved[SETTINGS_WORDS];      // Settings in the newest slot
+static uint16_t seen[SETTINGS_WORDS];       // Settings at the last flushConfig()
+static uint32_t changedAt;                  // tickNow() when seen last changed
+static uint8_t urgent = 0;                  // Save without the delay
+static uint8_t seq = 0;                     // SEQ of the newest slot
+static uint8_t slot = 1;                    // Slot holding it; saves alternate
+static uint16_t slotWords[CONFIG_SLOT_WORDS];   // Save in flight (EEPROM_JOB_CONFIG)
+static uint16_t bootTicks = 0;
+static uint16_t idWords[EEPROM_ID_WORDS];   // ID, ~ID; also the write in flight
+
+/**
+ * @brief CRC field of a slot with this SEQ and these settings
+ *
+ * Seeded with 0xFF so an all-zero slot does not pass.
+ */
+static uint8_t slotCrc(uint8_t slotSeq, const uint16_t *settings) {
+    uint8_t bytes[1 + 2 * SETTINGS_WORDS];
+
+    bytes[0] = slotSeq;
+    for (uint8_t i = 0; i < SETTINGS_WORDS; i++) {
+        putU16(&bytes[1 + 2 * i], settings[i]);
+    }
+    return crc8(0xFF, bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Packs the settings now in force into words 1-7
+ */
+static void captureSettings(uint16_t *settings) {
+    settings[0] = ((uint16_t)CONFIG_VERSION << 8) | systemState.currentState;
+    settings[1] = ((uint16_t)getUserPattern(0) << 8)
+                | (getLogging() ? FLAG_LOGGING : 0)
+                | (getLoopMode() == LOOP_CLOSED ? FLAG_CLOSED : 0)
+                | (getTelemetryMode() << FLAG_MODE_SHIFT)
+                | (getTelemetryFormat() & FLAG_FORMAT);
+    settings[2] = pwmControl[0].stepOverride * SYSTICK_MS;
+    settings[3] = getTelemetryInterval();
+    settings[4] = getDutyOverride(0);
+    settings[5] = getLoopTarget();
+    settings[6] = getLogInterval();
+}
+
+/**
+ * @brief 1 if the slot passes its CRC and holds values in range
+ */
+static uint8_t slotValid(const uint16_t *words) {
+    const uint16_t *settings = &words[1];
+
+    return (words[0] & 0xFF) == slotCrc(words[0] >> 8, settings)
+        && (settings[0] >> 8) == CONFIG_VERSION
+        && (settings[0] & 0xFF) < STATE_COUNT
+        && (settings[1] >> 8) < PATTERN_COUNT
+        && (settings[1] & FLAG_FORMAT) <= TELEMETRY_COMPRESSED
+        && ((settings[1] & FLAG_MODE) >> FLAG_MODE_SHIFT) <= TELEMETRY_MODE_CHANGE
+        && (!settings[2] || settings[2] >= SYSTICK_MS)
+        && settings[4] <= PWM_PERIOD
+        && settings[5] <= 1023
+        && settings[6] >= EELOG_MIN_INTERVAL_MS;
+}
+
+uint8_t loadConfig() {
+    uint16_t words[2][CONFIG_SLOT_WORDS];
+    uint8_t newest = 2;
+    const uint16_t *settings;
+    uint8_t flags;
+
+    idWords[0] = halEepromRead(EEPROM_ID_BASE);
+    idWords[1] = halEepromRead(EEPROM_ID_BASE + 1);
+
+    for (uint8_t s = 0; s < 2; s++) {
+        for (uint8_t i = 0; i < CONFIG_SLOT_WORDS; i++) {
+            words[s][i] = halEepromRead(EEPROM_CONFIG_BASE + s * CONFIG_SLOT_WORDS + i);
+        }
+        if (!slotValid(words[s])) {
+            continue;
+        }
+        // SEQ wraps; the newer one is less than half the range ahead
+        if (newest == 2 || (int8_t)((words[s][0] >> 8) - (words[newest][0] >> 8)) > 0) {
+            newest = s;
+        }
+    }
+    if (newest == 2) {
+        return 0;                           // Blank or corrupted: defaults
+    }
+    slot = newest;
+    seq = words[newest][0] >> 8;
+    settings = &words[newest][1];
+    flags = settings[1] & 0xFF;
+
+    setTelemetryFormat(flags & FLAG_FORMAT);
+    setTelemetryMode((flags & FLAG_MODE) >> FLAG_MODE_SHIFT);
+    setTelemetryInterval(settings[3]);
+    setPatternStep(PWM_ALL_CHANNELS, settings[2]);
+    setLoopMode((flags & FLAG_CLOSED) ? LOOP_CLOSED : LOOP_OPEN);   // Open without the sensor
+    setLoopTarget(settings[5]);
+    setLogging((flags & FLAG_LOGGING) ? 1 : 0, settings[6]);
+
+    config.userPattern = settings[1] >> 8;
+    config.dutyOverride = settings[4];
+#if CONFIG_RESTORE_STATE
+    config.state = settings[0] & 0xFF;
+    setClockMode(getStateClock(config.state));  // UART starts at the state's baud rate
+#endif
+    return 1;
+}
+
+const Config *getConfig() {
+    return &config;
+}
+
+void flushConfig(uint8_t immediate) {
+    uint16_t settings[SETTINGS_WORDS];
+    uint8_t changed = 0;
+    uint8_t differs = 0;
+
+    if (!started) {
+        return;                             // Still booting from the saved slot
+    }
+    if (immediate) {
+        urgent = 1;
+    }
+
+    captureSettings(settings);
+    for (uint8_t i = 0; i < SETTINGS_WORDS; i++) {
+        uint8_t live = (LIVE_SETTINGS >> i) & 1;
+
+        if (settings[i] != seen[i]) {
+            seen[i] = settings[i];
+            changed |= !live;
+        }
+        differs |= (seen[i] != saved[i]) && (urgent || !live);
+    }
+    if (changed) {
+        changedAt = tickNow();
+    }
+
+    if (!differs) {
+        urgent = 0;
+        return;
+    }
+    if (!urgent && tickNow() - changedAt < MS_TO_TICKS(CONFIG_SAVE_DELAY_MS)) {
+        return;
+    }
+    if (eepromJobBusy(EEPROM_JOB_CONFIG)) {
+        return;                             // slotWords is still being written
+    }
+
+    // Into the older slot; the newest stays valid until this one is
+    seq++;
+    slot ^= 1;
+    slotWords[0] = ((uint16_t)seq << 8) | slotCrc(seq, seen);
+    for (uint8_t i = 0; i < SETTINGS_WORDS; i++) {
+        slotWords[1 + i] = seen[i];
+        saved[i] = seen[i];
+    }
+    eepromWrite(EEPROM_JOB_CONFIG, EEPROM_CONFIG_BASE + slot * CONFIG_SLOT_WORDS,
+                slotWords, CONFIG_SLOT_WORDS);
+    urgent = 0;
+}
+
+void recordBootTime() {
+    uint32_t ticks = tickNow();
+
+    bootTicks = (ticks > 0xFFFF) ? 0xFFFF : ticks;
+
+    // What is in force now counts as saved; only later changes are written
+    captureSettings(saved);
+    for (uint8_t i = 0; i < SETTINGS_WORDS; i++) {
+        seen[i] = saved[i];
+    }
+    started = 1;
+}
+
+uint16_t getBootTime() {
+    return bootTicks;
+}
+
+uint8_t bootOverBudget() {
+    return (uint32_t)bootTicks + MS_TO_TICKS(BOOT_UNTIMED_MS) > MS_TO_TICKS(BOOT_BUDGET_MS);
+}
+
+uint16_t getDeviceId() {
+    // Erased words (0xFFFF twice) fail the check too
+    return ((idWords[0] ^ idWords[1]) == 0xFFFF) ? idWords[0] : 0;
+}
+
+uint8_t setDeviceId(uint16_t id) {
+    if (eepromJobBusy(EEPROM_JOB_ID)) {
+        return 0;                           // idWords is still being written
+    }
+    idWords[0] = id;
+    idWords[1] = ~id;
+    eepromWrite(EEPROM_JOB_ID, EEPROM_ID_BASE, idWords, EEPROM_ID_WORDS);
+    return 1;
+}
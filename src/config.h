@@ -0,0 +1,158 @@
+/*
+ * File:   config.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the stored configuration. The runtime
+ *             settings the host and buttons can change, and the state
+ *             the unit was in, are kept in a record in data EEPROM and
+ *             loaded at reset, before the peripherals are set up.
+ *
+ * The record alternates between two slots at EEPROM_CONFIG_BASE
+ * (eeprom.h), so a reset during a save leaves the previous one intact.
+ * Each slot is CONFIG_SLOT_WORDS words:
+ *   word 0  [15..8]  SEQ       Counts saves; the newer valid slot wins
+ *           [7..0]   CRC       CRC-8 (telemetry.h) of SEQ and words 1-7
+ *   word 1  [15..8]  VERSION   CONFIG_VERSION
+ *           [7..0]   STATE     state_t
+ *   word 2  [15..8]  PATTERN   PATTERN_* for the blink states (CMD_SET_PATTERN)
+ *           [5]      LOGGING   EEPROM log on (eeLog.h)
+ *           [4]      LOOP      LOOP_OPEN or LOOP_CLOSED
+ *           [3..2]   MODE      TELEMETRY_MODE_* streaming mode
+ *           [1..0]   FORMAT    TELEMETRY_* format
+ *   word 3  STEP      Pattern step override in ms, 0 for each pattern's own
+ *   word 4  RATE      Telemetry interval in ms
+ *   word 5  OVERRIDE  Duty override, 0 to follow the ADC
+ *   word 6  TARGET    Closed-loop target, 0 for the potentiometer
+ *   word 7  INTERVAL  ms per logged sample
+ * Per-channel settings are stored for channel 0 and restored on all.
+ *
+ * The device ID, which tells units on a shared test bench apart
+ * (CMD_SET_ID), is kept outside the slots at EEPROM_ID_BASE as the ID
+ * and its complement, so settings saves and a corrupted slot leave it
+ * alone.
+ *
+ * Saving is polled from the main loop: once the settings have stayed
+ * changed for CONFIG_SAVE_DELAY_MS, so a host changing several of them
+ * writes one record, not one per command. STATE and OVERRIDE change far
+ * more often (buttons, CMD_STREAM, duty sweeps), so they are stored with
+ * the next save but do not start one. Entering OFF_MODE saves at once,
+ * before the core sleeps, so the state comes back as it was at the last
+ * switch-off or settings save.
+ *
+ * Expected write rate: one save per host settings change and per
+ * switch-off, each rewriting every word of one slot. At 100 of them a
+ * day, a slot word sees 50 erase/writes a day against the data EEPROM's
+ * 100,000, about five years.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "hal.h"
+
+/**
+ * @brief Restore the state saved with the settings at reset
+ *
+ * 0 always starts in OFF_MODE with the saved settings.
+ */
+#ifndef CONFIG_RESTORE_STATE
+#define CONFIG_RESTORE_STATE    1
+#endif
+
+/**
+ * @brief How long the settings must stay unchanged before they are saved
+ *
+ * Each save rewrites one slot, so this spares the EEPROM when the host
+ * changes several settings in a row.
+ */
+#ifndef CONFIG_SAVE_DELAY_MS
+#define CONFIG_SAVE_DELAY_MS    2000
+#endif
+
+#define CONFIG_VERSION      2       // Bump when the slot layout changes
+#define CONFIG_SLOT_WORDS   8
+
+/**
+ * @brief Settings owned by the state machine, as loaded
+ *
+ * The other modules' settings are applied by loadConfig() itself.
+ *
+ * @field state:         state_t to start in
+ * @field userPattern:   PATTERN_* for the blink states
+ * @field dutyOverride:  Duty count, 0 to follow the ADC
+ */
+typedef struct {
+    uint8_t state;
+    uint8_t userPattern;
+    uint16_t dutyOverride;
+} Config;
+
+/**
+ * @brief Reads the newer valid slot and applies its settings.
+ *
+ * Call once from init(), after initPWM() and eepromInit() and before
+ * IOinit() and InitUART2(). When a state is restored, the clock moves to
+ * that state's so the UART starts at its baud rate. Without a valid slot
+ * every module keeps its defaults. The device ID is read either way.
+ *
+ * @return 1 if a slot was loaded
+ */
+uint8_t loadConfig();
+
+/**
+ * @brief Returns the state machine's settings.
+ *
+ * Defaults (OFF_MODE, PATTERN_BLINK, no override) if nothing was loaded.
+ */
+const Config *getConfig();
+
+/**
+ * @brief Saves the settings if they changed.
+ *
+ * Call from the main loop after every batch of events. Does nothing while
+ * the configuration job (eeprom.h) is still writing; the EVT_NVM at its
+ * end brings the main loop back.
+ *
+ * @param immediate  1 to save without waiting for CONFIG_SAVE_DELAY_MS;
+ *                   it stays in force until the save has started
+ */
+void flushConfig(uint8_t immediate);
+
+/**
+ * @brief Notes that the LED is at its restored level.
+ *
+ * Call once from main() after initStateMachine().
+ */
+void recordBootTime();
+
+/**
+ * @brief Returns the ticks (TICK_HZ) from timerInit() to recordBootTime().
+ *
+ * The span starts after reset, the Power-up Timer and the first newClk();
+ * see BOOT_BUDGET_MS (power.h).
+ */
+uint16_t getBootTime();
+
+/**
+ * @brief Returns 1 if getBootTime() plus BOOT_UNTIMED_MS exceeded
+ * BOOT_BUDGET_MS.
+ */
+uint8_t bootOverBudget();
+
+/**
+ * @brief Returns the device ID, 0 if none was set.
+ */
+uint16_t getDeviceId();
+
+/**
+ * @brief Stores a new device ID.
+ *
+ * Returns at once; the two words are written in the background.
+ *
+ * @param id  1-65535, or 0 to clear it
+ * @return 0 if the previous ID is still being written
+ */
+uint8_t setDeviceId(uint16_t id);
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * File:   control.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the fixed-point PI brightness controller.
+ */
+
+#include "control.h"
+#include "ADC.h"
+#include "PWM.h"
+
+#define PI_OUTPUT_MAX       ((int32_t)PWM_PERIOD << 8)  // Full duty in Q8
+
+static uint8_t loopMode = LOOP_OPEN;
+static uint16_t loopTarget = 0;         // Host target, 0 to follow the pot
+static volatile uint8_t running = 0;    // Set while the ISR may step
+static volatile uint16_t setpoint = 0;  // Sensor reading to hold
+static int32_t integral = 0;            // Q8 duty counts, ISR-owned while running
+static uint16_t lastStep;               // Tick of the last scheduled step
+
+uint8_t setLoopMode(uint8_t mode) {
+#if !ADC_SENSOR_ENABLED
+    if (mode == LOOP_CLOSED) {
+        return 0;                       // Nothing to close the loop with
+    }
+#endif
+    loopMode = mode;
+    if (mode == LOOP_OPEN) {
+        pauseControl();
+    }
+    return 1;
+}
+
+uint8_t getLoopMode() {
+    return loopMode;
+}
+
+void setLoopTarget(uint16_t target) {
+    loopTarget = target;
+}
+
+uint16_t getLoopTarget() {
+    return loopTarget;
+}
+
+void resumeControl(uint16_t newSetpoint) {
+    uint8_t savedIPL;
+
+    setpoint = newSetpoint;             // Single write; the ISR reads it once
+    if (running) {
+        return;
+    }
+
+    savedIPL = halMaskInterrupts(); // integral and lastStep belong to the ISR
+    integral = (int32_t)pwmControl[0].baseDutyCycle << 8;
+    lastStep = tickNow16();
+    running = 1;
+    halRestoreInterrupts(savedIPL);
+}
+
+void pauseControl() {
+    running = 0;
+}
+
+void controlStep(uint16_t sensor) {
+    uint16_t now;
+    uint16_t base;
+    int16_t error;
+    int32_t proportional;
+    int32_t low;
+    int32_t high;
+    int32_t output;
+
+    if (!running) {
+        return;
+    }
+
+    // Fixed-rate schedule; restart from now if an interval was missed
+    now = tickNow16();
+    if ((uint16_t)(now - lastStep) < PI_PERIOD_TICKS) {
+        return;
+    }
+    lastStep += PI_PERIOD_TICKS;
+    if ((uint16_t)(now - lastStep) >= PI_PERIOD_TICKS) {
+        lastStep = now;
+    }
+
+    // The sensor only sees the base duty cycle at full pattern level
+    if (pwmControl[0].patternLevel != PATTERN_LEVEL_MAX) {
+        return;
+    }
+
+    // Output limits for this step: full range, narrowed by the slew limit
+    base = pwmControl[0].baseDutyCycle;
+    low = (base > PI_MAX_STEP) ? (int32_t)(base - PI_MAX_STEP) << 8 : 0;
+    high = (int32_t)(base + PI_MAX_STEP) << 8;
+    if (high > PI_OUTPUT_MAX) {
+        high = PI_OUTPUT_MAX;
+    }
+
+    error = (int16_t)setpoint - (int16_t)sensor;
+    proportional = (int32_t)PI_KP * error;
+    output = integral + proportional;
+
+    // Anti-windup: integrate only if that does not push further into a limit
+    if ((error > 0 && output < high) || (error < 0 && output > low)) {
+        integral += (int32_t)PI_KI * error;
+        if (integral < 0) {
+            integral = 0;
+        } else if (integral > PI_OUTPUT_MAX) {
+            integral = PI_OUTPUT_MAX;
+        }
+        output = integral + proportional;
+    }
+
+    if (output < low) {
+        output = low;
+    } else if (output > high) {
+        output = high;
+    }
+
+    pwmControl[0].baseDutyCycle = (uint16_t)(output >> 8);
+    refreshDutyCycle(0);
+}
@@ -0,0 +1,123 @@
+/*
+ * File:   control.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for closed-loop brightness regulation.
+ *             A fixed-point PI controller holds the light sensor reading
+ *             (ADC.h, ADC_SENSOR_ENABLED) at a target by adjusting the
+ *             base duty cycle. The target is the potentiometer reading or
+ *             a host-set value (command.h, CMD_SET_LOOP).
+ *
+ * The controller steps every PI_PERIOD_MS from the ADC interrupt:
+ *   error    = target - sensor                   (ADC counts)
+ *   integral = integral + PI_KI * error          (skipped while the output
+ *                                                 is limited in that direction)
+ *   duty     = (integral + PI_KP * error) >> 8   (gains are Q8)
+ * The duty is clamped to 0-PWM_PERIOD and moves at most PI_MAX_STEP
+ * counts per step. It is held while a pattern dims the LED below full
+ * level.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "hal.h"
+#include "timeDelay.h"
+
+/**
+ * Brightness loop modes:
+ * - LOOP_OPEN:   Gamma-corrected potentiometer reading sets the duty
+ * - LOOP_CLOSED: PI controller holds the sensor at the target
+ */
+#define LOOP_OPEN           0
+#define LOOP_CLOSED         1
+
+/**
+ * @brief Controller step period in milliseconds
+ *
+ * Steps are taken from the ADC interrupt, so each one can be late by up
+ * to one ADC_SAMPLES_PER_INT conversion batch.
+ */
+#ifndef PI_PERIOD_MS
+#define PI_PERIOD_MS        20
+#endif
+
+#define PI_PERIOD_TICKS     ((uint16_t)((uint32_t)PI_PERIOD_MS * TICK_HZ / 1000))
+
+/**
+ * @brief Controller gains, Q8 duty counts per ADC count of error
+ *
+ * Tune for the photodiode and its load resistor: PI_KP 64 is 0.25 duty
+ * counts per count of error, PI_KI 32 adds 1/8 count per count every step.
+ */
+#ifndef PI_KP
+#define PI_KP               64
+#endif
+
+#ifndef PI_KI
+#define PI_KI               32
+#endif
+
+/**
+ * @brief Largest duty change per controller step (slew limit)
+ */
+#ifndef PI_MAX_STEP
+#define PI_MAX_STEP         16
+#endif
+
+/**
+ * @brief Selects open- or closed-loop brightness.
+ *
+ * Takes effect at the next brightness update of an LED-on state.
+ *
+ * @param mode LOOP_OPEN or LOOP_CLOSED
+ * @return 1 if applied, 0 if LOOP_CLOSED without ADC_SENSOR_ENABLED
+ */
+uint8_t setLoopMode(uint8_t mode);
+
+/**
+ * @brief Returns LOOP_OPEN or LOOP_CLOSED.
+ */
+uint8_t getLoopMode();
+
+/**
+ * @brief Sets the closed-loop target.
+ *
+ * @param target Sensor reading to hold (1-1023), or 0 to follow the
+ *               potentiometer
+ */
+void setLoopTarget(uint16_t target);
+
+/**
+ * @brief Returns the host-set target, 0 if the potentiometer is in control.
+ */
+uint16_t getLoopTarget();
+
+/**
+ * @brief Runs the controller toward a setpoint.
+ *
+ * Called from updateBrightness() on every reading. The first call after
+ * pauseControl() preloads the integral with the current base duty cycle,
+ * so taking over from open loop does not step the LED.
+ *
+ * @param setpoint Sensor reading to hold
+ */
+void resumeControl(uint16_t setpoint);
+
+/**
+ * @brief Stops the controller; the duty cycle is left as it is.
+ */
+void pauseControl();
+
+/**
+ * @brief Takes one controller step if one is due.
+ *
+ * Called from the ADC interrupt with every new sensor average. Writes
+ * pwmControl[0].baseDutyCycle and pushes it to the output.
+ *
+ * @param sensor Averaged light sensor reading
+ */
+void controlStep(uint16_t sensor);
+
+#endif
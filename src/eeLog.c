@@ -0,0 +1,210 @@
+/*
+ * File:   eeLog.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the data EEPROM sample logger.
+ */
+
+#include <stddef.h>
+#include "eeLog.h"
+#include "events.h"
+#include "telemetry.h"
+#include "timeDelay.h"
+#include "PWM.h"
+
+#define WORD0_EMPTY     0x8000
+#define WORD0_PHASE     0x4000
+#define WORD1_CHECK     0x8000
+#define DUTY_MAX        ((1 << EELOG_DUTY_BITS) - 1)
+#define ADC_MASK        0x03FF
+
+// Ring position, main program only
+static uint8_t head = 0;                // Next record to write
+static uint8_t count = 0;               // Records stored
+static uint8_t phase = 0;               // PHASE of records written this pass
+static uint8_t tornHead = 0;            // Record at head is torn; count includes it
+
+static uint8_t logging = EELOG_AUTOSTART;
+static uint16_t intervalMs = EELOG_INTERVAL_MS;
+static uint32_t intervalTicks = MS_TO_TICKS(EELOG_INTERVAL_MS);
+static uint32_t lastSample;
+static uint8_t sampled = 0;             // lastSample is valid
+
+static uint16_t record[2];              // Record in flight (EEPROM_JOB_LOG)
+
+// Dump progress
+static uint8_t dumping = 0;
+static uint8_t dumpFirst;               // Slot of the oldest record
+static uint8_t dumpCount;
+static uint8_t dumpSent;
+
+/**
+ * @brief 1 while a record or clear is queued or being written
+ */
+static uint8_t writing(void) {
+    return eepromJobBusy(EEPROM_JOB_LOG) || eepromJobBusy(EEPROM_JOB_ERASE);
+}
+
+/**
+ * @brief 1 if a reset came between the two words of a slot's last write
+ */
+static uint8_t recordTorn(uint8_t slot) {
+    uint16_t word0 = halEepromRead(2 * slot);
+    uint8_t phaseBit = (word0 & WORD0_PHASE) ? 1 : 0;
+    uint8_t checkBit = (halEepromRead(2 * slot + 1) & WORD1_CHECK) ? 1 : 0;
+
+    return !(word0 & WORD0_EMPTY) && phaseBit != checkBit;
+}
+
+void eeLogInit() {
+    uint16_t first;
+
+    first = halEepromRead(0);
+    if (first & WORD0_EMPTY) {
+        return;                         // Empty log: start from record 0
+    }
+
+    // Records up to the head carry record 0's phase; after it comes
+    // either the previous pass or erased records
+    phase = (first & WORD0_PHASE) ? 1 : 0;
+    count = EELOG_RECORDS;
+    for (uint8_t i = 1; i < EELOG_RECORDS; i++) {
+        uint16_t word0 = halEepromRead(2 * i);
+
+        if ((word0 & WORD0_EMPTY) || ((word0 ^ first) & WORD0_PHASE)) {
+            head = i;
+            count = (word0 & WORD0_EMPTY) ? i : EELOG_RECORDS;
+            break;
+        }
+    }
+    if (head == 0) {
+        phase ^= 1;                     // One pass ended on the last record
+    }
+
+    // Only the record at the head can be torn, and only once the ring is full
+    tornHead = (count == EELOG_RECORDS) && recordTorn(head);
+}
+
+void eeLogSample(uint16_t duty, uint16_t adcValue) {
+    uint32_t now = tickNow();
+
+    if (!logging || dumping || writing()) {
+        return;
+    }
+    if (sampled && now - lastSample < intervalTicks) {
+        return;
+    }
+    sampled = 1;
+    lastSample = now;
+
+    duty >>= PWM_RESOLUTION_BITS - EELOG_DUTY_BITS;
+    if (duty > DUTY_MAX) {
+        duty = DUTY_MAX;                // PWM_PERIOD itself
+    }
+    record[0] = (phase ? WORD0_PHASE : 0)
+              | ((now >> EELOG_STAMP_SHIFT) & EELOG_STAMP_MASK);
+    record[1] = (phase ? WORD1_CHECK : 0) | (duty << 10) | (adcValue & ADC_MASK);
+
+    // Word 1 goes first; the job is free, checked above
+    eepromWrite(EEPROM_JOB_LOG, 2 * head, record, 2);
+
+    tornHead = 0;                       // Being overwritten
+    if (++head == EELOG_RECORDS) {
+        head = 0;
+        phase ^= 1;                     // Next pass
+    }
+    if (count < EELOG_RECORDS) {
+        count++;
+    }
+}
+
+void setLogging(uint8_t enabled, uint16_t interval) {
+    logging = enabled;
+    if (interval) {
+        intervalMs = interval;
+        intervalTicks = MS_TO_TICKS(interval);
+    }
+}
+
+uint8_t getLogging() {
+    return logging;
+}
+
+uint16_t getLogInterval() {
+    return intervalMs;
+}
+
+uint8_t getLogCount() {
+    return count - tornHead;
+}
+
+uint8_t startLogDump() {
+    if (dumping || eepromJobBusy(EEPROM_JOB_ERASE)) {
+        return 0;
+    }
+    dumping = 1;
+    dumpFirst = (count < EELOG_RECORDS) ? 0 : head + tornHead;
+    if (dumpFirst == EELOG_RECORDS) {
+        dumpFirst = 0;
+    }
+    dumpCount = count - tornHead;
+    dumpSent = 0;
+    return 1;
+}
+
+uint8_t logDumping() {
+    return dumping;
+}
+
+void continueLogDump() {
+    uint8_t payload[2 + 4 * EELOG_DUMP_RECORDS];
+
+    // The EEPROM cannot be read mid-write; EVT_NVM brings us back
+    if (!dumping || eepromBusy()) {
+        return;
+    }
+
+    // An empty log still gets one frame, so the host sees the end
+    do {
+        uint8_t records = dumpCount - dumpSent;
+
+        if (records > EELOG_DUMP_RECORDS) {
+            records = EELOG_DUMP_RECORDS;
+        }
+        payload[0] = dumpSent;
+        payload[1] = dumpCount;
+        for (uint8_t i = 0; i < records; i++) {
+            uint8_t slot = dumpFirst + dumpSent + i;
+
+            if (slot >= EELOG_RECORDS) {
+                slot -= EELOG_RECORDS;
+            }
+
+            putU16(&payload[2 + 4 * i], halEepromRead(2 * slot) & EELOG_STAMP_MASK);
+            putU16(&payload[4 + 4 * i], halEepromRead(2 * slot + 1) & ~WORD1_CHECK);
+        }
+        if (!sendFrame(TELEMETRY_FRAME_LOG, payload, 2 + 4 * records)) {
+            return;                     // Retried on the next EVT_UART_TX
+        }
+        dumpSent += records;
+    } while (dumpSent < dumpCount);
+
+    dumping = 0;
+}
+
+uint8_t clearLog() {
+    if (dumping || eepromJobBusy(EEPROM_JOB_ERASE)) {
+        return 0;
+    }
+    head = 0;
+    count = 0;
+    phase = 0;
+    tornHead = 0;
+    sampled = 0;
+
+    // Top down, so record 0 goes last and a clear cut short by a reset
+    // still reads back as the old log rather than a mix
+    eepromWrite(EEPROM_JOB_ERASE, 0, NULL, EEPROM_LOG_WORDS);
+    return 1;
+}
@@ -0,0 +1,165 @@
+/*
+ * File:   eeLog.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the data EEPROM sample logger. While the
+ *             LED is streaming (the TRANSMIT states), one decimated sample
+ *             every EELOG_INTERVAL_MS is stored in a ring buffer in the
+ *             data EEPROM, so a capture survives when no PC is attached.
+ *             CMD_LOG (command.h) dumps it as TELEMETRY_FRAME_LOG frames.
+ *
+ * Each record is two EEPROM words:
+ *   word 0  [15]     EMPTY    1 in an erased record, 0 once written
+ *           [14]     PHASE    Flips every time the ring wraps
+ *           [13..0]  STAMP    tickNow() >> EELOG_STAMP_SHIFT, wraps
+ *   word 1  [15]     CHECK    PHASE again
+ *           [14..10] DUTY     Channel 0 duty, 0-31 of full scale
+ *           [9..0]   ADC      Channel 0 ADC reading
+ * Word 1 is written before word 0, so a reset between the two leaves the
+ * new DUTY and ADC under the old word 0. Each record is rewritten once per
+ * pass and PHASE flips every pass, so CHECK then differs from PHASE; the
+ * torn record (always the oldest, at the head) is left out of the count
+ * and the dump. In the first pass the old word 0 is erased and the record
+ * reads as EMPTY.
+ *
+ * Wear levelling comes from the ring itself: every record is rewritten
+ * once per pass. No head pointer is stored; eeLogInit() finds the head
+ * where PHASE changes (or the first EMPTY record).
+ *
+ * Records live below the configuration slots (eeprom.h) and are written
+ * through the EEPROM write scheduler; nothing waits for the EEPROM.
+ *
+ * Dump payload (TELEMETRY_FRAME_LOG), oldest record first:
+ *   [0]      FIRST    Position of the first record in this frame
+ *   [1]      COUNT    Records in the whole dump
+ *   [2..]    RECORDS  Up to EELOG_DUMP_RECORDS of:
+ *                     [0..1] STAMP, [2..3] DUTY << 10 | ADC (no CHECK)
+ */
+
+#ifndef EELOG_H
+#define EELOG_H
+
+#include "eeprom.h"
+
+/**
+ * @brief Default time between logged samples
+ *
+ * CMD_LOG can change it. At 5 s the ring holds about 10 minutes, and a
+ * unit streaming around the clock rewrites each word every 10 minutes,
+ * under the 100,000-cycle endurance for about two years.
+ */
+#ifndef EELOG_INTERVAL_MS
+#define EELOG_INTERVAL_MS   5000
+#endif
+
+/**
+ * @brief Log in the TRANSMIT states from reset
+ *
+ * 0 leaves logging off until CMD_LOG starts it.
+ */
+#ifndef EELOG_AUTOSTART
+#define EELOG_AUTOSTART     1
+#endif
+
+/**
+ * @brief Shortest interval CMD_LOG accepts
+ *
+ * One record a second already rewrites every word every two minutes.
+ */
+#define EELOG_MIN_INTERVAL_MS 1000
+
+#define EELOG_RECORDS       (EEPROM_LOG_WORDS / 2)
+#define EELOG_STAMP_SHIFT   15      // About 1.05 s per STAMP at TICK_HZ
+#define EELOG_STAMP_MASK    0x3FFF
+#define EELOG_DUTY_BITS     5
+#define EELOG_DUMP_RECORDS  7       // Per frame: 2 + 7 * 4 bytes of payload
+
+/**
+ * CMD_LOG operations:
+ * - EELOG_STOP:  Stop logging
+ * - EELOG_START: Log in the TRANSMIT states, optionally at a new interval
+ * - EELOG_DUMP:  Send every record, then carry on as before
+ * - EELOG_CLEAR: Erase every record
+ */
+#define EELOG_STOP          0
+#define EELOG_START         1
+#define EELOG_DUMP          2
+#define EELOG_CLEAR         3
+
+/**
+ * @brief Finds the ring's head.
+ *
+ * Call once from init(), after eepromInit(). Reads the whole log, about
+ * 119 word reads.
+ */
+void eeLogInit();
+
+/**
+ * @brief Logs a sample if logging is on and the interval has passed.
+ *
+ * Call from the TRANSMIT states on EVT_ADC. Skipped while a dump or
+ * clear is running or the previous record is still being written.
+ *
+ * @param duty      Channel 0 duty count (0-PWM_PERIOD)
+ * @param adcValue  Channel 0 ADC reading (0-1023)
+ */
+void eeLogSample(uint16_t duty, uint16_t adcValue);
+
+/**
+ * @brief Turns logging on or off.
+ *
+ * @param enabled   1 to log in the TRANSMIT states
+ * @param interval  ms between samples, 0 to keep the current interval
+ */
+void setLogging(uint8_t enabled, uint16_t interval);
+
+/**
+ * @brief Returns 1 if logging is on.
+ */
+uint8_t getLogging();
+
+/**
+ * @brief Returns the ms between logged samples.
+ */
+uint16_t getLogInterval();
+
+/**
+ * @brief Returns the number of records stored.
+ */
+uint8_t getLogCount();
+
+/**
+ * @brief Starts a dump of every record.
+ *
+ * Frames are queued by continueLogDump() as the UART FIFO drains.
+ *
+ * @return 0 if a dump or clear is already running
+ */
+uint8_t startLogDump();
+
+/**
+ * @brief Returns 1 while a dump is being sent.
+ *
+ * The telemetry stream holds off meanwhile, so the dump has the line.
+ */
+uint8_t logDumping();
+
+/**
+ * @brief Queues the next dump frames that fit.
+ *
+ * Call from the main loop on EVT_UART_TX and EVT_NVM. Does nothing unless
+ * a dump is running.
+ */
+void continueLogDump();
+
+/**
+ * @brief Starts erasing every record.
+ *
+ * Takes about a second of EEPROM writes in the background.
+ *
+ * @return 0 if a dump or clear is already running
+ */
+uint8_t clearLog();
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * File:   eeprom.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the data EEPROM write scheduler.
+ */
+
+#include "eeprom.h"
+#include "events.h"
+
+#define JOB_NONE    EEPROM_JOB_COUNT
+
+/**
+ * @brief One queued run of words
+ *
+ * @field words:  Contents, or NULL to erase
+ * @field index:  First word of the run
+ * @field left:   Words still to write, the one in progress included;
+ *                set by the main program only while 0
+ */
+typedef struct {
+    const uint16_t *words;
+    uint8_t index;
+    volatile uint8_t left;
+} EepromJob;
+
+static EepromJob jobs[EEPROM_JOB_COUNT];
+static volatile uint8_t active = JOB_NONE;  // Job being written
+
+/**
+ * @brief Starts the highest word the job has left
+ */
+static void writeNext(uint8_t job) {
+    EepromJob *entry = &jobs[job];
+    uint8_t offset = entry->left - 1;
+
+    halEepromWrite(entry->index + offset,
+                   entry->words ? entry->words[offset] : 0xFFFF);
+}
+
+void eepromInit() {
+    halEepromInit();
+}
+
+uint8_t eepromWrite(uint8_t job, uint8_t index, const uint16_t *words,
+                    uint8_t count) {
+    EepromJob *entry = &jobs[job];
+    uint8_t savedIPL;
+
+    if (entry->left) {
+        return 0;
+    }
+    entry->words = words;
+    entry->index = index;
+
+    // Otherwise the interrupt starts it after the job in progress
+    savedIPL = halMaskInterrupts();
+    entry->left = count;
+    if (active == JOB_NONE) {
+        active = job;
+        writeNext(job);
+    }
+    halRestoreInterrupts(savedIPL);
+    return 1;
+}
+
+uint8_t eepromJobBusy(uint8_t job) {
+    return jobs[job].left != 0;
+}
+
+uint8_t eepromBusy() {
+    // A job is only left pending behind one in progress
+    return active != JOB_NONE;
+}
+
+void eepromService() {
+    if (active == JOB_NONE) {
+        return;
+    }
+    if (--jobs[active].left) {
+        writeNext(active);
+        return;
+    }
+    postEvent(EVT_NVM);
+
+    active = JOB_NONE;
+    for (uint8_t i = 0; i < EEPROM_JOB_COUNT; i++) {
+        if (jobs[i].left) {
+            active = i;
+            writeNext(i);
+            return;
+        }
+    }
+}
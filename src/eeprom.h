@@ -0,0 +1,94 @@
+/*
+ * File:   eeprom.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the data EEPROM write scheduler. The sample
+ *             log (eeLog.h), the stored configuration and the device ID
+ *             (config.h) share the EEPROM, which takes one word at a time and about 4 ms
+ *             per word. Each writer owns a job slot; the write-complete
+ *             interrupt works through one job, then starts the next
+ *             pending one in slot order.
+ *
+ * Layout, in words:
+ *   0 .. EEPROM_CONFIG_BASE - 1            Sample log ring
+ *   EEPROM_CONFIG_BASE .. EEPROM_ID_BASE - 1
+ *                                          Two configuration slots
+ *   EEPROM_ID_BASE .. HAL_EEPROM_WORDS - 1 Device ID and its complement
+ *
+ * Words are read directly with halEepromRead(), but only while
+ * eepromBusy() is 0.
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include "hal.h"
+
+#define EEPROM_ID_WORDS     2
+#define EEPROM_ID_BASE      (HAL_EEPROM_WORDS - EEPROM_ID_WORDS)
+#define EEPROM_CONFIG_WORDS 16          // Two slots of CONFIG_SLOT_WORDS
+#define EEPROM_CONFIG_BASE  (EEPROM_ID_BASE - EEPROM_CONFIG_WORDS)
+#define EEPROM_LOG_WORDS    EEPROM_CONFIG_BASE
+
+/**
+ * Job slots, in the order pending jobs are started:
+ * - EEPROM_JOB_LOG:    One sample log record
+ * - EEPROM_JOB_CONFIG: One configuration slot
+ * - EEPROM_JOB_ID:     The device ID
+ * - EEPROM_JOB_ERASE:  Log clear; last, so it also wipes a record that
+ *                      was queued before it
+ */
+#define EEPROM_JOB_LOG      0
+#define EEPROM_JOB_CONFIG   1
+#define EEPROM_JOB_ID       2
+#define EEPROM_JOB_ERASE    3
+#define EEPROM_JOB_COUNT    4
+
+/**
+ * @brief Enables the write-complete interrupt.
+ *
+ * Call once from init(), before any other EEPROM function.
+ */
+void eepromInit();
+
+/**
+ * @brief Queues a run of words for writing.
+ *
+ * The highest word is written first and the word at index last, so a
+ * record whose first word marks it valid is only valid once complete.
+ * Returns at once; the writes happen in the background.
+ *
+ * @param job    EEPROM_JOB_* slot to use
+ * @param index  First word
+ * @param words  New contents, kept unchanged by the caller until the job
+ *               is done, or NULL to erase the words
+ * @param count  Number of words, at least 1
+ * @return 0 if that job is still busy with an earlier run
+ */
+uint8_t eepromWrite(uint8_t job, uint8_t index, const uint16_t *words,
+                    uint8_t count);
+
+/**
+ * @brief Returns 1 while a job is queued or being written.
+ *
+ * @param job  EEPROM_JOB_* slot
+ */
+uint8_t eepromJobBusy(uint8_t job);
+
+/**
+ * @brief Returns 1 while any job is queued or being written.
+ *
+ * The EEPROM cannot be read meanwhile, and the core must not sleep.
+ */
+uint8_t eepromBusy();
+
+/**
+ * @brief Write-complete interrupt work
+ *
+ * Called from _NVMInterrupt. Starts the next word or the next job, and
+ * posts EVT_NVM whenever a job is done.
+ */
+void eepromService();
+
+#endif
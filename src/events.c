@@ -0,0 +1,39 @@
+/*
+ * File:   events.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Implementation of the interrupt-to-main-loop event flags.
+ */
+
+#include "events.h"
+#include "power.h"
+#include "profile.h"
+
+volatile uint16_t pendingEvents = 0;
+
+uint16_t waitForEvents() {
+    uint16_t events;
+
+    while (1) {
+        halMaskInterrupts();        // Mask interrupts while checking
+        events = pendingEvents;
+        pendingEvents = 0;
+
+        if (events) {
+            halRestoreInterrupts(0);
+            return events;
+        }
+
+        // A masked interrupt still wakes the core from Idle or Sleep, it
+        // just does not vector until the priority is dropped below
+        if (sleepAllowed()) {
+            enterSleep();
+        } else {
+            PROFILE_START(idleStart);
+            halIdle();
+            PROFILE_STOP(PROF_IDLE, idleStart);     // Before the waking ISR runs
+        }
+        halRestoreInterrupts(0);    // Let the waking ISR run and post
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * File:   events.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Header file for the event flags shared between interrupts and
+ *             the main loop. ISRs post events, the main loop idles until one arrives.
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "hal.h"
+
+/**
+ * Event bits:
+ * - EVT_BUTTON:  A debounced button event is ready (takeButtonEvents())
+ * - EVT_ADC:     A new averaged ADC reading was published
+ * - EVT_PATTERN: A pattern finished a pass (looped or reached its end)
+ * - EVT_UART_TX: The UART transmit FIFO has drained
+ * - EVT_BUTTON_WAKE:  A button edge arrived while the clock was too slow
+ *                     to debounce; raise it and start the system tick
+ * - EVT_BUTTONS_IDLE: Debouncing finished and released the system tick
+ * - EVT_UART_RX: Bytes arrived in the UART receive FIFO
+ * - EVT_NVM:     The data EEPROM finished its queued writes
+ * - EVT_INPUT:   A filtered potentiometer reading changed (with EVT_ADC)
+ * - EVT_LATENCY: A latency measurement reached the LED (latency.h)
+ */
+#define EVT_BUTTON   0x0001
+#define EVT_ADC      0x0002
+#define EVT_PATTERN  0x0004
+#define EVT_UART_TX  0x0008
+#define EVT_BUTTON_WAKE  0x0010
+#define EVT_BUTTONS_IDLE 0x0020
+#define EVT_UART_RX  0x0040
+#define EVT_NVM      0x0080
+#define EVT_INPUT    0x0100
+#define EVT_LATENCY  0x0200
+
+// Pending event bits, set from interrupts and consumed by waitForEvents()
+extern volatile uint16_t pendingEvents;
+
+/**
+ * @brief Marks events as pending. Safe to call from any ISR.
+ *
+ * With a constant argument this compiles to single-instruction bit sets,
+ * so it cannot tear against another interrupt.
+ *
+ * @param events Bitmask of EVT_* values
+ */
+static inline void postEvent(uint16_t events) {
+    pendingEvents |= events;
+}
+
+/**
+ * @brief Idles the CPU until at least one event is pending.
+ *
+ * Checks and clears the pending set with interrupts masked, so an event
+ * posted just before Idle() still wakes the core instead of being missed.
+ * Sleeps instead of idling when sleepAllowed() says nothing is running.
+ *
+ * @return Bitmask of the events that were pending
+ */
+uint16_t waitForEvents();
+
+#endif
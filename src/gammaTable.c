@@ -0,0 +1,48 @@
+/*
+ * File:   gammaTable.c
+ * Generated by gen_gamma.py - do not edit by hand.
+ *
+ * Description: Gamma 2.2 brightness curve, 256 entries,
+ *             duty counts out of 1024.
+ */
+
+#include "gammaTable.h"
+
+#if GAMMA_INDEX_BITS != 8 || PWM_PERIOD != 1024
+#error "gammaTable.c is out of date; re-run gen_gamma.py"
+#endif
+
+const uint16_t gammaTable[GAMMA_TABLE_SIZE] = {
+       0,    0,    0,    0,    0,    0,    0,    0,
+       1,    1,    1,    1,    1,    1,    2,    2,
+       2,    3,    3,    3,    4,    4,    5,    5,
+       6,    6,    7,    7,    8,    9,    9,   10,
+      11,   11,   12,   13,   14,   15,   16,   16,
+      17,   18,   19,   20,   21,   23,   24,   25,
+      26,   27,   28,   30,   31,   32,   34,   35,
+      36,   38,   39,   41,   42,   44,   46,   47,
+      49,   51,   52,   54,   56,   58,   60,   61,
+      63,   65,   67,   69,   71,   73,   76,   78,
+      80,   82,   84,   87,   89,   91,   94,   96,
+      99,  101,  104,  106,  109,  111,  114,  117,
+     119,  122,  125,  128,  131,  133,  136,  139,
+     142,  145,  148,  152,  155,  158,  161,  164,
+     168,  171,  174,  178,  181,  184,  188,  191,
+     195,  199,  202,  206,  210,  213,  217,  221,
+     225,  229,  233,  237,  241,  245,  249,  253,
+     257,  261,  265,  269,  274,  278,  282,  287,
+     291,  296,  300,  305,  309,  314,  319,  323,
+     328,  333,  338,  342,  347,  352,  357,  362,
+     367,  372,  377,  383,  388,  393,  398,  404,
+     409,  414,  420,  425,  431,  436,  442,  447,
+     453,  459,  464,  470,  476,  482,  488,  494,
+     499,  505,  511,  518,  524,  530,  536,  542,
+     548,  555,  561,  568,  574,  580,  587,  593,
+     600,  607,  613,  620,  627,  634,  640,  647,
+     654,  661,  668,  675,  682,  689,  696,  704,
+     711,  718,  725,  733,  740,  747,  755,  762,
+     770,  778,  785,  793,  801,  808,  816,  824,
+     832,  840,  848,  856,  864,  872,  880,  888,
+     896,  904,  913,  921,  929,  938,  946,  955,
+     963,  972,  980,  989,  998, 1006, 1015, 1024,
+};
@@ -0,0 +1,27 @@
+/*
+ * File:   gammaTable.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Header file for the generated brightness lookup table.
+ *             gammaTable.c is produced by gen_gamma.py.
+ */
+
+#ifndef GAMMATABLE_H
+#define GAMMATABLE_H
+
+#include <stdint.h>
+#include "PWM.h"
+
+#define GAMMA_INDEX_BITS    8                       // ADC bits used as index
+#define GAMMA_TABLE_SIZE    (1 << GAMMA_INDEX_BITS)
+
+/**
+ * @brief Converts a 10-bit ADC reading to a gammaTable index
+ */
+#define GAMMA_INDEX(adc)    ((adc) >> (10 - GAMMA_INDEX_BITS))
+
+// Duty count (0-PWM_PERIOD) for each index; const, so placed in program memory
+extern const uint16_t gammaTable[GAMMA_TABLE_SIZE];
+
+#endif
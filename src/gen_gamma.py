@@ -0,0 +1,76 @@
+# -*- coding: utf-8 -*-
+"""
+@author: Ahron Ramos, Adrian Co, Zaira Ramji
+
+@description: Generates gammaTable.c, the brightness lookup table that maps
+              the top bits of the ADC reading straight to a PWM duty count.
+              Run by the Makefile before each build; the output is also
+              committed so the project builds without Python.
+
+Usage:
+    python gen_gamma.py [gamma] > gammaTable.c
+"""
+
+import sys
+
+INDEX_BITS = 8              # Table is indexed by ADC >> (10 - INDEX_BITS)
+PWM_PERIOD = 1024           # Must match PWM_PERIOD in PWM.h
+GAMMA = 2.2                 # Perceived brightness ~ duty ^ (1 / GAMMA)
+
+
+def build_table(gamma: float) -> list[int]:
+    """
+    Compute duty counts for each table index.
+
+    Index 0 is fully off and the last index is fully on; every other
+    entry follows duty = PWM_PERIOD * (index / max) ^ gamma.
+
+    Args:
+        gamma: Exponent of the brightness curve (1.0 = linear)
+
+    Returns:
+        List of duty counts, one per index
+    """
+    size = 1 << INDEX_BITS
+    return [round(PWM_PERIOD * (i / (size - 1)) ** gamma) for i in range(size)]
+
+
+def render(table: list[int], gamma: float) -> str:
+    """
+    Format the table as a C source file.
+
+    Args:
+        table: Duty counts from build_table()
+        gamma: Exponent used, recorded in the file header
+
+    Returns:
+        Contents of gammaTable.c
+    """
+    rows = []
+    for start in range(0, len(table), 8):
+        rows.append("    " + ", ".join(f"{v:4d}" for v in table[start:start + 8]) + ",")
+
+    return (
+        "/*\n"
+        " * File:   gammaTable.c\n"
+        " * Generated by gen_gamma.py - do not edit by hand.\n"
+        " *\n"
+        f" * Description: Gamma {gamma} brightness curve, {len(table)} entries,\n"
+        f" *             duty counts out of {PWM_PERIOD}.\n"
+        " */\n"
+        "\n"
+        '#include "gammaTable.h"\n'
+        "\n"
+        f"#if GAMMA_INDEX_BITS != {INDEX_BITS} || PWM_PERIOD != {PWM_PERIOD}\n"
+        '#error "gammaTable.c is out of date; re-run gen_gamma.py"\n'
+        "#endif\n"
+        "\n"
+        "const uint16_t gammaTable[GAMMA_TABLE_SIZE] = {\n"
+        + "\n".join(rows) + "\n"
+        "};\n"
+    )
+
+
+if __name__ == "__main__":
+    gamma = float(sys.argv[1]) if len(sys.argv) > 1 else GAMMA
+    sys.stdout.write(render(build_table(gamma), gamma))
@@ -0,0 +1,120 @@
+# -*- coding: utf-8 -*-
+"""
+@author: Ahron Ramos, Adrian Co, Zaira Ramji
+
+@description: Generates patternTable.c, the waveform tables played by the
+              pattern engine (patternTick() in PWM.c). Each entry is a
+              brightness level the channel's duty count is scaled by, so a
+              step costs one table read and one multiply on the device.
+              Run by the Makefile before each build; the output is also
+              committed so the project builds without Python.
+
+Usage:
+    python gen_pattern.py > patternTable.c
+"""
+
+import math
+import sys
+
+LEVEL_BITS = 12             # Must match PATTERN_LEVEL_BITS in patternTable.h
+LEVEL_MAX = 1 << LEVEL_BITS
+SYSTICK_MS = 4              # Must match SYSTICK_MS in timeDelay.h
+GAMMA = 2.2                 # Same curve as gen_gamma.py
+RAMP_STEPS = 64             # Entries in the fades and the breathing cycle
+CANDLE_SEED = 0x2F          # Fixed, so the table only changes on purpose
+
+
+def perceived(x: float) -> int:
+    """
+    Level for a perceived brightness, so fades look even to the eye.
+
+    Args:
+        x: Perceived brightness, 0.0 to 1.0
+
+    Returns:
+        Level out of LEVEL_MAX
+    """
+    return round(LEVEL_MAX * max(0.0, min(1.0, x)) ** GAMMA)
+
+
+def ramp() -> list[float]:
+    return [i / (RAMP_STEPS - 1) for i in range(RAMP_STEPS)]
+
+
+def breathe() -> list[float]:
+    return [(1 - math.cos(2 * math.pi * i / RAMP_STEPS)) / 2 for i in range(RAMP_STEPS)]
+
+
+def heartbeat() -> list[float]:
+    # 40 ms steps: lub, short gap, softer dub, then rest to one second
+    return [1, 1, 0.4, 0, 0, 0.8, 0.8, 0.3] + [0] * 17
+
+
+def candle() -> list[float]:
+    # Full-period 8-bit LCG; brightness between 60 % and 100 %
+    values = []
+    state = CANDLE_SEED
+    for _ in range(32):
+        state = (state * 77 + 37) & 0xFF
+        values.append(0.6 + 0.4 * state / 255)
+    return values
+
+
+# In PATTERN_* order: (name, C array, levels, loops, ms per step)
+PATTERNS = [
+    ("PATTERN_STEADY",    "steady",    [LEVEL_MAX],                           False, SYSTICK_MS),
+    ("PATTERN_BLINK",     "blink",     [LEVEL_MAX, 0],                        True,  500),
+    ("PATTERN_FADE_IN",   "fadeIn",    [perceived(x) for x in ramp()],        False, 16),
+    ("PATTERN_FADE_OUT",  "fadeOut",   [perceived(x) for x in ramp()][::-1],  False, 16),
+    ("PATTERN_BREATHE",   "breathe",   [perceived(x) for x in breathe()],     True,  48),
+    ("PATTERN_STROBE",    "strobe",    [LEVEL_MAX] + [0] * 7,                 True,  20),
+    ("PATTERN_HEARTBEAT", "heartbeat", [perceived(x) for x in heartbeat()],   True,  40),
+    ("PATTERN_CANDLE",    "candle",    [perceived(x) for x in candle()],      True,  60),
+]
+
+
+def render() -> str:
+    """
+    Format every pattern as a C source file.
+
+    Returns:
+        Contents of patternTable.c
+    """
+    arrays = []
+    entries = []
+    for name, array, levels, loops, step_ms in PATTERNS:
+        assert len(levels) <= 255, f"{name} is too long for PatternTable.length"
+        assert step_ms % SYSTICK_MS == 0, f"{name} step is not whole system ticks"
+
+        rows = []
+        for start in range(0, len(levels), 8):
+            rows.append("    " + ", ".join(f"{v:4d}" for v in levels[start:start + 8]) + ",")
+        arrays.append(f"static const uint16_t {array}[{len(levels)}] = {{\n"
+                      + "\n".join(rows) + "\n};\n")
+        entries.append(f"    [{name}] = {{{array}, {len(levels)}, {int(loops)}, {step_ms}}},")
+
+    return (
+        "/*\n"
+        " * File:   patternTable.c\n"
+        " * Generated by gen_pattern.py - do not edit by hand.\n"
+        " *\n"
+        f" * Description: {len(PATTERNS)} waveform tables, levels out of {LEVEL_MAX},\n"
+        f" *             gamma {GAMMA} where the level follows a curve.\n"
+        " */\n"
+        "\n"
+        '#include "patternTable.h"\n'
+        "\n"
+        f"#if PATTERN_LEVEL_BITS != {LEVEL_BITS} || PATTERN_COUNT != {len(PATTERNS)}"
+        f" || SYSTICK_MS != {SYSTICK_MS}\n"
+        '#error "patternTable.c is out of date; re-run gen_pattern.py"\n'
+        "#endif\n"
+        "\n"
+        + "\n".join(arrays) + "\n"
+        "const PatternTable patternTables[PATTERN_COUNT] = {\n"
+        + "\n".join(entries) + "\n"
+        "};\n"
+    )
+
+
+if __name__ == "__main__":
+    sys.stdout.write(render())
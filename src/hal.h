@@ -0,0 +1,283 @@
+/*
+ * File:   hal.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Hardware abstraction layer. Every other header includes
+ *             this one instead of the device headers, so the control
+ *             logic builds both for the PIC24 and on a host PC.
+ *
+ * The interface is split between this header and the driver headers:
+ *   hal.h          Interrupt masking, Idle/Sleep, UART2, buttons, PWM
+ *                  output, data EEPROM and the oscillator switch
+ *   timeDelay.h    Free-running tick, system tick and delays
+ *   ADC.h          Potentiometer and light sensor readings
+ *   UART2.h        Transmit and receive FIFOs (portable, on top of the
+ *                  halUart*() calls below)
+ *   clkChange.h    Clock modes (portable, on top of halClockSwitch())
+ *
+ * PIC24 implementation: hal_pic24.c, timeDelay.c and ADC.c.
+ * Host implementation:  host/hal_host.c, built with HAL_HOST defined
+ *                       (see host/Makefile). Its simulation controls
+ *                       are declared in host/hal_host.h.
+ *
+ * Code that only uses these interfaces (stateMachine.c, PWM.c, IOs.c,
+ * telemetry.c, command.c, control.c, events.c, power.c, profile.c,
+ * clkChange.c, UART2.c, eeprom.c, eeLog.c, config.c) must not touch SFRs
+ * directly.
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef HAL_HOST
+#include "host/hal_host.h"
+#else
+#include <xc.h>
+#include <p24F16KA101.h>
+#endif
+
+// ---- Interrupts ----
+
+#ifndef HAL_HOST
+/**
+ * @brief Masks every maskable interrupt.
+ *
+ * A masked interrupt keeps its flag and vectors once the level drops.
+ *
+ * @return Previous priority level, for halRestoreInterrupts()
+ */
+static inline uint8_t halMaskInterrupts() {
+    uint8_t level = SRbits.IPL;
+
+    SRbits.IPL = 7;
+    return level;
+}
+
+/**
+ * @brief Returns to a priority level saved by halMaskInterrupts().
+ *
+ * @param level 0 lets every interrupt in
+ */
+static inline void halRestoreInterrupts(uint8_t level) {
+    SRbits.IPL = level;
+}
+
+// ---- Power ----
+
+/**
+ * @brief Stops the CPU until an interrupt; peripherals keep running.
+ */
+static inline void halIdle() {
+    Idle();
+}
+
+/**
+ * @brief Stops the CPU and the peripheral clocks until an interrupt.
+ */
+static inline void halSleep() {
+    Sleep();
+}
+
+// ---- UART ----
+
+/**
+ * @brief Raises the TX interrupt so TxServiceUART2() runs.
+ */
+static inline void halUartKick() {
+    IFS1bits.U2TXIF = 1;
+}
+
+/**
+ * @brief Reports whether the hardware TX FIFO is full.
+ */
+static inline uint8_t halUartTxFull() {
+    return U2STAbits.UTXBF;
+}
+
+/**
+ * @brief Reports whether the last byte has left the shift register.
+ */
+static inline uint8_t halUartTxDone() {
+    return U2STAbits.TRMT;
+}
+
+/**
+ * @brief Puts one byte in the hardware TX FIFO.
+ */
+static inline void halUartWrite(char character) {
+    U2TXREG = character;
+}
+
+/**
+ * @brief Reports whether a received byte is waiting.
+ */
+static inline uint8_t halUartRxReady() {
+    return U2STAbits.URXDA;
+}
+
+/**
+ * @brief Takes one received byte.
+ */
+static inline char halUartRead() {
+    return U2RXREG;
+}
+
+/**
+ * @brief Clears a receive overrun, which stops reception until cleared.
+ *
+ * @return 1 if bytes were lost to an overrun
+ */
+static inline uint8_t halUartRxOverrun() {
+    if (!U2STAbits.OERR) {
+        return 0;
+    }
+    U2STAbits.OERR = 0;
+    return 1;
+}
+
+/**
+ * @brief Sets the baud rate generator.
+ *
+ * @param brg U2BRG value (BRGH = 1)
+ */
+static inline void halUartSetBaud(uint16_t brg) {
+    U2BRG = brg;
+}
+#endif
+
+/**
+ * @brief Configures UART2 (RB0 TX, RB1 RX, 8N1) and its interrupts.
+ *
+ * Both interrupts run at priority 3 and call TxServiceUART2() and
+ * RxServiceUART2() (UART2.h).
+ *
+ * @param brg U2BRG value (BRGH = 1)
+ */
+void halUartInit(uint16_t brg);
+
+// ---- Deep Sleep ----
+
+/**
+ * @brief Enters Deep Sleep; the core comes back through reset.
+ *
+ * @param retained Word kept across Deep Sleep for halDeepSleepWake()
+ */
+void halDeepSleep(uint16_t retained);
+
+/**
+ * @brief Checks whether this reset was a wake from Deep Sleep.
+ *
+ * On a Deep Sleep wake, clears the wake flag and releases the I/O pins,
+ * which call this after configuring them again.
+ *
+ * @param retained Set to the word given to halDeepSleep() if it survived
+ *                 intact; left alone otherwise
+ * @return 1 after a Deep Sleep wake, 0 after any other reset
+ */
+uint8_t halDeepSleepWake(uint16_t *retained);
+
+// ---- Clock ----
+
+/**
+ * @brief Switches the oscillator with interrupts masked.
+ *
+ * @param clkval 8 (8 MHz), 500 (500 kHz) or 32 (32 kHz)
+ */
+void halClockSwitch(unsigned int clkval);
+
+// ---- Buttons ----
+
+#define HAL_BUTTON_COUNT 3
+
+/**
+ * @brief Configures the button inputs and their change notification.
+ *
+ * Pull-ups enabled; any edge raises _CNInterrupt (priority 6).
+ */
+void halButtonsInit();
+
+/**
+ * @brief Reads the raw level of one button.
+ *
+ * @param index 0 for PB1 to HAL_BUTTON_COUNT - 1
+ * @return 1 when released (pulled up), 0 when pressed
+ */
+uint8_t halButtonLevel(uint8_t index);
+
+// ---- PWM output ----
+
+/**
+ * @brief LED outputs the PWM backend can drive
+ *
+ * OC1, the only output compare module, drives a single LED. The software
+ * backend toggles up to three pins from one Timer1 timebase.
+ */
+#define HAL_PWM_MAX_CHANNELS 3
+
+/**
+ * @brief Configures the LED pins and the PWM timebase for PWM_BACKEND.
+ *
+ * Leaves the LEDs off.
+ */
+void halPwmInit();
+
+/**
+ * @brief Starts the shared PWM timebase.
+ *
+ * Set each channel's duty with halPwmSetDuty() first.
+ *
+ * @param period Duty counts per PWM period
+ */
+void halPwmStart(uint16_t period);
+
+/**
+ * @brief Stops the PWM timebase and drives the LEDs low.
+ */
+void halPwmStop();
+
+/**
+ * @brief Sets a channel's duty count from the next PWM period.
+ *
+ * Only stages the value: the output switches at a period boundary, so a
+ * period is never cut short or stretched. Lock-free and safe to call
+ * from any context; if calls race, the last one wins.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1
+ * @param duty     Duty count (0 to period)
+ */
+void halPwmSetDuty(uint8_t channel, uint16_t duty);
+
+// ---- Data EEPROM ----
+
+#define HAL_EEPROM_WORDS 256    // 512 bytes
+
+/**
+ * @brief Enables the NVM write-complete interrupt.
+ *
+ * It runs at priority 1 and calls eepromService() (eeprom.h).
+ */
+void halEepromInit();
+
+/**
+ * @brief Reads one data EEPROM word.
+ *
+ * Not while a write is in progress.
+ *
+ * @param index 0 to HAL_EEPROM_WORDS - 1
+ */
+uint16_t halEepromRead(uint8_t index);
+
+/**
+ * @brief Starts erasing and writing one data EEPROM word.
+ *
+ * Returns at once; the write takes about 4 ms and ends with the
+ * write-complete interrupt. Start the next one from there, never while
+ * a write is in progress.
+ *
+ * @param index  0 to HAL_EEPROM_WORDS - 1
+ * @param value  New contents; 0xFFFF leaves the word erased
+ */
+void halEepromWrite(uint8_t index, uint16_t value);
+
+#endif
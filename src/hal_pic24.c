@@ -0,0 +1,340 @@
+/*
+ * File:   hal_pic24.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: PIC24F16KA101 implementation of the hardware abstraction
+ *             layer (hal.h): Deep Sleep, oscillator switching, button
+ *             inputs, UART2, the PWM output for both PWM backends and the
+ *             data EEPROM.
+ */
+
+#include "hal.h"
+#include "PWM.h"
+#include "UART2.h"
+#include "profile.h"
+#include "eeprom.h"
+#include "latency.h"
+
+/**
+ * Pin Definitions:
+ * - PB1: Push button 1 on RA2 (CN30)
+ * - PB2: Push button 2 on RB4 (CN1)
+ * - PB3: Push button 3 on RA4 (CN0)
+ * - LED: RA6/OC1 or RB8 depending on PWM_BACKEND (see PWM.h)
+ * - LED1, LED2: RB9 (pin 13) and RB7 (pin 11) for PWM_CHANNELS > 1
+ */
+#define PB1 PORTAbits.RA2
+#define PB2 PORTBbits.RB4
+#define PB3 PORTAbits.RA4
+
+#if PWM_BACKEND == PWM_BACKEND_OC
+#define LED_TRIS    TRISAbits.TRISA6    // OC1 is fixed to RA6 (pin 14)
+#define LED         LATAbits.LATA6      // Pin level while OC1 is disabled
+#else
+// Every software PWM channel is on PORTB, so one LATB write updates them all
+static const uint16_t LED_MASKS[HAL_PWM_MAX_CHANNELS] = {
+    1 << 8,                             // RB8 (pin 12)
+    1 << 9,                             // RB9 (pin 13)
+    1 << 7,                             // RB7 (pin 11)
+};
+static uint16_t ledMaskAll = 0;         // LED_MASKS of the PWM_CHANNELS in use
+static uint8_t pwmCounter = 0;          // Software PWM position within period
+
+// Duty handoff: writers stage into dutyShadow and raise dutyPublished; the
+// ISR copies every channel into dutyActive at the next period boundary
+static volatile uint16_t dutyShadow[PWM_CHANNELS];
+static volatile uint8_t dutyPublished = 0;
+static uint8_t dutyActive[PWM_CHANNELS];    // ISR-owned, in PWM_SW_STEPS
+#endif
+
+// The whole data EEPROM; noload keeps programming the part from erasing it
+static int __attribute__((space(eedata), noload)) eeData[HAL_EEPROM_WORDS];
+
+// ---- Power ----
+
+// DSGPR0 holds the retained word, DSGPR1 its complement as a validity check
+void halDeepSleep(uint16_t retained) {
+    DSGPR0 = retained;
+    DSGPR1 = ~retained;
+
+    asm volatile ("disi #4");           // DSEN must be set right before PWRSAV
+    DSCONbits.DSEN = 1;
+    DSCONbits.DSEN = 1;
+    Sleep();                            // Wakes through reset
+}
+
+uint8_t halDeepSleepWake(uint16_t *retained) {
+    if (!RCONbits.DPSLP) {
+        return 0;                       // Power-on or other reset
+    }
+    RCONbits.DPSLP = 0;
+
+    if ((uint16_t)(DSGPR0 ^ DSGPR1) == 0xFFFF) {
+        *retained = DSGPR0;
+    }
+    DSCONbits.RELEASE = 0;              // Pins are configured again; unlatch them
+    return 1;
+}
+
+// ---- Clock ----
+
+void halClockSwitch(unsigned int clkval) {
+    uint8_t COSCNOSC;
+    uint8_t savedIPL;
+    switch(clkval) {
+        case 8: // 8 MHz
+            COSCNOSC = 0x00;
+            break;
+        case 500: // 500 kHz
+            COSCNOSC = 0x66;
+            break;
+        case 32: // 32 kHz
+            COSCNOSC = 0x55;
+            break;
+        default:
+            COSCNOSC = 0x55;
+    }
+    savedIPL = halMaskInterrupts();
+    CLKDIVbits.RCDIV = 0;
+    __builtin_write_OSCCONH(COSCNOSC);
+    __builtin_write_OSCCONL(0x01);
+    while(OSCCONbits.OSWEN==1) {}
+    halRestoreInterrupts(savedIPL);
+}
+
+// ---- Buttons ----
+
+void halButtonsInit() {
+    // ---- Button 1 Configuration (RA2) ----
+    TRISAbits.TRISA4 = 1;     // Set RA4 as input
+    CNPU1bits.CN0PUE = 1;     // Enable internal pull-up resistor
+    CNEN1bits.CN0IE = 1;      // Enable change notification interrupt
+
+    // ---- Button 2 Configuration (RB4) ----
+    TRISBbits.TRISB4 = 1;     // Set RB4 as input
+    CNPU1bits.CN1PUE = 1;     // Enable internal pull-up resistor
+    CNEN1bits.CN1IE = 1;      // Enable change notification interrupt
+
+    // ---- Button 3 Configuration (RA4) ----
+    TRISAbits.TRISA2 = 1;     // Set RA2 as input
+    CNPU2bits.CN30PUE = 1;    // Enable internal pull-up resistor
+    CNEN2bits.CN30IE = 1;     // Enable change notification interrupt
+
+    // ---- Change Notification Interrupt Configuration ----
+    IPC4bits.CNIP = 6;        // Set interrupt priority
+    IFS1bits.CNIF = 0;        // Clear interrupt flag
+    IEC1bits.CNIE = 1;        // Enable change notification interrupts
+}
+
+uint8_t halButtonLevel(uint8_t index) {
+    return (index == 0)
+            ? PB1
+            : (index == 1)
+                ? PB2
+                : PB3;
+}
+
+// ---- UART ----
+
+void halUartInit(uint16_t brg) {
+    // Configure I/O pins
+    TRISBbits.TRISB0 = 0;           // TX output
+    TRISBbits.TRISB1 = 1;           // RX input
+    LATBbits.LATB0 = 1;             // TX idle high
+
+    // Configure UART2: 8-bit, no parity, 1 stop bit, high-speed mode
+    U2MODE = 0x0008;                // BRGH = 1 (16x clock)
+    U2BRG = brg;
+
+    // Configure TX interrupts and enable UART
+    U2STA = 0x0000;                 // Interrupt when a byte moves to the shift register
+    IFS1bits.U2TXIF = 0;            // Clear TX flag
+    IPC7bits.U2TXIP = 3;            // TX priority
+    IEC1bits.U2TXIE = 1;            // Enable TX interrupt
+
+    // Configure RX interrupts
+    IFS1bits.U2RXIF = 0;            // Clear RX flag
+    IPC7bits.U2RXIP = 3;            // RX priority
+    IEC1bits.U2RXIE = 1;            // Enable RX interrupt
+
+    U2MODEbits.UARTEN = 1;          // Enable UART
+    U2STAbits.UTXEN = 1;            // Enable transmitter
+}
+
+void __attribute__((interrupt, no_auto_psv)) _U2TXInterrupt(void) {
+    IFS1bits.U2TXIF = 0;
+    TxServiceUART2();
+}
+
+void __attribute__((interrupt, no_auto_psv)) _U2RXInterrupt(void) {
+    IFS1bits.U2RXIF = 0;
+    RxServiceUART2();
+}
+
+// ---- PWM output ----
+
+void halPwmInit() {
+#if PWM_BACKEND == PWM_BACKEND_OC
+    LED_TRIS = 0;                   // LED pin as output
+    LED = 0;                        // Start with LED off
+
+    // Timer2 becomes the PWM timebase
+    T2CONbits.TCKPS = 0;            // Timer2 prescaler: 1:1
+    IEC0bits.T2IE = 0;              // No interrupt needed per PWM period
+
+    // Output Compare 1 in PWM mode
+    OC1CON = 0;                     // Disabled until startPWM()
+    OC1CONbits.OCTSEL = 0;          // Timer2 is the time base
+    OC1CONbits.OCSIDL = 0;          // Keep running in CPU idle mode
+#else
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        ledMaskAll |= LED_MASKS[i];
+    }
+    TRISB &= ~ledMaskAll;           // LED pins as outputs
+    LATB &= ~ledMaskAll;            // Start with the LEDs off
+#endif
+}
+
+void halPwmStart(uint16_t period) {
+#if PWM_BACKEND == PWM_BACKEND_OC
+    // Period is PR2 + 1 counts; output stays high when OC1R > PR2
+    PR2 = period - 1;
+    TMR2 = 0;
+    OC1R = OC1RS;                   // First period uses the duty already set
+    OC1CONbits.OCM = 0b110;         // PWM mode, fault pin disabled
+    T2CONbits.TON = 1;              // Start the timebase
+#else
+    (void)period;                   // Fixed at PWM_SW_STEPS
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        dutyActive[i] = dutyShadow[i] >> PWM_SW_SHIFT;
+    }
+    dutyPublished = 0;
+    pwmCounter = 0;
+    startTimer1(PWM_SW_TICK);
+#endif
+}
+
+void halPwmStop() {
+#if PWM_BACKEND == PWM_BACKEND_OC
+    OC1CONbits.OCM = 0b000;         // Release the pin back to LATA6
+    T2CONbits.TON = 0;
+    TMR2 = 0;
+    LED = 0;
+#else
+    stopTimer1();
+    LATB &= ~ledMaskAll;
+#endif
+}
+
+/**
+ * OC1RS is double-buffered by hardware and only copied into OC1R at the
+ * next Timer2 period match. The software backend does the same with
+ * dutyShadow: one word write per channel, then one flag byte, so neither
+ * side ever masks interrupts.
+ */
+void halPwmSetDuty(uint8_t channel, uint16_t duty) {
+#if PWM_BACKEND == PWM_BACKEND_OC
+    (void)channel;                  // PWM_CHANNELS is 1
+    OC1RS = duty;
+#if LATENCY_ENABLED
+    IFS0bits.T2IF = 0;              // The next period match loads OC1RS
+    IEC0bits.T2IE = 1;
+#endif
+#else
+    dutyShadow[channel] = duty;     // Single word write, never torn
+    dutyPublished = 1;              // After the value, so the ISR sees both
+#endif
+}
+
+#if PWM_BACKEND == PWM_BACKEND_TIMER1
+/**
+ * @brief Timer 1 interrupt service routine for PWM generation.
+ *
+ * Implements software PWM by:
+ * 1. Incrementing counter within PWM period
+ * 2. Taking newly published duty cycles when a period starts
+ * 3. Setting every LED from one counter vs duty cycle comparison each
+ *
+ * PWM Operation:
+ * - Counter cycles from 0 to PWM_SW_STEPS-1
+ * - LED turns on when counter < duty cycle scaled to PWM_SW_STEPS
+ * - Duty cycles only change at counter 0, so no period is cut short
+ * - All channels share the counter, so each extra channel costs one
+ *   comparison rather than another interrupt
+ */
+void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void) {
+    PROFILE_START(start);
+    uint16_t on = 0;
+
+    // Increment and wrap PWM counter within period (power of two)
+    pwmCounter = (pwmCounter + 1) & (PWM_SW_STEPS - 1);
+
+    // Period boundary: swap in every channel staged since the last one
+    if (pwmCounter == 0 && dutyPublished) {
+        dutyPublished = 0;          // Before the reads, so a racing publish is kept
+        for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+            dutyActive[i] = dutyShadow[i] >> PWM_SW_SHIFT;
+        }
+        LATENCY_STAGE(LAT_OUTPUT);
+    }
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        // LED on when counter less than duty cycle
+        if (pwmCounter < dutyActive[i]) {
+            on |= LED_MASKS[i];
+        }
+    }
+    LATB = (LATB & ~ledMaskAll) | on;
+    PROFILE_STOP(PROF_PWM_SW, start);
+
+    IFS0bits.T1IF = 0;  // Clear Timer1 interrupt flag
+}
+#endif
+
+#if PWM_BACKEND == PWM_BACKEND_OC && LATENCY_ENABLED
+/**
+ * @brief Timer 2 interrupt service routine, latency builds only.
+ *
+ * Enabled by halPwmSetDuty() for the period match that starts the first
+ * period with the new duty, then off again.
+ */
+void __attribute__((interrupt, no_auto_psv)) _T2Interrupt(void) {
+    LATENCY_STAGE(LAT_OUTPUT);
+    IEC0bits.T2IE = 0;
+    IFS0bits.T2IF = 0;  // Clear Timer2 interrupt flag
+}
+#endif
+
+// ---- Data EEPROM ----
+
+void halEepromInit() {
+    IFS0bits.NVMIF = 0;             // Clear flag
+    IPC3bits.NVMIP = 1;             // Below everything else
+    IEC0bits.NVMIE = 1;             // Interrupt at the end of each write
+}
+
+uint16_t halEepromRead(uint8_t index) {
+    uint16_t savedPage = TBLPAG;
+    uint16_t value;
+
+    TBLPAG = __builtin_tblpage(eeData);
+    value = __builtin_tblrdl(__builtin_tbloffset(eeData) + 2 * index);
+    TBLPAG = savedPage;
+    return value;
+}
+
+void halEepromWrite(uint8_t index, uint16_t value) {
+    uint16_t savedPage = TBLPAG;
+
+    NVMCON = 0x4004;                // One data EEPROM word, erased first (PGMONLY = 0)
+    TBLPAG = __builtin_tblpage(eeData);
+    __builtin_tblwtl(__builtin_tbloffset(eeData) + 2 * index, value);
+    __builtin_write_NVM();          // Unlock sequence and WR; does not wait
+    TBLPAG = savedPage;
+}
+
+void __attribute__((interrupt, no_auto_psv)) _NVMInterrupt(void) {
+    IFS0bits.NVMIF = 0;
+    eepromService();
+}
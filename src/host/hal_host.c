@@ -0,0 +1,675 @@
+/*
+ * File:   hal_host.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Host PC simulation behind hal.h, timeDelay.h and ADC.h.
+ *             Replaces hal_pic24.c, timeDelay.c, ADC.c and main.c's
+ *             interrupt handlers in the HAL_HOST build.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "timeDelay.h"
+#include "ADC.h"
+#include "UART2.h"
+#include "IOs.h"
+#include "PWM.h"
+#include "clkChange.h"
+#include "events.h"
+#include "telemetry.h"
+#include "latency.h"
+#include "control.h"
+#include "eeprom.h"
+#include "adcFilter.h"
+
+#define SIM_SYSTICK_TICKS   MS_TO_TICKS(SYSTICK_MS)
+#define SIM_UART_FIFO_DEPTH 4           // Hardware TX FIFO, as on the PIC24
+#define SIM_RX_BUFFER_SIZE  256
+#define SIM_EEPROM_WRITE_TICKS MS_TO_TICKS(4)   // Erase and write of one word
+
+volatile uint8_t simIPL = 0;
+
+// ---- Time ----
+static uint32_t simTick = 0;
+static uint32_t simCycles = 0;
+static uint32_t cycleRemainder = 0;     // Fraction of a cycle, in 1 / TICK_HZ
+static uint8_t sysTickUsers = 0;
+static uint32_t nextSysTick = 0;
+
+// ---- ADC ----
+static uint8_t adcRunning = 0;
+static uint32_t nextAdcFill = 0;
+static uint16_t potValues[PWM_CHANNELS];
+static uint8_t potNoise = 0;            // +/- LSBs added to each reading
+static uint16_t noiseSeed = 1;
+static uint16_t (*sensorModel)(uint16_t duty) = NULL;
+static uint16_t adcLatest[PWM_CHANNELS];
+static uint16_t adcTick = 0;
+static uint8_t adcReady = 0;
+static uint16_t sensorLatest = 0;
+
+// ---- UART ----
+static uint16_t uartBrg = 0;
+static uint8_t txFifo = 0;              // Bytes in the hardware TX FIFO
+static char txFifoData[SIM_UART_FIFO_DEPTH];
+static uint8_t txShifting = 0;          // A byte is in the shift register
+static uint32_t txShiftDone = 0;        // Tick when it has been sent
+static uint8_t capture[SIM_UART_CAPTURE_SIZE];
+static uint32_t captureHead = 0;
+static uint32_t captureTail = 0;
+static uint8_t rxData[SIM_RX_BUFFER_SIZE];
+static uint16_t rxHead = 0;
+static uint16_t rxTail = 0;
+
+// ---- Pins and power ----
+static uint8_t buttonLevels[HAL_BUTTON_COUNT] = {1, 1, 1};
+static uint8_t buttonsEnabled = 0;
+static uint16_t pwmDuty[HAL_PWM_MAX_CHANNELS];   // In force this period
+static uint16_t pwmStaged[HAL_PWM_MAX_CHANNELS]; // Set by halPwmSetDuty()
+static uint8_t pwmPublished = 0;        // Staged since the last period began
+static uint8_t pwmRunning = 0;
+static uint32_t pwmPeriodCycles = 0;
+static uint32_t pwmNextPeriod = 0;      // simCycles at the next period start
+static unsigned int clockValue = 500;
+static uint16_t deepSleeps = 0;
+static uint16_t eepromInverted[HAL_EEPROM_WORDS];   // ~contents: zeroed is erased
+static uint8_t eepromWriting = 0;
+static uint32_t eepromWriteDone = 0;
+static void (*stallHook)(void) = NULL;
+static void (*tickHook)(uint32_t tick) = NULL;
+
+// ---- Simulated interrupts ----
+
+// Pending interrupt flags, highest priority first
+#define IRQ_CN          0x01
+#define IRQ_ADC         0x02
+#define IRQ_SYSTICK     0x04
+#define IRQ_UART_TX     0x08
+#define IRQ_UART_RX     0x10
+#define IRQ_NVM         0x20
+#define IRQ_PWM         0x40            // Period start after a new duty
+
+static uint8_t pendingIrqs = 0;
+
+/**
+ * @brief Mirrors the system tick ISR in main.c
+ */
+static void sysTickInterrupt() {
+    uint8_t savedIPL = halMaskInterrupts();
+
+    if ((sysTickUsers & SYSTICK_BUTTONS) && !IOcheck()) {
+        releaseSysTick(SYSTICK_BUTTONS);
+        postEvent(EVT_BUTTONS_IDLE);
+    }
+    halRestoreInterrupts(savedIPL);
+
+    patternTick();
+}
+
+/**
+ * @brief Mirrors the change notification ISR in main.c
+ */
+static void changeInterrupt() {
+    LATENCY_EDGE();
+    if (getClockMode() < CLOCK_BUTTONS) {
+        postEvent(EVT_BUTTON_WAKE);
+    } else {
+        requestSysTick(SYSTICK_BUTTONS);
+    }
+}
+
+/**
+ * @brief One potentiometer reading, with the noise from simSetPotNoise()
+ */
+static uint16_t potReading(uint8_t channel) {
+    int16_t value = potValues[channel];
+
+    if (potNoise) {
+        noiseSeed = noiseSeed * 25173 + 13849;      // 16-bit LCG
+        value += (int16_t)((noiseSeed >> 8) % (2 * potNoise + 1)) - potNoise;
+    }
+    return (value < 0) ? 0 : (value > 1023) ? 1023 : value;
+}
+
+/**
+ * @brief Mirrors the ADC buffer-full ISR in ADC.c
+ */
+static void adcInterrupt() {
+    uint8_t changed = 0;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        uint16_t sum = 0;
+        uint16_t reading;
+
+        for (uint8_t pass = 0; pass < ADC_SCAN_PASSES; pass++) {
+            sum += potReading(i);
+        }
+        reading = adcFilterStep(i, sum);
+        changed |= (reading != adcLatest[i]);
+        adcLatest[i] = reading;
+    }
+    sensorLatest = sensorModel ? sensorModel(pwmControl[0].currentDutyCycle) : 0;
+    adcTick = (uint16_t)simTick;
+    adcReady = 1;
+    telemetryWindowAdd(adcLatest[0]);
+#if ADC_SENSOR_ENABLED
+    controlStep(sensorLatest);
+#endif
+    postEvent(EVT_ADC);
+    if (changed) {
+        postEvent(EVT_INPUT);
+        LATENCY_START(LAT_SOURCE_POT);
+    }
+}
+
+/**
+ * @brief Ticks per UART byte (start, 8 data and stop bits)
+ */
+static uint32_t byteTicks() {
+    uint32_t baud = getClockProfile()->fcy / (4UL * (uartBrg + 1));
+    uint32_t ticks = 10 * TICK_HZ / (baud ? baud : 1);
+
+    return ticks ? ticks : 1;
+}
+
+/**
+ * @brief Moves the next FIFO byte into an idle shift register
+ */
+static void startShift() {
+    if (txShifting || !txFifo) {
+        return;
+    }
+    capture[captureHead % SIM_UART_CAPTURE_SIZE] = (uint8_t)txFifoData[0];
+    for (uint8_t i = 1; i < txFifo; i++) {
+        txFifoData[i - 1] = txFifoData[i];
+    }
+    txFifo--;
+    txShifting = 1;
+    txShiftDone = simTick + byteTicks();
+    pendingIrqs |= IRQ_UART_TX;         // Interrupt when a byte moves to the shift register
+}
+
+/**
+ * @brief Runs the pending interrupts the current priority level lets in.
+ *
+ * Each handler runs at its own priority, as on the PIC24, so only higher
+ * priorities nest inside it.
+ */
+static void deliverInterrupts() {
+    static const struct {
+        uint8_t irq;
+        uint8_t priority;
+    } order[] = {
+        {IRQ_CN, 6},
+        {IRQ_ADC, 5},
+#if PWM_BACKEND == PWM_BACKEND_OC
+        {IRQ_SYSTICK, 2},               // Timer1
+#else
+        {IRQ_SYSTICK, 3},               // Timer2
+#endif
+        {IRQ_UART_TX, 3},
+        {IRQ_UART_RX, 3},
+#if PWM_BACKEND == PWM_BACKEND_OC
+        {IRQ_PWM, 3},                   // Timer2, latency builds
+#else
+        {IRQ_PWM, 2},                   // Timer1
+#endif
+        {IRQ_NVM, 1},
+    };
+    uint8_t i = 0;
+
+    while (i < sizeof(order) / sizeof(order[0])) {
+        uint8_t irq = order[i].irq;
+        uint8_t savedIPL = simIPL;
+
+        if (!(pendingIrqs & irq) || simIPL >= order[i].priority) {
+            i++;
+            continue;
+        }
+        pendingIrqs &= ~irq;
+        simIPL = order[i].priority;
+        switch (irq) {
+            case IRQ_CN:
+                changeInterrupt();
+                break;
+            case IRQ_ADC:
+                adcInterrupt();
+                break;
+            case IRQ_SYSTICK:
+                sysTickInterrupt();
+                break;
+            case IRQ_UART_TX:
+                TxServiceUART2();
+                startShift();
+                break;
+            case IRQ_UART_RX:
+                RxServiceUART2();
+                break;
+            case IRQ_PWM:
+                LATENCY_STAGE(LAT_OUTPUT);
+                break;
+            default:
+                eepromService();
+                break;
+        }
+        simIPL = savedIPL;
+        i = 0;                          // A handler may have raised another
+    }
+}
+
+void halRestoreInterrupts(uint8_t level) {
+    simIPL = level;
+    deliverInterrupts();
+}
+
+static uint8_t anythingScheduled() {
+    return sysTickUsers || adcRunning || txShifting || txFifo || eepromWriting ||
+           pendingIrqs || (pwmRunning && pwmPublished);
+}
+
+static void stall() {
+    if (!stallHook) {
+        fprintf(stderr, "sim: firmware waits at tick %lu with nothing to wake it\n",
+                (unsigned long)simTick);
+        abort();
+    }
+    stallHook();
+}
+
+// ---- hal.h ----
+
+void halIdle() {
+    if (pendingIrqs) {
+        return;                         // A masked interrupt still wakes the core
+    }
+    if (!anythingScheduled()) {
+        stall();
+    }
+    simAdvance(1);
+}
+
+void halSleep() {
+    stall();                            // Timers and peripherals are stopped
+}
+
+void halDeepSleep(uint16_t retained) {
+    (void)retained;
+    deepSleeps++;
+    stall();                            // Returns instead of resetting
+}
+
+uint8_t halDeepSleepWake(uint16_t *retained) {
+    (void)retained;
+    return 0;
+}
+
+void halClockSwitch(unsigned int clkval) {
+    clockValue = clkval;
+}
+
+void halButtonsInit() {
+    buttonsEnabled = 1;
+}
+
+uint8_t halButtonLevel(uint8_t index) {
+    return buttonLevels[index];
+}
+
+void halUartInit(uint16_t brg) {
+    uartBrg = brg;
+}
+
+void halUartSetBaud(uint16_t brg) {
+    uartBrg = brg;
+}
+
+void halUartKick() {
+    pendingIrqs |= IRQ_UART_TX;
+    deliverInterrupts();                // Runs at once unless masked
+}
+
+uint8_t halUartTxFull() {
+    return txFifo == SIM_UART_FIFO_DEPTH;
+}
+
+uint8_t halUartTxDone() {
+    if (txShifting || txFifo) {
+        simAdvance(1);                  // FlushUART2() spins on this
+    }
+    return !txShifting && !txFifo;
+}
+
+void halUartWrite(char character) {
+    if (txFifo < SIM_UART_FIFO_DEPTH) {
+        txFifoData[txFifo++] = character;
+    }
+    startShift();
+}
+
+uint8_t halUartRxReady() {
+    return rxTail != rxHead;
+}
+
+char halUartRead() {
+    char character = (char)rxData[rxTail];
+
+    rxTail = (rxTail + 1) % SIM_RX_BUFFER_SIZE;
+    return character;
+}
+
+uint8_t halUartRxOverrun() {
+    return 0;
+}
+
+void halPwmInit() {
+    for (uint8_t i = 0; i < HAL_PWM_MAX_CHANNELS; i++) {
+        pwmDuty[i] = 0;
+        pwmStaged[i] = 0;
+    }
+    pwmPublished = 0;
+    pwmRunning = 0;
+}
+
+// Periods are counted in instruction cycles, so they stretch with the clock
+void halPwmStart(uint16_t period) {
+#if PWM_BACKEND == PWM_BACKEND_OC
+    pwmPeriodCycles = period;           // PR2 + 1 at a 1:1 prescaler
+#else
+    (void)period;
+    pwmPeriodCycles = (uint32_t)PWM_SW_STEPS * PWM_SW_TICK;
+#endif
+    for (uint8_t i = 0; i < HAL_PWM_MAX_CHANNELS; i++) {
+        pwmDuty[i] = pwmStaged[i];      // First period uses the duty already set
+    }
+    pwmPublished = 0;
+    pwmNextPeriod = simCycles + pwmPeriodCycles;
+    pwmRunning = 1;
+}
+
+void halPwmStop() {
+    pwmRunning = 0;
+}
+
+// Staged duties take over at the next period start, as OC1RS and dutyShadow do
+void halPwmSetDuty(uint8_t channel, uint16_t duty) {
+    pwmStaged[channel] = duty;
+    pwmPublished = 1;
+}
+
+void halEepromInit() {
+}
+
+uint16_t halEepromRead(uint8_t index) {
+    if (eepromWriting) {
+        fprintf(stderr, "sim: EEPROM read during a write at tick %lu\n",
+                (unsigned long)simTick);
+        abort();
+    }
+    return ~eepromInverted[index];
+}
+
+// Takes effect at once; the interrupt follows SIM_EEPROM_WRITE_TICKS later
+void halEepromWrite(uint8_t index, uint16_t value) {
+    if (eepromWriting) {
+        fprintf(stderr, "sim: EEPROM write started during a write at tick %lu\n",
+                (unsigned long)simTick);
+        abort();
+    }
+    eepromInverted[index] = ~value;
+    eepromWriting = 1;
+    eepromWriteDone = simTick + SIM_EEPROM_WRITE_TICKS;
+}
+
+// ---- timeDelay.h ----
+
+void timerInit() {
+}
+
+void startTimer1(uint16_t pr_val) {
+    (void)pr_val;                       // Software PWM is not simulated
+}
+
+void stopTimer1() {
+}
+
+void startTimer2(uint16_t time_ms) {
+    (void)time_ms;
+}
+
+void stopTimer2() {
+}
+
+void requestSysTick(uint8_t user) {
+    if (!sysTickUsers) {
+        nextSysTick = simTick + SIM_SYSTICK_TICKS;
+    }
+    sysTickUsers |= user;
+}
+
+void releaseSysTick(uint8_t user) {
+    sysTickUsers &= ~user;
+}
+
+uint8_t getSysTickUsers() {
+    return sysTickUsers;
+}
+
+void retuneTimers() {
+    if (sysTickUsers) {
+        nextSysTick = simTick + SIM_SYSTICK_TICKS;
+    }
+}
+
+void delay_ms(uint16_t time_ms) {
+    simAdvance(MS_TO_TICKS(time_ms));
+}
+
+uint32_t tickNow() {
+    return simTick;
+}
+
+uint32_t cycleNow() {
+    return simCycles;
+}
+
+uint8_t cycleResolution() {
+    return 0;
+}
+
+// ---- ADC.h ----
+
+void init_ADC() {
+}
+
+void ADC_start() {
+    if (!adcRunning) {
+        adcFilterReset();
+        adcRunning = 1;
+        nextAdcFill = simTick + SIM_ADC_INTERVAL_TICKS;
+    }
+}
+
+void ADC_stop() {
+    adcRunning = 0;
+}
+
+uint16_t ADC_latest() {
+    return ADC_latestChannel(0);
+}
+
+uint16_t ADC_latestChannel(uint8_t channel) {
+    adcReady = 0;
+    return adcLatest[channel];
+}
+
+uint16_t ADC_latestTick() {
+    return adcTick;
+}
+
+uint16_t ADC_latestSensor() {
+    return sensorLatest;
+}
+
+uint8_t ADC_sampleReady() {
+    return adcReady;
+}
+
+uint16_t ADC_readBlocking() {
+    return potValues[0];
+}
+
+uint16_t ADC_readWith(uint8_t samc, uint8_t adcs) {
+    (void)samc;
+    (void)adcs;
+    return potValues[0];
+}
+
+// ---- Simulation controls ----
+
+void simReset() {
+    simIPL = 0;
+    simTick = 0;
+    simCycles = 0;
+    cycleRemainder = 0;
+    sysTickUsers = 0;
+    adcRunning = 0;
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        potValues[i] = 0;
+    }
+    potNoise = 0;
+    noiseSeed = 1;
+    sensorModel = NULL;
+    pendingIrqs = 0;
+    eepromWriting = 0;                  // Contents are kept, as on the part
+    txFifo = 0;
+    txShifting = 0;
+    captureHead = 0;
+    captureTail = 0;
+    rxHead = 0;
+    rxTail = 0;
+    for (uint8_t i = 0; i < HAL_BUTTON_COUNT; i++) {
+        buttonLevels[i] = 1;
+    }
+    halPwmInit();
+    deepSleeps = 0;
+    stallHook = NULL;
+    tickHook = NULL;
+}
+
+void simAdvance(uint32_t ticks) {
+    while (ticks--) {
+        uint32_t fcy = getClockProfile()->fcy;
+
+        simTick++;
+        cycleRemainder += fcy;
+        simCycles += cycleRemainder / TICK_HZ;
+        cycleRemainder %= TICK_HZ;
+
+        if (sysTickUsers && (int32_t)(simTick - nextSysTick) >= 0) {
+            nextSysTick += SIM_SYSTICK_TICKS;
+            pendingIrqs |= IRQ_SYSTICK;
+        }
+        if (adcRunning && (int32_t)(simTick - nextAdcFill) >= 0) {
+            nextAdcFill += SIM_ADC_INTERVAL_TICKS;
+            pendingIrqs |= IRQ_ADC;
+        }
+        if (txShifting && (int32_t)(simTick - txShiftDone) >= 0) {
+            txShifting = 0;
+            captureHead++;              // Byte is on the wire
+            if (captureHead - captureTail > SIM_UART_CAPTURE_SIZE) {
+                captureTail = captureHead - SIM_UART_CAPTURE_SIZE;
+            }
+            startShift();
+        }
+        if (eepromWriting && (int32_t)(simTick - eepromWriteDone) >= 0) {
+            eepromWriting = 0;
+            pendingIrqs |= IRQ_NVM;
+        }
+        if (pwmRunning && (int32_t)(simCycles - pwmNextPeriod) >= 0) {
+            pwmNextPeriod += pwmPeriodCycles * (1 + (simCycles - pwmNextPeriod) / pwmPeriodCycles);
+            if (pwmPublished) {
+                pwmPublished = 0;
+                for (uint8_t i = 0; i < HAL_PWM_MAX_CHANNELS; i++) {
+                    pwmDuty[i] = pwmStaged[i];
+                }
+                pendingIrqs |= IRQ_PWM;
+            }
+        }
+        deliverInterrupts();
+        if (tickHook) {
+            tickHook(simTick);
+        }
+    }
+}
+
+void simSetPot(uint8_t channel, uint16_t value) {
+    potValues[channel] = value;
+}
+
+void simSetPotNoise(uint8_t lsb) {
+    potNoise = lsb;
+}
+
+void simSetSensorModel(uint16_t (*model)(uint16_t duty)) {
+    sensorModel = model;
+}
+
+void simSetButton(uint8_t index, uint8_t level) {
+    if (buttonLevels[index] == level) {
+        return;
+    }
+    buttonLevels[index] = level;
+    if (buttonsEnabled) {
+        pendingIrqs |= IRQ_CN;
+        deliverInterrupts();
+    }
+}
+
+void simUartReceive(const uint8_t *bytes, uint16_t length) {
+    while (length--) {
+        uint16_t next = (rxHead + 1) % SIM_RX_BUFFER_SIZE;
+
+        if (next != rxTail) {
+            rxData[rxHead] = *bytes;
+            rxHead = next;
+        }
+        bytes++;
+    }
+    pendingIrqs |= IRQ_UART_RX;
+    deliverInterrupts();
+}
+
+uint16_t simUartTake(uint8_t *out, uint16_t max) {
+    uint16_t count = 0;
+
+    while (count < max && captureTail != captureHead) {
+        out[count++] = capture[captureTail++ % SIM_UART_CAPTURE_SIZE];
+    }
+    return count;
+}
+
+void simSetStallHook(void (*hook)(void)) {
+    stallHook = hook;
+}
+
+void simSetTickHook(void (*hook)(uint32_t tick)) {
+    tickHook = hook;
+}
+
+uint16_t simPwmDuty(uint8_t channel) {
+    return pwmDuty[channel];
+}
+
+uint8_t simPwmRunning() {
+    return pwmRunning;
+}
+
+unsigned int simClockValue() {
+    return clockValue;
+}
+
+uint16_t simDeepSleeps() {
+    return deepSleeps;
+}
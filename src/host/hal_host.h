@@ -0,0 +1,177 @@
+/*
+ * File:   hal_host.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Host PC side of the hardware abstraction layer (hal.h),
+ *             selected by defining HAL_HOST. Declares what the PIC24 build
+ *             gets inline from hal.h, plus controls for the simulation.
+ *
+ * The simulation is single-threaded. Time only moves in simAdvance(),
+ * which also plays the interrupts that would have fired: the system tick,
+ * ADC buffer fills, UART2 transmit progress, data EEPROM write completion
+ * and the change notification for simSetButton(). The data EEPROM keeps
+ * its contents across simReset(). waitForEvents() advances one tick per halIdle().
+ * Interrupts keep the PIC24 priorities: one raised while masked stays
+ * pending until halRestoreInterrupts() lets it in.
+ */
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdint.h>
+
+/**
+ * @brief ADC buffer fills, in ticks
+ *
+ * 16 conversions of 43 TAD at 2 TCY each at the 500 kHz clock is about
+ * 5.5 ms (172 ticks).
+ */
+#ifndef SIM_ADC_INTERVAL_TICKS
+#define SIM_ADC_INTERVAL_TICKS 172
+#endif
+
+/**
+ * @brief Bytes captured from the UART2 transmitter until simUartTake()
+ */
+#ifndef SIM_UART_CAPTURE_SIZE
+#define SIM_UART_CAPTURE_SIZE 65536
+#endif
+
+// Simulated CPU priority level, 7 while halMaskInterrupts() is in force
+extern volatile uint8_t simIPL;
+
+static inline uint8_t halMaskInterrupts() {
+    uint8_t level = simIPL;
+
+    simIPL = 7;
+    return level;
+}
+
+// Runs the interrupts that became pending while masked
+void halRestoreInterrupts(uint8_t level);
+
+void halIdle();
+void halSleep();
+
+void halUartKick();
+uint8_t halUartTxFull();
+uint8_t halUartTxDone();
+void halUartWrite(char character);
+uint8_t halUartRxReady();
+char halUartRead();
+uint8_t halUartRxOverrun();
+void halUartSetBaud(uint16_t brg);
+
+// ---- Simulation controls ----
+
+/**
+ * @brief Puts the simulated hardware back to its reset state.
+ *
+ * Firmware modules keep their own state; a fresh process is the only
+ * full reset.
+ */
+void simReset();
+
+/**
+ * @brief Moves simulated time forward, running due interrupts.
+ *
+ * @param ticks Ticks at TICK_HZ
+ */
+void simAdvance(uint32_t ticks);
+
+/**
+ * @brief Sets a potentiometer reading seen by the next ADC fills.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1
+ * @param value    0-1023
+ */
+void simSetPot(uint8_t channel, uint16_t value);
+
+/**
+ * @brief Adds pseudo-random noise to every potentiometer reading.
+ *
+ * Each reading of a buffer fill gets its own, uniform in +/- lsb, so the
+ * filter (adcFilter.h) has something to do.
+ *
+ * @param lsb  Noise amplitude in 10-bit LSBs, 0 for none
+ */
+void simSetPotNoise(uint8_t lsb);
+
+/**
+ * @brief Sets how the light sensor responds to the LED.
+ *
+ * @param model Returns the sensor reading (0-1023) for channel 0's duty
+ *              count; NULL for a dark sensor
+ */
+void simSetSensorModel(uint16_t (*model)(uint16_t duty));
+
+/**
+ * @brief Sets a button's pin level, raising the change notification.
+ *
+ * @param index  0 for PB1 to HAL_BUTTON_COUNT - 1
+ * @param level  1 released, 0 pressed
+ */
+void simSetButton(uint8_t index, uint8_t level);
+
+/**
+ * @brief Feeds bytes to the UART2 receiver as if sent by the host.
+ *
+ * @param bytes   Data
+ * @param length  Number of bytes
+ */
+void simUartReceive(const uint8_t *bytes, uint16_t length);
+
+/**
+ * @brief Takes the bytes the firmware has finished transmitting.
+ *
+ * @param out  Destination
+ * @param max  Capacity of out
+ * @return Number of bytes copied
+ */
+uint16_t simUartTake(uint8_t *out, uint16_t max);
+
+/**
+ * @brief Called when the firmware would idle or sleep with nothing able
+ *        to wake it; it must change an input (e.g. simSetButton()).
+ *
+ * Without a hook the simulation aborts instead of hanging.
+ */
+void simSetStallHook(void (*hook)(void));
+
+/**
+ * @brief Called at the end of every simulated tick, for scripted inputs.
+ *
+ * @param hook Receives tickNow(); NULL to remove
+ */
+void simSetTickHook(void (*hook)(uint32_t tick));
+
+/**
+ * @brief Returns the duty count a PWM output runs at this period.
+ *
+ * A halPwmSetDuty() value takes over at the next period start, one
+ * PWM_PERIOD (or PWM_SW_STEPS * PWM_SW_TICK) instruction cycles apart.
+ *
+ * @param channel 0 to HAL_PWM_MAX_CHANNELS - 1
+ */
+uint16_t simPwmDuty(uint8_t channel);
+
+/**
+ * @brief Reports whether the PWM timebase is running.
+ */
+uint8_t simPwmRunning();
+
+/**
+ * @brief Returns the last clkval passed to halClockSwitch() (8, 500 or 32).
+ */
+unsigned int simClockValue();
+
+/**
+ * @brief Returns how many times the firmware entered Deep Sleep.
+ *
+ * halDeepSleep() calls the stall hook and returns on the host instead
+ * of resetting.
+ */
+uint16_t simDeepSleeps();
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * File:   sim_adc_noise.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: What the ADC filter (adcFilter.h) saves with a noisy,
+ *             fixed potentiometer: duty changes in ON_MODE and bytes of
+ *             a TELEMETRY_MODE_CHANGE stream over 10 s, then how long a
+ *             200 LSB step takes to reach the LED. Build with
+ *               make sims CFLAGS_EXTRA="-DADC_OVERSAMPLE_BITS=0 -DADC_EMA_SHIFT=0 -DADC_HYSTERESIS=0"
+ *             for the unfiltered figures.
+ */
+
+#include <stdio.h>
+#include "hal.h"
+#include "sim_app.h"
+#include "timeDelay.h"
+#include "stateMachine.h"
+#include "gammaTable.h"
+#include "telemetry.h"
+#include "command.h"
+
+#define NOISE_LSB       3
+#define MEASURE_TICKS   MS_TO_TICKS(10000)
+
+static uint8_t junk[32768];
+static uint32_t dutyChanges;
+static uint32_t uartBytes;
+static uint16_t lastDuty;
+
+static void countOutput(uint32_t tick) {
+    (void)tick;
+    if (simPwmDuty(0) != lastDuty) {
+        dutyChanges++;
+        lastDuty = simPwmDuty(0);
+    }
+    uartBytes += simUartTake(junk, sizeof(junk));
+}
+
+static void startCount(void) {
+    simUartTake(junk, sizeof(junk));
+    lastDuty = simPwmDuty(0);
+    dutyChanges = 0;
+    uartBytes = 0;
+}
+
+int main(void) {
+    static const uint8_t everyReading[2] = {0, 0};
+    static const uint8_t changeMode[1] = {TELEMETRY_MODE_CHANGE};
+    static const uint8_t streamOn[1] = {1};
+    uint32_t stepAt;
+    uint16_t target = gammaTable[GAMMA_INDEX(800)];
+
+    simAppBoot();
+    simSetPot(0, 600);
+    simSetPotNoise(NOISE_LSB);
+    simSetTickHook(countOutput);
+
+    dispatchEvent(SM_EVENT_PB1);
+    simAppRun(MS_TO_TICKS(500));                // Filter settled
+    startCount();
+    simAppRun(MEASURE_TICKS);
+    printf("ON_MODE, pot 600 +/- %d LSB, 10 s: %lu duty changes\n",
+           NOISE_LSB, (unsigned long)dutyChanges);
+
+    simSendCommand(1, CMD_SET_RATE, everyReading, sizeof(everyReading));
+    simSendCommand(2, CMD_SET_MODE, changeMode, sizeof(changeMode));
+    simSendCommand(3, CMD_STREAM, streamOn, sizeof(streamOn));
+    simAppRun(MS_TO_TICKS(500));
+    startCount();
+    simAppRun(MEASURE_TICKS);
+    printf("TELEMETRY_MODE_CHANGE stream, 10 s: %lu bytes\n", (unsigned long)uartBytes);
+
+    simSetPot(0, 800);
+    stepAt = tickNow();
+    while (simPwmDuty(0) < target - target / 50 && tickNow() - stepAt < MS_TO_TICKS(2000)) {
+        simAppRun(1);
+    }
+    printf("600 -> 800 step: duty within 2%% after %lu ms\n",
+           (unsigned long)((tickNow() - stepAt) * 1000 / TICK_HZ));
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * File:   sim_app.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: init() and the main loop of main.c for host programs.
+ */
+
+#include <setjmp.h>
+#include <stddef.h>
+#include "sim_app.h"
+#include "hal.h"
+#include "timeDelay.h"
+#include "stateMachine.h"
+#include "clkChange.h"
+#include "UART2.h"
+#include "PWM.h"
+#include "ADC.h"
+#include "IOs.h"
+#include "events.h"
+#include "command.h"
+#include "telemetry.h"
+#include "profile.h"
+#include "power.h"
+#include "eeprom.h"
+#include "eeLog.h"
+#include "config.h"
+#include "latency.h"
+
+static uint32_t runEnd;
+static jmp_buf runDone;
+
+/**
+ * @brief Moves a sleeping core on one tick, and ends the run on time
+ */
+static void stallUntilEnd(void) {
+    if (tickNow() >= runEnd) {
+        longjmp(runDone, 1);
+    }
+    simAdvance(1);
+}
+
+/**
+ * @brief main.c's handleStateTransition()
+ */
+static void handleStateTransition(void) {
+    uint16_t events = takeButtonEvents();
+
+    for (uint8_t i = 0; i < SM_EVENT_COUNT; i++) {
+        if ((events & (1 << i)) && dispatchEvent(i)) {
+            break;
+        }
+    }
+}
+
+void simAppBoot() {
+    simReset();
+    newClk(500);
+    timerInit();
+    profileReset();
+    initPWM();
+    eepromInit();
+    loadConfig();
+    IOinit();
+    resumeFromDeepSleep();
+    InitUART2();
+    init_ADC();
+    eeLogInit();
+    Disp2String("\033[2J\033[H");
+    initStateMachine();
+    recordBootTime();
+}
+
+void simAppRun(uint32_t ticks) {
+    runEnd = tickNow() + ticks;
+    simSetStallHook(stallUntilEnd);
+    if (setjmp(runDone)) {
+        halRestoreInterrupts(0);        // Left from inside waitForEvents()
+        simSetStallHook(NULL);
+        return;
+    }
+
+    while (tickNow() < runEnd) {
+        uint16_t events = waitForEvents();
+
+        if (events & EVT_BUTTON_WAKE) {
+            setClockMode(CLOCK_BUTTONS);
+            requestSysTick(SYSTICK_BUTTONS);
+        }
+        if (events & EVT_BUTTON) {
+            handleStateTransition();
+        }
+        if (events & (EVT_UART_RX | EVT_UART_TX)) {
+            processCommands();
+        }
+        if (events & EVT_BUTTONS_IDLE) {
+            applyStateClock();
+        }
+        if ((events & (EVT_UART_TX | EVT_NVM)) && !replyPending()) {
+            continueLogDump();
+        }
+
+        runState(events);
+        flushConfig(0);
+        latencyService();
+    }
+    simSetStallHook(NULL);
+}
+
+void simSendCommand(uint8_t seq, uint8_t type, const uint8_t *payload,
+                    uint8_t length) {
+    uint8_t frame[TELEMETRY_MAX_PAYLOAD + TELEMETRY_OVERHEAD];
+
+    frame[0] = TELEMETRY_SYNC;
+    frame[1] = seq;
+    frame[2] = type;
+    frame[3] = length;
+    for (uint8_t i = 0; i < length; i++) {
+        frame[4 + i] = payload[i];
+    }
+    frame[4 + length] = crc8(0, &frame[1], 3 + length);
+    simUartReceive(frame, length + TELEMETRY_OVERHEAD);
+}
@@ -0,0 +1,46 @@
+/*
+ * File:   sim_app.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: The firmware's init() and main loop for host programs
+ *             (the tests and the simulation benchmarks), which cannot
+ *             link main.c. Keep in step with main.c.
+ */
+
+#ifndef SIM_APP_H
+#define SIM_APP_H
+
+#include <stdint.h>
+
+/**
+ * @brief Resets the simulated board and runs init(), initStateMachine()
+ *        and recordBootTime() as main() does.
+ *
+ * The data EEPROM keeps what earlier runs in this process wrote.
+ */
+void simAppBoot();
+
+/**
+ * @brief Runs the main loop for a number of ticks.
+ *
+ * Sleeping with nothing to wake the core moves time on to the end.
+ * Use simSetTickHook() for scripted inputs; simAppRun() owns the stall
+ * hook while it runs.
+ *
+ * @param ticks Ticks at TICK_HZ
+ */
+void simAppRun(uint32_t ticks);
+
+/**
+ * @brief Sends one host command frame (command.h) to the UART receiver.
+ *
+ * @param seq      SEQ the reply will echo
+ * @param type     CMD_* value
+ * @param payload  LEN bytes, may be NULL if length is 0
+ * @param length   Payload length
+ */
+void simSendCommand(uint8_t seq, uint8_t type, const uint8_t *payload,
+                    uint8_t length);
+
+#endif // SIM_APP_H
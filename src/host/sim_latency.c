@@ -0,0 +1,111 @@
+/*
+ * File:   sim_latency.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Input-to-LED latency (latency.h) of bouncy button presses
+ *             and potentiometer steps, from the TELEMETRY_FRAME_LATENCY
+ *             frames: each button press, then the worst of each input.
+ *             The simulation has no CPU timing model: code runs in zero
+ *             time, so accept, state and publish only show the waits for
+ *             the debounce, ADC fills and ticks, not instruction time.
+ *             The output stage waits for the next PWM period (hal_host.c).
+ */
+
+#include <stdio.h>
+#include "hal.h"
+#include "sim_app.h"
+#include "timeDelay.h"
+#include "telemetry.h"
+#include "latency.h"
+
+#define BOUNCE_TICKS    20              // Contact bounce edges, about 0.6 ms apart
+#define HOLD_TICKS      MS_TO_TICKS(100)
+
+static uint8_t output[32768];
+static uint16_t outputLength;
+static uint32_t startTick;
+
+/**
+ * @brief Bouncy press at a tick, held HOLD_TICKS, then a bouncy release
+ */
+static void bouncyPress(uint32_t tick, uint32_t at, uint8_t button) {
+    static const uint8_t levels[5] = {0, 1, 0, 1, 0};
+
+    for (uint8_t k = 0; k < 5; k++) {
+        if (tick == at + k * BOUNCE_TICKS) {
+            simSetButton(button, levels[k]);
+        }
+        if (tick == at + HOLD_TICKS + k * BOUNCE_TICKS) {
+            simSetButton(button, 1 - levels[k]);
+        }
+    }
+}
+
+static void script(uint32_t tick) {
+    uint32_t t = tick - startTick;
+
+    outputLength += simUartTake(&output[outputLength], sizeof(output) - outputLength);
+    bouncyPress(t, 1000, 0);                    // OFF -> ON
+    for (uint8_t k = 0; k < 20; k++) {
+        if (t == 40000 + k * 8000UL) {
+            simSetPot(0, (k & 1) ? 300 : 700);
+        }
+    }
+    bouncyPress(t, 250000, 1);                  // ON -> ON_BLINK
+    bouncyPress(t, 300000, 1);                  // and back
+}
+
+int main(void) {
+    static const char *names[LAT_STAGE_COUNT] = {"input", "accept", "state", "publish", "output"};
+    uint16_t worst[2][LAT_STAGE_COUNT] = {{0}};
+    uint16_t count[2] = {0};
+
+    simAppBoot();
+    simSetPot(0, 600);
+    startTick = tickNow();
+    simSetTickHook(script);
+    simAppRun(400000);
+
+    printf("Ticks from the first input edge; no CPU time is simulated\n");
+    printf("button  reached  accept  state  publish  output (ms)\n");
+    for (int i = 0; i + TELEMETRY_OVERHEAD <= outputLength; i++) {
+        const uint8_t *payload = &output[i + 4];
+        uint8_t group;
+
+        if (output[i] != TELEMETRY_SYNC || output[i + 2] != TELEMETRY_FRAME_LATENCY
+                || output[i + 3] != LATENCY_FRAME_PAYLOAD
+                || crc8(0, &output[i + 1], 3 + LATENCY_FRAME_PAYLOAD)
+                   != output[i + 4 + LATENCY_FRAME_PAYLOAD]) {
+            continue;
+        }
+        group = (payload[0] == LAT_SOURCE_POT);
+        count[group]++;
+        if (!group) {
+            printf("PB%u     0x%02X   ", payload[0] + 1, payload[1]);
+        }
+        for (uint8_t stage = LAT_ACCEPT; stage < LAT_STAGE_COUNT; stage++) {
+            uint16_t ticks = getU16(&payload[2 * stage + 2]);
+
+            if (ticks > worst[group][stage]) {
+                worst[group][stage] = ticks;
+            }
+            if (!group) {
+                printf("  %6.1f", ticks * 1000.0 / TICK_HZ);
+            }
+        }
+        if (!group) {
+            printf("\n");
+        }
+        i += TELEMETRY_OVERHEAD + LATENCY_FRAME_PAYLOAD - 1;
+    }
+
+    for (uint8_t group = 0; group < 2; group++) {
+        printf("%s: %u measured, worst", group ? "pot" : "buttons", count[group]);
+        for (uint8_t stage = LAT_ACCEPT; stage < LAT_STAGE_COUNT; stage++) {
+            printf(" %s %.1f ms", names[stage], worst[group][stage] * 1000.0 / TICK_HZ);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,688 @@
+/*
+ * File:   test_host.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Host tests for the portable modules, run by make test.
+ *             Each test runs in its own process, since the firmware
+ *             modules keep their state (hal_host.h), and starts from a
+ *             blank data EEPROM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hal.h"
+#include "sim_app.h"
+#include "timeDelay.h"
+#include "stateMachine.h"
+#include "clkChange.h"
+#include "UART2.h"
+#include "PWM.h"
+#include "IOs.h"
+#include "gammaTable.h"
+#include "patternTable.h"
+#include "telemetry.h"
+#include "command.h"
+#include "power.h"
+#include "eeprom.h"
+#include "eeLog.h"
+#include "config.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long)(actual), e_ = (long)(expected); \
+    if (a_ != e_) { \
+        fprintf(stderr, "  %s:%d: %s is %ld, expected %ld\n", \
+                __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+static uint8_t captured[32768];
+
+/**
+ * @brief Waits for the UART to go idle and takes what it sent
+ */
+static uint16_t takeOutput(void) {
+    FlushUART2();
+    return simUartTake(captured, sizeof(captured));
+}
+
+/**
+ * @brief Finds the next frame of a type in the captured bytes
+ *
+ * @return Offset of its SYNC byte, or -1
+ */
+static int findFrame(uint16_t length, int from, uint8_t type) {
+    for (int i = from; i + TELEMETRY_OVERHEAD <= length; i++) {
+        uint8_t payloadLength = captured[i + 3];
+
+        if (captured[i] != TELEMETRY_SYNC || captured[i + 2] != type
+                || i + TELEMETRY_OVERHEAD + payloadLength > length) {
+            continue;
+        }
+        if (crc8(0, &captured[i + 1], 3 + payloadLength) == captured[i + 4 + payloadLength]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void settle(uint32_t ticks) {
+    simAppRun(ticks);
+}
+
+// ---- State machine ----
+
+#define OFF     OFF_MODE
+#define OFF_B   OFF_BLINK
+#define ON      ON_MODE
+#define ON_B    ON_BLINK
+#define TX_ON   TRANSMIT_UART_ON
+#define TX_B    TRANSMIT_UART_BLINK
+
+// The documented behaviour, kept apart from stateMachine.c's copy
+static const uint8_t expectedNext[STATE_COUNT][SM_EVENT_COUNT] = {
+    //               PB1    PB2    PB3    PB1L   PB2L   PB3L   PB1D   PB2D   PB3D   S_ON   S_OFF
+    [OFF_MODE]   = {ON,    OFF_B, OFF,   OFF,   OFF,   OFF,   ON,    OFF_B, OFF,   OFF,   OFF},
+    [OFF_BLINK]  = {OFF_B, OFF,   OFF_B, OFF,   OFF_B, OFF_B, OFF_B, OFF,   OFF_B, OFF_B, OFF_B},
+    [ON_MODE]    = {OFF,   ON_B,  TX_ON, OFF,   ON,    ON,    OFF,   ON_B,  TX_ON, TX_ON, ON},
+    [ON_BLINK]   = {ON_B,  ON,    TX_B,  OFF,   ON_B,  ON_B,  ON_B,  ON,    TX_B,  TX_B,  ON_B},
+    [TRANSMIT_UART_ON]    = {OFF,  TX_B, ON,   OFF,  TX_ON, TX_ON, OFF,  TX_B,  ON,   TX_ON, ON},
+    [TRANSMIT_UART_BLINK] = {TX_B, TX_ON, ON_B, OFF, TX_B,  TX_B,  TX_B, TX_ON, ON_B, TX_B,  ON_B},
+};
+
+// Events that reach each state from OFF_MODE, ending at SM_EVENT_COUNT
+static const uint8_t pathFromOff[STATE_COUNT][4] = {
+    [OFF_MODE]            = {SM_EVENT_COUNT},
+    [OFF_BLINK]           = {SM_EVENT_PB2, SM_EVENT_COUNT},
+    [ON_MODE]             = {SM_EVENT_PB1, SM_EVENT_COUNT},
+    [ON_BLINK]            = {SM_EVENT_PB1, SM_EVENT_PB2, SM_EVENT_COUNT},
+    [TRANSMIT_UART_ON]    = {SM_EVENT_PB1, SM_EVENT_PB3, SM_EVENT_COUNT},
+    [TRANSMIT_UART_BLINK] = {SM_EVENT_PB1, SM_EVENT_PB2, SM_EVENT_PB3, SM_EVENT_COUNT},
+};
+
+#undef OFF
+#undef OFF_B
+#undef ON
+#undef ON_B
+#undef TX_ON
+#undef TX_B
+
+static void testTransitionTable(void) {
+    simAppBoot();
+    CHECK_EQ(systemState.currentState, OFF_MODE);
+
+    for (uint8_t state = 0; state < STATE_COUNT; state++) {
+        for (uint8_t event = 0; event < SM_EVENT_COUNT; event++) {
+            uint8_t next = expectedNext[state][event];
+
+            dispatchEvent(SM_EVENT_PB1_LONG);       // OFF_MODE from anywhere
+            for (const uint8_t *step = pathFromOff[state]; *step != SM_EVENT_COUNT; step++) {
+                dispatchEvent(*step);
+            }
+            CHECK_EQ(systemState.currentState, state);
+
+            CHECK_EQ(dispatchEvent(event), next != state);
+            if (systemState.currentState != next) {
+                fprintf(stderr, "  state %u event %u went to %u, expected %u\n",
+                        state, event, systemState.currentState, next);
+                failures++;
+            }
+        }
+    }
+}
+
+static uint32_t tapsAt;
+
+/**
+ * @brief Two 60 ms taps of PB1, 100 ms apart, from tapsAt
+ */
+static void doubleTap(uint32_t tick) {
+    uint32_t t = tick - tapsAt;
+
+    if (t == 0 || t == MS_TO_TICKS(160)) {
+        simSetButton(0, 0);
+    } else if (t == MS_TO_TICKS(60) || t == MS_TO_TICKS(220)) {
+        simSetButton(0, 1);
+    }
+}
+
+static void testStateActions(void) {
+    StateTraceEntry trace[2];
+
+    simAppBoot();
+    CHECK(!simPwmRunning());
+
+    dispatchEvent(SM_EVENT_PB1);
+    CHECK(simPwmRunning());
+    CHECK_EQ(getClockMode(), getStateClock(ON_MODE));
+    CHECK_EQ(getStateTrace(trace, 1), 1);
+    CHECK_EQ(trace[0].from, OFF_MODE);
+    CHECK_EQ(trace[0].to, ON_MODE);
+    CHECK_EQ(trace[0].event, SM_EVENT_PB1);
+
+    dispatchEvent(SM_EVENT_PB3);
+    CHECK_EQ(getClockMode(), getStateClock(TRANSMIT_UART_ON));
+
+    // A corrupted state falls back to OFF_MODE before the lookup
+    systemState.currentState = STATE_COUNT;
+    CHECK_EQ(dispatchEvent(SM_EVENT_PB2), 1);
+    CHECK_EQ(systemState.currentState, OFF_BLINK);
+
+    systemState.currentState = 0xFF;
+    runState(0);
+    CHECK_EQ(systemState.currentState, OFF_MODE);
+    CHECK(!simPwmRunning());
+
+    // Two quick taps are two presses, the second reported as a double
+    tapsAt = tickNow() + 1;
+    simSetTickHook(doubleTap);
+    settle(MS_TO_TICKS(500));
+    simSetTickHook(NULL);
+    CHECK_EQ(getStateTrace(trace, 2), 2);
+    CHECK_EQ(trace[1].to, ON_MODE);
+    CHECK_EQ(trace[0].from, ON_MODE);
+    CHECK_EQ(trace[0].to, OFF_MODE);
+    CHECK_EQ(trace[0].event, SM_EVENT_PB1_DOUBLE);
+    CHECK_EQ(systemState.currentState, OFF_MODE);
+
+    // Two-digit events print in full: TRANSMIT_UART_ON->ON_MODE, STREAM_OFF
+    dispatchEvent(SM_EVENT_PB1);
+    dispatchEvent(SM_EVENT_STREAM_ON);
+    dispatchEvent(SM_EVENT_STREAM_OFF);
+    takeOutput();
+    dumpStateTrace();
+    CHECK_EQ(takeOutput() > 14, 1);
+    CHECK(memcmp(&captured[5], " 4->2 10\n", 9) == 0);
+}
+
+// ---- Duty scaling ----
+
+static void testDutyScaling(void) {
+    for (uint32_t duty = 0; duty <= PWM_PERIOD; duty++) {
+        CHECK_EQ(PATTERN_SCALE(duty, PATTERN_LEVEL_MAX), duty);
+        CHECK_EQ(PATTERN_SCALE(duty, 0), 0);
+        CHECK_EQ(PATTERN_SCALE(duty, PATTERN_LEVEL_MAX / 2), duty / 2);
+        CHECK(PATTERN_SCALE(duty, PATTERN_LEVEL_MAX - 1) <= duty);
+    }
+
+    CHECK_EQ(gammaTable[0], 0);
+    CHECK_EQ(gammaTable[GAMMA_TABLE_SIZE - 1], PWM_PERIOD);
+    for (uint16_t i = 1; i < GAMMA_TABLE_SIZE; i++) {
+        CHECK(gammaTable[i] >= gammaTable[i - 1]);
+    }
+    CHECK_EQ(GAMMA_INDEX(1023), GAMMA_TABLE_SIZE - 1);
+
+    // The LED follows the filtered pot through the gamma table
+    simAppBoot();
+    simSetPot(0, 700);
+    dispatchEvent(SM_EVENT_PB1);
+    settle(MS_TO_TICKS(500));
+    CHECK_EQ(simPwmDuty(0), gammaTable[GAMMA_INDEX(pwmControl[0].adcValue)]);
+    CHECK(pwmControl[0].adcValue >= 690 && pwmControl[0].adcValue <= 710);
+
+    // A new duty waits for the next PWM period
+    setDutyOverride(0, 300);
+    CHECK(simPwmDuty(0) != 300);
+    settle(MS_TO_TICKS(20));                        // Software PWM: 12.8 ms
+    CHECK_EQ(simPwmDuty(0), 300);
+
+    // PATTERN_BLINK swings between off and the base duty
+    dispatchEvent(SM_EVENT_PB2);
+    for (int i = 0; i < 40; i++) {
+        uint16_t duty;
+
+        settle(MS_TO_TICKS(50));
+        duty = simPwmDuty(0);
+        CHECK(duty == 0 || duty == 300);
+    }
+}
+
+// ---- Frames ----
+
+static void testCrcAndFrames(void) {
+    static const uint8_t check[] = "123456789";
+    static const uint8_t payload[3] = {0x11, 0x22, 0x33};
+    uint8_t tooLong[TELEMETRY_MAX_PAYLOAD + 1] = {0};
+    uint16_t length;
+    uint8_t seq;
+    int at;
+
+    CHECK_EQ(crc8(0, check, 9), 0xF4);             // CRC-8/SMBUS check value
+    CHECK_EQ(crc8(0, NULL, 0), 0);
+    CHECK_EQ(crc8(crc8(0, check, 4), check + 4, 5), 0xF4);
+
+    simAppBoot();
+    takeOutput();
+
+    CHECK_EQ(sendFrame(0x42, payload, sizeof(payload)), 1);
+    CHECK_EQ(sendFrame(0x42, payload, sizeof(payload)), 1);
+    CHECK_EQ(sendFrame(0x42, tooLong, sizeof(tooLong)), 0);
+    length = takeOutput();
+    CHECK_EQ(length, 2 * (sizeof(payload) + TELEMETRY_OVERHEAD));
+    CHECK_EQ(captured[0], TELEMETRY_SYNC);
+    CHECK_EQ(captured[2], 0x42);
+    CHECK_EQ(captured[3], sizeof(payload));
+    CHECK(memcmp(&captured[4], payload, sizeof(payload)) == 0);
+    CHECK_EQ(captured[7], crc8(0, &captured[1], 6));
+    seq = captured[1];
+    CHECK_EQ(captured[8 + 1], (uint8_t)(seq + 1));
+
+    {
+        static const uint16_t extras[2] = {0x0123, 0x0456};
+
+        CHECK_EQ(sendSampleFrame(0xBEEF, 42, 1000, extras, 2), 1);
+        length = takeOutput();
+        CHECK_EQ(length, TELEMETRY_SAMPLE_PAYLOAD + 4 + TELEMETRY_OVERHEAD);
+        CHECK_EQ(captured[2], TELEMETRY_FRAME_SAMPLE);
+        CHECK_EQ(getU16(&captured[4]), 0xBEEF);
+        CHECK_EQ(captured[6], 42);
+        CHECK_EQ(getU16(&captured[7]), 1000);
+        CHECK_EQ(getU16(&captured[9]), 0x0123);
+        CHECK_EQ(getU16(&captured[11]), 0x0456);
+    }
+
+    // CMD_QUERY reply: SEQ, STATUS, then the data in command.h
+    dispatchEvent(SM_EVENT_PB1);
+    takeOutput();
+    simSendCommand(0x5A, CMD_QUERY, NULL, 0);
+    settle(MS_TO_TICKS(200));
+    length = takeOutput();
+    at = findFrame(length, 0, CMD_QUERY | TELEMETRY_FRAME_REPLY);
+    CHECK(at >= 0);
+    if (at >= 0) {
+        const uint8_t *reply = &captured[at + 4];
+
+        CHECK_EQ(captured[at + 3], 29);
+        CHECK_EQ(reply[0], 0x5A);
+        CHECK_EQ(reply[1], CMD_OK);
+        CHECK_EQ(reply[2], ON_MODE);
+        CHECK_EQ(reply[21], PWM_CHANNELS);
+        CHECK_EQ(reply[28] & ~QUERY_FLAG_BOOT_LATE, 0);
+    }
+
+    // A corrupted command is counted, not executed
+    {
+        uint8_t bad[TELEMETRY_OVERHEAD] = {TELEMETRY_SYNC, 1, CMD_QUERY, 0, 0};
+
+        bad[4] = crc8(0, &bad[1], 3) ^ 0xFF;
+        simUartReceive(bad, sizeof(bad));
+        settle(MS_TO_TICKS(200));
+        length = takeOutput();
+        CHECK_EQ(findFrame(length, 0, CMD_QUERY | TELEMETRY_FRAME_REPLY), -1);
+        CHECK_EQ(getCommandErrors(), 1);
+    }
+}
+
+// ---- Compressed stream ----
+
+static uint16_t readVarint(const uint8_t **at) {
+    uint16_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = *(*at)++;
+        value |= (uint16_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+static int16_t unzigzag(uint16_t value) {
+    return (int16_t)(value >> 1) ^ -(int16_t)(value & 1);
+}
+
+#define STREAM_SAMPLES 600
+
+static void testCompressedRoundTrip(void) {
+    static uint16_t adcIn[STREAM_SAMPLES], adcOut[STREAM_SAMPLES];
+    static uint8_t dutyIn[STREAM_SAMPLES], dutyOut[STREAM_SAMPLES];
+    static uint8_t stream[32768];
+    uint32_t streamLength = 0;
+    uint32_t frames = 0;
+    int decoded = 0;
+    int sinceKey = 0;
+    int16_t adc = 0;
+    int16_t duty = 0;
+
+    // Runs, small steps, varint-sized jumps and both extremes
+    for (int i = 0; i < STREAM_SAMPLES; i++) {
+        adcIn[i] = (i < 100) ? 512
+                 : (i < 200) ? 512 + (i % 7) - 3
+                 : (i < 300) ? ((i & 1) ? 1023 : 0)
+                 : (i < 400) ? (uint16_t)(i * 37 % 1024)
+                 : 300;
+        dutyIn[i] = (i < 400) ? (uint8_t)(adcIn[i] * 100UL / 1023) : (i % 50 < 25 ? 0 : 100);
+    }
+
+    simAppBoot();
+    setTelemetryFormat(TELEMETRY_COMPRESSED);
+    takeOutput();
+    startTelemetryStream();
+    for (int i = 0; i < STREAM_SAMPLES; i++) {
+        CHECK_EQ(sendCompressedSample((uint16_t)(i * 172), dutyIn[i], adcIn[i]), 1);
+        FlushUART2();                   // Never full, so nothing is dropped
+    }
+    stopTelemetryStream();
+    FlushUART2();
+    streamLength = simUartTake(stream, sizeof(stream));
+
+    for (uint32_t i = 0; i + TELEMETRY_OVERHEAD <= streamLength; ) {
+        uint8_t type = stream[i + 2];
+        uint8_t length = stream[i + 3];
+        const uint8_t *payload = &stream[i + 4];
+        uint16_t tick = getU16(payload);
+
+        CHECK_EQ(stream[i], TELEMETRY_SYNC);
+        CHECK_EQ(stream[i + 4 + length], crc8(0, &stream[i + 1], 3 + length));
+        if (failures) {
+            return;
+        }
+        frames++;
+
+        if (type == TELEMETRY_FRAME_KEY) {
+            CHECK_EQ(length, TELEMETRY_SAMPLE_PAYLOAD);
+            duty = payload[2];
+            adc = getU16(&payload[3]);
+            adcOut[decoded] = adc;
+            dutyOut[decoded++] = duty;
+            sinceKey = 0;
+        } else if (type == TELEMETRY_FRAME_DELTA) {
+            const uint8_t *token = &payload[3];
+            int first = decoded;
+
+            while (decoded - first < payload[2] && decoded < STREAM_SAMPLES) {
+                uint16_t head = readVarint(&token);
+
+                if (head & 1) {
+                    for (uint16_t run = head >> 1; run > 0 && decoded < STREAM_SAMPLES; run--) {
+                        adcOut[decoded] = adc;
+                        dutyOut[decoded++] = duty;
+                    }
+                } else {
+                    adc += unzigzag(head >> 1);
+                    duty += unzigzag(readVarint(&token));
+                    adcOut[decoded] = adc;
+                    dutyOut[decoded++] = duty;
+                }
+            }
+            CHECK_EQ(token - payload, length);
+            CHECK_EQ(decoded - first, payload[2]);
+            CHECK_EQ(tick, (uint16_t)((decoded - 1) * 172));
+            sinceKey += payload[2];
+            CHECK(sinceKey <= TELEMETRY_KEY_INTERVAL);
+        } else {
+            CHECK(0);                   // Nothing else is streamed here
+        }
+        i += length + TELEMETRY_OVERHEAD;
+    }
+
+    CHECK_EQ(decoded, STREAM_SAMPLES);
+    for (int i = 0; i < decoded && i < STREAM_SAMPLES; i++) {
+        if (adcOut[i] != adcIn[i] || dutyOut[i] != dutyIn[i]) {
+            fprintf(stderr, "  sample %d decoded as %u/%u, sent %u/%u\n",
+                    i, dutyOut[i], adcOut[i], dutyIn[i], adcIn[i]);
+            failures++;
+            break;
+        }
+    }
+    // The steady stretches must come out far smaller than sample frames
+    CHECK(streamLength < STREAM_SAMPLES * (TELEMETRY_SAMPLE_PAYLOAD + TELEMETRY_OVERHEAD) / 2);
+    CHECK(frames < STREAM_SAMPLES / 4);
+}
+
+// ---- Stored configuration ----
+
+/**
+ * @brief Writes a slot as saveConfig() would, optionally with a bad CRC
+ */
+static void writeSlot(uint8_t slot, uint8_t seq, const uint16_t *settings, uint8_t crcOk) {
+    uint8_t bytes[1 + 2 * (CONFIG_SLOT_WORDS - 1)];
+    uint8_t crc;
+
+    bytes[0] = seq;
+    for (uint8_t i = 0; i < CONFIG_SLOT_WORDS - 1; i++) {
+        putU16(&bytes[1 + 2 * i], settings[i]);
+    }
+    crc = crc8(0xFF, bytes, sizeof(bytes)) ^ (crcOk ? 0 : 0x01);
+
+    halEepromWrite(EEPROM_CONFIG_BASE + slot * CONFIG_SLOT_WORDS, ((uint16_t)seq << 8) | crc);
+    simAdvance(MS_TO_TICKS(5));
+    for (uint8_t i = 0; i < CONFIG_SLOT_WORDS - 1; i++) {
+        halEepromWrite(EEPROM_CONFIG_BASE + slot * CONFIG_SLOT_WORDS + 1 + i, settings[i]);
+        simAdvance(MS_TO_TICKS(5));
+    }
+}
+
+static void setState(uint16_t *settings, uint8_t state) {
+    settings[0] = ((uint16_t)CONFIG_VERSION << 8) | state;
+}
+
+static void testConfigSlots(void) {
+    uint16_t a[CONFIG_SLOT_WORDS - 1] = {0, (uint16_t)PATTERN_BREATHE << 8 | TELEMETRY_BINARY,
+                                         0, 100, 0, 0, EELOG_INTERVAL_MS};
+    uint16_t b[CONFIG_SLOT_WORDS - 1];
+
+    simAppBoot();
+    CHECK_EQ(loadConfig(), 0);                      // Blank EEPROM
+
+    setState(a, ON_MODE);
+    memcpy(b, a, sizeof(b));
+    setState(b, ON_BLINK);
+
+    // The newer SEQ wins, across the wrap too
+    writeSlot(0, 5, a, 1);
+    writeSlot(1, 6, b, 1);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_BLINK);
+    CHECK_EQ(getConfig()->userPattern, PATTERN_BREATHE);
+    CHECK_EQ(getTelemetryFormat(), TELEMETRY_BINARY);
+
+    writeSlot(0, 0x00, a, 1);
+    writeSlot(1, 0xFF, b, 1);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_MODE);
+
+    // A bad CRC, version or value leaves the other slot in charge
+    writeSlot(0, 0x00, a, 0);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_BLINK);
+
+    b[0] = ((uint16_t)(CONFIG_VERSION + 1) << 8) | ON_BLINK;
+    writeSlot(0, 0x00, a, 1);
+    writeSlot(1, 0x01, b, 1);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_MODE);
+
+    setState(b, STATE_COUNT);
+    writeSlot(1, 0x01, b, 1);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_MODE);
+
+    setState(b, ON_BLINK);
+    b[6] = EELOG_MIN_INTERVAL_MS - 1;
+    writeSlot(1, 0x01, b, 1);
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_MODE);
+
+    writeSlot(0, 0x00, a, 0);
+    CHECK_EQ(loadConfig(), 0);                      // Neither slot valid
+}
+
+static void testConfigSave(void) {
+    simAppBoot();
+    dispatchEvent(SM_EVENT_PB1);
+    dispatchEvent(SM_EVENT_PB2);
+    setUserPattern(PWM_ALL_CHANNELS, PATTERN_CANDLE);
+    flushConfig(1);
+    settle(MS_TO_TICKS(200));
+    CHECK(!eepromBusy());
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_BLINK);
+    CHECK_EQ(getConfig()->userPattern, PATTERN_CANDLE);
+
+    // A state change alone waits for the next save, switching off saves
+    dispatchEvent(SM_EVENT_PB2);
+    settle(MS_TO_TICKS(CONFIG_SAVE_DELAY_MS + 500));
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, ON_BLINK);
+    dispatchEvent(SM_EVENT_PB1);
+    settle(MS_TO_TICKS(200));
+    CHECK_EQ(loadConfig(), 1);
+    CHECK_EQ(getConfig()->state, OFF_MODE);
+}
+
+// ---- Power ----
+
+static uint32_t releaseAt;
+
+static void releaseButton(uint32_t tick) {
+    if (tick == releaseAt) {
+        simSetButton(0, 1);
+    }
+}
+
+static void testWakeLatency(void) {
+    WakeLatency wake;
+
+    simAppBoot();
+    settle(MS_TO_TICKS(100));                       // Asleep in OFF_MODE
+    clearWakeLatency();
+
+    simSetButton(0, 0);
+    releaseAt = tickNow() + MS_TO_TICKS(400);
+    simSetTickHook(releaseButton);
+    settle(MS_TO_TICKS(600));
+    simSetTickHook(NULL);
+
+    CHECK_EQ(systemState.currentState, ON_MODE);
+    getWakeLatency(&wake);
+    CHECK(wake.last >= MS_TO_TICKS(DEBOUNCE_TICKS * SYSTICK_MS));  // The debounce
+    CHECK(wake.last <= MS_TO_TICKS(WAKE_LATENCY_BUDGET_MS));
+    CHECK_EQ(wake.max, wake.last);
+    CHECK_EQ(wake.misses, 0);
+}
+
+// ---- EEPROM log ----
+
+/**
+ * @brief Fills the ring as if a write tore at record 5 of the second pass
+ */
+static void writeTornLog(uint8_t torn) {
+    for (uint8_t i = 0; i < EELOG_RECORDS; i++) {
+        uint8_t phase = (i < 5);            // Records 0-4 rewritten this pass
+        uint16_t word0 = (phase ? 0x4000 : 0) | i;
+        uint16_t word1 = (phase ? 0x8000 : 0) | (3 << 10) | i;
+
+        if (i == 5 && torn) {
+            word1 = 0x8000 | (9 << 10) | 999;   // New word 1, old word 0
+        }
+        halEepromWrite(2 * i, word0);
+        simAdvance(MS_TO_TICKS(5));
+        halEepromWrite(2 * i + 1, word1);
+        simAdvance(MS_TO_TICKS(5));
+    }
+}
+
+static uint16_t dumpLog(void) {
+    takeOutput();
+    CHECK_EQ(startLogDump(), 1);
+    for (int i = 0; i < 1000 && logDumping(); i++) {
+        continueLogDump();
+        simAdvance(MS_TO_TICKS(20));
+    }
+    CHECK(!logDumping());
+    return takeOutput();
+}
+
+static void testTornLogRecord(void) {
+    uint16_t length;
+    int at;
+
+    simAppBoot();
+    writeTornLog(0);
+    eeLogInit();
+    CHECK_EQ(getLogCount(), EELOG_RECORDS);
+
+    writeTornLog(1);
+    eeLogInit();
+    CHECK_EQ(getLogCount(), EELOG_RECORDS - 1);
+
+    // The dump starts after the torn record and skips it
+    length = dumpLog();
+    at = findFrame(length, 0, TELEMETRY_FRAME_LOG);
+    CHECK(at >= 0);
+    if (at >= 0) {
+        const uint8_t *payload = &captured[at + 4];
+
+        CHECK_EQ(payload[0], 0);
+        CHECK_EQ(payload[1], EELOG_RECORDS - 1);
+        CHECK_EQ(getU16(&payload[2]), 6);
+        CHECK_EQ(getU16(&payload[4]), (3 << 10) | 6);
+    }
+
+    // The next sample overwrites it, and the count is whole again
+    CHECK_EQ(clearLog(), 1);
+    settle(MS_TO_TICKS(5000));
+    CHECK_EQ(getLogCount(), 0);
+}
+
+// ---- Runner ----
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} TestCase;
+
+static const TestCase tests[] = {
+    {"transition table",         testTransitionTable},
+    {"state actions",            testStateActions},
+    {"duty scaling and gamma",   testDutyScaling},
+    {"CRC-8 and frame layout",   testCrcAndFrames},
+    {"compressed round trip",    testCompressedRoundTrip},
+    {"config slot validity",     testConfigSlots},
+    {"config save",              testConfigSave},
+    {"wake latency",             testWakeLatency},
+    {"torn log record",          testTornLogRecord},
+};
+
+int main(void) {
+    int failed = 0;
+    int count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < count; i++) {
+        int status = 1;
+        pid_t child;
+
+        fflush(stdout);
+        child = fork();
+        if (child == 0) {
+            tests[i].run();
+            fflush(stderr);
+            _exit(failures ? 1 : 0);
+        }
+        if (child > 0) {
+            waitpid(child, &status, 0);
+        }
+        if (status != 0) {
+            failed++;
+        }
+        printf("%s  %s\n", status ? "FAIL" : "ok  ", tests[i].name);
+    }
+
+    printf("%d of %d tests passed\n", count - failed, count);
+    return failed ? 1 : 0;
+}
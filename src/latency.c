@@ -0,0 +1,94 @@
+/*
+ * File:   latency.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the input-to-LED latency measurement.
+ */
+
+#include "latency.h"
+#include "telemetry.h"
+#include "events.h"
+
+#define STAGE_BIT(stage)    (1 << (stage))
+#define GAP_TICKS           MS_TO_TICKS(LATENCY_BURST_GAP_MS)
+#define TIMEOUT_TICKS       MS_TO_TICKS(LATENCY_TIMEOUT_MS)
+
+#if LATENCY_ENABLED
+static uint16_t burstStart;             // First edge after a quiet gap; CN ISR only
+static uint16_t lastEdge;
+static uint8_t measured;                // LAT_SOURCE_* being measured
+static uint16_t stamps[LAT_STAGE_COUNT];
+static volatile uint8_t reached = 0;    // STAGE_BIT()s stamped, 0 while idle
+#endif
+
+void latencyEdge() {
+#if LATENCY_ENABLED
+    uint16_t now = tickNow16();
+
+    if ((uint16_t)(now - lastEdge) > GAP_TICKS) {
+        burstStart = now;
+    }
+    lastEdge = now;
+#endif
+}
+
+void latencyStart(uint8_t source) {
+#if LATENCY_ENABLED
+    uint8_t savedIPL = halMaskInterrupts();     // Buttons and ADC race for it
+
+    if (!reached) {
+        measured = source;
+        stamps[LAT_ACCEPT] = tickNow16();
+        stamps[LAT_INPUT] = (source == LAT_SOURCE_POT) ? stamps[LAT_ACCEPT]
+                                                      : burstStart;
+        reached = STAGE_BIT(LAT_INPUT) | STAGE_BIT(LAT_ACCEPT);
+    }
+    halRestoreInterrupts(savedIPL);
+#endif
+}
+
+void latencyStage(uint8_t stage) {
+#if LATENCY_ENABLED
+    uint8_t savedIPL = halMaskInterrupts();
+
+    if ((reached & (STAGE_BIT(stage) | STAGE_BIT(stage - 1))) == STAGE_BIT(stage - 1)) {
+        stamps[stage] = tickNow16();
+        reached |= STAGE_BIT(stage);
+        if (stage == LAT_OUTPUT) {
+            postEvent(EVT_LATENCY);
+        }
+    }
+    halRestoreInterrupts(savedIPL);
+#endif
+}
+
+void latencyService() {
+#if LATENCY_ENABLED
+    uint8_t payload[LATENCY_FRAME_PAYLOAD];
+    uint8_t savedIPL;
+
+    if (!reached) {
+        return;
+    }
+    if (!(reached & STAGE_BIT(LAT_OUTPUT))
+        && (uint16_t)(tickNow16() - stamps[LAT_INPUT]) < TIMEOUT_TICKS) {
+        return;                         // Still on its way
+    }
+
+    // A late stage cannot land between the copy and the release
+    savedIPL = halMaskInterrupts();
+    payload[0] = measured;
+    payload[1] = reached;
+    putU16(&payload[2], stamps[LAT_INPUT]);
+    for (uint8_t i = LAT_ACCEPT; i < LAT_STAGE_COUNT; i++) {
+        putU16(&payload[2 * i + 2], (reached & STAGE_BIT(i))
+                                    ? stamps[i] - stamps[LAT_INPUT] : 0);
+    }
+    halRestoreInterrupts(savedIPL);
+
+    if (sendFrame(TELEMETRY_FRAME_LATENCY, payload, sizeof(payload))) {
+        reached = 0;                    // Free for the next input
+    }
+#endif
+}
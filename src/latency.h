@@ -0,0 +1,139 @@
+/*
+ * File:   latency.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the input-to-LED latency measurement.
+ *             Compiled out unless LATENCY_ENABLED is 1.
+ *
+ * An input is stamped with tickNow16() (TICK_HZ) at each stage on its way
+ * to the LED (latStage_t):
+ *   LAT_INPUT    First sign of it: the first change notification edge of
+ *                the button's release, or the ADC fill whose filtered
+ *                potentiometer reading moved
+ *   LAT_ACCEPT   Debouncing accepted the press or double press (IOcheck());
+ *                the same fill for the potentiometer
+ *   LAT_STATE    The state machine changed state (buttons), or the do
+ *                action took EVT_INPUT (potentiometer)
+ *   LAT_PUBLISH  The new duty was handed to the PWM (refreshDutyCycle())
+ *   LAT_OUTPUT   The first PWM period with the new duty began
+ * Each stage is only taken after the one before it, so the pattern tick
+ * and the controller, which also publish duties, do not cut in. One input
+ * is measured at a time; inputs that arrive meanwhile are not. Long
+ * presses are not measured, as they are accepted while held.
+ *
+ * Once LAT_OUTPUT is reached, or after LATENCY_TIMEOUT_MS for inputs that
+ * never get there (a press that changes nothing, or turns the LED off),
+ * latencyService() sends one TELEMETRY_FRAME_LATENCY frame:
+ *   [0]      SOURCE   LAT_SOURCE_* input
+ *   [1]      REACHED  Bit per latStage_t stamped
+ *   [2..3]   INPUT    Tick of LAT_INPUT
+ *   [4..5]   ACCEPT   Ticks from LAT_INPUT to LAT_ACCEPT, 0 if not reached
+ *   [6..7]   STATE    Ticks from LAT_INPUT to LAT_STATE
+ *   [8..9]   PUBLISH  Ticks from LAT_INPUT to LAT_PUBLISH
+ *   [10..11] OUTPUT   Ticks from LAT_INPUT to LAT_OUTPUT
+ * Frames go out in every state and format; stream binary, or not at all,
+ * while measuring so the host can parse them.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "hal.h"
+#include "timeDelay.h"
+
+/**
+ * @brief Compile-time switch for the measurement
+ *
+ * Define as 1 in the project's preprocessor macros to measure. With the
+ * OC backend it also takes the Timer2 interrupt for one period after
+ * each publish.
+ */
+#ifndef LATENCY_ENABLED
+#define LATENCY_ENABLED 0
+#endif
+
+/**
+ * @brief Longest a measurement waits for LAT_OUTPUT before it is sent
+ *
+ * Under the 2 s that 16-bit ticks span.
+ */
+#ifndef LATENCY_TIMEOUT_MS
+#define LATENCY_TIMEOUT_MS  1000
+#endif
+
+/**
+ * @brief Quiet time that separates two bursts of button edges
+ *
+ * Longer than contact bounce, shorter than a press.
+ */
+#define LATENCY_BURST_GAP_MS    5
+
+#define LATENCY_FRAME_PAYLOAD   12
+
+/**
+ * Stages, in order (see above)
+ */
+typedef enum {
+    LAT_INPUT,
+    LAT_ACCEPT,
+    LAT_STATE,
+    LAT_PUBLISH,
+    LAT_OUTPUT,
+    LAT_STAGE_COUNT
+} latStage_t;
+
+/**
+ * Inputs:
+ * - LAT_SOURCE_PB1 .. LAT_SOURCE_PB3: Button index 0-2
+ * - LAT_SOURCE_POT: Any potentiometer
+ */
+#define LAT_SOURCE_PB1      0
+#define LAT_SOURCE_POT      3
+
+#if LATENCY_ENABLED
+#define LATENCY_EDGE()          latencyEdge()
+#define LATENCY_START(source)   latencyStart(source)
+#define LATENCY_STAGE(stage)    latencyStage(stage)
+#else
+#define LATENCY_EDGE()
+#define LATENCY_START(source)
+#define LATENCY_STAGE(stage)
+#endif
+
+/**
+ * @brief Notes a button change notification edge.
+ *
+ * Called from _CNInterrupt.
+ */
+void latencyEdge();
+
+/**
+ * @brief Starts measuring an accepted input, unless one is being measured.
+ *
+ * Stamps LAT_ACCEPT, and LAT_INPUT from the last burst of edges for a
+ * button or now for the potentiometer. Safe to call from any interrupt
+ * priority.
+ *
+ * @param source  LAT_SOURCE_* input
+ */
+void latencyStart(uint8_t source);
+
+/**
+ * @brief Stamps a stage if the measurement has just reached the one before.
+ *
+ * Safe to call from any interrupt priority. LAT_OUTPUT posts EVT_LATENCY.
+ *
+ * @param stage  latStage_t, after LAT_ACCEPT
+ */
+void latencyStage(uint8_t stage);
+
+/**
+ * @brief Sends a finished measurement.
+ *
+ * Call from the main loop after every batch of events. Retries on a
+ * later call if the UART FIFO has no room.
+ */
+void latencyService();
+
+#endif
@@ -42,7 +42,12 @@
 #pragma config ICS = PGx2               // PGC2/PGD2 used for programming/debugging
 
 // FDS
+#include "power.h"                      // LOW_POWER_MODE picks the DSWDT period
+#if LOW_POWER_MODE == LOW_POWER_DEEP_SLEEP
+#pragma config DSWDTPS = DSWDTPS3       // Deep Sleep Watchdog Timer Postscale (1:128, ~135 ms button poll)
+#else
 #pragma config DSWDTPS = DSWDTPSF       // Deep Sleep Watchdog Timer Postscale (1:2,147,483,648)
+#endif
 #pragma config DSWDTOSC = LPRC          // DSWDT uses LPRC as reference clock
 #pragma config RTCOSC = SOSC            // RTCC uses SOSC as reference clock
 #pragma config DSBOREN = ON             // Deep Sleep BOR enabled
@@ -58,26 +63,23 @@
 #include "PWM.h"
 #include "ADC.h"
 #include "IOs.h"
+#include "events.h"
+#include "command.h"
+#include "profile.h"
+#include "bench.h"
+#include "eeLog.h"
+#include "eeprom.h"
+#include "config.h"
+#include "latency.h"
 
 /**
- * Pin Definitions:
+ * Pin Definitions (hal_pic24.c):
  * - PB1: Push button 1, used for toggling system modes (OFF/ON).
  * - PB2: Push button 2, used for enabling/disabling blinking modes.
  * - PB3: Push button 3, used for UART transmission trigger.
- * - LED: Output pin controlling the LED (brightness or blinking).
+ * - LED: Output pin controlling the LED (brightness or blinking),
+ *        RA6/OC1 or RB8 depending on PWM_BACKEND (see PWM.h).
  */
-#define PB1 PORTAbits.RA2               // Button 1 on pin RA2
-#define PB2 PORTBbits.RB4               // Button 2 on pin RB4
-#define PB3 PORTAbits.RA4               // Button 3 on pin RA4
-#define LED LATBbits.LATB8              // LED on pin RB8
-
-/**
- * Global Variables:
- * - pwmCounter: Tracks cycles for PWM timing.
- * - buttonFlag: Flag to indicate button press events.
- */
-uint8_t pwmCounter = 0;
-uint8_t buttonFlag = 0;
 
 /**
  * @brief Initializes system configuration and peripherals.
@@ -86,6 +88,7 @@ uint8_t buttonFlag = 0;
  * - Configures all pins as digital I/O
  * - Sets the clock frequency
  * - Initializes timers
+ * - Loads the stored configuration from data EEPROM
  * - Configures I/O pins
  * - Sets up UART communication for terminal display
  * - Configures the ADC module for analog-to-digital conversion
@@ -99,36 +102,54 @@ void init();
 /**
  * @brief Handles transitions between system states based on button inputs.
  *
- * Transitions system states and manages associated actions such as:
- * - Enabling/disabling LED blinking
- * - Adjusting LED brightness via PWM
- * - Sending ADC data via UART
- * 
- * The function performs the following:
- * - Reads button inputs to determine state changes
- * - Executes corresponding actions for each state
+ * Takes the debounced button events and turns each into a state machine
+ * event, presses first (PB1, PB2, PB3), then long and double presses,
+ * stopping at the first one that changes state.
  */
 void handleStateTransition();
 
 /**
  * @brief Main program entry point for system operation.
  *
- * Initializes system settings and enters an infinite loop to check button states,
- * handle state transitions, and reset button flags.
+ * Initializes system settings, enters the initial state and then idles
+ * until an interrupt posts an event. Button events and host commands
+ * drive state transitions; every batch of events is then handed to the
+ * current state's do handler.
  */
 int main() {
     init();
-    while (1) {   
-        if (buttonFlag) {
-            buttonFlag = IOcheck();
+    initStateMachine();
+    recordBootTime();               // LED restored; reported by CMD_QUERY
+#if BENCH_ENABLED
+    runBenchmarks();                // Benchmark build: never returns
+#endif
+    PROFILE_START(loopStart);
+
+    while (1) {
+        uint16_t events = waitForEvents();
+        PROFILE_LAP(PROF_LOOP, loopStart);  // Period and jitter of the loop
+
+        if (events & EVT_BUTTON_WAKE) {
+            setClockMode(CLOCK_BUTTONS);    // Fast enough for the system tick
+            requestSysTick(SYSTICK_BUTTONS);
         }
-
-        handleStateTransition();
-
-        // Clear button press flags after processing state transitions
-        for (int i = 0; i < 3; i++) {
-            buttons[i].pressed = 0;
+        if (events & EVT_BUTTON) {
+            handleStateTransition();    // Debounced in the system tick
+        }
+        if (events & (EVT_UART_RX | EVT_UART_TX)) {
+            processCommands();          // Host commands, and held replies
         }
+        if (events & EVT_BUTTONS_IDLE) {
+            applyStateClock();          // Drop back to the state's clock
+        }
+        if ((events & (EVT_UART_TX | EVT_NVM)) && !replyPending()) {
+            continueLogDump();          // Next frames of a CMD_LOG dump
+        }
+
+        runState(events);
+        flushConfig(0);                 // Saved once the settings stay put
+        latencyService();               // Finished input-to-LED measurements
+        PROFILE_STOP(PROF_WORK, loopStart);
     }
     
     return 0;
@@ -136,172 +157,77 @@ int main() {
 
 void init() {
     AD1PCFG = 0xFFFF;               // Configure all pins as digital
-    newClk(500);                    // Set the clock frequency
+    newClk(500);                    // Start at 500 kHz (CLOCK_500KHZ)
     timerInit();                    // Initialize timer
+    profileReset();                 // Instrumentation counts from here
+    initPWM();                      // Claim timers and LED pin for PWM
+    eepromInit();                   // Write-complete interrupt
+    loadConfig();                   // Saved settings, and the state's clock
     IOinit();                       // Initialize I/O pins
+    resumeFromDeepSleep();          // Back to Deep Sleep unless a button is down
     InitUART2();                    // Initialize UART communication    
     init_ADC();                     // Initialize ADC
+    eeLogInit();                    // Find where the EEPROM log left off
     Disp2String("\033[2J\033[H");   // Clear the terminal screen
 }
 
 void handleStateTransition() {
-    switch (systemState.currentState) {
-        case OFF_MODE:
-            // System completely off - LED disabled and timers stopped
-            delay_ms(20);
-            LED = 0;
-            stopBlink();        // Disable blinking mode
-            stopTimer1();       // Stop PWM timer
-            stopTimer2();       // Stop blink timer
-
-            // State transitions:
-            // PB1 -> ON_MODE: Turn system on
-            // PB2 -> OFF_BLINK: Enter blinking mode
-            if (buttons[0].pressed) systemState.currentState = ON_MODE;
-            else if (buttons[1].pressed) systemState.currentState = OFF_BLINK;
-            break;
-                
-        case OFF_BLINK:
-            // System off but LED blinking at max brightness
-            blink();                             // Enable blink functionality
-            updateBrightness(pwmControl.period); // Set to max brightness
-
-            // State transitions:
-            // PB2 -> OFF_MODE: Return to fully off state
-            if (buttons[1].pressed) {
-                systemState.currentState = OFF_MODE;
-                stopBlink();
-            }
-            break;
-
-        case ON_MODE:
-            // System on with LED at brightness determined by ADC
-            updateBrightness(0); // Set LED brightness from ADC
-
-            // State transitions:
-            // PB1 -> OFF_MODE: Turn system off
-            // PB2 -> ON_BLINK: Enter blinking while on
-            // PB3 -> TRANSMIT_UART_ON: Start UART transmission while on
-            if (buttons[0].pressed) systemState.currentState = OFF_MODE;
-            else if (buttons[1].pressed) systemState.currentState = ON_BLINK;
-            else if (buttons[2].pressed) systemState.currentState = TRANSMIT_UART_ON;
-            break;
-
-        case ON_BLINK:
-            // System on with LED blinking
-            blink();                // Enable blinking mode
-            updateBrightness(0);    // Set LED brightness from ADC
-
-            // State transitions:
-            // PB2 -> ON_MODE: Return to steady LED
-            // PB3 -> TRANSMIT_UART_BLINK: Start UART transmission while blinking
-            if (buttons[1].pressed) {
-                systemState.currentState = ON_MODE;
-                stopBlink();
-            } else if (buttons[2].pressed) systemState.currentState = TRANSMIT_UART_BLINK;
-            break;
-
-        case TRANSMIT_UART_ON:
-            // System on with LED steady and UART transmission active
-            updateBrightness(0);     // Set LED brightness from ADC
-            transmitVoltageADC();    // Transmit ADC voltage over UART
-
-            // State transitions:
-            // PB1 -> OFF_MODE: Turn system off
-            // PB2 -> TRANSMIT_UART_BLINK: Switch to blinking with UART
-            // PB3 -> ON_MODE: Stop UART transmission, remain on
-            if (buttons[0].pressed) systemState.currentState = OFF_MODE;
-            else if (buttons[1].pressed) systemState.currentState = TRANSMIT_UART_BLINK;
-            else if (buttons[2].pressed) systemState.currentState = ON_MODE;
-            break;
-
-        case TRANSMIT_UART_BLINK:
-            // System on with LED blinking and UART transmission active
-            blink();                // Enable blinking mode
-            updateBrightness(0);    // Set LED brightness from ADC
-            transmitVoltageADC();   // Transmit ADC voltage over UART
+    uint16_t events = takeButtonEvents();
 
-            // State transitions:
-            // PB2 -> TRANSMIT_UART_ON: Switch to steady on with UART
-            // PB3 -> ON_BLINK: Stop UART transmission, continue blinking
-            if (buttons[1].pressed) {
-                systemState.currentState = TRANSMIT_UART_ON;
-                stopBlink();
-            } else if (buttons[2].pressed) systemState.currentState = ON_BLINK;
-            break;
-
-        default:
-            // Handle undefined states by resetting to OFF_MODE
-            systemState.currentState = OFF_MODE;
+    for (uint8_t i = 0; i < SM_EVENT_COUNT; i++) {
+        if ((events & (1 << i)) && dispatchEvent(i)) {
             break;
+        }
     }
 }
 
 /**
- * @brief Timer 1 interrupt service routine for PWM generation.
+ * @brief System tick interrupt service routine.
  *
- * Implements software PWM by:
- * 1. Incrementing counter within PWM period
- * 2. Setting current duty cycle based on blink state
- * 3. Controlling LED based on counter vs duty cycle comparison
- * 
- * PWM Operation:
- * - Counter cycles from 0 to period-1
- * - LED turns on when counter < duty cycle
- * - Duty cycle varies based on blink state and base brightness
+ * Runs every SYSTICK_MS while debouncing or playing a pattern. Served by
+ * Timer1 when the OC backend owns Timer2, and by Timer2 when software PWM
+ * owns Timer1.
  */
+#if PWM_BACKEND == PWM_BACKEND_OC
 void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void) {
-    // Increment and wrap PWM counter within period
-    pwmCounter = (pwmCounter + 1) % pwmControl.period;
-    
-    // If blinking enabled, use current duty cycle, else use base duty cycle
-    pwmControl.currentDutyCycle = pwmControl.blinkEnabled 
-            ? pwmControl.currentDutyCycle 
-            : pwmControl.baseDutyCycle;
-    
-    // LED on when counter less than duty cycle
-    LED = (pwmCounter < pwmControl.currentDutyCycle) ? 1 : 0;
-    
-    IFS0bits.T1IF = 0;  // Clear Timer1 interrupt flag
-}
-
-/**
- * @brief Timer 2 interrupt service routine for blink timing.
- *    
- * Controls LED blinking by:
- * 1. Toggling blink state at regular intervals
- * 2. Setting duty cycle to either blink level or 0 based on state
- * 
- * Blinking is implemented using PWM for smooth transitions:
- * - When blinkState true: LED at specified blink brightness
- * - When blinkState false: LED off (duty cycle = 0)
- */
+#else
 void __attribute__((interrupt, no_auto_psv)) _T2Interrupt(void) {
-    if (pwmControl.blinkEnabled) {
-        // Toggle between on and off states
-        pwmControl.blinkState = !pwmControl.blinkState;
-        
-        // Set duty cycle based on blink state
-        pwmControl.currentDutyCycle = pwmControl.blinkState 
-                ? pwmControl.blinkDutyCycle  // During 'on' phase
-                : 0;                         // During 'off' phase
+#endif
+    PROFILE_START(start);
+    // Masked so a CN edge cannot land between the check and the release
+    uint8_t savedIPL = halMaskInterrupts();
+
+    if ((getSysTickUsers() & SYSTICK_BUTTONS) && !IOcheck()) {
+        releaseSysTick(SYSTICK_BUTTONS);    // Buttons settled and idle
+        postEvent(EVT_BUTTONS_IDLE);
     }
-    IFS0bits.T2IF = 0;  // Clear Timer2 interrupt flag
-}
+    halRestoreInterrupts(savedIPL);
 
-/**
- * @brief Timer 3 interrupt service routine
- *
- */
-void __attribute__((interrupt, no_auto_psv)) _T3Interrupt(void) {
-    IFS0bits.T3IF = 0;  // Clear Timer 3 interrupt flag
+    patternTick();
+    PROFILE_STOP(PROF_SYSTICK, start);
+
+#if PWM_BACKEND == PWM_BACKEND_OC
+    IFS0bits.T1IF = 0;  // Clear Timer1 interrupt flag
+#else
+    IFS0bits.T2IF = 0;  // Clear Timer2 interrupt flag
+#endif
 }
 
 /**
  * @brief Change Notification interrupt service routine.
  *
+ * Starts the system tick so the buttons get sampled and debounced. Below
+ * CLOCK_BUTTONS the main loop raises the clock first.
  */
 void __attribute__((interrupt, no_auto_psv)) _CNInterrupt(void) {
-    buttonFlag = 1;      // Signal main loop to process button states
-    IFS1bits.CNIF = 0;   // Clear CN interrupt flag
-}
+    PROFILE_START(start);
+    LATENCY_EDGE();
+
+    if (getClockMode() < CLOCK_BUTTONS) {
+        postEvent(EVT_BUTTON_WAKE);
+    } else {
+        requestSysTick(SYSTICK_BUTTONS);
+    }
+    PROFILE_STOP(PROF_CN, start);
+    IFS1bits.CNIF = 0;      // Clear CN interrupt flag
+}
\ No newline at end of file
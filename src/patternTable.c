@@ -0,0 +1,83 @@
+/*
+ * File:   patternTable.c
+ * Generated by gen_pattern.py - do not edit by hand.
+ *
+ * Description: 8 waveform tables, levels out of 4096,
+ *             gamma 2.2 where the level follows a curve.
+ */
+
+#include "patternTable.h"
+
+#if PATTERN_LEVEL_BITS != 12 || PATTERN_COUNT != 8 || SYSTICK_MS != 4
+#error "patternTable.c is out of date; re-run gen_pattern.py"
+#endif
+
+static const uint16_t steady[1] = {
+    4096,
+};
+
+static const uint16_t blink[2] = {
+    4096,    0,
+};
+
+static const uint16_t fadeIn[64] = {
+       0,    0,    2,    5,   10,   16,   23,   33,
+      44,   57,   71,   88,  107,  127,  150,  174,
+     201,  230,  260,  293,  328,  365,  405,  446,
+     490,  536,  584,  635,  688,  743,  801,  861,
+     923,  988, 1055, 1124, 1196, 1270, 1347, 1426,
+    1508, 1592, 1679, 1768, 1860, 1954, 2051, 2150,
+    2252, 2356, 2463, 2573, 2685, 2800, 2918, 3038,
+    3161, 3287, 3415, 3546, 3679, 3815, 3954, 4096,
+};
+
+static const uint16_t fadeOut[64] = {
+    4096, 3954, 3815, 3679, 3546, 3415, 3287, 3161,
+    3038, 2918, 2800, 2685, 2573, 2463, 2356, 2252,
+    2150, 2051, 1954, 1860, 1768, 1679, 1592, 1508,
+    1426, 1347, 1270, 1196, 1124, 1055,  988,  923,
+     861,  801,  743,  688,  635,  584,  536,  490,
+     446,  405,  365,  328,  293,  260,  230,  201,
+     174,  150,  127,  107,   88,   71,   57,   44,
+      33,   23,   16,   10,    5,    2,    0,    0,
+};
+
+static const uint16_t breathe[64] = {
+       0,    0,    0,    1,    3,    8,   18,   34,
+      60,   97,  150,  219,  308,  419,  553,  710,
+     891, 1095, 1319, 1562, 1818, 2085, 2356, 2627,
+    2891, 3142, 3375, 3583, 3761, 3904, 4010, 4074,
+    4096, 4074, 4010, 3904, 3761, 3583, 3375, 3142,
+    2891, 2627, 2356, 2085, 1818, 1562, 1319, 1095,
+     891,  710,  553,  419,  308,  219,  150,   97,
+      60,   34,   18,    8,    3,    1,    0,    0,
+};
+
+static const uint16_t strobe[8] = {
+    4096,    0,    0,    0,    0,    0,    0,    0,
+};
+
+static const uint16_t heartbeat[25] = {
+    4096, 4096,  546,    0,    0, 2507, 2507,  290,
+       0,    0,    0,    0,    0,    0,    0,    0,
+       0,    0,    0,    0,    0,    0,    0,    0,
+       0,
+};
+
+static const uint16_t candle[32] = {
+    1946, 3422, 3435, 1547, 1908, 2791, 1674, 3346,
+    1331, 1631, 1927, 1753, 2469, 2353, 1606, 2169,
+    3159, 2480, 3233, 1974, 3110, 1955, 1539, 3984,
+    2342, 3526, 1780, 2209, 3832, 1597, 1473, 2678,
+};
+
+const PatternTable patternTables[PATTERN_COUNT] = {
+    [PATTERN_STEADY] = {steady, 1, 0, 4},
+    [PATTERN_BLINK] = {blink, 2, 1, 500},
+    [PATTERN_FADE_IN] = {fadeIn, 64, 0, 16},
+    [PATTERN_FADE_OUT] = {fadeOut, 64, 0, 16},
+    [PATTERN_BREATHE] = {breathe, 64, 1, 48},
+    [PATTERN_STROBE] = {strobe, 8, 1, 20},
+    [PATTERN_HEARTBEAT] = {heartbeat, 25, 1, 40},
+    [PATTERN_CANDLE] = {candle, 32, 1, 60},
+};
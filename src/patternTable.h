@@ -0,0 +1,74 @@
+/*
+ * File:   patternTable.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the generated waveform tables of the pattern
+ *             engine (playPattern() in PWM.h). patternTable.c is produced
+ *             by gen_pattern.py.
+ */
+
+#ifndef PATTERNTABLE_H
+#define PATTERNTABLE_H
+
+#include <stdint.h>
+#include "timeDelay.h"
+
+/**
+ * Patterns, in patternTables order:
+ * - PATTERN_STEADY:    Constant full level; the LED shows its base duty
+ * - PATTERN_BLINK:     Square wave, 500 ms on and off
+ * - PATTERN_FADE_IN:   Off to full in about 1 s, then holds
+ * - PATTERN_FADE_OUT:  Full to off in about 1 s, then holds
+ * - PATTERN_BREATHE:   Raised-cosine swell, about 3 s per breath
+ * - PATTERN_STROBE:    20 ms flash every 160 ms
+ * - PATTERN_HEARTBEAT: Double pulse once a second
+ * - PATTERN_CANDLE:    Fixed pseudo-random flicker between 60 % and full
+ */
+#define PATTERN_STEADY      0
+#define PATTERN_BLINK       1
+#define PATTERN_FADE_IN     2
+#define PATTERN_FADE_OUT    3
+#define PATTERN_BREATHE     4
+#define PATTERN_STROBE      5
+#define PATTERN_HEARTBEAT   6
+#define PATTERN_CANDLE      7
+#define PATTERN_COUNT       8
+
+/**
+ * @brief Level resolution
+ *
+ * Levels are fractions of the base duty count out of PATTERN_LEVEL_MAX,
+ * which leaves the duty unchanged. gen_pattern.py must be re-run if this
+ * changes.
+ */
+#define PATTERN_LEVEL_BITS  12
+#define PATTERN_LEVEL_MAX   (1U << PATTERN_LEVEL_BITS)
+
+/**
+ * @brief Scales a duty count by a pattern level
+ *
+ * A 16 x 16 bit multiply and a shift; PATTERN_LEVEL_MAX returns duty.
+ */
+#define PATTERN_SCALE(duty, level) \
+    ((uint16_t)(((uint32_t)(duty) * (level)) >> PATTERN_LEVEL_BITS))
+
+/**
+ * @brief One waveform
+ *
+ * @field levels:  Level of each step (0-PATTERN_LEVEL_MAX)
+ * @field length:  Number of steps
+ * @field loops:   1 to restart after the last step, 0 to hold it
+ * @field stepMs:  Default step length, a multiple of SYSTICK_MS
+ */
+typedef struct {
+    const uint16_t *levels;
+    uint8_t length;
+    uint8_t loops;
+    uint16_t stepMs;
+} PatternTable;
+
+// Every pattern by PATTERN_* id; const, so placed in program memory
+extern const PatternTable patternTables[PATTERN_COUNT];
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * File:   power.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the low-power OFF path and the
+ *             wake-to-LED latency measurement.
+ */
+
+#include "power.h"
+#include "timeDelay.h"
+#include "UART2.h"
+#include "IOs.h"
+#include "telemetry.h"
+#include "eeprom.h"
+
+#define WAKE_BUDGET_TICKS MS_TO_TICKS(WAKE_LATENCY_BUDGET_MS)
+
+static uint8_t sleepEnabled = 0;        // Current state allows Sleep
+static volatile uint8_t measuringWake = 0;  // A wake is waiting for a press
+static uint16_t wakeStamp;              // tickNow16() just after waking
+static WakeLatency wakeLatency = {0, 0, 0};
+
+void setSleepAllowed(uint8_t allowed) {
+    sleepEnabled = allowed;
+}
+
+uint8_t sleepAllowed() {
+#if LOW_POWER_MODE == LOW_POWER_IDLE
+    return 0;
+#else
+    // Timers, ADC and UART all stop in Sleep, so only sleep once
+    // nobody is using them (the OFF entry action stops the ADC and PWM)
+    // and no EEPROM write is in progress
+    return sleepEnabled && !getSysTickUsers() && TxIdleUART2() && !eepromBusy();
+#endif
+}
+
+void enterSleep() {
+#if LOW_POWER_MODE == LOW_POWER_DEEP_SLEEP
+    halDeepSleep(getTelemetryFormat()); // Only this survives; wakes through reset
+#else
+    halSleep();                         // CN edge on any button wakes the core
+    wakeStamp = tickNow16();            // Timer3 was frozen; this is "now"
+    measuringWake = 1;
+#endif
+}
+
+void recordWakeLatency() {
+    uint16_t latency;
+
+    if (!measuringWake) {
+        return;
+    }
+    measuringWake = 0;
+
+    latency = tickNow16() - wakeStamp;
+    wakeLatency.last = latency;
+    if (latency > wakeLatency.max) {
+        wakeLatency.max = latency;
+    }
+    if (latency > WAKE_BUDGET_TICKS && wakeLatency.misses != 0xFFFF) {
+        wakeLatency.misses++;
+    }
+}
+
+void getWakeLatency(WakeLatency *out) {
+    uint8_t savedIPL = halMaskInterrupts();     // Updated in the system tick ISR
+
+    *out = wakeLatency;
+    halRestoreInterrupts(savedIPL);
+}
+
+void clearWakeLatency() {
+    uint8_t savedIPL = halMaskInterrupts();
+
+    wakeLatency.last = 0;
+    wakeLatency.max = 0;
+    wakeLatency.misses = 0;
+    halRestoreInterrupts(savedIPL);
+}
+
+void resumeFromDeepSleep() {
+#if LOW_POWER_MODE == LOW_POWER_DEEP_SLEEP
+    uint16_t format = getTelemetryFormat();
+    uint8_t released = 1;
+
+    if (!halDeepSleepWake(&format)) {
+        return;                         // Power-on or other reset
+    }
+    setTelemetryFormat((uint8_t)format);
+
+    for (uint8_t i = 0; i < HAL_BUTTON_COUNT; i++) {
+        released &= halButtonLevel(i);
+    }
+    if (released) {
+        enterSleep();                   // Nothing pressed, keep polling
+    }
+
+    // A button is already down, so no edge will arrive; debounce it now
+    requestSysTick(SYSTICK_BUTTONS);
+    wakeStamp = tickNow16();
+    measuringWake = 1;
+#endif
+}
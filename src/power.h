@@ -0,0 +1,131 @@
+/*
+ * File:   power.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for the low-power OFF path. When the current
+ *             state allows it and nothing is running, the event loop enters
+ *             Sleep instead of Idle and a button change notification wakes it.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include "hal.h"
+
+/**
+ * Low-power modes for LOW_POWER_MODE:
+ * - LOW_POWER_IDLE:       Never go below Idle
+ * - LOW_POWER_SLEEP:      Sleep; any button edge wakes the core
+ * - LOW_POWER_DEEP_SLEEP: Deep Sleep; change notification cannot wake it on
+ *                         this part, so the DSWDT wakes it every ~135 ms
+ *                         (DSWDTPS in main.c) to poll the buttons. Wake goes
+ *                         through reset; resumeFromDeepSleep() restores state.
+ */
+#define LOW_POWER_IDLE          0
+#define LOW_POWER_SLEEP         1
+#define LOW_POWER_DEEP_SLEEP    2
+
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE LOW_POWER_SLEEP
+#endif
+
+/**
+ * @brief Wake-to-press latency budget
+ *
+ * Covers the clock switch and the 20 ms debounce. Deep Sleep adds up to a
+ * DSWDT period plus the reset path, which this budget does not cover.
+ */
+#ifndef WAKE_LATENCY_BUDGET_MS
+#define WAKE_LATENCY_BUDGET_MS 40
+#endif
+
+/**
+ * @brief Power-on to LED-restored budget
+ *
+ * getBootTime() (config.h) only counts from timerInit(). The reset path,
+ * the Power-up Timer (PWRTEN = ON, 64 ms nominal) and the first newClk()
+ * run before it and are charged as BOOT_UNTIMED_MS instead.
+ */
+#ifndef BOOT_BUDGET_MS
+#define BOOT_BUDGET_MS 100
+#endif
+#ifndef BOOT_UNTIMED_MS
+#define BOOT_UNTIMED_MS 64
+#endif
+
+/**
+ * @brief Wake latency measurements
+ *
+ * Measured from the instruction after Sleep to the first debounced button
+ * press (IOcheck()). Presses are reported on release, so the LED follows
+ * once the button is let go; how long it is held is not counted. Ticks
+ * stop during Sleep, so the sleep itself is not counted either. Reported
+ * by CMD_PROFILE (command.h).
+ *
+ * @field last:    Most recent latency in ticks
+ * @field max:     Worst latency seen in ticks
+ * @field misses:  Wakes that exceeded WAKE_LATENCY_BUDGET_MS
+ */
+typedef struct {
+    uint16_t last;
+    uint16_t max;
+    uint16_t misses;
+} WakeLatency;
+
+/**
+ * @brief Lets the event loop sleep while nothing is active.
+ *
+ * Set by states whose only job is to wait for a button.
+ *
+ * @param allowed   1 to allow Sleep, 0 to stay in Idle
+ */
+void setSleepAllowed(uint8_t allowed);
+
+/**
+ * @brief Reports whether the core may sleep right now.
+ *
+ * True when the state allows it, the system tick is stopped, the UART
+ * has finished transmitting and no EEPROM write is in progress. Call
+ * with interrupts masked.
+ */
+uint8_t sleepAllowed();
+
+/**
+ * @brief Enters Sleep (or Deep Sleep) until a button wakes the core.
+ *
+ * Call with interrupts masked, in place of Idle(). An enabled interrupt
+ * still wakes the core; it vectors once the caller lowers the priority.
+ */
+void enterSleep();
+
+/**
+ * @brief Completes a wake measurement at the first debounced press.
+ *
+ * Called from IOcheck() in the system tick ISR. Does nothing unless a
+ * wake is being measured.
+ */
+void recordWakeLatency();
+
+/**
+ * @brief Copies the wake latency measurements.
+ *
+ * @param out   Receives last, max and misses
+ */
+void getWakeLatency(WakeLatency *out);
+
+/**
+ * @brief Clears max and misses, and last.
+ */
+void clearWakeLatency();
+
+/**
+ * @brief Resumes after a Deep Sleep wake.
+ *
+ * Call from init() once the button pins are configured. Restores the saved
+ * state and releases the I/O latches. Goes straight back to Deep Sleep if
+ * no button is down. Does nothing after any other reset.
+ */
+void resumeFromDeepSleep();
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * File:   profile.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Implementation of the cycle-count instrumentation.
+ */
+
+#include "profile.h"
+#include "telemetry.h"
+#include "UART2.h"
+
+#if PROFILE_ENABLED
+static ProfileStat stats[PROF_SITE_COUNT];
+static uint32_t profileSince = 0;       // cycleNow() at the last reset
+#endif
+
+void profileReset() {
+#if PROFILE_ENABLED
+    uint8_t savedIPL = halMaskInterrupts();
+
+    for (uint8_t i = 0; i < PROF_SITE_COUNT; i++) {
+        stats[i].count = 0;
+        stats[i].min = 0xFFFFFFFF;
+        stats[i].max = 0;
+        stats[i].sum = 0;
+    }
+    profileSince = cycleNow();
+    halRestoreInterrupts(savedIPL);
+#endif
+}
+
+void profileRecord(uint8_t site, uint32_t start) {
+#if PROFILE_ENABLED
+    uint32_t cycles = cycleNow() - start;
+    ProfileStat *stat = &stats[site];
+    uint8_t savedIPL = halMaskInterrupts(); // Sites nest; finish one update at a time
+
+    if (stat->count != 0xFFFF && stat->sum + cycles >= stat->sum) {
+        stat->count++;                  // Both stop together so the mean holds
+        stat->sum += cycles;
+    }
+    if (cycles < stat->min) {
+        stat->min = cycles;
+    }
+    if (cycles > stat->max) {
+        stat->max = cycles;
+    }
+    halRestoreInterrupts(savedIPL);
+#endif
+}
+
+uint32_t profileLap(uint8_t site, uint32_t start) {
+#if PROFILE_ENABLED
+    uint32_t now = cycleNow();
+
+    profileRecord(site, start);
+    return now;
+#else
+    return start;
+#endif
+}
+
+void getProfileStat(uint8_t site, ProfileStat *out) {
+#if PROFILE_ENABLED
+    uint8_t savedIPL = halMaskInterrupts();
+
+    *out = stats[site];
+    halRestoreInterrupts(savedIPL);
+#else
+    out->count = 0;
+    out->min = 0;
+    out->max = 0;
+    out->sum = 0;
+#endif
+}
+
+uint32_t getProfileElapsed() {
+#if PROFILE_ENABLED
+    return cycleNow() - profileSince;
+#else
+    return 0;
+#endif
+}
+
+void dumpProfile() {
+    ProfileStat stat;
+    uint8_t payload[PROFILE_FRAME_PAYLOAD];
+
+    for (uint8_t i = 0; i < PROF_SITE_COUNT; i++) {
+        getProfileStat(i, &stat);
+        payload[0] = i;
+        payload[1] = stat.count & 0xFF;
+        payload[2] = stat.count >> 8;
+        putU32(&payload[3], stat.count ? stat.min : 0);
+        putU32(&payload[7], stat.max);
+        putU32(&payload[11], stat.sum);
+
+        while (TxSpaceUART2() < PROFILE_FRAME_PAYLOAD + TELEMETRY_OVERHEAD) {
+            halIdle();      // Debug dump: wait for room rather than drop frames
+        }
+        sendFrame(TELEMETRY_FRAME_PROFILE, payload, sizeof(payload));
+    }
+}
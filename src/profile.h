@@ -0,0 +1,138 @@
+/*
+ * File:   profile.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ *
+ * Description: Header file for cycle-count instrumentation of interrupts
+ *             and the main loop. Compiled out unless PROFILE_ENABLED is 1.
+ *
+ * Each site keeps count, min, max and sum of its durations in instruction
+ * cycles (cycleNow()). An interrupt's time includes any higher-priority
+ * interrupt that pre-empted it. Timer3 stops in Sleep, so PROF_LOOP and
+ * PROF_IDLE only cover time spent awake.
+ *
+ * CMD_PROFILE (command.h) answers with the run summary and then sends one
+ * TELEMETRY_FRAME_PROFILE frame per site:
+ *   [0]      SITE   profSite_t
+ *   [1..2]   COUNT  Durations recorded, stops at 0xFFFF
+ *   [3..6]   MIN    Shortest duration in cycles
+ *   [7..10]  MAX    Longest duration in cycles
+ *   [11..14] SUM    Sum of the counted durations, stops before overflow
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "hal.h"
+#include "timeDelay.h"
+
+/**
+ * @brief Compile-time switch for the instrumentation
+ *
+ * Each site costs two cycleNow() reads. Define as 1 in the project's
+ * preprocessor macros to measure.
+ */
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+#define PROFILE_FRAME_PAYLOAD   15
+
+/**
+ * @brief Instrumented sites
+ *
+ * @field PROF_SYSTICK:  System tick ISR (_T1Interrupt or _T2Interrupt)
+ * @field PROF_PWM_SW:   Software PWM ISR (_T1Interrupt, Timer1 backend only)
+ * @field PROF_CN:       Button change notification ISR
+ * @field PROF_U2TX:     UART2 transmit ISR
+ * @field PROF_U2RX:     UART2 receive ISR
+ * @field PROF_ADC:      ADC buffer-full ISR
+ * @field PROF_ADC_READ: ADC_readWith() from call to return
+ * @field PROF_LOOP:     Main loop period, wake to wake
+ * @field PROF_WORK:     Main loop work, wake to the next wait
+ * @field PROF_IDLE:     Each stay in Idle()
+ */
+typedef enum {
+    PROF_SYSTICK,
+    PROF_PWM_SW,
+    PROF_CN,
+    PROF_U2TX,
+    PROF_U2RX,
+    PROF_ADC,
+    PROF_ADC_READ,
+    PROF_LOOP,
+    PROF_WORK,
+    PROF_IDLE,
+    PROF_SITE_COUNT
+} profSite_t;
+
+/**
+ * @brief Statistics for one site
+ *
+ * @field count:  Durations added to sum
+ * @field min:    Shortest duration in cycles
+ * @field max:    Longest duration in cycles
+ * @field sum:    Total of the counted durations
+ */
+typedef struct {
+    uint16_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;
+} ProfileStat;
+
+#if PROFILE_ENABLED
+#define PROFILE_START(var)          uint32_t var = cycleNow()
+#define PROFILE_STOP(site, var)     profileRecord(site, var)
+#define PROFILE_LAP(site, var)      (var = profileLap(site, var))
+#else
+#define PROFILE_START(var)
+#define PROFILE_STOP(site, var)
+#define PROFILE_LAP(site, var)
+#endif
+
+/**
+ * @brief Clears every site and restarts the elapsed time.
+ */
+void profileReset();
+
+/**
+ * @brief Adds the time since start to a site.
+ *
+ * Safe to call from any interrupt priority.
+ *
+ * @param site   profSite_t
+ * @param start  cycleNow() at the start of the measured span
+ */
+void profileRecord(uint8_t site, uint32_t start);
+
+/**
+ * @brief Adds the time since start to a site and starts the next span.
+ *
+ * @param site   profSite_t
+ * @param start  cycleNow() at the start of the measured span
+ * @return cycleNow() at the end of the span
+ */
+uint32_t profileLap(uint8_t site, uint32_t start);
+
+/**
+ * @brief Copies the statistics of one site.
+ *
+ * @param site  profSite_t
+ * @param out   Destination
+ */
+void getProfileStat(uint8_t site, ProfileStat *out);
+
+/**
+ * @brief Returns the cycles elapsed since profileReset().
+ */
+uint32_t getProfileElapsed();
+
+/**
+ * @brief Queues one TELEMETRY_FRAME_PROFILE frame per site.
+ *
+ * Debug dump: waits for FIFO room rather than drop frames.
+ */
+void dumpProfile();
+
+#endif
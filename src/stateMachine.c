@@ -0,0 +1,383 @@
+/*
+ * File:   stateMachine.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Table-driven implementation of the system state machine.
+ *             Transitions and per-state handlers are const tables, which XC16
+ *             places in program memory, so dispatch is a single lookup.
+ */
+
+#include <stddef.h>
+#include "stateMachine.h"
+#include "events.h"
+#include "PWM.h"
+#include "ADC.h"
+#include "UART2.h"
+#include "clkChange.h"
+#include "timeDelay.h"
+#include "power.h"
+#include "telemetry.h"
+#include "command.h"
+#include "eeLog.h"
+#include "config.h"
+#include "latency.h"
+
+SystemState systemState = {
+    .currentState = OFF_MODE
+};
+
+/**
+ * @brief Per-state actions
+ *
+ * @field entry:    Runs once when the state is entered (may be NULL)
+ * @field exit:     Runs once when the state is left (may be NULL)
+ * @field run:      Runs for every batch of main-loop events (may be NULL)
+ * @field clock:    System clock while in the state
+ * @field pattern:  PATTERN_* played on the LEDs, or PATTERN_USER
+ */
+typedef struct {
+    void (*entry)(void);
+    void (*exit)(void);
+    void (*run)(uint16_t events);
+    uint8_t clock;
+    uint8_t pattern;
+} StateHandlers;
+
+#define PATTERN_USER    0xFF        // The host's choice (setUserPattern())
+
+#if CLOCK_SCALING
+#define CLK_OFF     CLOCK_32KHZ     // Nothing to do but wait for a button
+#define CLK_ON      CLOCK_500KHZ    // PWM, ADC and blink timing
+#define CLK_TX      CLOCK_500KHZ    // Same UART_BAUD; 8 MHz would only burn power
+#else
+#define CLK_OFF     CLOCK_500KHZ
+#define CLK_ON      CLOCK_500KHZ
+#define CLK_TX      CLOCK_500KHZ
+#endif
+
+static uint16_t dutyOverride[PWM_CHANNELS];     // Host-set duty, 0 to follow the ADC
+static uint8_t userPattern[PWM_CHANNELS];       // Host-set pattern of the blink states
+
+/**
+ * @brief Sets every channel from its override or potentiometer
+ */
+static void followInputs(void) {
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        updateChannelBrightness(i, dutyOverride[i]);
+    }
+}
+
+// ---- Entry, exit and do actions ----
+
+static void offEntry(void) {
+    // System completely off - LED disabled and timers stopped
+    stopPWM();                  // Stop PWM and drive the LED low
+    ADC_stop();                 // No readings needed while off
+    setSleepAllowed(1);         // Sleep until a button wakes us
+    flushConfig(1);             // Settings saved before the power goes
+}
+
+static void offExit(void) {
+    setSleepAllowed(0);
+}
+
+static void offBlinkEntry(void) {
+    // System off but LED blinking at max brightness
+    updateBrightness(PWM_PERIOD);
+}
+
+static void onEntry(void) {
+    // LED at brightness determined by ADC, under the state's pattern
+    followInputs();             // Starts PWM and the ADC
+}
+
+static void transmitEntry(void) {
+    onEntry();
+    startTelemetryStream();     // Fresh window, keyframe first
+}
+
+static void transmitExit(void) {
+    stopTelemetryStream();      // Send samples held for compression
+}
+
+static void onRun(uint16_t events) {
+    if (events & EVT_INPUT) {
+        LATENCY_STAGE(LAT_STATE);
+        followInputs();         // Track the potentiometers when they move
+    }
+}
+
+static void transmitRun(uint16_t events) {
+    uint8_t sent;
+
+    onRun(events);
+    if (events & EVT_ADC) {
+        // Kept in EEPROM too, in case nothing is listening
+        eeLogSample(pwmControl[0].currentDutyCycle, pwmControl[0].adcValue);
+    }
+    if (events & EVT_INPUT) {
+        telemetryInputChanged();
+    }
+    if (!(events & (EVT_ADC | EVT_UART_TX)) || !telemetryDue() || logDumping()
+            || replyPending()) {
+        return;
+    }
+
+    sent = (getTelemetryMode() == TELEMETRY_MODE_WINDOW)
+            ? sendWindowStats()
+            : transmitVoltageADC();
+    if (sent) {                 // Retried on the next event if the FIFO is full
+        telemetrySent();
+    }
+}
+
+// ---- Tables ----
+
+static const StateHandlers stateHandlers[STATE_COUNT] = {
+    //                     entry          exit          run          clock    pattern
+    [OFF_MODE]            = {offEntry,      offExit,      NULL,        CLK_OFF, PATTERN_STEADY},
+    [OFF_BLINK]           = {offBlinkEntry, NULL,         NULL,        CLK_ON,  PATTERN_BLINK},
+    [ON_MODE]             = {onEntry,       NULL,         onRun,       CLK_ON,  PATTERN_STEADY},
+    [ON_BLINK]            = {onEntry,       NULL,         onRun,       CLK_ON,  PATTERN_USER},
+    [TRANSMIT_UART_ON]    = {transmitEntry, transmitExit, transmitRun, CLK_TX,  PATTERN_STEADY},
+    [TRANSMIT_UART_BLINK] = {transmitEntry, transmitExit, transmitRun, CLK_TX,  PATTERN_USER},
+};
+
+#undef CLK_OFF
+#undef CLK_ON
+#undef CLK_TX
+
+// Next state for each (state, event); the current state means "ignore"
+// Holding PB1 is a shortcut to OFF_MODE from anywhere. IOcheck() reports
+// the second of two quick taps as a double press only, so the PBnD columns
+// repeat the PBn ones to make it a second press. The remaining long
+// presses are free for new rows. The host stream commands only act in the
+// LED-on states.
+#define OFF     OFF_MODE
+#define OFF_B   OFF_BLINK
+#define ON      ON_MODE
+#define ON_B    ON_BLINK
+#define TX_ON   TRANSMIT_UART_ON
+#define TX_B    TRANSMIT_UART_BLINK
+
+static const uint8_t transitionTable[STATE_COUNT][SM_EVENT_COUNT] = {
+    //               PB1    PB2    PB3    PB1L   PB2L   PB3L   PB1D   PB2D   PB3D   S_ON   S_OFF
+    [OFF_MODE]   = {ON,    OFF_B, OFF,   OFF,   OFF,   OFF,   ON,    OFF_B, OFF,   OFF,   OFF},
+    [OFF_BLINK]  = {OFF_B, OFF,   OFF_B, OFF,   OFF_B, OFF_B, OFF_B, OFF,   OFF_B, OFF_B, OFF_B},
+    [ON_MODE]    = {OFF,   ON_B,  TX_ON, OFF,   ON,    ON,    OFF,   ON_B,  TX_ON, TX_ON, ON},
+    [ON_BLINK]   = {ON_B,  ON,    TX_B,  OFF,   ON_B,  ON_B,  ON_B,  ON,    TX_B,  TX_B,  ON_B},
+    [TRANSMIT_UART_ON]    = {OFF,  TX_B, ON,   OFF,  TX_ON, TX_ON, OFF,  TX_B,  ON,   TX_ON, ON},
+    [TRANSMIT_UART_BLINK] = {TX_B, TX_ON, ON_B, OFF, TX_B,  TX_B,  TX_B, TX_ON, ON_B, TX_B,  ON_B},
+};
+
+#undef OFF
+#undef OFF_B
+#undef ON
+#undef ON_B
+#undef TX_ON
+#undef TX_B
+
+// ---- Transition trace ----
+
+#if STATE_TRACE_DEPTH > 0
+static StateTraceEntry stateTrace[STATE_TRACE_DEPTH];
+static uint8_t traceNext = 0;       // Slot for the next entry
+static uint8_t traceCount = 0;      // Valid entries, up to STATE_TRACE_DEPTH
+
+static void recordTransition(uint8_t from, uint8_t to, uint8_t event) {
+    StateTraceEntry *entry = &stateTrace[traceNext];
+
+    entry->stamp = STATE_TRACE_CLOCK();
+    entry->from = from;
+    entry->to = to;
+    entry->event = event;
+
+    traceNext = (traceNext + 1 == STATE_TRACE_DEPTH) ? 0 : traceNext + 1;
+    if (traceCount < STATE_TRACE_DEPTH) {
+        traceCount++;
+    }
+}
+#else
+#define recordTransition(from, to, event) ((void)0)
+#endif
+
+/**
+ * @brief Plays the current state's pattern on every channel
+ *
+ * Channels already playing it keep their place, so a pattern carries on
+ * across ON_BLINK and TRANSMIT_UART_BLINK.
+ */
+static void applyStatePattern(void) {
+    uint8_t pattern = stateHandlers[systemState.currentState].pattern;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        uint8_t wanted = (pattern == PATTERN_USER) ? userPattern[i] : pattern;
+
+        if (getPattern(i) != wanted) {
+            playPattern(i, wanted);
+        }
+    }
+}
+
+/**
+ * @brief Puts a corrupted state back to OFF_MODE and enters it
+ *
+ * Every lookup of stateHandlers[] and transitionTable[] goes through
+ * this first, so an out-of-range currentState is never used as an index.
+ */
+static void checkState(void) {
+    if (systemState.currentState < STATE_COUNT) {
+        return;
+    }
+    systemState.currentState = OFF_MODE;
+    if (stateHandlers[OFF_MODE].entry) {
+        stateHandlers[OFF_MODE].entry();
+    }
+    applyStatePattern();
+    applyStateClock();
+}
+
+// ---- Public interface ----
+
+void initStateMachine() {
+    const Config *config = getConfig();
+
+    // Where the last power cycle left off, or OFF_MODE at first boot
+    systemState.currentState = config->state;
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        userPattern[i] = config->userPattern;
+        dutyOverride[i] = config->dutyOverride;
+    }
+    if (stateHandlers[systemState.currentState].entry) {
+        stateHandlers[systemState.currentState].entry();
+    }
+    applyStatePattern();
+    applyStateClock();
+}
+
+clockMode_t getStateClock(uint8_t state) {
+    return (clockMode_t)stateHandlers[state].clock;
+}
+
+void applyStateClock() {
+    uint8_t mode = getStateClock(systemState.currentState);
+
+    // The 4 ms system tick would starve the CPU at 32 kHz; stay at the
+    // debounce clock until the buttons settle (EVT_BUTTONS_IDLE)
+    if (mode < CLOCK_BUTTONS && (getSysTickUsers() & SYSTICK_BUTTONS)) {
+        mode = CLOCK_BUTTONS;
+    }
+    setClockMode((clockMode_t)mode);
+}
+
+uint8_t dispatchEvent(smEvent_t event) {
+    uint8_t current;
+    uint8_t next;
+
+    checkState();
+    current = systemState.currentState;
+    next = transitionTable[current][event];
+
+    if (next == current) {
+        return 0;
+    }
+
+    if (stateHandlers[current].exit) {
+        stateHandlers[current].exit();
+    }
+    systemState.currentState = next;
+    LATENCY_STAGE(LAT_STATE);       // Before the entry action publishes
+    recordTransition(current, next, event);
+    if (stateHandlers[next].entry) {
+        stateHandlers[next].entry();
+    }
+    applyStatePattern();
+    applyStateClock();
+
+    return 1;
+}
+
+void setDutyOverride(uint8_t channel, uint16_t duty) {
+    if (duty > PWM_PERIOD) {
+        duty = PWM_PERIOD;
+    }
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        if (channel == PWM_ALL_CHANNELS || channel == i) {
+            dutyOverride[i] = duty;
+        }
+    }
+
+    // OFF_BLINK keeps its full-brightness override
+    if (systemState.currentState >= ON_MODE) {
+        followInputs();
+    }
+}
+
+uint16_t getDutyOverride(uint8_t channel) {
+    return dutyOverride[channel];
+}
+
+void setUserPattern(uint8_t channel, uint8_t pattern) {
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++) {
+        if (channel == PWM_ALL_CHANNELS || channel == i) {
+            userPattern[i] = pattern;
+        }
+    }
+
+    // Restarts the pattern even if it was already playing
+    if (stateHandlers[systemState.currentState].pattern == PATTERN_USER) {
+        playPattern(channel, pattern);
+    }
+}
+
+uint8_t getUserPattern(uint8_t channel) {
+    return userPattern[channel];
+}
+
+void runState(uint16_t events) {
+    checkState();
+    if (stateHandlers[systemState.currentState].run) {
+        stateHandlers[systemState.currentState].run(events);
+    }
+}
+
+uint8_t getStateTrace(StateTraceEntry *out, uint8_t max) {
+#if STATE_TRACE_DEPTH > 0
+    uint8_t index = traceNext;
+    uint8_t copied = 0;
+
+    while (copied < traceCount && copied < max) {
+        index = (index == 0) ? STATE_TRACE_DEPTH - 1 : index - 1;
+        out[copied++] = stateTrace[index];
+    }
+    return copied;
+#else
+    return 0;
+#endif
+}
+
+void dumpStateTrace() {
+#if STATE_TRACE_DEPTH > 0
+    StateTraceEntry entries[STATE_TRACE_DEPTH];
+    uint8_t count = getStateTrace(entries, STATE_TRACE_DEPTH);
+
+    for (uint8_t i = 0; i < count; i++) {
+        char line[14];      // "sssss f->t ee\n"
+        uint8_t length = FormatDec(line, entries[i].stamp, 5);
+
+        line[length++] = ' ';
+        length += FormatDec(&line[length], entries[i].from, 1);
+        line[length++] = '-';
+        line[length++] = '>';
+        length += FormatDec(&line[length], entries[i].to, 1);
+        line[length++] = ' ';
+        length += FormatDec(&line[length], entries[i].event, 2);    // Up to SM_EVENT_COUNT - 1
+        line[length++] = '\n';
+
+        while (!PutRecordUART2(line, length)) {
+            halIdle();      // Debug dump: wait for room rather than drop lines
+        }
+    }
+#endif
+}
@@ -9,8 +9,28 @@
 #ifndef STATEMACHINE_H
 #define STATEMACHINE_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
+#include "timeDelay.h"
+#include "clkChange.h"
+
+/**
+ * @brief Depth of the transition trace ring buffer
+ *
+ * The last STATE_TRACE_DEPTH transitions are kept in RAM for field
+ * debugging. Define as 0 to compile the trace out.
+ */
+#ifndef STATE_TRACE_DEPTH
+#define STATE_TRACE_DEPTH 8
+#endif
+
+/**
+ * @brief Timestamp source for trace entries
+ *
+ * Low 16 bits of the free-running tick (TICK_HZ).
+ */
+#ifndef STATE_TRACE_CLOCK
+#define STATE_TRACE_CLOCK() tickNow16()
+#endif
 
 /**
  * @brief Enumeration of all possible system states
@@ -19,9 +39,9 @@
  * @field OFF_MODE:             System is in off state
  * @field OFF_BLINK:            System is off with blinking indicator
  * @field ON_MODE:              System is in on state
- * @field ON_BLINK:             System is on with blinking indicator
+ * @field ON_BLINK:             System is on, playing the selected pattern
  * @field TRANSMIT_UART_ON:     UART transmission in on state
- * @field TRANSMIT_UART_BLINK   UART transmission with blinking indicator
+ * @field TRANSMIT_UART_BLINK   UART transmission playing the selected pattern
  */
 typedef enum {
     OFF_MODE,
@@ -29,9 +49,43 @@ typedef enum {
     ON_MODE,
     ON_BLINK,
     TRANSMIT_UART_ON,
-    TRANSMIT_UART_BLINK
+    TRANSMIT_UART_BLINK,
+    STATE_COUNT
 } state_t;
 
+/**
+ * @brief Enumeration of inputs that can cause a state transition
+ *
+ * Ordered to match the BUTTON_* bits from takeButtonEvents(), so bit n
+ * of the button event mask is event n.
+ *
+ * @field SM_EVENT_PB1:         Button 1 released
+ * @field SM_EVENT_PB2:         Button 2 released
+ * @field SM_EVENT_PB3:         Button 3 released
+ * @field SM_EVENT_PB1_LONG:    Button 1 held for LONG_PRESS_TICKS
+ * @field SM_EVENT_PB2_LONG:    Button 2 held for LONG_PRESS_TICKS
+ * @field SM_EVENT_PB3_LONG:    Button 3 held for LONG_PRESS_TICKS
+ * @field SM_EVENT_PB1_DOUBLE:  Button 1 released twice within DOUBLE_PRESS_TICKS
+ * @field SM_EVENT_PB2_DOUBLE:  Button 2 released twice within DOUBLE_PRESS_TICKS
+ * @field SM_EVENT_PB3_DOUBLE:  Button 3 released twice within DOUBLE_PRESS_TICKS
+ * @field SM_EVENT_STREAM_ON:   Host asked to start streaming (command.h)
+ * @field SM_EVENT_STREAM_OFF:  Host asked to stop streaming
+ */
+typedef enum {
+    SM_EVENT_PB1,
+    SM_EVENT_PB2,
+    SM_EVENT_PB3,
+    SM_EVENT_PB1_LONG,
+    SM_EVENT_PB2_LONG,
+    SM_EVENT_PB3_LONG,
+    SM_EVENT_PB1_DOUBLE,
+    SM_EVENT_PB2_DOUBLE,
+    SM_EVENT_PB3_DOUBLE,
+    SM_EVENT_STREAM_ON,
+    SM_EVENT_STREAM_OFF,
+    SM_EVENT_COUNT
+} smEvent_t;
+
 /**
  * @brief Structure to maintain system state
  * 
@@ -43,9 +97,115 @@ typedef struct {
 } SystemState;
 
 // Global system state instance
-// Initialized to OFF_MODE by default
-SystemState systemState = {
-    .currentState = OFF_MODE
-};
+// Initialized to OFF_MODE in stateMachine.c
+extern SystemState systemState;
+
+/**
+ * @brief One recorded state transition
+ *
+ * @field stamp:  STATE_TRACE_CLOCK() value when the transition happened
+ * @field from:   State that was left
+ * @field to:     State that was entered
+ * @field event:  smEvent_t that triggered it
+ */
+typedef struct {
+    uint16_t stamp;
+    uint8_t from;
+    uint8_t to;
+    uint8_t event;
+} StateTraceEntry;
+
+/**
+ * @brief Enters the initial state by running its entry action.
+ *
+ * The state, blink pattern and duty override come from the stored
+ * configuration (config.h), so call loadConfig() first.
+ */
+void initStateMachine();
+
+/**
+ * @brief Returns the clock a state runs at.
+ *
+ * @param state  state_t
+ */
+clockMode_t getStateClock(uint8_t state);
+
+/**
+ * @brief Switches to the current state's clock.
+ *
+ * Runs after every transition. Never drops below CLOCK_BUTTONS while the
+ * buttons hold the system tick; call again on EVT_BUTTONS_IDLE.
+ */
+void applyStateClock();
+
+/**
+ * @brief Looks up and performs the transition for an event.
+ *
+ * One table lookup picks the next state. If it differs from the current
+ * state, the old state's exit action and the new state's entry action run,
+ * the new state's pattern starts and the transition is recorded in the
+ * trace.
+ *
+ * @param event Input that occurred
+ * @return 1 if the state changed, 0 if the event is ignored in this state
+ */
+uint8_t dispatchEvent(smEvent_t event);
+
+/**
+ * @brief Fixes an LED duty cycle instead of following the potentiometer.
+ *
+ * Applied at once in the LED-on states and kept across transitions.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1, or PWM_ALL_CHANNELS
+ * @param duty     Duty count (1 to PWM_PERIOD), or 0 to follow the ADC again
+ */
+void setDutyOverride(uint8_t channel, uint16_t duty);
+
+/**
+ * @brief Returns a channel's duty override, 0 if the ADC is in control.
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
+ */
+uint16_t getDutyOverride(uint8_t channel);
+
+/**
+ * @brief Selects the pattern played in ON_BLINK and TRANSMIT_UART_BLINK.
+ *
+ * Applied at once in those states. OFF_BLINK always plays PATTERN_BLINK.
+ *
+ * @param channel  0 to PWM_CHANNELS - 1, or PWM_ALL_CHANNELS
+ * @param pattern  PATTERN_* (patternTable.h), PATTERN_BLINK by default
+ */
+void setUserPattern(uint8_t channel, uint8_t pattern);
+
+/**
+ * @brief Returns a channel's pattern for the blinking LED-on states.
+ *
+ * @param channel 0 to PWM_CHANNELS - 1
+ */
+uint8_t getUserPattern(uint8_t channel);
+
+/**
+ * @brief Performs the per-event work of the current state.
+ *
+ * @param events Bitmask of EVT_* values returned by waitForEvents()
+ */
+void runState(uint16_t events);
+
+/**
+ * @brief Copies recorded transitions, newest first.
+ *
+ * @param out  Destination array
+ * @param max  Capacity of out
+ * @return Number of entries copied
+ */
+uint8_t getStateTrace(StateTraceEntry *out, uint8_t max);
+
+/**
+ * @brief Prints the recorded transitions over UART2, newest first.
+ *
+ * One line per entry: "stamp from->to event".
+ */
+void dumpStateTrace();
 
-#endif
\ No newline at end of file
+#endif
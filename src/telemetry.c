@@ -0,0 +1,349 @@
+/*
+ * File:   telemetry.c
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Implementation of the framed binary telemetry protocol.
+ */
+
+#include "telemetry.h"
+#include "UART2.h"
+#include "PWM.h"
+
+// CRC-8 (poly 0x07) per nibble: two lookups per byte, 16 bytes of flash
+static const uint8_t CRC8_NIBBLE[16] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+static uint8_t telemetryFormat = TELEMETRY_DEFAULT_FORMAT;
+static uint8_t frameSeq = 0;
+static uint16_t intervalMs = 0;         // 0: stream every ADC reading
+static uint32_t intervalTicks = 0;
+static uint32_t lastSent = 0;           // Schedule of the last queued sample
+static uint8_t telemetryMode = TELEMETRY_MODE_RAW;
+static uint8_t inputChanged = 0;        // Owed a sample in TELEMETRY_MODE_CHANGE
+
+// Written by the ADC interrupt; read and reset with interrupts masked
+static volatile uint8_t windowActive = 0;
+static volatile TelemetryWindow window;
+
+// Compressed stream state (main loop only)
+#define DELTA_HEADER    3               // TICK, COUNT
+#define RUN_RESERVE     2               // Largest run token (run < 256)
+#define TOKEN_MAX       4               // 2-byte HEAD plus 2-byte duty varint
+
+static uint8_t deltaPayload[TELEMETRY_MAX_PAYLOAD];
+static uint8_t deltaLength = DELTA_HEADER;  // Bytes used, header included
+static uint8_t deltaCount = 0;          // Samples in the pending frame
+static uint8_t runLength = 0;           // Unchanged samples not yet written
+static uint8_t sinceKey = 0;            // Samples since the last keyframe
+static uint8_t needKey = 1;             // Chain broken or not started
+static uint16_t lastTick;
+static uint16_t lastAdc;
+static uint8_t lastDuty;
+
+void setTelemetryFormat(uint8_t format) {
+    telemetryFormat = format;
+    needKey = 1;                        // Compressed stream restarts cleanly
+}
+
+uint8_t getTelemetryFormat() {
+    return telemetryFormat;
+}
+
+void setTelemetryMode(uint8_t mode) {
+    telemetryMode = mode;
+    resetTelemetryWindow();
+    windowActive = (mode == TELEMETRY_MODE_WINDOW);
+}
+
+uint8_t getTelemetryMode() {
+    return telemetryMode;
+}
+
+void telemetryWindowAdd(uint16_t adcValue) {
+    uint16_t duty = pwmControl[0].currentDutyCycle;
+
+    if (!windowActive || window.count == 0xFFFF) {
+        return;
+    }
+
+    if (adcValue < window.adcMin) window.adcMin = adcValue;
+    if (adcValue > window.adcMax) window.adcMax = adcValue;
+    if (duty < window.dutyMin) window.dutyMin = duty;
+    if (duty > window.dutyMax) window.dutyMax = duty;
+    window.adcSum += adcValue;
+    window.dutySum += duty;
+    window.count++;
+}
+
+void resetTelemetryWindow() {
+    uint8_t savedIPL = halMaskInterrupts();
+
+    window.count = 0;
+    window.adcMin = 0xFFFF;
+    window.adcMax = 0;
+    window.adcSum = 0;
+    window.dutyMin = 0xFFFF;
+    window.dutyMax = 0;
+    window.dutySum = 0;
+    halRestoreInterrupts(savedIPL);
+}
+
+/**
+ * @brief Mean of a window sum in 12.4 fixed point
+ */
+static uint16_t windowMean(uint32_t sum, uint16_t count) {
+    return (uint16_t)((sum << TELEMETRY_MEAN_SHIFT) / count);
+}
+
+uint8_t sendWindowStats() {
+    TelemetryWindow stats;
+    uint8_t payload[TELEMETRY_WINDOW_PAYLOAD];
+    uint8_t savedIPL;
+    uint16_t adcMean;
+    uint16_t dutyMean;
+    uint16_t fields[7];
+    char record[36];
+    uint8_t length;
+
+    // Fits check first so a full FIFO leaves the window accumulating
+    if (TxSpaceUART2() < (getTelemetryFormat() != TELEMETRY_ASCII
+                          ? TELEMETRY_WINDOW_PAYLOAD + TELEMETRY_OVERHEAD
+                          : 36)) {
+        return 0;
+    }
+
+    // One section, so no sample lands between the copy and the reset
+    savedIPL = halMaskInterrupts();
+    stats = window;
+    resetTelemetryWindow();
+    halRestoreInterrupts(savedIPL);
+
+    if (!stats.count) {
+        return 1;
+    }
+    adcMean = windowMean(stats.adcSum, stats.count);
+    dutyMean = windowMean(stats.dutySum, stats.count);
+
+    if (getTelemetryFormat() != TELEMETRY_ASCII) {
+        putU16(&payload[0], TELEMETRY_CLOCK());
+        putU16(&payload[2], stats.count);
+        putU16(&payload[4], stats.adcMin);
+        putU16(&payload[6], stats.adcMax);
+        putU16(&payload[8], adcMean);
+        putU16(&payload[10], stats.dutyMin);
+        putU16(&payload[12], stats.dutyMax);
+        putU16(&payload[14], dutyMean);
+        return sendFrame(TELEMETRY_FRAME_WINDOW, payload, sizeof(payload));
+    }
+
+    // "ccccc aaaa aaaa aaaa dddd dddd dddd\n"
+    fields[0] = stats.count;
+    fields[1] = stats.adcMin;
+    fields[2] = stats.adcMax;
+    fields[3] = adcMean >> TELEMETRY_MEAN_SHIFT;
+    fields[4] = stats.dutyMin;
+    fields[5] = stats.dutyMax;
+    fields[6] = dutyMean >> TELEMETRY_MEAN_SHIFT;
+
+    length = FormatDec(record, fields[0], 5);
+    for (uint8_t i = 1; i < 7; i++) {
+        record[length++] = ' ';
+        length += FormatDec(&record[length], fields[i], 4);
+    }
+    record[length++] = '\n';
+    return PutRecordUART2(record, length);
+}
+
+void setTelemetryInterval(uint16_t interval) {
+    intervalMs = interval;
+    intervalTicks = MS_TO_TICKS(interval);
+}
+
+uint16_t getTelemetryInterval() {
+    return intervalMs;
+}
+
+void telemetryInputChanged() {
+    inputChanged = 1;
+}
+
+uint8_t telemetryDue() {
+    if (telemetryMode == TELEMETRY_MODE_CHANGE && !inputChanged) {
+        return 0;
+    }
+    return !intervalTicks || tickNow() - lastSent >= intervalTicks;
+}
+
+void telemetrySent() {
+    uint32_t now = tickNow();
+
+    inputChanged = 0;
+    lastSent += intervalTicks;
+    if (now - lastSent >= intervalTicks) {
+        lastSent = now;                 // Fell behind (FIFO full); resync
+    }
+}
+
+uint8_t crc8(uint8_t crc, const uint8_t *data, uint8_t length) {
+    while (length--) {
+        crc ^= *data++;
+        crc = (crc << 4) ^ CRC8_NIBBLE[crc >> 4];
+        crc = (crc << 4) ^ CRC8_NIBBLE[crc >> 4];
+    }
+    return crc;
+}
+
+uint8_t sendFrame(uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[TELEMETRY_MAX_PAYLOAD + TELEMETRY_OVERHEAD];
+
+    if (length > TELEMETRY_MAX_PAYLOAD) {
+        return 0;
+    }
+
+    frame[0] = TELEMETRY_SYNC;
+    frame[1] = frameSeq;
+    frame[2] = type;
+    frame[3] = length;
+    for (uint8_t i = 0; i < length; i++) {
+        frame[4 + i] = payload[i];
+    }
+    frame[4 + length] = crc8(0, &frame[1], 3 + length);
+
+    // Whole frame or nothing
+    if (!PutRecordUART2((const char *)frame, length + TELEMETRY_OVERHEAD)) {
+        return 0;
+    }
+    frameSeq++;
+    return 1;
+}
+
+/**
+ * @brief Writes the TICK, DUTY, ADC fields shared by samples and keyframes
+ */
+static void packSample(uint8_t *payload, uint16_t tick, uint8_t dutyPercent,
+                       uint16_t adcValue) {
+    putU16(&payload[0], tick);
+    payload[2] = dutyPercent;
+    putU16(&payload[3], adcValue);
+}
+
+uint8_t sendSampleFrame(uint16_t tick, uint8_t dutyPercent, uint16_t adcValue,
+                        const uint16_t *extras, uint8_t count) {
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    uint8_t length = TELEMETRY_SAMPLE_PAYLOAD;
+
+    if (count > TELEMETRY_MAX_EXTRAS) {
+        count = TELEMETRY_MAX_EXTRAS;
+    }
+
+    packSample(payload, tick, dutyPercent, adcValue);
+
+    for (uint8_t i = 0; i < count; i++) {
+        payload[length++] = extras[i] & 0xFF;
+        payload[length++] = extras[i] >> 8;
+    }
+
+    return sendFrame(TELEMETRY_FRAME_SAMPLE, payload, length);
+}
+
+// ---- Compressed stream ----
+
+#if TELEMETRY_KEY_INTERVAL < 1 || TELEMETRY_KEY_INTERVAL > 255
+#error "TELEMETRY_KEY_INTERVAL must be between 1 and 255"
+#endif
+
+static uint16_t zigzag(int16_t value) {
+    return ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+}
+
+static void putVarint(uint16_t value) {
+    while (value >= 0x80) {
+        deltaPayload[deltaLength++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    deltaPayload[deltaLength++] = value;
+}
+
+static void writeRun() {
+    if (runLength) {
+        putVarint(((uint16_t)runLength << 1) | 1);
+        runLength = 0;
+    }
+}
+
+/**
+ * @brief Queues the pending delta frame
+ *
+ * @return 1 if queued or empty; 0 if dropped, which forces a keyframe
+ */
+static uint8_t flushDelta() {
+    uint8_t queued;
+
+    if (!deltaCount) {
+        return 1;
+    }
+    writeRun();
+    putU16(&deltaPayload[0], lastTick);
+    deltaPayload[2] = deltaCount;
+    queued = sendFrame(TELEMETRY_FRAME_DELTA, deltaPayload, deltaLength);
+
+    deltaLength = DELTA_HEADER;
+    deltaCount = 0;
+    if (!queued) {
+        needKey = 1;                    // Host cannot follow the next deltas
+    }
+    return queued;
+}
+
+void startTelemetryStream() {
+    resetTelemetryWindow();
+    deltaLength = DELTA_HEADER;
+    deltaCount = 0;
+    runLength = 0;
+    needKey = 1;
+    inputChanged = 1;                   // The host needs a starting point
+}
+
+void stopTelemetryStream() {
+    flushDelta();
+}
+
+uint8_t sendCompressedSample(uint16_t tick, uint8_t dutyPercent, uint16_t adcValue) {
+    int16_t adcDelta = adcValue - lastAdc;
+    int16_t dutyDelta = (int16_t)dutyPercent - lastDuty;
+
+    if (needKey || sinceKey >= TELEMETRY_KEY_INTERVAL) {
+        uint8_t payload[TELEMETRY_SAMPLE_PAYLOAD];
+
+        flushDelta();                   // Deltas before the key still decode
+        packSample(payload, tick, dutyPercent, adcValue);
+        if (!sendFrame(TELEMETRY_FRAME_KEY, payload, sizeof(payload))) {
+            needKey = 1;
+            return 0;
+        }
+        needKey = 0;
+        sinceKey = 0;
+    } else if (!adcDelta && !dutyDelta) {
+        runLength++;                    // Bounded by TELEMETRY_KEY_INTERVAL
+        deltaCount++;
+        sinceKey++;
+    } else {
+        writeRun();                     // RUN_RESERVE kept room for it
+        if (deltaLength + TOKEN_MAX + RUN_RESERVE > TELEMETRY_MAX_PAYLOAD &&
+            !flushDelta()) {
+            return sendCompressedSample(tick, dutyPercent, adcValue);  // As a keyframe
+        }
+        putVarint(zigzag(adcDelta) << 1);
+        putVarint(zigzag(dutyDelta));
+        deltaCount++;
+        sinceKey++;
+    }
+
+    lastTick = tick;
+    lastAdc = adcValue;
+    lastDuty = dutyPercent;
+    return 1;
+}
@@ -0,0 +1,316 @@
+/*
+ * File:   telemetry.h
+ * Authors: Ahron Ramos, Adrian Co, Zaira Ramji
+ * Created on November 13, 2024, 4:28 PM
+ * 
+ * Description: Header file for the framed binary telemetry protocol.
+ *             Frames are queued on UART2 alongside (or instead of) the ASCII records.
+ *
+ * Frame layout (multi-byte fields little-endian):
+ *   [0]     SYNC     0xA5
+ *   [1]     SEQ      Frame counter, wraps at 256
+ *   [2]     TYPE     TELEMETRY_FRAME_* value
+ *   [3]     LEN      Payload length in bytes
+ *   [4..]   PAYLOAD  LEN bytes
+ *   [4+LEN] CRC      CRC-8 (poly 0x07, init 0x00) over SEQ..PAYLOAD
+ *
+ * Sample payload (TELEMETRY_FRAME_SAMPLE):
+ *   [0..1]  TICK     Tick (TICK_HZ) when the ADC reading was completed
+ *   [2]     DUTY     Duty cycle in percent (0-100)
+ *   [3..4]  ADC      Raw ADC reading (0-1023)
+ *   [5..]   EXTRA    Optional 16-bit extra fields, (LEN - 5) / 2 of them;
+ *                    DUTY, ADC pairs of channels 1 and up (PWM_CHANNELS)
+ *
+ * Window payload (TELEMETRY_FRAME_WINDOW), one per telemetry interval,
+ * for channel 0:
+ *   [0..1]   TICK      Tick when the window was closed
+ *   [2..3]   COUNT     ADC readings in the window
+ *   [4..5]   ADC_MIN   Smallest reading
+ *   [6..7]   ADC_MAX   Largest reading
+ *   [8..9]   ADC_MEAN  Mean reading, 12.4 fixed point
+ *   [10..11] DUTY_MIN  Smallest duty count (0-PWM_PERIOD)
+ *   [12..13] DUTY_MAX  Largest duty count
+ *   [14..15] DUTY_MEAN Mean duty count, 12.4 fixed point
+ *
+ * TELEMETRY_COMPRESSED streams channel 0's raw samples as keyframes and
+ * delta frames.
+ * A keyframe (TELEMETRY_FRAME_KEY) has the sample payload above. Delta
+ * frames (TELEMETRY_FRAME_DELTA) carry the samples that follow it:
+ *   [0..1]  TICK     Tick of the last sample in the frame; the host spaces
+ *                    the samples evenly since the previous frame
+ *   [2]     COUNT    Samples in the frame
+ *   [3..]   TOKENS   Varints (7 bits per byte, low first, bit 7 = more):
+ *                    HEAD = zz(ADC delta) << 1, then zz(DUTY delta)
+ *                    HEAD = run << 1 | 1 for run unchanged samples
+ * where zz() is the zig-zag map 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+ * A keyframe follows every TELEMETRY_KEY_INTERVAL samples and any frame
+ * that could not be queued; the host drops deltas after a SEQ gap until then.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "hal.h"
+#include "timeDelay.h"
+
+#define TELEMETRY_SYNC          0xA5
+#define TELEMETRY_OVERHEAD      5       // SYNC, SEQ, TYPE, LEN, CRC
+#define TELEMETRY_MAX_PAYLOAD   32
+
+#define TELEMETRY_FRAME_SAMPLE  0x01
+#define TELEMETRY_FRAME_WINDOW  0x02
+#define TELEMETRY_FRAME_KEY     0x03
+#define TELEMETRY_FRAME_DELTA   0x04
+#define TELEMETRY_FRAME_PROFILE 0x05    // Cycle-count statistics (profile.h)
+#define TELEMETRY_FRAME_LOG     0x06    // Data EEPROM log dump (eeLog.h)
+#define TELEMETRY_FRAME_LATENCY 0x07    // Input-to-LED latency (latency.h)
+#define TELEMETRY_FRAME_REPLY   0x80    // OR'd with a command type (command.h)
+
+#define TELEMETRY_SAMPLE_PAYLOAD 5      // TICK, DUTY, ADC without extras
+#define TELEMETRY_MAX_EXTRAS    ((TELEMETRY_MAX_PAYLOAD - TELEMETRY_SAMPLE_PAYLOAD) / 2)
+#define TELEMETRY_WINDOW_PAYLOAD 16
+#define TELEMETRY_MEAN_SHIFT    4       // Fraction bits of the window means
+
+/**
+ * Output formats for transmitVoltageADC():
+ * - TELEMETRY_ASCII:  "ddd aaaa\n" text records
+ * - TELEMETRY_BINARY: TELEMETRY_FRAME_SAMPLE frames
+ * - TELEMETRY_COMPRESSED: Keyframes and delta frames (see above)
+ */
+#define TELEMETRY_ASCII         0
+#define TELEMETRY_BINARY        1
+#define TELEMETRY_COMPRESSED    2
+
+#ifndef TELEMETRY_DEFAULT_FORMAT
+#define TELEMETRY_DEFAULT_FORMAT TELEMETRY_ASCII
+#endif
+
+/**
+ * @brief Samples between keyframes in TELEMETRY_COMPRESSED
+ *
+ * Bounds how long the host waits to resync and how long a run of
+ * unchanged samples is held back. At most 255.
+ */
+#ifndef TELEMETRY_KEY_INTERVAL
+#define TELEMETRY_KEY_INTERVAL  64
+#endif
+
+/**
+ * Streaming modes:
+ * - TELEMETRY_MODE_RAW:    One sample per telemetry interval
+ * - TELEMETRY_MODE_WINDOW: Min, max, mean and count of every ADC reading
+ *                          and duty cycle in each interval. ASCII records
+ *                          are "count amin amax amean dmin dmax dmean\n"
+ *                          with integer means.
+ * - TELEMETRY_MODE_CHANGE: A raw sample only when a filtered potentiometer
+ *                          reading changed (EVT_INPUT), at most one per
+ *                          interval. Duty changes from a pattern or the
+ *                          brightness loop do not count.
+ */
+#define TELEMETRY_MODE_RAW      0
+#define TELEMETRY_MODE_WINDOW   1
+#define TELEMETRY_MODE_CHANGE   2
+
+/**
+ * @brief Running statistics for one telemetry window
+ *
+ * @field count:    Readings added, saturates at 0xFFFF
+ * @field adcMin:   Smallest ADC reading
+ * @field adcMax:   Largest ADC reading
+ * @field adcSum:   Sum of ADC readings
+ * @field dutyMin:  Smallest duty count
+ * @field dutyMax:  Largest duty count
+ * @field dutySum:  Sum of duty counts
+ */
+typedef struct {
+    uint16_t count;
+    uint16_t adcMin;
+    uint16_t adcMax;
+    uint32_t adcSum;
+    uint16_t dutyMin;
+    uint16_t dutyMax;
+    uint32_t dutySum;
+} TelemetryWindow;
+
+/**
+ * @brief Timestamp source for frames without a sample time of their own
+ *
+ * Low 16 bits of the free-running tick (TICK_HZ).
+ */
+#ifndef TELEMETRY_CLOCK
+#define TELEMETRY_CLOCK() tickNow16()
+#endif
+
+/**
+ * @brief Selects the record format used by transmitVoltageADC().
+ *
+ * Restarts the compressed stream with a keyframe.
+ *
+ * @param format TELEMETRY_ASCII, TELEMETRY_BINARY or TELEMETRY_COMPRESSED
+ */
+void setTelemetryFormat(uint8_t format);
+
+/**
+ * @brief Returns the record format used by transmitVoltageADC().
+ *
+ * @return TELEMETRY_ASCII, TELEMETRY_BINARY or TELEMETRY_COMPRESSED
+ */
+uint8_t getTelemetryFormat();
+
+/**
+ * @brief Selects raw samples, window statistics or changes for streaming.
+ *
+ * Starts a new window.
+ *
+ * @param mode TELEMETRY_MODE_RAW, TELEMETRY_MODE_WINDOW or TELEMETRY_MODE_CHANGE
+ */
+void setTelemetryMode(uint8_t mode);
+
+/**
+ * @brief Returns the streaming mode.
+ */
+uint8_t getTelemetryMode();
+
+/**
+ * @brief Adds one ADC reading and channel 0's duty cycle to the window.
+ *
+ * Called from the ADC interrupt, so no reading is missed when main-loop
+ * events coalesce. Does nothing outside TELEMETRY_MODE_WINDOW.
+ *
+ * @param adcValue Averaged ADC reading
+ */
+void telemetryWindowAdd(uint16_t adcValue);
+
+/**
+ * @brief Discards the statistics gathered so far.
+ */
+void resetTelemetryWindow();
+
+/**
+ * @brief Prepares a new stream: fresh window, keyframe first.
+ *
+ * TELEMETRY_MODE_CHANGE starts with the current reading.
+ */
+void startTelemetryStream();
+
+/**
+ * @brief Ends a stream, queuing any samples still held for compression.
+ */
+void stopTelemetryStream();
+
+/**
+ * @brief Closes the current window and queues its statistics.
+ *
+ * Uses the current telemetry format. An empty window queues nothing.
+ * If the UART FIFO has no room the window keeps accumulating.
+ *
+ * @return 1 if queued (or empty), 0 if there was no room
+ */
+uint8_t sendWindowStats();
+
+/**
+ * @brief Sets the streaming interval.
+ *
+ * Raw samples are sent at this fixed rate; window statistics are closed
+ * at this rate.
+ *
+ * @param intervalMs Milliseconds per sample or window, 0 for every ADC reading
+ */
+void setTelemetryInterval(uint16_t intervalMs);
+
+/**
+ * @brief Returns the interval set by setTelemetryInterval().
+ */
+uint16_t getTelemetryInterval();
+
+/**
+ * @brief Notes that a potentiometer reading changed.
+ *
+ * Call from the TRANSMIT states on EVT_INPUT.
+ */
+void telemetryInputChanged();
+
+/**
+ * @brief Reports whether the next streamed sample is due.
+ *
+ * @return 1 if at least the telemetry interval has passed since the last
+ *         sample was queued and, in TELEMETRY_MODE_CHANGE, an input
+ *         changed since then
+ */
+uint8_t telemetryDue();
+
+/**
+ * @brief Advances the telemetry schedule after a sample was queued.
+ *
+ * Steps by whole intervals so the rate does not drift with loop timing;
+ * restarts from now if the schedule fell more than an interval behind.
+ */
+void telemetrySent();
+
+/**
+ * @brief Computes the CRC-8 (poly 0x07, init 0x00) of a buffer.
+ *
+ * @param crc     Running CRC, 0 for a new frame
+ * @param data    Bytes to add
+ * @param length  Number of bytes
+ * @return Updated CRC
+ */
+uint8_t crc8(uint8_t crc, const uint8_t *data, uint8_t length);
+
+/**
+ * @brief Payload field helpers; every multi-byte field is little-endian
+ */
+static inline void putU16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = value & 0xFF;
+    bytes[1] = value >> 8;
+}
+
+static inline void putU32(uint8_t *bytes, uint32_t value) {
+    putU16(&bytes[0], value & 0xFFFF);
+    putU16(&bytes[2], value >> 16);
+}
+
+static inline uint16_t getU16(const uint8_t *bytes) {
+    return bytes[0] | ((uint16_t)bytes[1] << 8);
+}
+
+/**
+ * @brief Wraps a payload in a frame and queues it on UART2.
+ *
+ * The frame is queued in full or not at all; SEQ only advances for
+ * frames that were queued, so gaps seen by the host are real drops.
+ *
+ * @param type     TELEMETRY_FRAME_* value
+ * @param payload  Payload bytes
+ * @param length   Payload length, at most TELEMETRY_MAX_PAYLOAD
+ * @return 1 if queued, 0 if the UART FIFO had no room
+ */
+uint8_t sendFrame(uint8_t type, const uint8_t *payload, uint8_t length);
+
+/**
+ * @brief Queues one TELEMETRY_FRAME_SAMPLE frame.
+ *
+ * @param tick         Sample timestamp, low 16 bits of tickNow()
+ * @param dutyPercent  Duty cycle in percent
+ * @param adcValue     Raw ADC reading
+ * @param extras       Optional extra fields (may be NULL when count is 0)
+ * @param count        Number of extras, at most TELEMETRY_MAX_EXTRAS
+ * @return 1 if queued, 0 if the UART FIFO had no room
+ */
+uint8_t sendSampleFrame(uint16_t tick, uint8_t dutyPercent, uint16_t adcValue,
+                        const uint16_t *extras, uint8_t count);
+
+/**
+ * @brief Adds one sample to the TELEMETRY_COMPRESSED stream.
+ *
+ * Samples are held until a delta frame fills up, the keyframe interval
+ * ends or stopTelemetryStream() is called.
+ *
+ * @param tick         Sample timestamp, low 16 bits of tickNow()
+ * @param dutyPercent  Duty cycle in percent
+ * @param adcValue     Raw ADC reading
+ * @return 1 if the sample was taken, 0 if a keyframe had no room (retry)
+ */
+uint8_t sendCompressedSample(uint16_t tick, uint8_t dutyPercent, uint16_t adcValue);
+
+#endif
@@ -5,6 +5,37 @@
  */
 
 #include "timeDelay.h"
+#include "PWM.h"
+#include "clkChange.h"
+
+static volatile uint16_t tickHigh = 0;      // Timer3 overflows since the last retune
+static uint32_t tickBase = 0;               // Normalized tick at the last retune
+static int8_t tickShift = 0;                // Raw Timer3 counts -> TICK_HZ
+static uint32_t cycleBase = 0;              // Instruction cycles at the last retune
+static uint8_t cycleShift = 0;              // log2 of the Timer3 prescaler
+
+// log2 of the prescaler selected by each TCKPS value
+static const uint8_t PRESCALE_SHIFT[4] = {0, 3, 6, 8};
+static volatile uint8_t sysTickUsers = 0;   // SYSTICK_* bits currently active
+
+/**
+ * @brief (Re)starts the system tick timer for the current clock
+ */
+static void startSysTickTimer() {
+    const ClockProfile *clk = getClockProfile();
+
+#if PWM_BACKEND == PWM_BACKEND_OC
+    T1CONbits.TCKPS = clk->timerPrescale;
+    TMR1 = 0;
+    PR1 = clk->sysTickPR;
+    T1CONbits.TON = 1;
+#else
+    T2CONbits.TCKPS = clk->timerPrescale;
+    TMR2 = 0;
+    PR2 = clk->sysTickPR;
+    T2CONbits.TON = 1;
+#endif
+}
 
 void timerInit() {
     // Timer2 Configuration
@@ -14,7 +45,7 @@ void timerInit() {
     T1CONbits.TCKPS = 0;                // Timer1 prescaler: 1:1
     T1CONbits.TCS   = 0;                // Internal clock source
     T1CONbits.TSIDL = 0;                // Operate during CPU idle mode
-    IPC5bits.INT1IP = 2;                // Timer1 interrupt priority: 2
+    IPC0bits.T1IP   = 2;                // Timer1 interrupt priority: 2
     IFS0bits.T1IF   = 0;                // Clear Timer1 interrupt flag
     IEC0bits.T1IE   = 1;                // Enable Timer1 interrupts
     
@@ -26,13 +57,68 @@ void timerInit() {
     IFS0bits.T2IF   = 0;                // Clear Timer2 interrupt flag
     IEC0bits.T2IE   = 1;                // Enable Timer2 interrupts
 
-    // Timer 3 Initialization
-    T3CONbits.TCKPS = 1;                // Set Timer3 prescaler to 1:8
+    // Timer 3 Initialization (free-running tick)
+    T3CONbits.TCKPS = getClockProfile()->timerPrescale;
+    tickShift       = getClockProfile()->tickShift;
+    cycleShift      = PRESCALE_SHIFT[getClockProfile()->timerPrescale];
     T3CONbits.TCS   = 0;                // Use the internal clock source for Timer3
     T3CONbits.TSIDL = 0;                // Timer3 continues to operate in CPU idle mode
     IPC2bits.T3IP   = 4;                // Set Timer3 interrupt priority to 4
     IFS0bits.T3IF   = 0;                // Clear Timer3 interrupt flag
     IEC0bits.T3IE   = 1;                // Enable Timer3 interrupts
+    PR3             = 0xFFFF;           // Count through the full 16 bits
+    TMR3            = 0;
+    T3CONbits.TON   = 1;                // Tick runs from here on
+}
+
+void requestSysTick(uint8_t user) {
+    uint8_t savedIPL = halMaskInterrupts(); // Users are added from ISRs too
+
+    if (!sysTickUsers) {
+        startSysTickTimer();
+    }
+    sysTickUsers |= user;
+    halRestoreInterrupts(savedIPL);
+}
+
+void releaseSysTick(uint8_t user) {
+    uint8_t savedIPL = halMaskInterrupts();
+
+    sysTickUsers &= ~user;
+    if (!sysTickUsers) {
+#if PWM_BACKEND == PWM_BACKEND_OC
+        stopTimer1();
+#else
+        T2CONbits.TON = 0;
+        TMR2 = 0;
+#endif
+    }
+    halRestoreInterrupts(savedIPL);
+}
+
+uint8_t getSysTickUsers() {
+    return sysTickUsers;
+}
+
+void retuneTimers() {
+    const ClockProfile *clk = getClockProfile();
+    uint8_t savedIPL = halMaskInterrupts();
+
+    tickBase = tickNow();               // Carry the count across the switch
+    cycleBase = cycleNow();
+    T3CONbits.TON   = 0;
+    TMR3            = 0;
+    tickHigh        = 0;
+    IFS0bits.T3IF   = 0;
+    T3CONbits.TCKPS = clk->timerPrescale;
+    tickShift       = clk->tickShift;
+    cycleShift      = PRESCALE_SHIFT[clk->timerPrescale];
+    T3CONbits.TON   = 1;
+
+    if (sysTickUsers) {
+        startSysTickTimer();
+    }
+    halRestoreInterrupts(savedIPL);
 }
 
 void startTimer1(uint16_t pr_val) {
@@ -46,8 +132,9 @@ void stopTimer1() {
 }
 
 void startTimer2(uint16_t time_ms) {
-    // Calculate PR value: (time_ms * clock frequency) / (prescaler * 2)
-    PR2 = (uint16_t)(((uint32_t)time_ms) * 500 / 128);
+    // Calculate PR value: time_ms * FCY / (prescaler * 1000)
+    T2CONbits.TCKPS = 2;                // 1:64
+    PR2 = (uint16_t)(((uint32_t)time_ms) * (getClockProfile()->fcy / 64) / 1000);
     T2CONbits.TON = 1;                  // Turn on Timer2
 }
 
@@ -58,9 +145,61 @@ void stopTimer2() {
 }
 
 void delay_ms(uint16_t time_ms) {
-    PR3 = (uint16_t)(((uint32_t)time_ms) * 500 / 16);
-    TMR3 = 0;
-    T3CONbits.TON = 1;
-    Idle();
-    T3CONbits.TON = 0;
+    uint32_t start = tickNow();
+    uint32_t length = MS_TO_TICKS(time_ms);
+
+    while (tickNow() - start < length)
+        ; // Wait on the tick
+}
+
+/**
+ * @brief Reads Timer3 extended to 32 bits by its overflow count
+ */
+static uint32_t tickRaw() {
+    uint16_t high;
+    uint16_t low;
+    uint8_t pending;
+
+    // Re-read if the overflow ISR ran in between
+    do {
+        high = tickHigh;
+        low = TMR3;
+        pending = IFS0bits.T3IF;
+    } while (high != tickHigh);
+
+    // Overflow happened but its ISR could not run yet (masked or pre-empted)
+    if (pending && low < 0x8000) {
+        high++;
+    }
+
+    return ((uint32_t)high << 16) | low;
+}
+
+uint32_t tickNow() {
+    uint32_t raw = tickRaw();
+
+    if (tickShift > 0) {
+        raw >>= tickShift;
+    } else if (tickShift < 0) {
+        raw <<= -tickShift;
+    }
+    return tickBase + raw;
+}
+
+uint32_t cycleNow() {
+    return cycleBase + (tickRaw() << cycleShift);
+}
+
+uint8_t cycleResolution() {
+    return cycleShift;
+}
+
+/**
+ * @brief Timer 3 interrupt service routine
+ *
+ * Extends the 16-bit tick to 32 bits on each overflow.
+ */
+void __attribute__((interrupt, no_auto_psv)) _T3Interrupt(void) {
+    tickHigh++;
+    IFS0bits.T3IF = 0;  // Clear Timer 3 interrupt flag
 }
\ No newline at end of file
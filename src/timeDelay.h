@@ -5,14 +5,46 @@
  * 
  * Description: Header file for timer delay functions. Provides initialization 
  *              and control functions for Timer1 and Timer2, allowing precise 
- *              delay operations in the embedded system.
+ *              delay operations in the embedded system. Timer3 runs free as the
+ *              system timestamp tick.
  */
 
 #ifndef TIMEDELAY_H
 #define TIMEDELAY_H
 
-#include <xc.h>
-#include <p24F16KA101.h>
+#include "hal.h"
+
+/**
+ * @brief Rate of the free-running Timer3 tick
+ *
+ * At the 500 kHz system clock (FCY = 250 kHz) Timer3 counts FCY / 8,
+ * one tick every 32 us. Other clocks pick their own prescaler and
+ * tickNow() scales the raw count back to this rate (see ClockProfile).
+ */
+#define TICK_HZ 31250UL
+
+/**
+ * @brief Converts milliseconds to ticks at compile time where possible
+ */
+#define MS_TO_TICKS(ms) ((uint32_t)(ms) * TICK_HZ / 1000)
+
+/**
+ * @brief Period of the shared system tick interrupt
+ *
+ * The system tick only runs while one of its users needs it, and is
+ * served by whichever of Timer1/Timer2 the PWM backend leaves free
+ * (Timer1 for PWM_BACKEND_OC, Timer2 for PWM_BACKEND_TIMER1). Its period
+ * register follows the clock mode.
+ */
+#define SYSTICK_MS      4
+
+/**
+ * System tick users:
+ * - SYSTICK_BUTTONS: Button debouncing and press timing
+ * - SYSTICK_PATTERN: Pattern step timing (playPattern() in PWM.h)
+ */
+#define SYSTICK_BUTTONS 0x01
+#define SYSTICK_PATTERN 0x02
 
 /**
  * @brief Initializes the timers (Timer1 and Timer2).
@@ -20,8 +52,11 @@
  * This function configures:
  * - Timer1: 16-bit mode with a 1:1 prescaler.
  * - Timer2: 16-bit mode with a 1:64 prescaler.
+ * - Timer3: free-running tick at TICK_HZ for the current clock mode,
+ *           extended to 32 bits by its overflow interrupt.
  * 
- * Enables interrupts for both timers.
+ * Enables interrupts for all timers. initPWM() may re-purpose them
+ * afterwards depending on the selected PWM backend.
  */
 void timerInit();
 
@@ -45,7 +80,7 @@ void stopTimer1();
  * @brief Starts Timer2 with a specific delay in milliseconds.
  * 
  * Configures Timer2's period register based on the input delay and starts the timer.
- * The delay is calculated using the system clock frequency and a prescaler of 1:64.
+ * The delay is calculated using the current FCY and a prescaler of 1:64.
  * 
  * @param time_ms The desired delay in milliseconds.
  */
@@ -59,16 +94,84 @@ void startTimer2(uint16_t time_ms);
 void stopTimer2();
 
 /**
- * @brief Delays program execution for specified milliseconds using Timer3 and Idle mode
+ * @brief Registers a user of the system tick, starting it if idle.
+ *
+ * Safe to call from ISRs.
+ *
+ * @param user SYSTICK_* bit of the caller
+ */
+void requestSysTick(uint8_t user);
+
+/**
+ * @brief Deregisters a user of the system tick, stopping it once unused.
+ *
+ * Safe to call from ISRs.
+ *
+ * @param user SYSTICK_* bit of the caller
+ */
+void releaseSysTick(uint8_t user);
+
+/**
+ * @brief Returns the SYSTICK_* users currently holding the system tick.
+ */
+uint8_t getSysTickUsers();
+
+/**
+ * @brief Reprograms Timer3 and the system tick for the current clock.
+ *
+ * Called by setClockMode() after an oscillator switch. The tick count
+ * carries on from where it was, so deadlines taken before the switch
+ * stay valid.
+ */
+void retuneTimers();
+
+/**
+ * @brief Delays program execution for specified milliseconds
  * 
- * Uses Timer3 with PR3 as period register. The function:
- * - Calculates PR3 value based on input milliseconds
- * - Uses a prescaler of 8
- * - Enters Idle mode to save power during delay
- * - Exits when Timer3 interrupt occurs
+ * Waits on the free-running tick. Timer3 no longer has a period match at
+ * the deadline to wake Idle mode, so this spins; keep it for start-up and
+ * calibration paths rather than the event loop.
  * 
  * @param time_ms The delay duration in milliseconds (16-bit value)
  */
 void delay_ms(uint16_t time_ms);
 
+/**
+ * @brief Returns the 32-bit free-running tick count.
+ *
+ * Safe to call from any context, including ISRs that pre-empt the
+ * Timer3 overflow interrupt.
+ *
+ * @return Ticks at TICK_HZ since timerInit()
+ */
+uint32_t tickNow();
+
+/**
+ * @brief Returns instruction cycles counted by Timer3.
+ *
+ * Resolution is the Timer3 prescaler (1, 8 or 64 cycles depending on the
+ * clock mode). Carried across clock switches like tickNow(); Timer3 stops
+ * in Sleep, so sleeping time is not counted. Wraps after 2^32 cycles.
+ *
+ * @return Instruction cycles since timerInit(), excluding Sleep
+ */
+uint32_t cycleNow();
+
+/**
+ * @brief Returns log2 of the cycleNow() resolution in the current clock.
+ */
+uint8_t cycleResolution();
+
+/**
+ * @brief Returns the low 16 bits of the tick count.
+ *
+ * Timer3 no longer counts at TICK_HZ in every clock mode, so this goes
+ * through tickNow() rather than reading TMR3 directly.
+ *
+ * @return Ticks at TICK_HZ, wrapping every 65536 ticks
+ */
+static inline uint16_t tickNow16() {
+    return (uint16_t)tickNow();
+}
+
 #endif